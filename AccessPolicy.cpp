@@ -0,0 +1,565 @@
+#include "AccessPolicy.h"
+#include "Log.h"
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sddl.h>
+#endif
+
+namespace
+{
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t' || text.front() == '\r'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // ASCII only, as HTTP.sys folds URLs; a byte of a UTF-8 sequence is left alone
+    char Fold(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+    }
+
+    std::string Lower(std::string_view text)
+    {
+        std::string lower(text);
+        for (char& c : lower)
+        {
+            c = Fold(c);
+        }
+        return lower;
+    }
+
+    // label is already folded
+    bool EqualFolded(const char* label, const char* text, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            if (label[i] != Fold(text[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+    uint64_t SegmentHash(std::string_view segment)
+    {
+        uint64_t hash = FNV_OFFSET;
+        for (char c : segment)
+        {
+            hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    int HexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // The realm of user@REALM, or the domain of SSPI's DOMAIN\user
+    std::string_view RealmOf(std::string_view principal)
+    {
+        size_t at = principal.rfind('@');
+        if (at != std::string_view::npos)
+        {
+            return principal.substr(at + 1);
+        }
+        size_t backslash = principal.find('\\');
+        return backslash == std::string_view::npos ? std::string_view() : principal.substr(0, backslash);
+    }
+
+#ifdef _WIN32
+    // Account or group name to its SID, as the domain controller knows it
+    bool LookupSid(std::string_view name, std::string& sid)
+    {
+        int length = MultiByteToWideChar(CP_UTF8, 0, name.data(), static_cast<int>(name.size()), nullptr, 0);
+        std::wstring wide(static_cast<size_t>(length), L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, name.data(), static_cast<int>(name.size()), &wide[0], length);
+
+        BYTE buffer[SECURITY_MAX_SID_SIZE];
+        DWORD sidSize = sizeof(buffer);
+        wchar_t domain[256];
+        DWORD domainSize = ARRAYSIZE(domain);
+        SID_NAME_USE use;
+        LPWSTR text = nullptr;
+        if (!LookupAccountNameW(nullptr, wide.c_str(), buffer, &sidSize, domain, &domainSize, &use) ||
+            !ConvertSidToStringSidW(buffer, &text))
+        {
+            return false;
+        }
+        sid.clear();
+        for (const wchar_t* c = text; *c; c++)
+        {
+            sid += static_cast<char>(*c);
+        }
+        LocalFree(text);
+        return true;
+    }
+#endif
+}
+
+AccessPolicy::AccessPolicy(PrincipalTable& principals, std::chrono::seconds membershipLifetime)
+    : m_principals(principals)
+    , m_membershipLifetime(membershipLifetime)
+    , m_edgeMask(0)
+    , m_words(1)
+    , m_needsSids(false)
+    , m_allowed(0)
+    , m_denied(0)
+    , m_unknown(0)
+    , m_resolved(0)
+{
+}
+
+bool AccessPolicy::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        Log::Write(LogLevel::Error) << L"Cannot read authorization rules " << path;
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    if (!Compile(text.str()))
+    {
+        return false;
+    }
+    Log::Write(LogLevel::Info) << L"Authorization: " << m_rules.size() << L" rules over " << m_subjects.size()
+        << L" subjects from " << path;
+    return true;
+}
+
+bool AccessPolicy::Compile(std::string_view rules)
+{
+    m_subjects.clear();
+    m_subjects.emplace("*", ANY_SUBJECT);
+    m_needsSids = false;
+
+    // Prefix to the subjects of its rule; an empty list allows nobody
+    std::map<std::string, std::vector<uint32_t>> prefixes;
+    std::string scratch;
+    size_t lineNumber = 0;
+    while (!rules.empty())
+    {
+        size_t newline = rules.find('\n');
+        std::string_view line = Trim(rules.substr(0, newline));
+        rules = newline == std::string_view::npos ? std::string_view() : rules.substr(newline + 1);
+        lineNumber++;
+        if (line.empty() || line.front() == '#')
+        {
+            continue;
+        }
+
+        size_t space = line.find_first_of(" \t");
+        std::string_view prefix = line.substr(0, space);
+        std::string_view list = space == std::string_view::npos ? std::string_view() : Trim(line.substr(space));
+        if (prefix.front() != '/' || list.empty())
+        {
+            Log::Write(LogLevel::Error) << L"Authorization rules line " << lineNumber << L": expected a /path and who may request it";
+            return false;
+        }
+
+        std::string canonical = Lower(Canonicalize(prefix, scratch));
+        if (canonical.size() > 1 && canonical.back() == '/')
+        {
+            canonical.pop_back();
+        }
+        if (prefixes.count(canonical) != 0)
+        {
+            Log::Write(LogLevel::Error) << L"Authorization rules line " << lineNumber << L": second rule for " << canonical;
+            return false;
+        }
+        std::vector<uint32_t>& subjects = prefixes[canonical];
+        if (list == "-")
+        {
+            continue;
+        }
+        while (!list.empty())
+        {
+            size_t comma = list.find(',');
+            std::string_view name = Trim(list.substr(0, comma));
+            list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+            uint32_t subject = 0;
+            if (!AddSubject(name, subject))
+            {
+                Log::Write(LogLevel::Error) << L"Authorization rules line " << lineNumber << L": unknown subject \""
+                    << name << L"\"";
+                return false;
+            }
+            subjects.push_back(subject);
+        }
+    }
+    m_words = (m_subjects.size() + 63) / 64;
+
+    // Segment trie, built as a tree and then laid out breadth first
+    struct BuildNode
+    {
+        std::map<std::string, size_t> children;
+        int32_t rule = -1;
+    };
+    std::vector<BuildNode> tree(1);
+    m_rules.clear();
+    m_ruleWords.clear();
+    for (const auto& prefix : prefixes)
+    {
+        size_t node = 0;
+        std::string_view rest = std::string_view(prefix.first).substr(1);
+        while (!rest.empty())
+        {
+            size_t slash = rest.find('/');
+            std::string segment(rest.substr(0, slash));
+            rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+            auto child = tree[node].children.find(segment);
+            if (child == tree[node].children.end())
+            {
+                child = tree[node].children.emplace(segment, tree.size()).first;
+                tree.emplace_back();
+            }
+            node = child->second;
+        }
+
+        // One run of (word, bits) per word the rule touches
+        std::map<uint32_t, uint64_t> words;
+        for (uint32_t subject : prefix.second)
+        {
+            words[subject / 64] |= uint64_t(1) << (subject % 64);
+        }
+        Rule rule;
+        rule.first = static_cast<uint32_t>(m_ruleWords.size());
+        rule.count = static_cast<uint32_t>(words.size());
+        for (const auto& word : words)
+        {
+            m_ruleWords.push_back(RuleWord{ word.first, word.second });
+        }
+        tree[node].rule = static_cast<int32_t>(m_rules.size());
+        m_rules.push_back(rule);
+    }
+
+    size_t slots = 16;
+    while (slots < tree.size() * 2)
+    {
+        slots *= 2;
+    }
+    m_edges.assign(slots, Edge());
+    m_edgeMask = slots - 1;
+    m_nodes.assign(1, Node());
+    m_labels.clear();
+    std::vector<size_t> order(1, 0);    // tree index of each laid-out node
+    for (size_t next = 0; next < order.size(); next++)
+    {
+        const BuildNode& built = tree[order[next]];
+        m_nodes[next].rule = built.rule;
+        for (const auto& child : built.children)
+        {
+            Node node;
+            node.label = static_cast<uint32_t>(m_labels.size());
+            node.labelLength = static_cast<uint32_t>(child.first.size());
+            m_labels += child.first;
+
+            Edge edge;
+            edge.hash = SegmentHash(child.first);
+            edge.parent = static_cast<uint32_t>(next);
+            edge.child = static_cast<uint32_t>(m_nodes.size());
+            size_t slot = EdgeSlot(edge.parent, edge.hash) & m_edgeMask;
+            while (m_edges[slot].child != 0)
+            {
+                slot = (slot + 1) & m_edgeMask;
+            }
+            m_edges[slot] = edge;
+
+            m_nodes.push_back(node);
+            order.push_back(child.second);
+        }
+    }
+    return true;
+}
+
+bool AccessPolicy::AddSubject(std::string_view text, uint32_t& subject)
+{
+    if (text.empty() || text == "-" || text == "@")
+    {
+        return false;
+    }
+
+    std::string key = Lower(text);
+    if (key == "*")
+    {
+        subject = ANY_SUBJECT;
+        return true;
+    }
+    if (key.compare(0, 4, "s-1-") == 0)
+    {
+        m_needsSids = true;
+    }
+    else if (key.find('@') == std::string::npos)
+    {
+        // A name: only the directory knows its SID
+#ifdef _WIN32
+        std::string sid;
+        if (!LookupSid(text, sid))
+        {
+            return false;
+        }
+        key = Lower(sid);
+        m_needsSids = true;
+#else
+        return false;
+#endif
+    }
+
+    auto known = m_subjects.find(key);
+    if (known == m_subjects.end())
+    {
+        known = m_subjects.emplace(key, static_cast<uint32_t>(m_subjects.size())).first;
+    }
+    subject = known->second;
+    return true;
+}
+
+std::string_view AccessPolicy::Canonicalize(std::string_view path, std::string& scratch)
+{
+    // Most paths are already canonical; look before copying
+    bool clean = !path.empty() && path.front() == '/';
+    for (size_t i = 0; clean && i < path.size(); i++)
+    {
+        char c = path[i];
+        if (c == '%' || c == '\\')
+        {
+            clean = false;
+        }
+        else if (c == '/' && i + 1 < path.size())
+        {
+            std::string_view next = path.substr(i + 1, 3);
+            clean = next[0] != '/' && next != "." && next != ".." && next.substr(0, 2) != "./" && next != "../";
+        }
+    }
+    if (clean)
+    {
+        return path;
+    }
+
+    std::string decoded;
+    decoded.reserve(path.size());
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        char c = path[i];
+        if (c == '%' && i + 2 < path.size() && HexValue(path[i + 1]) >= 0 && HexValue(path[i + 2]) >= 0)
+        {
+            decoded += static_cast<char>(HexValue(path[i + 1]) * 16 + HexValue(path[i + 2]));
+            i += 2;
+        }
+        else
+        {
+            decoded += c == '\\' ? '/' : c;
+        }
+    }
+
+    scratch.assign(1, '/');
+    std::string_view rest = decoded;
+    while (!rest.empty())
+    {
+        size_t slash = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+        if (segment.empty() || segment == ".")
+        {
+            continue;
+        }
+        if (segment == "..")
+        {
+            // Above the root stays at the root, as HTTP.sys does
+            size_t last = scratch.size() > 1 ? scratch.rfind('/', scratch.size() - 2) : 0;
+            scratch.resize(last + 1);
+            continue;
+        }
+        scratch.append(segment.data(), segment.size());
+        scratch += '/';
+    }
+    if (scratch.size() > 1)
+    {
+        scratch.pop_back();
+    }
+    return scratch;
+}
+
+bool AccessPolicy::FindRule(std::string_view path, bool canonical, int32_t& rule) const
+{
+    if (path.empty() || path[0] != '/')
+    {
+        return false;
+    }
+
+    // Past the last matching segment the rest is still scanned: a ".." or an
+    // escape further on could lead back under a rule
+    uint32_t node = 0;
+    bool matching = true;
+    rule = m_nodes[0].rule;
+    const char* text = path.data();
+    size_t i = 1;
+    while (i < path.size())
+    {
+        size_t start = i;
+        uint64_t hash = FNV_OFFSET;
+        for (; i < path.size() && text[i] != '/'; i++)
+        {
+            char c = text[i];
+            if ((c == '%' || c == '\\') && !canonical)
+            {
+                return false;
+            }
+            hash = (hash ^ static_cast<uint8_t>(Fold(c))) * FNV_PRIME;
+        }
+        size_t length = i - start;
+        i++;
+        if (length == 0 || (text[start] == '.' && (length == 1 || (length == 2 && text[start + 1] == '.'))))
+        {
+            return false;
+        }
+        if (!matching)
+        {
+            continue;
+        }
+
+        size_t slot = EdgeSlot(node, hash) & m_edgeMask;
+        for (;; slot = (slot + 1) & m_edgeMask)
+        {
+            const Edge& edge = m_edges[slot];
+            if (edge.child == 0)
+            {
+                matching = false;
+                break;
+            }
+            const Node& child = m_nodes[edge.child];
+            if (edge.hash == hash && edge.parent == node && child.labelLength == length &&
+                EqualFolded(m_labels.data() + child.label, text + start, length))
+            {
+                node = edge.child;
+                rule = child.rule >= 0 ? child.rule : rule;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+const uint64_t* AccessPolicy::Resolve(std::string_view principal, const std::vector<std::string>* sids)
+{
+    std::vector<uint64_t> members(m_words, 0);
+    auto add = [&](const std::string& key)
+    {
+        auto known = m_subjects.find(key);
+        if (known != m_subjects.end())
+        {
+            members[known->second / 64] |= uint64_t(1) << (known->second % 64);
+        }
+    };
+    members[0] |= uint64_t(1) << ANY_SUBJECT;
+    add(Lower(principal));
+    std::string_view realm = RealmOf(principal);
+    if (!realm.empty())
+    {
+        std::string key = "@";
+        add(key.append(Lower(realm)));
+    }
+    if (sids)
+    {
+        for (const std::string& sid : *sids)
+        {
+            add(Lower(sid));
+        }
+    }
+    m_resolved.fetch_add(1, std::memory_order_relaxed);
+
+    std::string key(reinterpret_cast<const char*>(members.data()), members.size() * sizeof(uint64_t));
+    std::lock_guard<std::mutex> lock(m_internMutex);
+    auto interned = m_interned.find(key);
+    if (interned != m_interned.end())
+    {
+        return interned->second;
+    }
+    m_groupSets.push_back(std::move(members));
+    const uint64_t* set = m_groupSets.back().data();
+    m_interned.emplace(std::move(key), set);
+    return set;
+}
+
+AccessDecision AccessPolicy::Authorize(uint32_t principal, std::string_view name, const std::vector<std::string>* sids,
+    std::string_view path, Clock::time_point now)
+{
+    int32_t ruleIndex = -1;
+    if (!m_nodes.empty() && !FindRule(path, false, ruleIndex))
+    {
+        thread_local std::string scratch;
+        FindRule(Canonicalize(path, scratch), true, ruleIndex);
+    }
+    if (ruleIndex < 0 || m_rules[ruleIndex].count == 0)
+    {
+        m_denied.fetch_add(1, std::memory_order_relaxed);
+        return AccessDecision::Deny;
+    }
+
+    // "*" needs no membership
+    const Rule& rule = m_rules[ruleIndex];
+    const RuleWord* words = m_ruleWords.data() + rule.first;
+    if (words[0].index == 0 && (words[0].bits & (uint64_t(1) << ANY_SUBJECT)))
+    {
+        m_allowed.fetch_add(1, std::memory_order_relaxed);
+        return AccessDecision::Allow;
+    }
+
+    const uint64_t* members = m_principals.Groups(principal, now);
+    if (!members)
+    {
+        if (!sids && m_needsSids)
+        {
+            m_unknown.fetch_add(1, std::memory_order_relaxed);
+            return AccessDecision::Unknown;
+        }
+        members = Resolve(name, sids);
+        m_principals.SetGroups(principal, members, now + m_membershipLifetime);
+    }
+
+    for (uint32_t i = 0; i < rule.count; i++)
+    {
+        if (members[words[i].index] & words[i].bits)
+        {
+            m_allowed.fetch_add(1, std::memory_order_relaxed);
+            return AccessDecision::Allow;
+        }
+    }
+    m_denied.fetch_add(1, std::memory_order_relaxed);
+    return AccessDecision::Deny;
+}
+
+AccessPolicyStats AccessPolicy::GetStats() const
+{
+    AccessPolicyStats stats;
+    stats.allowed = m_allowed.load(std::memory_order_relaxed);
+    stats.denied = m_denied.load(std::memory_order_relaxed);
+    stats.unknown = m_unknown.load(std::memory_order_relaxed);
+    stats.resolved = m_resolved.load(std::memory_order_relaxed);
+    stats.rules = m_rules.size();
+    stats.subjects = m_subjects.size();
+    std::lock_guard<std::mutex> lock(m_internMutex);
+    stats.groupSets = m_groupSets.size();
+    return stats;
+}
\ No newline at end of file
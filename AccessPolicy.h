@@ -0,0 +1,159 @@
+#pragma once
+
+#include "PrincipalTable.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class AccessDecision
+{
+    Allow,
+    Deny,       // answer 403
+    Unknown     // no membership known for the principal; authenticate again to get one
+};
+
+struct AccessPolicyStats
+{
+    uint64_t allowed = 0;
+    uint64_t denied = 0;
+    uint64_t unknown = 0;       // session requests sent back to Negotiate for their groups
+    uint64_t resolved = 0;      // memberships worked out from a principal's SIDs
+    size_t rules = 0;
+    size_t subjects = 0;
+    size_t groupSets = 0;       // distinct memberships the principals share
+};
+
+// Per-path authorization compiled from a rules file, one rule per line:
+//
+//     # prefix     who may request it (any one of them)
+//     /            *
+//     /reports     @EXAMPLE.COM
+//     /admin/      S-1-5-21-1004336348-1177238915-682003330-512, alice@EXAMPLE.COM
+//     /private/    -
+//
+// A subject is "*" (any authenticated principal), "@REALM" (principals of a
+// realm, or of a domain for SSPI's DOMAIN\user names), a principal, a SID of
+// the user or one of its groups, or on Windows an account or group name
+// ("EXAMPLE\Web Admins"), which is looked up as a SID when the file loads;
+// "-" allows nobody. Subjects match regardless of case, and so do paths,
+// folded over ASCII only: HTTP.sys serves "/ADMIN/x" as "/admin/x", so a
+// rule matched as sent would be stepped around by changing case.
+// The longest prefix that matches on whole path segments decides ("/admin"
+// covers "/admin" and "/admin/x" but not "/administrator"); a path no rule
+// covers is denied. Paths are percent-decoded and their dot segments
+// resolved before matching, as HTTP.sys already does for its cooked URLs,
+// so an encoding cannot step around a rule.
+//
+// Prefixes compile into a trie of path segments whose edges sit in one hash
+// table keyed by parent and segment hash, so each segment of a path costs a
+// hash folded into the scan for the next slash and one probe; the same scan
+// spots a path that needs canonicalizing. Subjects are numbered and a
+// principal's membership is the set of subject numbers it satisfies, worked
+// out once from the SIDs its authentication returned and kept in the
+// principal's PrincipalTable entry for the membership lifetime. Equal sets
+// are interned and shared, since most users of a directory fall into a few
+// group combinations. A decision is then a trie walk, a load from the table
+// by principal ID and an AND of the rule's words of the set with the
+// principal's.
+class AccessPolicy
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    AccessPolicy(PrincipalTable& principals, std::chrono::seconds membershipLifetime);
+
+    // Reads and compiles a rules file; false, with the reason logged, on any
+    // error. Called once, before the first Authorize.
+    bool Load(const std::string& path);
+    bool Compile(std::string_view rules);
+
+    // True when some rule names a SID, so memberships need the SIDs of the
+    // principal's authentication and cannot be worked out from a name
+    bool NeedsSids() const { return m_needsSids; }
+
+    // principal is the table's ID of name (NO_PRINCIPAL when the table was
+    // full, which leaves nowhere to cache its membership); sids are those of
+    // the authentication that just succeeded, or null for a session cookie,
+    // which can only use a cached membership. now is when the request came.
+    AccessDecision Authorize(uint32_t principal, std::string_view name, const std::vector<std::string>* sids,
+        std::string_view path, Clock::time_point now);
+
+    AccessPolicyStats GetStats() const;
+
+    // Path with percent-escapes decoded, backslashes turned into slashes,
+    // empty and "." segments dropped and ".." applied; path itself when it
+    // needs none of that, otherwise written to scratch
+    static std::string_view Canonicalize(std::string_view path, std::string& scratch);
+
+    static constexpr uint32_t ANY_SUBJECT = 0;      // "*": every membership has it
+
+private:
+    struct Node
+    {
+        uint32_t label = 0;         // offset of the segment in m_labels
+        uint32_t labelLength = 0;
+        int32_t rule = -1;
+    };
+
+    // Slot of the open-addressed table from (parent, segment hash) to child
+    struct Edge
+    {
+        uint64_t hash = 0;
+        uint32_t parent = 0;
+        uint32_t child = 0;         // 0 = empty; the root is nobody's child
+    };
+
+    // Words of the subject set a rule accepts, as (word index, bits) pairs in m_ruleWords
+    struct Rule
+    {
+        uint32_t first = 0;
+        uint32_t count = 0;         // 0 = nobody
+    };
+
+    struct RuleWord
+    {
+        uint32_t index;
+        uint64_t bits;
+    };
+
+    // Subject number for text, adding it when new; false if the subject is invalid
+    bool AddSubject(std::string_view text, uint32_t& subject);
+
+    static uint64_t EdgeSlot(uint32_t parent, uint64_t hash) { return (hash ^ (parent * 0x9e3779b97f4a7c15ull)) >> 7; }
+
+    // The rule deciding path, or -1, in rule; false, with no lookup
+    // finished, when path needs canonicalizing (never when canonical says
+    // it already was, and an escape in it is a decoded character)
+    bool FindRule(std::string_view path, bool canonical, int32_t& rule) const;
+
+    // The interned subject set of a principal with sids (null: the name alone)
+    const uint64_t* Resolve(std::string_view principal, const std::vector<std::string>* sids);
+
+    PrincipalTable& m_principals;
+    std::chrono::seconds m_membershipLifetime;
+
+    std::vector<Node> m_nodes;          // m_nodes[0] is the root, "/"
+    std::string m_labels;
+    std::vector<Edge> m_edges;          // at most half full
+    size_t m_edgeMask;
+    std::vector<Rule> m_rules;
+    std::vector<RuleWord> m_ruleWords;
+    std::unordered_map<std::string, uint32_t> m_subjects;   // lower-cased subject to number
+    size_t m_words;                     // 64-bit words in a subject set
+    bool m_needsSids;
+
+    mutable std::mutex m_internMutex;
+    std::deque<std::vector<uint64_t>> m_groupSets;          // never moved, so entries point into it
+    std::unordered_map<std::string, const uint64_t*> m_interned;    // set words as bytes to the set
+
+    std::atomic<uint64_t> m_allowed;
+    std::atomic<uint64_t> m_denied;
+    std::atomic<uint64_t> m_unknown;
+    std::atomic<uint64_t> m_resolved;
+};
\ No newline at end of file
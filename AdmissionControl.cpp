@@ -0,0 +1,257 @@
+#include "AdmissionControl.h"
+#include "SecureRandom.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr uint64_t TAG_MASK = ~uint64_t(0xFFFFFF);
+    constexpr uint32_t SECOND_MASK = 0xFFFFFF;
+
+    uint64_t Mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    size_t RoundUp(size_t count)
+    {
+        size_t rounded = 1;
+        while (rounded < count)
+        {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+    // Seconds until a rejected-token entry expires; 0 once it has (or is empty).
+    // Expiry seconds wrap at 24 bits, which no lifetime comes near.
+    uint32_t Remaining(uint64_t entry, uint32_t second)
+    {
+        uint32_t remaining = (static_cast<uint32_t>(entry) - second) & SECOND_MASK;
+        return remaining <= AdmissionControl::MAX_REJECT_SECONDS ? remaining : 0;
+    }
+}
+
+AdmissionControl::AdmissionControl(size_t clientSlots, size_t rejectedSlots)
+    : m_epoch(Clock::now())
+    , m_seed(0)
+    , m_interval(0)
+    , m_tolerance(0)
+    , m_rejectSeconds(0)
+    , m_admitted(0)
+    , m_throttled(0)
+    , m_repeated(0)
+    , m_rejectedCount(0)
+    , m_evicted(0)
+{
+    // A seed the client cannot guess keeps it from aiming at one set
+    if (!GenerateRandom(reinterpret_cast<uint8_t*>(&m_seed), sizeof(m_seed)))
+    {
+        m_seed = Mix(static_cast<uint64_t>(m_epoch.time_since_epoch().count()));
+    }
+
+    size_t clientSets = RoundUp((std::max)(clientSlots / WAYS, size_t(1)));
+    m_clients.reset(new ClientSlot[clientSets * WAYS]);
+    m_clientSetMask = clientSets - 1;
+
+    // Set indexes must stay clear of the tag bits
+    size_t rejectedSets = (std::min)(RoundUp((std::max)(rejectedSlots / 2, size_t(1))), size_t(SECOND_MASK + 1) / 2);
+    m_rejected.reset(new std::atomic<uint64_t>[rejectedSets * 2]);
+    for (size_t i = 0; i < rejectedSets * 2; i++)
+    {
+        m_rejected[i].store(0, std::memory_order_relaxed);
+    }
+    m_rejectedSetMask = rejectedSets - 1;
+
+    SetLimits(AdmissionLimits());
+}
+
+void AdmissionControl::SetLimits(const AdmissionLimits& limits)
+{
+    std::lock_guard<std::mutex> lock(m_limitsMutex);
+    m_limits = limits;
+    m_limits.rejectSeconds = (std::min)(limits.rejectSeconds, MAX_REJECT_SECONDS);
+    if (limits.clientRate == 0)
+    {
+        m_limits.clientBurst = 0;
+        m_interval.store(0, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_limits.clientBurst = limits.clientBurst ? limits.clientBurst : limits.clientRate;
+        int64_t interval = 1000000000 / static_cast<int64_t>(limits.clientRate);
+        m_tolerance.store(interval * m_limits.clientBurst, std::memory_order_relaxed);
+        m_interval.store(interval, std::memory_order_relaxed);
+    }
+    m_rejectSeconds.store(m_limits.rejectSeconds, std::memory_order_relaxed);
+}
+
+AdmissionLimits AdmissionControl::GetLimits() const
+{
+    std::lock_guard<std::mutex> lock(m_limitsMutex);
+    return m_limits;
+}
+
+Admission AdmissionControl::Admit(uint64_t client, std::string_view token, Clock::time_point now)
+{
+    if (client != 0 && m_interval.load(std::memory_order_relaxed) != 0)
+    {
+        int64_t ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_epoch).count();
+        ClientSlot* slot = FindBucket(client, ticks);
+        if (slot && !Take(*slot, ticks))
+        {
+            m_throttled.fetch_add(1, std::memory_order_relaxed);
+            return Admission::Throttle;
+        }
+    }
+
+    if (!token.empty() && m_rejectSeconds.load(std::memory_order_relaxed) != 0)
+    {
+        uint64_t digest = Digest(token);
+        uint32_t second = Seconds(now);
+        const std::atomic<uint64_t>* set = &m_rejected[(digest & m_rejectedSetMask) * 2];
+        for (size_t i = 0; i < 2; i++)
+        {
+            uint64_t entry = set[i].load(std::memory_order_relaxed);
+            if (((entry ^ digest) & TAG_MASK) == 0 && Remaining(entry, second) != 0)
+            {
+                m_repeated.fetch_add(1, std::memory_order_relaxed);
+                return Admission::Repeat;
+            }
+        }
+    }
+
+    m_admitted.fetch_add(1, std::memory_order_relaxed);
+    return Admission::Admit;
+}
+
+void AdmissionControl::Reject(std::string_view token, Clock::time_point now)
+{
+    uint32_t seconds = m_rejectSeconds.load(std::memory_order_relaxed);
+    if (token.empty() || seconds == 0)
+    {
+        return;
+    }
+
+    uint64_t digest = Digest(token);
+    uint32_t second = Seconds(now);
+    std::atomic<uint64_t>* set = &m_rejected[(digest & m_rejectedSetMask) * 2];
+
+    // The token's own way if it is there already, otherwise the one expiring first
+    uint64_t first = set[0].load(std::memory_order_relaxed);
+    uint64_t other = set[1].load(std::memory_order_relaxed);
+    size_t way = 0;
+    if (((other ^ digest) & TAG_MASK) == 0)
+    {
+        way = 1;
+    }
+    else if (((first ^ digest) & TAG_MASK) != 0 && Remaining(other, second) < Remaining(first, second))
+    {
+        way = 1;
+    }
+    set[way].store((digest & TAG_MASK) | ((second + seconds) & SECOND_MASK), std::memory_order_relaxed);
+    m_rejectedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+AdmissionControl::ClientSlot* AdmissionControl::FindBucket(uint64_t client, int64_t now)
+{
+    ClientSlot* set = &m_clients[(Mix(client ^ m_seed) & m_clientSetMask) * WAYS];
+    ClientSlot* victim = nullptr;
+    uint64_t victimClient = 0;
+    int64_t victimDue = INT64_MAX;
+    for (size_t i = 0; i < WAYS; i++)
+    {
+        uint64_t owner = set[i].client.load(std::memory_order_relaxed);
+        if (owner == client)
+        {
+            return &set[i];
+        }
+        int64_t due = owner == 0 ? INT64_MIN : set[i].due.load(std::memory_order_relaxed);
+        if (due < victimDue)
+        {
+            victim = &set[i];
+            victimClient = owner;
+            victimDue = due;
+        }
+    }
+
+    // Losing the way to another new client lets this request through unmetered
+    if (!victim->client.compare_exchange_strong(victimClient, client, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    if (victimClient != 0 && victimDue > now)
+    {
+        m_evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+    victim->due.store(INT64_MIN, std::memory_order_relaxed);
+    return victim;
+}
+
+bool AdmissionControl::Take(ClientSlot& slot, int64_t now)
+{
+    int64_t interval = m_interval.load(std::memory_order_relaxed);
+    int64_t tolerance = m_tolerance.load(std::memory_order_relaxed);
+    int64_t due = slot.due.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        int64_t next = (std::max)(due, now) + interval;
+        if (next - now > tolerance)
+        {
+            return false;
+        }
+        if (slot.due.compare_exchange_weak(due, next, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+}
+
+uint64_t AdmissionControl::Digest(std::string_view token) const
+{
+    // Not cryptographic, but seeded: a client cannot make its tokens collide
+    // with anyone else's on purpose. Four lanes keep the multiplier busy.
+    uint64_t lanes[4] = { m_seed, m_seed ^ 0x9e3779b97f4a7c15ull, m_seed ^ 0x6a09e667f3bcc909ull, m_seed ^ token.size() };
+    const char* data = token.data();
+    size_t i = 0;
+    for (; i + 32 <= token.size(); i += 32)
+    {
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * 0xbf58476d1ce4e5b9ull;
+            lanes[lane] ^= lanes[lane] >> 31;
+        }
+    }
+
+    uint64_t hash = Mix(lanes[0]) ^ Mix(lanes[1] + 1) ^ Mix(lanes[2] + 2) ^ Mix(lanes[3] + 3);
+    for (; i < token.size(); i += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + i, (std::min)(token.size() - i, sizeof(word)));
+        hash = Mix(hash ^ word);
+    }
+    return hash;
+}
+
+uint32_t AdmissionControl::Seconds(Clock::time_point now) const
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - m_epoch).count()) & SECOND_MASK;
+}
+
+AdmissionStats AdmissionControl::GetStats() const
+{
+    AdmissionStats stats;
+    stats.admitted = m_admitted.load(std::memory_order_relaxed);
+    stats.throttled = m_throttled.load(std::memory_order_relaxed);
+    stats.repeated = m_repeated.load(std::memory_order_relaxed);
+    stats.rejected = m_rejectedCount.load(std::memory_order_relaxed);
+    stats.evicted = m_evicted.load(std::memory_order_relaxed);
+    return stats;
+}
\ No newline at end of file
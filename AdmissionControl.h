@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+struct AdmissionLimits
+{
+    unsigned clientRate = 0;        // Negotiate tokens per second one client address may send on; 0 = no limit
+    unsigned clientBurst = 0;       // tokens it may send at once before the rate applies; 0 = the rate
+    unsigned rejectSeconds = 10;    // how long a rejected token is answered 401 without another try; 0 = never
+};
+
+struct AdmissionStats
+{
+    uint64_t admitted = 0;
+    uint64_t throttled = 0;     // answered 429 for their client's rate
+    uint64_t repeated = 0;      // answered 401 as a token rejected moments ago
+    uint64_t rejected = 0;      // rejected tokens remembered
+    uint64_t evicted = 0;       // clients whose bucket went to another client before it refilled
+};
+
+enum class Admission
+{
+    Admit,
+    Throttle,       // answer 429
+    Repeat          // answer 401: the token was just rejected
+};
+
+// Gate in front of the provider for Negotiate requests, deciding before a
+// token is decoded or queued for an auth thread. Both checks are lock-free
+// and live in fixed tables allocated up front, so a flood costs neither
+// memory nor contention.
+//
+// Each client address (ClientAddressKey) has a token bucket, kept as the
+// generic cell rate algorithm's single "due" time: a token moves due one
+// interval on, and is admitted if that leaves due at most burst intervals
+// ahead of now. Buckets sit in sets of four per cache line, picked by a seeded hash of
+// the address; a new client takes an empty way or the one due earliest,
+// whose bucket is (nearly) full anyway. Requests with no known address are
+// not limited.
+//
+// Tokens that failed on their own account (AuthResult::badToken) are
+// remembered by a seeded 64-bit digest for a few seconds, in two-way sets of
+// one word each holding a tag and an expiry, so replaying a rejected token
+// costs a hash of its text rather than a decode and a trip to the provider.
+class AdmissionControl
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Slot counts are rounded up to powers of two
+    AdmissionControl(size_t clientSlots, size_t rejectedSlots);
+
+    // Takes effect for the next request; buckets keep their state
+    void SetLimits(const AdmissionLimits& limits);
+    AdmissionLimits GetLimits() const;
+
+    // Decides on a Negotiate token (base64, possibly empty) from client, which
+    // is 0 when the transport does not know the address
+    Admission Admit(uint64_t client, std::string_view token, Clock::time_point now);
+
+    // Remembers token as rejected
+    void Reject(std::string_view token, Clock::time_point now);
+
+    AdmissionStats GetStats() const;
+
+    static constexpr size_t WAYS = 4;
+    static constexpr unsigned MAX_REJECT_SECONDS = 3600;
+
+private:
+    struct alignas(16) ClientSlot
+    {
+        std::atomic<uint64_t> client{ 0 };     // 0 = empty
+        std::atomic<int64_t> due{ 0 };         // ns since m_epoch
+    };
+
+    // The bucket of client, claiming a way of its set when it has none
+    ClientSlot* FindBucket(uint64_t client, int64_t now);
+    bool Take(ClientSlot& slot, int64_t now);
+    uint64_t Digest(std::string_view token) const;
+    uint32_t Seconds(Clock::time_point now) const;
+
+    Clock::time_point m_epoch;
+    uint64_t m_seed;
+
+    std::unique_ptr<ClientSlot[]> m_clients;
+    size_t m_clientSetMask;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_rejected;   // tag in the high 40 bits, expiry second in the low 24
+    size_t m_rejectedSetMask;
+
+    mutable std::mutex m_limitsMutex;
+    AdmissionLimits m_limits;
+    std::atomic<int64_t> m_interval;       // ns per token; 0 = no limit
+    std::atomic<int64_t> m_tolerance;      // burst intervals
+    std::atomic<uint32_t> m_rejectSeconds;
+
+    std::atomic<uint64_t> m_admitted;
+    std::atomic<uint64_t> m_throttled;
+    std::atomic<uint64_t> m_repeated;
+    std::atomic<uint64_t> m_rejectedCount;
+    std::atomic<uint64_t> m_evicted;
+};
\ No newline at end of file
@@ -0,0 +1,475 @@
+#include "Aes.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AES_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AES_TARGET(features)
+#else
+#include <cpuid.h>
+#define AES_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace
+{
+    inline uint8_t Times2(uint8_t value)
+    {
+        return static_cast<uint8_t>((value << 1) ^ ((value & 0x80) ? 0x1b : 0));
+    }
+
+    inline uint8_t RotateLeft8(uint8_t value, int count)
+    {
+        return static_cast<uint8_t>((value << count) | (value >> (8 - count)));
+    }
+
+    // S-box and its inverse, generated from the field inverse and the affine map
+    struct SubstitutionTables
+    {
+        uint8_t forward[256];
+        uint8_t inverse[256];
+
+        SubstitutionTables()
+        {
+            uint8_t p = 1;
+            uint8_t q = 1;
+            do
+            {
+                p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+                q ^= static_cast<uint8_t>(q << 1);
+                q ^= static_cast<uint8_t>(q << 2);
+                q ^= static_cast<uint8_t>(q << 4);
+                if (q & 0x80)
+                {
+                    q ^= 0x09;
+                }
+                uint8_t value = q ^ RotateLeft8(q, 1) ^ RotateLeft8(q, 2) ^ RotateLeft8(q, 3) ^ RotateLeft8(q, 4);
+                forward[p] = value ^ 0x63;
+            } while (p != 1);
+            forward[0] = 0x63;
+
+            for (int i = 0; i < 256; i++)
+            {
+                inverse[forward[i]] = static_cast<uint8_t>(i);
+            }
+        }
+    };
+
+    const SubstitutionTables& Tables()
+    {
+        static const SubstitutionTables tables;
+        return tables;
+    }
+
+    void MixColumns(uint8_t* state)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            uint8_t* column = state + c * 4;
+            uint8_t a0 = column[0], a1 = column[1], a2 = column[2], a3 = column[3];
+            uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+            column[0] ^= all ^ Times2(a0 ^ a1);
+            column[1] ^= all ^ Times2(a1 ^ a2);
+            column[2] ^= all ^ Times2(a2 ^ a3);
+            column[3] ^= all ^ Times2(a3 ^ a0);
+        }
+    }
+
+    // InvMixColumns as a fixed pre-multiplication followed by MixColumns, so
+    // it costs a few shifts per column and has no data-dependent branches
+    void InverseMixColumns(uint8_t* state)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            uint8_t* column = state + c * 4;
+            uint8_t u = Times2(Times2(column[0] ^ column[2]));
+            uint8_t v = Times2(Times2(column[1] ^ column[3]));
+            column[0] ^= u;
+            column[1] ^= v;
+            column[2] ^= u;
+            column[3] ^= v;
+        }
+        MixColumns(state);
+    }
+
+    // Bytes are column-major: byte i is row i % 4 of column i / 4
+    void SubBytesShiftRows(uint8_t* state, const uint8_t* box)
+    {
+        uint8_t shifted[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int row = i % 4;
+            int column = (i / 4 + row) % 4;
+            shifted[i] = box[state[column * 4 + row]];
+        }
+        memcpy(state, shifted, 16);
+    }
+
+    void InverseSubBytesShiftRows(uint8_t* state, const uint8_t* box)
+    {
+        uint8_t shifted[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int row = i % 4;
+            int column = (i / 4 + 4 - row) % 4;
+            shifted[i] = box[state[column * 4 + row]];
+        }
+        memcpy(state, shifted, 16);
+    }
+
+    inline void XorBlock(uint8_t* target, const uint8_t* value)
+    {
+        for (size_t i = 0; i < Aes::BLOCK_SIZE; i++)
+        {
+            target[i] ^= value[i];
+        }
+    }
+
+    void EncryptPortable(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out)
+    {
+        const uint8_t* box = Tables().forward;
+        uint8_t state[16];
+        memcpy(state, in, 16);
+        XorBlock(state, keys);
+        for (int round = 1; round < rounds; round++)
+        {
+            SubBytesShiftRows(state, box);
+            MixColumns(state);
+            XorBlock(state, keys + round * 16);
+        }
+        SubBytesShiftRows(state, box);
+        XorBlock(state, keys + rounds * 16);
+        memcpy(out, state, 16);
+    }
+
+    // Equivalent inverse cipher over the inverse-mixed schedule
+    void DecryptPortable(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out)
+    {
+        const uint8_t* box = Tables().inverse;
+        uint8_t state[16];
+        memcpy(state, in, 16);
+        XorBlock(state, keys);
+        for (int round = 1; round < rounds; round++)
+        {
+            InverseSubBytesShiftRows(state, box);
+            InverseMixColumns(state);
+            XorBlock(state, keys + round * 16);
+        }
+        InverseSubBytesShiftRows(state, box);
+        XorBlock(state, keys + rounds * 16);
+        memcpy(out, state, 16);
+    }
+
+#ifdef AES_X86
+    AES_TARGET("aes,sse2")
+    void EncryptAesNi(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out)
+    {
+        const __m128i* schedule = reinterpret_cast<const __m128i*>(keys);
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), schedule[0]);
+        for (int round = 1; round < rounds; round++)
+        {
+            block = _mm_aesenc_si128(block, schedule[round]);
+        }
+        block = _mm_aesenclast_si128(block, schedule[rounds]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+    }
+
+    AES_TARGET("aes,sse2")
+    void DecryptAesNi(const uint8_t* keys, int rounds, const uint8_t* in, uint8_t* out)
+    {
+        const __m128i* schedule = reinterpret_cast<const __m128i*>(keys);
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), schedule[0]);
+        for (int round = 1; round < rounds; round++)
+        {
+            block = _mm_aesdec_si128(block, schedule[round]);
+        }
+        block = _mm_aesdeclast_si128(block, schedule[rounds]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+    }
+
+    // Decryption round keys for aesdec: reversed, inner ones through aesimc
+    AES_TARGET("aes,sse2")
+    void InverseKeysAesNi(const uint8_t* encryptKeys, int rounds, uint8_t* decryptKeys)
+    {
+        const __m128i* forward = reinterpret_cast<const __m128i*>(encryptKeys);
+        __m128i* inverse = reinterpret_cast<__m128i*>(decryptKeys);
+        inverse[0] = forward[rounds];
+        for (int round = 1; round < rounds; round++)
+        {
+            inverse[round] = _mm_aesimc_si128(forward[rounds - round]);
+        }
+        inverse[rounds] = forward[0];
+    }
+
+    // CBC decryption has no chain between block decryptions, so four run
+    // interleaved to cover the latency of aesdec
+    AES_TARGET("aes,sse2")
+    void DecryptCbcAesNi(const uint8_t* keys, int rounds, const uint8_t* in, size_t blocks, uint8_t* iv, uint8_t* out)
+    {
+        const __m128i* schedule = reinterpret_cast<const __m128i*>(keys);
+        const __m128i* source = reinterpret_cast<const __m128i*>(in);
+        __m128i* target = reinterpret_cast<__m128i*>(out);
+        __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+        size_t i = 0;
+
+        for (; i + 4 <= blocks; i += 4)
+        {
+            __m128i c0 = _mm_loadu_si128(source + i);
+            __m128i c1 = _mm_loadu_si128(source + i + 1);
+            __m128i c2 = _mm_loadu_si128(source + i + 2);
+            __m128i c3 = _mm_loadu_si128(source + i + 3);
+            __m128i b0 = _mm_xor_si128(c0, schedule[0]);
+            __m128i b1 = _mm_xor_si128(c1, schedule[0]);
+            __m128i b2 = _mm_xor_si128(c2, schedule[0]);
+            __m128i b3 = _mm_xor_si128(c3, schedule[0]);
+            for (int round = 1; round < rounds; round++)
+            {
+                b0 = _mm_aesdec_si128(b0, schedule[round]);
+                b1 = _mm_aesdec_si128(b1, schedule[round]);
+                b2 = _mm_aesdec_si128(b2, schedule[round]);
+                b3 = _mm_aesdec_si128(b3, schedule[round]);
+            }
+            b0 = _mm_aesdeclast_si128(b0, schedule[rounds]);
+            b1 = _mm_aesdeclast_si128(b1, schedule[rounds]);
+            b2 = _mm_aesdeclast_si128(b2, schedule[rounds]);
+            b3 = _mm_aesdeclast_si128(b3, schedule[rounds]);
+            _mm_storeu_si128(target + i, _mm_xor_si128(b0, previous));
+            _mm_storeu_si128(target + i + 1, _mm_xor_si128(b1, c0));
+            _mm_storeu_si128(target + i + 2, _mm_xor_si128(b2, c1));
+            _mm_storeu_si128(target + i + 3, _mm_xor_si128(b3, c2));
+            previous = c3;
+        }
+
+        for (; i < blocks; i++)
+        {
+            __m128i c = _mm_loadu_si128(source + i);
+            __m128i b = _mm_xor_si128(c, schedule[0]);
+            for (int round = 1; round < rounds; round++)
+            {
+                b = _mm_aesdec_si128(b, schedule[round]);
+            }
+            b = _mm_aesdeclast_si128(b, schedule[rounds]);
+            _mm_storeu_si128(target + i, _mm_xor_si128(b, previous));
+            previous = c;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(iv), previous);
+    }
+
+    bool DetectAesNi()
+    {
+        unsigned registers[4];
+#ifdef _MSC_VER
+        int values[4];
+        __cpuid(values, 1);
+        for (int i = 0; i < 4; i++)
+        {
+            registers[i] = static_cast<unsigned>(values[i]);
+        }
+#else
+        __cpuid(1, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        return (registers[2] & (1u << 25)) != 0;
+    }
+#else
+    bool DetectAesNi()
+    {
+        return false;
+    }
+#endif
+}
+
+Aes::Aes()
+    : m_rounds(0)
+    , m_kernel(Kernel::Portable)
+{
+    memset(m_encryptKeys, 0, sizeof(m_encryptKeys));
+    memset(m_decryptKeys, 0, sizeof(m_decryptKeys));
+}
+
+bool Aes::SetKey(const void* key, size_t keyLength)
+{
+    return SetKey(ActiveKernel(), key, keyLength);
+}
+
+bool Aes::SetKey(Kernel kernel, const void* key, size_t keyLength)
+{
+    if ((keyLength != 16 && keyLength != 32) || !Supported(kernel))
+    {
+        return false;
+    }
+
+    const uint8_t* box = Tables().forward;
+    int words = static_cast<int>(keyLength / 4);
+    m_rounds = words + 6;
+    m_kernel = kernel;
+    int totalWords = 4 * (m_rounds + 1);
+
+    memcpy(m_encryptKeys, key, keyLength);
+    uint8_t roundConstant = 1;
+    for (int i = words; i < totalWords; i++)
+    {
+        uint8_t temp[4];
+        memcpy(temp, m_encryptKeys + (i - 1) * 4, 4);
+        if (i % words == 0)
+        {
+            uint8_t first = temp[0];
+            temp[0] = box[temp[1]] ^ roundConstant;
+            temp[1] = box[temp[2]];
+            temp[2] = box[temp[3]];
+            temp[3] = box[first];
+            roundConstant = Times2(roundConstant);
+        }
+        else if (words > 6 && i % words == 4)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                temp[j] = box[temp[j]];
+            }
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            m_encryptKeys[i * 4 + j] = m_encryptKeys[(i - words) * 4 + j] ^ temp[j];
+        }
+    }
+
+#ifdef AES_X86
+    if (kernel == Kernel::AesNi)
+    {
+        InverseKeysAesNi(m_encryptKeys, m_rounds, m_decryptKeys);
+        return true;
+    }
+#endif
+
+    // Reversed, with InvMixColumns on the inner round keys (what aesimc computes)
+    memcpy(m_decryptKeys, m_encryptKeys + m_rounds * 16, 16);
+    for (int round = 1; round < m_rounds; round++)
+    {
+        memcpy(m_decryptKeys + round * 16, m_encryptKeys + (m_rounds - round) * 16, 16);
+        InverseMixColumns(m_decryptKeys + round * 16);
+    }
+    memcpy(m_decryptKeys + m_rounds * 16, m_encryptKeys, 16);
+    return true;
+}
+
+void Aes::EncryptBlock(const uint8_t* in, uint8_t* out) const
+{
+#ifdef AES_X86
+    if (m_kernel == Kernel::AesNi)
+    {
+        EncryptAesNi(m_encryptKeys, m_rounds, in, out);
+        return;
+    }
+#endif
+    EncryptPortable(m_encryptKeys, m_rounds, in, out);
+}
+
+void Aes::DecryptBlock(const uint8_t* in, uint8_t* out) const
+{
+#ifdef AES_X86
+    if (m_kernel == Kernel::AesNi)
+    {
+        DecryptAesNi(m_decryptKeys, m_rounds, in, out);
+        return;
+    }
+#endif
+    DecryptPortable(m_decryptKeys, m_rounds, in, out);
+}
+
+void Aes::DecryptCbc(const uint8_t* in, size_t blocks, uint8_t* iv, uint8_t* out) const
+{
+#ifdef AES_X86
+    if (m_kernel == Kernel::AesNi)
+    {
+        DecryptCbcAesNi(m_decryptKeys, m_rounds, in, blocks, iv, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < blocks; i++)
+    {
+        DecryptPortable(m_decryptKeys, m_rounds, in + i * BLOCK_SIZE, out + i * BLOCK_SIZE);
+        XorBlock(out + i * BLOCK_SIZE, iv);
+        memcpy(iv, in + i * BLOCK_SIZE, BLOCK_SIZE);
+    }
+}
+
+void Aes::EncryptCts(const uint8_t* in, size_t length, uint8_t* out) const
+{
+    uint8_t chain[BLOCK_SIZE] = {};
+    if (length <= BLOCK_SIZE)
+    {
+        EncryptBlock(in, out);
+        return;
+    }
+
+    // Plain CBC up to the last two blocks
+    size_t blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t tail = length - (blocks - 1) * BLOCK_SIZE;
+    for (size_t i = 0; i + 2 < blocks; i++)
+    {
+        XorBlock(chain, in + i * BLOCK_SIZE);
+        EncryptBlock(chain, chain);
+        memcpy(out + i * BLOCK_SIZE, chain, BLOCK_SIZE);
+    }
+
+    // The last full block's ciphertext is stolen to pad the final one, and
+    // the two are written in swapped order
+    const uint8_t* last = in + (blocks - 2) * BLOCK_SIZE;
+    uint8_t stolen[BLOCK_SIZE];
+    XorBlock(chain, last);
+    EncryptBlock(chain, stolen);
+
+    uint8_t padded[BLOCK_SIZE] = {};
+    memcpy(padded, last + BLOCK_SIZE, tail);
+    XorBlock(padded, stolen);
+    EncryptBlock(padded, out + (blocks - 2) * BLOCK_SIZE);
+    memcpy(out + (blocks - 1) * BLOCK_SIZE, stolen, tail);
+}
+
+void Aes::DecryptCts(const uint8_t* in, size_t length, uint8_t* out) const
+{
+    uint8_t chain[BLOCK_SIZE] = {};
+    if (length <= BLOCK_SIZE)
+    {
+        DecryptBlock(in, out);
+        return;
+    }
+
+    size_t blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t tail = length - (blocks - 1) * BLOCK_SIZE;
+    DecryptCbc(in, blocks - 2, chain, out);
+
+    // Undo the swap: the second-to-last ciphertext block hides the final
+    // plaintext, padded with the tail of the stolen block
+    const uint8_t* swapped = in + (blocks - 2) * BLOCK_SIZE;
+    uint8_t decrypted[BLOCK_SIZE];
+    DecryptBlock(swapped, decrypted);
+
+    uint8_t stolen[BLOCK_SIZE];
+    memcpy(stolen, swapped + BLOCK_SIZE, tail);
+    memcpy(stolen + tail, decrypted + tail, BLOCK_SIZE - tail);
+    for (size_t i = 0; i < tail; i++)
+    {
+        out[(blocks - 1) * BLOCK_SIZE + i] = decrypted[i] ^ stolen[i];
+    }
+
+    DecryptBlock(stolen, out + (blocks - 2) * BLOCK_SIZE);
+    XorBlock(out + (blocks - 2) * BLOCK_SIZE, chain);
+}
+
+Aes::Kernel Aes::ActiveKernel()
+{
+    static const Kernel kernel = DetectAesNi() ? Kernel::AesNi : Kernel::Portable;
+    return kernel;
+}
+
+bool Aes::Supported(Kernel kernel)
+{
+    return kernel <= ActiveKernel();
+}
+
+const char* Aes::KernelName(Kernel kernel)
+{
+    return kernel == Kernel::AesNi ? "aes-ni" : "portable";
+}
\ No newline at end of file
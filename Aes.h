@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// AES-128 and AES-256 (FIPS 197) with an AES-NI kernel chosen at first use
+// when the CPU has it, and a portable byte-oriented fallback. Both key
+// schedules are expanded once in SetKey, so a key kept alongside its keytab
+// entry costs nothing per message.
+//
+// The only mode is CBC with ciphertext stealing and the last two blocks
+// swapped (CBC-CS3 with a zero IV), which is what the Kerberos AES
+// encryption types use (RFC 3962).
+class Aes
+{
+public:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    enum class Kernel
+    {
+        Portable,
+        AesNi
+    };
+
+    Aes();
+
+    // keyLength is 16 or 32; returns false for anything else
+    bool SetKey(const void* key, size_t keyLength);
+    bool SetKey(Kernel kernel, const void* key, size_t keyLength);
+
+    void EncryptBlock(const uint8_t* in, uint8_t* out) const;
+
+    // length must be at least one block; in and out may not overlap
+    void EncryptCts(const uint8_t* in, size_t length, uint8_t* out) const;
+    void DecryptCts(const uint8_t* in, size_t length, uint8_t* out) const;
+
+    static Kernel ActiveKernel();
+    static bool Supported(Kernel kernel);
+    static const char* KernelName(Kernel kernel);
+
+private:
+    static constexpr int MAX_ROUNDS = 14;
+
+    void DecryptBlock(const uint8_t* in, uint8_t* out) const;
+    void DecryptCbc(const uint8_t* in, size_t blocks, uint8_t* iv, uint8_t* out) const;
+
+    alignas(16) uint8_t m_encryptKeys[(MAX_ROUNDS + 1) * BLOCK_SIZE];
+    alignas(16) uint8_t m_decryptKeys[(MAX_ROUNDS + 1) * BLOCK_SIZE];   // inverse-mixed, for the equivalent inverse cipher
+    int m_rounds;
+    Kernel m_kernel;
+};
\ No newline at end of file
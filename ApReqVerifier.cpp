@@ -0,0 +1,707 @@
+#include "ApReqVerifier.h"
+#include "Base64.h"
+#include "Der.h"
+#include "Keytab.h"
+#include "Log.h"
+#include "Pac.h"
+#include "RequestArena.h"
+#include "SecureRandom.h"
+#include "Sha256.h"
+#include <cstring>
+
+namespace
+{
+    // One limiter for every rejection reason, so a replay storm stays one message a second
+    LogLimiter g_rejectionLog;
+
+    // DER contents (without tag and length) of the mechanism OIDs
+    const uint8_t SPNEGO_OID[] = { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x02 };
+    const uint8_t KRB5_OID[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+    const uint8_t MS_KRB5_OID[] = { 0x2a, 0x86, 0x48, 0x82, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+
+    const uint8_t TOK_ID_AP_REQ[] = { 0x01, 0x00 };
+    const uint8_t TOK_ID_AP_REP[] = { 0x02, 0x00 };
+
+    constexpr int64_t GSS_CHECKSUM_TYPE = 0x8003;   // RFC 4121 4.1.1
+    constexpr int64_t AD_IF_RELEVANT = 1;
+    constexpr int64_t AD_WIN2K_PAC = 128;
+    constexpr size_t MAX_REPLY_SIZE = 512;
+
+    bool IsKerberosOid(const DerReader& oid)
+    {
+        return oid.Equals(KRB5_OID, sizeof(KRB5_OID)) || oid.Equals(MS_KRB5_OID, sizeof(MS_KRB5_OID));
+    }
+
+    // KerberosTime is always "YYYYMMDDHHMMSSZ"
+    bool ParseTime(const DerReader& value, int64_t& seconds)
+    {
+        if (value.Size() != 15 || value.Data()[14] != 'Z')
+        {
+            return false;
+        }
+        int digits[14];
+        for (int i = 0; i < 14; i++)
+        {
+            uint8_t c = value.Data()[i];
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            digits[i] = c - '0';
+        }
+        int64_t year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+        int64_t month = digits[4] * 10 + digits[5];
+        int64_t day = digits[6] * 10 + digits[7];
+        int64_t hour = digits[8] * 10 + digits[9];
+        int64_t minute = digits[10] * 10 + digits[11];
+        int64_t second = digits[12] * 10 + digits[13];
+        if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+        {
+            return false;
+        }
+
+        // Days from the civil date (Howard Hinnant's algorithm)
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yearOfEra = year - era * 400;
+        int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        int64_t days = era * 146097 + dayOfEra - 719468;
+        seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+        return true;
+    }
+
+    struct EncryptedData
+    {
+        int64_t etype = 0;
+        int64_t kvno = -1;      // -1 when absent
+        DerReader cipher;
+    };
+
+    bool ParseEncryptedData(DerReader& parent, int number, EncryptedData& data)
+    {
+        DerReader field;
+        DerReader sequence;
+        if (!parent.Read(DerReader::Context(number), field) || !field.Read(DerReader::SEQUENCE, sequence) ||
+            !sequence.ReadTaggedInteger(0, data.etype))
+        {
+            return false;
+        }
+        if (sequence.PeekTag() == DerReader::Context(1) && !sequence.ReadTaggedInteger(1, data.kvno))
+        {
+            return false;
+        }
+        return sequence.ReadTagged(2, DerReader::OCTET_STRING, data.cipher);
+    }
+
+    // PrincipalName ::= SEQUENCE { name-type [0], name-string [1] SEQUENCE OF KerberosString }
+    bool ParsePrincipal(DerReader& parent, int number, DerReader& names)
+    {
+        DerReader field;
+        DerReader sequence;
+        int64_t nameType = 0;
+        return parent.Read(DerReader::Context(number), field) && field.Read(DerReader::SEQUENCE, sequence) &&
+            sequence.ReadTaggedInteger(0, nameType) && sequence.ReadTagged(1, DerReader::SEQUENCE, names);
+    }
+
+    bool SamePrincipal(DerReader a, DerReader b)
+    {
+        while (!a.Empty() && !b.Empty())
+        {
+            DerReader left;
+            DerReader right;
+            if (!a.Read(DerReader::GENERAL_STRING, left) || !b.Read(DerReader::GENERAL_STRING, right) ||
+                left.Size() != right.Size() || memcmp(left.Data(), right.Data(), left.Size()) != 0)
+            {
+                return false;
+            }
+        }
+        return a.Empty() && b.Empty();
+    }
+
+    void AppendPrincipal(std::string& out, DerReader names, const DerReader& realm)
+    {
+        bool first = true;
+        while (!names.Empty())
+        {
+            DerReader name;
+            if (!names.Read(DerReader::GENERAL_STRING, name))
+            {
+                break;
+            }
+            if (!first)
+            {
+                out += '/';
+            }
+            out.append(reinterpret_cast<const char*>(name.Data()), name.Size());
+            first = false;
+        }
+        out += '@';
+        out.append(reinterpret_cast<const char*>(realm.Data()), realm.Size());
+    }
+
+    void PrependOid(DerWriter& writer, const DerReader& oid)
+    {
+        size_t mark = writer.Mark();
+        writer.Prepend(oid.Data(), oid.Size());
+        writer.Wrap(DerReader::OID, mark);
+    }
+
+    // What the token carried, as far as the reply needs it
+    struct Framing
+    {
+        bool spnego = false;
+        DerReader spnegoMech;   // first mechanism the client listed
+        DerReader innerMech;    // mechanism OID of the Kerberos token itself
+        DerReader apReq;
+    };
+
+    // GSS framing: [APPLICATION 0] { mech OID, mech-specific bytes }
+    bool ParseKerberosToken(DerReader token, Framing& framing)
+    {
+        DerReader body;
+        if (!token.Read(DerReader::Application(0), body) || !token.Empty() ||
+            !body.Read(DerReader::OID, framing.innerMech) || !IsKerberosOid(framing.innerMech) ||
+            body.Size() < 2 || memcmp(body.Data(), TOK_ID_AP_REQ, 2) != 0)
+        {
+            return false;
+        }
+        framing.apReq = DerReader(body.Data() + 2, body.Size() - 2);
+        return true;
+    }
+
+    bool ParseFraming(const uint8_t* token, size_t length, Framing& framing)
+    {
+        DerReader outer(token, length);
+        DerReader body;
+        DerReader oid;
+        if (!outer.Read(DerReader::Application(0), body) || !outer.Empty() || !body.Read(DerReader::OID, oid))
+        {
+            return false;
+        }
+        if (IsKerberosOid(oid))
+        {
+            return ParseKerberosToken(DerReader(token, length), framing);
+        }
+        if (!oid.Equals(SPNEGO_OID, sizeof(SPNEGO_OID)))
+        {
+            return false;
+        }
+
+        // NegTokenInit with an optimistic Kerberos token for the first listed
+        // mechanism. A mechListMIC, or a token for a later mechanism, needs
+        // the MIC exchange only the library implements.
+        framing.spnego = true;
+        DerReader choice;
+        DerReader init;
+        DerReader mechTypes;
+        if (!body.Read(DerReader::Context(0), choice) || !choice.Read(DerReader::SEQUENCE, init) ||
+            !init.ReadTagged(0, DerReader::SEQUENCE, mechTypes) ||
+            !mechTypes.Read(DerReader::OID, framing.spnegoMech) || !IsKerberosOid(framing.spnegoMech))
+        {
+            return false;
+        }
+
+        DerReader skipped;
+        bool present = false;
+        DerReader mechToken;
+        if (!init.ReadOptional(DerReader::Context(1), skipped, present) ||
+            !init.ReadTagged(2, DerReader::OCTET_STRING, mechToken) || !init.Empty())
+        {
+            return false;
+        }
+        return ParseKerberosToken(mechToken, framing);
+    }
+
+    // The mutual-authentication reply: AP-REP with EncAPRepPart echoing the
+    // authenticator's time, in GSS framing
+    bool BuildApRep(DerWriter& writer, const Framing& framing, int64_t sessionEtype, const KerberosUsageKey& replyKey,
+        const DerReader& ctime, int64_t cusec)
+    {
+        uint8_t plainBuffer[128];
+        DerWriter part(plainBuffer, sizeof(plainBuffer));
+        uint8_t random[KerberosCrypto::CONFOUNDER_SIZE + 4];
+        if (!GenerateRandom(random, sizeof(random)))
+        {
+            return false;
+        }
+        uint32_t sequence = ((static_cast<uint32_t>(random[16]) << 24) | (static_cast<uint32_t>(random[17]) << 16) |
+            (static_cast<uint32_t>(random[18]) << 8) | random[19]) & 0x3fffffff;
+
+        part.PrependTaggedInteger(3, sequence);
+        part.PrependTaggedInteger(1, cusec);
+        size_t timeMark = part.Mark();
+        part.Prepend(ctime.Data(), ctime.Size());
+        part.Wrap(DerReader::GENERALIZED_TIME, timeMark);
+        part.Wrap(DerReader::Context(0), timeMark);
+        part.Wrap(DerReader::SEQUENCE, 0);
+        part.Wrap(DerReader::Application(27), 0);
+        if (part.Overflowed())
+        {
+            return false;
+        }
+
+        size_t cipherLength = KerberosCrypto::EncryptedLength(part.Size());
+        uint8_t scratch[sizeof(plainBuffer) + KerberosCrypto::CONFOUNDER_SIZE];
+        uint8_t cipher[sizeof(plainBuffer) + KerberosCrypto::CONFOUNDER_SIZE + KerberosCrypto::CHECKSUM_SIZE];
+        replyKey.Encrypt(random, part.Data(), part.Size(), scratch, cipher);
+
+        size_t start = writer.Mark();
+        size_t mark = writer.Mark();
+        writer.Prepend(cipher, cipherLength);
+        writer.Wrap(DerReader::OCTET_STRING, mark);
+        writer.Wrap(DerReader::Context(2), mark);
+        writer.PrependTaggedInteger(0, sessionEtype);
+        writer.Wrap(DerReader::SEQUENCE, start);
+        writer.Wrap(DerReader::Context(2), start);
+        writer.PrependTaggedInteger(1, 15);
+        writer.PrependTaggedInteger(0, 5);
+        writer.Wrap(DerReader::SEQUENCE, start);
+        writer.Wrap(DerReader::Application(15), start);
+
+        writer.Prepend(TOK_ID_AP_REP, sizeof(TOK_ID_AP_REP));
+        PrependOid(writer, framing.innerMech);
+        writer.Wrap(DerReader::Application(0), start);
+        return !writer.Overflowed();
+    }
+
+    // AuthorizationData ::= SEQUENCE OF SEQUENCE { ad-type [0] Int32, ad-data [1] OCTET STRING }.
+    // A KDC puts the PAC inside an AD-IF-RELEVANT element.
+    bool ReadPacSids(DerReader authorizationData, int depth, std::vector<std::string>& sids)
+    {
+        DerReader elements;
+        if (!authorizationData.Read(DerReader::SEQUENCE, elements))
+        {
+            return false;
+        }
+        while (!elements.Empty())
+        {
+            DerReader element;
+            int64_t type = 0;
+            DerReader data;
+            if (!elements.Read(DerReader::SEQUENCE, element) || !element.ReadTaggedInteger(0, type) ||
+                !element.ReadTagged(1, DerReader::OCTET_STRING, data))
+            {
+                return false;
+            }
+            if (type == AD_WIN2K_PAC)
+            {
+                return Pac::ReadSids(data.Data(), data.Size(), sids);
+            }
+            if (type == AD_IF_RELEVANT && depth < 2 && ReadPacSids(data, depth + 1, sids))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+ApReqVerifier::ApReqVerifier(size_t replayEntries, std::chrono::seconds clockSkew, bool readSids)
+    : m_replayCache(replayEntries, clockSkew * 2)
+    , m_clockSkew(clockSkew.count())
+    , m_readSids(readSids)
+    , m_accepted(0)
+    , m_rejected(0)
+    , m_fallbacks(0)
+{
+}
+
+bool ApReqVerifier::Load(const std::string& keytab)
+{
+    return Load(std::vector<std::string>{ keytab });
+}
+
+bool ApReqVerifier::Load(const std::vector<std::string>& keytabs)
+{
+    auto keys = std::make_shared<KeySet>();
+    for (const std::string& keytab : keytabs)
+    {
+        std::vector<KeytabEntry> entries;
+        if (!Keytab::Load(keytab, entries))
+        {
+            Log::Write(LogLevel::Error) << L"Failed to read keytab " << std::wstring(keytab.begin(), keytab.end());
+            return false;
+        }
+
+        for (const KeytabEntry& entry : entries)
+        {
+            if (!KerberosCrypto::IsSupported(entry.etype))
+            {
+                continue;
+            }
+            ServiceKey key;
+            key.realm = entry.realm;
+            key.components = entry.components;
+            key.kvno = entry.kvno;
+            key.etype = entry.etype;
+            if (key.ticketKey.Initialize(entry.etype, entry.key.data(), entry.key.size(), KerberosCrypto::USAGE_TICKET))
+            {
+                keys->keys.push_back(std::move(key));
+            }
+        }
+    }
+
+    size_t count = keys->keys.size();
+    Log::Write(LogLevel::Info) << L"Native AP-REQ verifier loaded " << count << L" AES keys from " << keytabs.size()
+        << (keytabs.size() == 1 ? L" keytab" : L" keytabs");
+    if (count == 0)
+    {
+        return false;
+    }
+    std::atomic_store(&m_keys, std::shared_ptr<const KeySet>(std::move(keys)));
+    return true;
+}
+
+size_t ApReqVerifier::KeyCount() const
+{
+    std::shared_ptr<const KeySet> keys = std::atomic_load(&m_keys);
+    return keys ? keys->keys.size() : 0;
+}
+
+ApReqOutcome ApReqVerifier::Count(ApReqOutcome outcome)
+{
+    switch (outcome)
+    {
+    case ApReqOutcome::Accepted:
+        m_accepted.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case ApReqOutcome::Rejected:
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+    return outcome;
+}
+
+ApReqOutcome ApReqVerifier::Verify(const uint8_t* token, size_t length, int64_t now, AuthResult& result,
+    int64_t& ticketEnd)
+{
+    Framing framing;
+    if (!ParseFraming(token, length, framing))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // AP-REQ ::= [APPLICATION 14] SEQUENCE { pvno, msg-type, ap-options, ticket, authenticator }
+    DerReader message = framing.apReq;
+    DerReader apReq;
+    DerReader fields;
+    int64_t pvno = 0;
+    int64_t messageType = 0;
+    DerReader options;
+    if (!message.Read(DerReader::Application(14), apReq) || !apReq.Read(DerReader::SEQUENCE, fields) ||
+        !fields.ReadTaggedInteger(0, pvno) || pvno != 5 || !fields.ReadTaggedInteger(1, messageType) ||
+        messageType != 14 || !fields.ReadTagged(2, DerReader::BIT_STRING, options) || options.Size() < 2)
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    uint8_t optionBits = options.Data()[1];
+    bool useSessionKey = (optionBits & 0x40) != 0;
+    bool mutual = (optionBits & 0x20) != 0;
+    if (useSessionKey)
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // Ticket ::= [APPLICATION 1] SEQUENCE { tkt-vno, realm, sname, enc-part }
+    DerReader ticketField;
+    DerReader ticketApp;
+    DerReader ticket;
+    int64_t ticketVersion = 0;
+    DerReader realm;
+    DerReader serviceNames;
+    EncryptedData ticketData;
+    EncryptedData authenticatorData;
+    if (!fields.Read(DerReader::Context(3), ticketField) || !ticketField.Read(DerReader::Application(1), ticketApp) ||
+        !ticketApp.Read(DerReader::SEQUENCE, ticket) || !ticket.ReadTaggedInteger(0, ticketVersion) ||
+        ticketVersion != 5 || !ticket.ReadTagged(1, DerReader::GENERAL_STRING, realm) ||
+        !ParsePrincipal(ticket, 2, serviceNames) || !ParseEncryptedData(ticket, 3, ticketData) ||
+        !ParseEncryptedData(fields, 4, authenticatorData))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // The key for this service principal, etype and version (the newest when
+    // the ticket does not say)
+    std::shared_ptr<const KeySet> keys = std::atomic_load(&m_keys);
+    if (!keys)
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    const ServiceKey* key = nullptr;
+    for (const ServiceKey& candidate : keys->keys)
+    {
+        if (candidate.etype != ticketData.etype || candidate.realm.size() != realm.Size() ||
+            memcmp(candidate.realm.data(), realm.Data(), realm.Size()) != 0)
+        {
+            continue;
+        }
+        DerReader names = serviceNames;
+        size_t matched = 0;
+        for (; matched < candidate.components.size() && !names.Empty(); matched++)
+        {
+            DerReader name;
+            if (!names.Read(DerReader::GENERAL_STRING, name) || name.Size() != candidate.components[matched].size() ||
+                memcmp(name.Data(), candidate.components[matched].data(), name.Size()) != 0)
+            {
+                break;
+            }
+        }
+        if (matched != candidate.components.size() || !names.Empty())
+        {
+            continue;
+        }
+        if (ticketData.kvno >= 0 ? candidate.kvno == static_cast<uint32_t>(ticketData.kvno)
+                                 : (!key || candidate.kvno > key->kvno))
+        {
+            key = &candidate;
+            if (ticketData.kvno >= 0)
+            {
+                break;
+            }
+        }
+    }
+    if (!key)
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // EncTicketPart ::= [APPLICATION 3] SEQUENCE { flags, key, crealm, cname, transited,
+    //     authtime, starttime OPTIONAL, endtime, renew-till OPTIONAL, caddr OPTIONAL, authorization-data OPTIONAL }
+    RequestArena& arena = RequestArena::ForThread();
+    uint8_t* ticketScratch = arena.AllocateArray<uint8_t>(ticketData.cipher.Size());
+    const uint8_t* ticketPlain = nullptr;
+    size_t ticketPlainLength = 0;
+    if (!key->ticketKey.Decrypt(ticketData.cipher.Data(), ticketData.cipher.Size(), ticketScratch, ticketPlain,
+        ticketPlainLength))
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: ticket integrity check failed";
+        return Count(ApReqOutcome::Rejected);
+    }
+
+    DerReader encTicket(ticketPlain, ticketPlainLength);
+    DerReader encTicketApp;
+    DerReader part;
+    DerReader ticketFlags;
+    DerReader sessionKeyField;
+    DerReader sessionKeySequence;
+    int64_t sessionEtype = 0;
+    DerReader sessionKey;
+    DerReader clientRealm;
+    DerReader clientNames;
+    DerReader transited;
+    DerReader authTimeValue;
+    DerReader startTimeValue;
+    DerReader endTimeValue;
+    bool hasStartTime = false;
+    if (!encTicket.Read(DerReader::Application(3), encTicketApp) || !encTicketApp.Read(DerReader::SEQUENCE, part) ||
+        !part.ReadTagged(0, DerReader::BIT_STRING, ticketFlags) || ticketFlags.Size() < 2 ||
+        !part.Read(DerReader::Context(1), sessionKeyField) ||
+        !sessionKeyField.Read(DerReader::SEQUENCE, sessionKeySequence) ||
+        !sessionKeySequence.ReadTaggedInteger(0, sessionEtype) ||
+        !sessionKeySequence.ReadTagged(1, DerReader::OCTET_STRING, sessionKey) ||
+        !part.ReadTagged(2, DerReader::GENERAL_STRING, clientRealm) || !ParsePrincipal(part, 3, clientNames) ||
+        !part.Read(DerReader::Context(4), transited) ||
+        !part.ReadTagged(5, DerReader::GENERALIZED_TIME, authTimeValue))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    if (part.PeekTag() == DerReader::Context(6))
+    {
+        hasStartTime = true;
+        if (!part.ReadTagged(6, DerReader::GENERALIZED_TIME, startTimeValue))
+        {
+            return Count(ApReqOutcome::Fallback);
+        }
+    }
+    int64_t authTime = 0;
+    int64_t startTime = 0;
+    int64_t endTime = 0;
+    if (!part.ReadTagged(7, DerReader::GENERALIZED_TIME, endTimeValue) || !ParseTime(authTimeValue, authTime) ||
+        !ParseTime(endTimeValue, endTime) || (hasStartTime && !ParseTime(startTimeValue, startTime)))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    if (!hasStartTime)
+    {
+        startTime = authTime;
+    }
+
+    // Group SIDs from the PAC; a ticket without one (not from AD) just has none
+    DerReader renewTill;
+    DerReader addresses;
+    DerReader authorizationData;
+    bool hasRenewTill = false;
+    bool hasAddresses = false;
+    bool hasAuthorizationData = false;
+    if (m_readSids && (!part.ReadOptional(DerReader::Context(8), renewTill, hasRenewTill) ||
+        !part.ReadOptional(DerReader::Context(9), addresses, hasAddresses) ||
+        !part.ReadOptional(DerReader::Context(10), authorizationData, hasAuthorizationData)))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // TicketFlags bit 7: invalid (postdated, not yet validated)
+    if (ticketFlags.Data()[1] & 0x01)
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: ticket is marked invalid";
+        return Count(ApReqOutcome::Rejected);
+    }
+    if (startTime - m_clockSkew > now || endTime + m_clockSkew < now)
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: ticket is not yet valid or has expired";
+        return Count(ApReqOutcome::Rejected);
+    }
+    if (!KerberosCrypto::IsSupported(static_cast<int32_t>(sessionEtype)) ||
+        KerberosCrypto::KeySize(static_cast<int32_t>(sessionEtype)) != sessionKey.Size())
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // Authenticator ::= [APPLICATION 2] SEQUENCE { authenticator-vno, crealm, cname,
+    //     cksum OPTIONAL, cusec, ctime, subkey OPTIONAL, seq-number OPTIONAL, authorization-data OPTIONAL }
+    KerberosUsageKey authenticatorKey;
+    if (authenticatorData.etype != sessionEtype ||
+        !authenticatorKey.Initialize(static_cast<int32_t>(sessionEtype), sessionKey.Data(), sessionKey.Size(),
+            KerberosCrypto::USAGE_AUTHENTICATOR))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    uint8_t* authenticatorScratch = arena.AllocateArray<uint8_t>(authenticatorData.cipher.Size());
+    const uint8_t* authenticatorPlain = nullptr;
+    size_t authenticatorPlainLength = 0;
+    if (!authenticatorKey.Decrypt(authenticatorData.cipher.Data(), authenticatorData.cipher.Size(),
+        authenticatorScratch, authenticatorPlain, authenticatorPlainLength))
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: authenticator integrity check failed";
+        return Count(ApReqOutcome::Rejected);
+    }
+
+    DerReader encAuthenticator(authenticatorPlain, authenticatorPlainLength);
+    DerReader authenticatorApp;
+    DerReader authenticator;
+    int64_t authenticatorVersion = 0;
+    DerReader authenticatorRealm;
+    DerReader authenticatorNames;
+    DerReader checksumField;
+    DerReader checksum;
+    int64_t checksumType = 0;
+    DerReader checksumValue;
+    int64_t cusec = 0;
+    DerReader ctimeValue;
+    if (!encAuthenticator.Read(DerReader::Application(2), authenticatorApp) ||
+        !authenticatorApp.Read(DerReader::SEQUENCE, authenticator) ||
+        !authenticator.ReadTaggedInteger(0, authenticatorVersion) || authenticatorVersion != 5 ||
+        !authenticator.ReadTagged(1, DerReader::GENERAL_STRING, authenticatorRealm) ||
+        !ParsePrincipal(authenticator, 2, authenticatorNames))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // GSS-API requires the 0x8003 checksum carrying the context flags
+    if (!authenticator.Read(DerReader::Context(3), checksumField) || !checksumField.Read(DerReader::SEQUENCE, checksum) ||
+        !checksum.ReadTaggedInteger(0, checksumType) || checksumType != GSS_CHECKSUM_TYPE ||
+        !checksum.ReadTagged(1, DerReader::OCTET_STRING, checksumValue) || checksumValue.Size() < 24 ||
+        !authenticator.ReadTaggedInteger(4, cusec) ||
+        !authenticator.ReadTagged(5, DerReader::GENERALIZED_TIME, ctimeValue))
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    int64_t ctime = 0;
+    if (!ParseTime(ctimeValue, ctime) || cusec < 0 || cusec > 999999)
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+    if (authenticatorRealm.Size() != clientRealm.Size() ||
+        memcmp(authenticatorRealm.Data(), clientRealm.Data(), clientRealm.Size()) != 0 ||
+        !SamePrincipal(authenticatorNames, clientNames))
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: authenticator client does not match the ticket";
+        return Count(ApReqOutcome::Rejected);
+    }
+    if (ctime < now - m_clockSkew || ctime > now + m_clockSkew)
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: authenticator time is outside the allowed clock skew";
+        return Count(ApReqOutcome::Rejected);
+    }
+
+    // Only an authenticator that verified is recorded, so forged ones cannot
+    // fill the cache
+    Sha256::Digest replayKey = Sha256::Hash(authenticatorData.cipher.Data(), authenticatorData.cipher.Size());
+    ReplayCheck replay = m_replayCache.Insert(replayKey);
+    if (replay == ReplayCheck::Replay)
+    {
+        Log::Write(LogLevel::Warning, g_rejectionLog) << L"Native AP-REQ: replayed authenticator";
+        return Count(ApReqOutcome::Rejected);
+    }
+    if (replay == ReplayCheck::Full)
+    {
+        // Without room to record it a replay could not be told later; the
+        // library keeps its own replay cache
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    // Reply: NegTokenResp { accept-completed, supportedMech, responseToken (AP-REP) },
+    // or the bare AP-REP without SPNEGO
+    uint8_t* reply = arena.AllocateArray<uint8_t>(MAX_REPLY_SIZE);
+    DerWriter writer(reply, MAX_REPLY_SIZE);
+    if (mutual)
+    {
+        KerberosUsageKey replyKey;
+        if (!replyKey.Initialize(static_cast<int32_t>(sessionEtype), sessionKey.Data(), sessionKey.Size(),
+                KerberosCrypto::USAGE_AP_REP) ||
+            !BuildApRep(writer, framing, sessionEtype, replyKey, ctimeValue, cusec))
+        {
+            return Count(ApReqOutcome::Fallback);
+        }
+    }
+    if (framing.spnego)
+    {
+        if (mutual)
+        {
+            writer.Wrap(DerReader::OCTET_STRING, 0);
+            writer.Wrap(DerReader::Context(2), 0);
+        }
+        size_t mark = writer.Mark();
+        PrependOid(writer, framing.spnegoMech);
+        writer.Wrap(DerReader::Context(1), mark);
+        const uint8_t acceptCompleted[] = { DerReader::Context(0), 0x03, DerReader::ENUMERATED, 0x01, 0x00 };
+        writer.Prepend(acceptCompleted, sizeof(acceptCompleted));
+        writer.Wrap(DerReader::SEQUENCE, 0);
+        writer.Wrap(DerReader::Context(1), 0);
+    }
+    if (writer.Overflowed())
+    {
+        return Count(ApReqOutcome::Fallback);
+    }
+
+    result.status = AuthStatus::Success;
+    if (writer.Size() > 0)
+    {
+        result.outputToken = Base64::Encode(writer.Data(), writer.Size());
+    }
+    result.principal.clear();
+    AppendPrincipal(result.principal, clientNames, clientRealm);
+    result.sids.clear();
+    if (hasAuthorizationData)
+    {
+        ReadPacSids(authorizationData, 0, result.sids);
+    }
+    ticketEnd = endTime;
+    return Count(ApReqOutcome::Accepted);
+}
+
+ApReqStats ApReqVerifier::GetStats() const
+{
+    ApReqStats stats;
+    stats.accepted = m_accepted.load(std::memory_order_relaxed);
+    stats.rejected = m_rejected.load(std::memory_order_relaxed);
+    stats.fallbacks = m_fallbacks.load(std::memory_order_relaxed);
+    stats.replays = m_replayCache.Replays();
+    stats.replayCacheFull = m_replayCache.Full();
+    return stats;
+}
\ No newline at end of file
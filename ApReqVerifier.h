@@ -0,0 +1,90 @@
+#pragma once
+
+#include "AuthResult.h"
+#include "KerberosCrypto.h"
+#include "ReplayCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class ApReqOutcome
+{
+    Accepted,
+    Rejected,   // a token the library would refuse too: bad integrity, expired, skewed, replayed
+    Fallback    // not the common case; hand it to the auth provider
+};
+
+struct ApReqStats
+{
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    uint64_t fallbacks = 0;
+    uint64_t replays = 0;
+    uint64_t replayCacheFull = 0;   // fallbacks for want of room to record the authenticator
+};
+
+// In-process verifier for the common first leg: a Kerberos AP-REQ, raw or
+// wrapped in a SPNEGO NegTokenInit that lists Kerberos first, whose ticket
+// and session key are aes128/aes256-cts-hmac-sha1-96. It decrypts the ticket
+// with the keytab key (schedules expanded at load), decrypts the
+// authenticator with the session key, checks times against the allowed skew
+// and the authenticator against the replay cache, and returns the client
+// principal together with the SPNEGO reply (and an AP-REP when the client
+// asked for mutual authentication).
+//
+// Tokens it does not fully understand - other mechanisms or etypes,
+// user-to-user, a mechListMIC, keys the keytab lacks - come back as Fallback
+// so the library sees them unchanged, as do valid ones the replay cache has no
+// room to record: it holds replayEntries live authenticators, each kept for
+// twice the clock skew in 32 bytes of table. Scratch buffers come from the
+// request arena, so the caller must hold an ArenaScope.
+class ApReqVerifier
+{
+public:
+    // readSids also returns the SIDs in the ticket's PAC with the principal
+    ApReqVerifier(size_t replayEntries, std::chrono::seconds clockSkew, bool readSids = false);
+
+    // Loads the aes keys of a keytab; false if it cannot be read or has none
+    bool Load(const std::string& keytab);
+
+    // Loads the aes keys of every keytab as one set. Safe while Verify runs:
+    // the new set replaces the old whole, and on failure the old one stays.
+    bool Load(const std::vector<std::string>& keytabs);
+    size_t KeyCount() const;
+
+    // now is the current time in seconds since 1970 (UTC). On Accepted,
+    // result holds the principal and reply token and ticketEnd the ticket's
+    // end time on the same clock.
+    ApReqOutcome Verify(const uint8_t* token, size_t length, int64_t now, AuthResult& result, int64_t& ticketEnd);
+
+    ApReqStats GetStats() const;
+
+private:
+    struct ServiceKey
+    {
+        std::string realm;
+        std::vector<std::string> components;
+        uint32_t kvno = 0;
+        int32_t etype = 0;
+        KerberosUsageKey ticketKey;
+    };
+
+    struct KeySet
+    {
+        std::vector<ServiceKey> keys;
+    };
+
+    ApReqOutcome Count(ApReqOutcome outcome);
+
+    std::shared_ptr<const KeySet> m_keys;   // replaced whole on reload, read with atomic_load
+    ReplayCache m_replayCache;
+    int64_t m_clockSkew;
+    bool m_readSids;
+
+    std::atomic<uint64_t> m_accepted;
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_fallbacks;
+};
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "AuthProvider.h"
+#include "Log.h"
+#include "MockAuthProvider.h"
+
+#ifdef _WIN32
+#include "SspiAuthProvider.h"
+#elif defined(KERBEROS_ECHO_HAVE_GSSAPI)
+#include "GssapiAuthProvider.h"
+#endif
+
+std::unique_ptr<AuthProvider> CreateAuthProvider(const ServerConfig& config)
+{
+    if (config.authProvider == L"mock")
+    {
+        return std::make_unique<MockAuthProvider>(config.mockAuthMicros);
+    }
+
+#ifdef _WIN32
+    if (config.authProvider.empty() || config.authProvider == L"sspi")
+    {
+        return std::make_unique<SspiAuthProvider>(!config.authzRules.empty());
+    }
+#elif defined(KERBEROS_ECHO_HAVE_GSSAPI)
+    if (config.authProvider.empty() || config.authProvider == L"gssapi")
+    {
+        return std::make_unique<GssapiAuthProvider>(config.keytab, !config.authzRules.empty());
+    }
+#endif
+
+    if (!config.authProvider.empty())
+    {
+        Log::Write(LogLevel::Error) << L"Authentication provider not available in this build: " << config.authProvider;
+    }
+    return nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "AuthResult.h"
+#include "SecurityContextTable.h"
+#include "ServerConfig.h"
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// One identity the service accepts tickets for
+struct AcceptorIdentity
+{
+    std::string principal;  // "service/host[@REALM]"; empty = any principal the keytab or account holds
+    std::string keytab;     // empty = the provider's default keytab
+};
+
+// Acceptor credentials a provider acquired for one identity. A leg holds a
+// reference while it runs and a parked handshake while it waits, so a newer
+// credential can replace this one at any time; the handle is released with
+// the last reference.
+class AcceptorCredential
+{
+public:
+    virtual ~AcceptorCredential() = default;
+
+    std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max();
+};
+
+// A security package that accepts Negotiate tokens. KerberosAuth owns one and
+// wraps it with the layers every backend shares: token decoding into the
+// request arena, the verified-token cache, the pending handshake table and
+// the authentication counters. Accept is called from many threads at once,
+// each with its own context.
+class AuthProvider
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~AuthProvider() = default;
+
+    virtual bool Initialize() = 0;
+
+    // Acquires inbound credentials for identity; null on failure. Called at
+    // start and again from CredentialManager's refresh thread while legs run.
+    virtual std::shared_ptr<AcceptorCredential> AcquireCredential(const AcceptorIdentity& identity) = 0;
+
+    // Runs one leg on a decoded token with credential, one this provider
+    // acquired. When continuing is set, context holds the handle an earlier
+    // leg left behind. On ContinueNeeded the provider stores the handle to
+    // park in context; on any other outcome it has released it. expiry is
+    // lowered to the ticket's expiry when it is known.
+    virtual void Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length, bool continuing,
+        PendingContext& context, AuthResult& result, Clock::time_point& expiry) = 0;
+
+    // Drops a parked handle (evicted, expired or left at shutdown)
+    virtual void ReleaseContext(const PendingContext& context) = 0;
+
+    virtual void Cleanup() = 0;
+    virtual const wchar_t* Name() const = 0;
+};
+
+// Builds the provider named by config.authProvider, or the platform default.
+// Returns null when no provider is available.
+std::unique_ptr<AuthProvider> CreateAuthProvider(const ServerConfig& config);
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class AuthStatus
+{
+    Success,
+    ContinueNeeded,     // send the output token back with 401 and wait for the next leg
+    Failed,
+    Overloaded          // shed before the provider saw it; answer 503, not a new challenge
+};
+
+// Outcome of one authentication leg
+struct AuthResult
+{
+    AuthStatus status = AuthStatus::Failed;
+    std::string outputToken;    // base64 token for WWW-Authenticate; empty when there is none
+    std::string principal;      // authenticated client name (UTF-8) on success
+    uint32_t principalId = 0;   // PrincipalTable ID of principal; 0 when it has none
+    std::vector<std::string> sids;  // SIDs of the principal and its groups ("S-1-5-21-..."), when an authorization policy wants them
+    bool badToken = false;      // failed for what the token itself holds, so presenting it again fails the same way
+};
\ No newline at end of file
@@ -0,0 +1,487 @@
+#include "Base64.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BASE64_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASE64_TARGET(features)
+#else
+#include <cpuid.h>
+#define BASE64_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace
+{
+    const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Character -> 6-bit value, or 0xff for anything outside the alphabet
+    struct DecodeTable
+    {
+        uint8_t values[256];
+
+        DecodeTable()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                values[i] = 0xff;
+            }
+            for (int i = 0; i < 64; i++)
+            {
+                values[static_cast<uint8_t>(ALPHABET[i])] = static_cast<uint8_t>(i);
+            }
+        }
+    };
+
+    const DecodeTable DECODE;
+
+    // The SIMD kernels handle whole blocks and report how much they consumed;
+    // the scalar code finishes the rest
+    using EncodeBlocks = size_t (*)(const uint8_t* in, size_t length, char* out);
+    using DecodeBlocks = bool (*)(const char* in, size_t length, uint8_t* out, size_t& consumed);
+
+    size_t EncodeScalar(const uint8_t* in, size_t length, char* out)
+    {
+        char* start = out;
+        size_t i = 0;
+        for (; i + 3 <= length; i += 3)
+        {
+            uint32_t triple = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+            out[0] = ALPHABET[triple >> 18];
+            out[1] = ALPHABET[(triple >> 12) & 0x3f];
+            out[2] = ALPHABET[(triple >> 6) & 0x3f];
+            out[3] = ALPHABET[triple & 0x3f];
+            out += 4;
+        }
+
+        size_t rest = length - i;
+        if (rest > 0)
+        {
+            uint32_t triple = static_cast<uint32_t>(in[i]) << 16;
+            if (rest == 2)
+            {
+                triple |= static_cast<uint32_t>(in[i + 1]) << 8;
+            }
+            out[0] = ALPHABET[triple >> 18];
+            out[1] = ALPHABET[(triple >> 12) & 0x3f];
+            out[2] = rest == 2 ? ALPHABET[(triple >> 6) & 0x3f] : '=';
+            out[3] = '=';
+            out += 4;
+        }
+        return static_cast<size_t>(out - start);
+    }
+
+    // Whole quanta without padding
+    bool DecodeScalar(const char* in, size_t length, uint8_t* out)
+    {
+        const uint8_t* text = reinterpret_cast<const uint8_t*>(in);
+        for (size_t i = 0; i < length; i += 4)
+        {
+            uint32_t a = DECODE.values[text[i]];
+            uint32_t b = DECODE.values[text[i + 1]];
+            uint32_t c = DECODE.values[text[i + 2]];
+            uint32_t d = DECODE.values[text[i + 3]];
+            if ((a | b | c | d) & 0x80)
+            {
+                return false;
+            }
+            uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+            out[0] = static_cast<uint8_t>(triple >> 16);
+            out[1] = static_cast<uint8_t>(triple >> 8);
+            out[2] = static_cast<uint8_t>(triple);
+            out += 3;
+        }
+        return true;
+    }
+
+    size_t NoEncodeBlocks(const uint8_t*, size_t, char*)
+    {
+        return 0;
+    }
+
+    bool NoDecodeBlocks(const char*, size_t, uint8_t*, size_t& consumed)
+    {
+        consumed = 0;
+        return true;
+    }
+
+#ifdef BASE64_X86
+    // Kernels follow Mula and Lemire, "Faster Base64 Encoding and Decoding
+    // using AVX2 Instructions": bytes are split into 6-bit indices with
+    // multiplies, and characters are classified by nibble lookups.
+
+    BASE64_TARGET("sse4.1")
+    __m128i EncodeIndicesToAscii128(__m128i indices)
+    {
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+        const __m128i shift = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        result = _mm_shuffle_epi8(shift, result);
+        return _mm_add_epi8(result, indices);
+    }
+
+    BASE64_TARGET("sse4.1")
+    size_t EncodeSse41(const uint8_t* in, size_t length, char* out)
+    {
+        // 12 bytes in, 16 characters out; each load reads 16 bytes
+        size_t i = 0;
+        for (; i + 16 <= length; i += 12)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            block = _mm_shuffle_epi8(block, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+            __m128i high = _mm_mulhi_epu16(_mm_and_si128(block, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+            __m128i low = _mm_mullo_epi16(_mm_and_si128(block, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), EncodeIndicesToAscii128(_mm_or_si128(high, low)));
+            out += 16;
+        }
+        return i;
+    }
+
+    BASE64_TARGET("sse4.1")
+    bool DecodeSse41(const char* in, size_t length, uint8_t* out, size_t& consumed)
+    {
+        const __m128i lutLow = _mm_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m128i lutHigh = _mm_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+        // 16 characters in, 12 bytes out; each store writes 16 bytes, so stop
+        // while the caller's buffer still has room for the overhang
+        size_t i = 0;
+        for (; i + 20 <= length; i += 16)
+        {
+            __m128i text = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(text, 4), mask2F);
+            __m128i lowNibbles = _mm_and_si128(text, mask2F);
+            __m128i low = _mm_shuffle_epi8(lutLow, lowNibbles);
+            __m128i high = _mm_shuffle_epi8(lutHigh, highNibbles);
+            if (!_mm_testz_si128(low, high))
+            {
+                consumed = i;
+                return false;
+            }
+            __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(text, mask2F), highNibbles));
+            __m128i values = _mm_add_epi8(text, roll);
+
+            __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+            packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+            out += 12;
+        }
+        consumed = i;
+        return true;
+    }
+
+    BASE64_TARGET("avx2")
+    size_t EncodeAvx2(const uint8_t* in, size_t length, char* out)
+    {
+        const __m256i shuffle = _mm256_set_epi8(
+            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+        const __m256i shift = _mm256_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+        // 24 bytes in (12 per lane), 32 characters out; the second load
+        // reads up to byte 28
+        size_t i = 0;
+        for (; i + 28 <= length; i += 24)
+        {
+            __m128i lowLane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i highLane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+            __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lowLane), highLane, 1);
+            block = _mm256_shuffle_epi8(block, shuffle);
+            __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(block, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            __m256i low = _mm256_mullo_epi16(_mm256_and_si256(block, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            __m256i indices = _mm256_or_si256(high, low);
+
+            __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+            result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+            out += 32;
+        }
+        return i;
+    }
+
+    BASE64_TARGET("avx2")
+    bool DecodeAvx2(const char* in, size_t length, uint8_t* out, size_t& consumed)
+    {
+        const __m256i lutLow = _mm256_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m256i lutHigh = _mm256_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i mask2F = _mm256_set1_epi8(0x2f);
+        const __m256i pack = _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        // 32 characters in, 24 bytes out; each store writes 32 bytes
+        size_t i = 0;
+        for (; i + 40 <= length; i += 32)
+        {
+            __m256i text = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(text, 4), mask2F);
+            __m256i lowNibbles = _mm256_and_si256(text, mask2F);
+            __m256i low = _mm256_shuffle_epi8(lutLow, lowNibbles);
+            __m256i high = _mm256_shuffle_epi8(lutHigh, highNibbles);
+            if (!_mm256_testz_si256(low, high))
+            {
+                consumed = i;
+                return false;
+            }
+            __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(text, mask2F), highNibbles));
+            __m256i values = _mm256_add_epi8(text, roll);
+
+            __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+            packed = _mm256_shuffle_epi8(packed, pack);
+            packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+            out += 24;
+        }
+        consumed = i;
+        return true;
+    }
+
+    void Cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4])
+    {
+#ifdef _MSC_VER
+        int values[4];
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; i++)
+        {
+            registers[i] = static_cast<unsigned>(values[i]);
+        }
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    // XCR0: which register files the OS saves on context switch
+    uint64_t ReadXcr0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+
+    Base64::Kernel DetectKernel()
+    {
+        unsigned registers[4];
+        Cpuid(0, 0, registers);
+        unsigned maxLeaf = registers[0];
+
+        Cpuid(1, 0, registers);
+        bool ssse3 = (registers[2] & (1u << 9)) != 0;
+        bool sse41 = (registers[2] & (1u << 19)) != 0;
+        bool osxsave = (registers[2] & (1u << 27)) != 0;
+        bool avx = (registers[2] & (1u << 28)) != 0;
+
+        if (maxLeaf >= 7 && osxsave && avx && (ReadXcr0() & 0x6) == 0x6)
+        {
+            Cpuid(7, 0, registers);
+            if (registers[1] & (1u << 5))
+            {
+                return Base64::Kernel::Avx2;
+            }
+        }
+        return (ssse3 && sse41) ? Base64::Kernel::Sse41 : Base64::Kernel::Scalar;
+    }
+#else
+    Base64::Kernel DetectKernel()
+    {
+        return Base64::Kernel::Scalar;
+    }
+#endif
+
+    EncodeBlocks EncoderFor(Base64::Kernel kernel)
+    {
+#ifdef BASE64_X86
+        switch (kernel)
+        {
+        case Base64::Kernel::Avx2:
+            return EncodeAvx2;
+        case Base64::Kernel::Sse41:
+            return EncodeSse41;
+        default:
+            break;
+        }
+#else
+        (void)kernel;
+#endif
+        return NoEncodeBlocks;
+    }
+
+    DecodeBlocks DecoderFor(Base64::Kernel kernel)
+    {
+#ifdef BASE64_X86
+        switch (kernel)
+        {
+        case Base64::Kernel::Avx2:
+            return DecodeAvx2;
+        case Base64::Kernel::Sse41:
+            return DecodeSse41;
+        default:
+            break;
+        }
+#else
+        (void)kernel;
+#endif
+        return NoDecodeBlocks;
+    }
+
+    struct Dispatch
+    {
+        Base64::Kernel kernel;
+        EncodeBlocks encode;
+        DecodeBlocks decode;
+    };
+
+    const Dispatch& Active()
+    {
+        static const Dispatch dispatch = []
+        {
+            Base64::Kernel kernel = DetectKernel();
+            return Dispatch{ kernel, EncoderFor(kernel), DecoderFor(kernel) };
+        }();
+        return dispatch;
+    }
+
+    size_t EncodeWith(EncodeBlocks blocks, const void* data, size_t length, char* out)
+    {
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+        size_t consumed = blocks(in, length, out);
+        return consumed / 3 * 4 + EncodeScalar(in + consumed, length - consumed, out + consumed / 3 * 4);
+    }
+
+    bool DecodeWith(DecodeBlocks blocks, std::string_view text, void* out, size_t& outLength)
+    {
+        size_t length = text.size();
+        if (length % 4 != 0)
+        {
+            return false;
+        }
+        if (length == 0)
+        {
+            outLength = 0;
+            return true;
+        }
+
+        // Everything but the final quantum must be free of padding
+        uint8_t* bytes = static_cast<uint8_t*>(out);
+        size_t body = length - 4;
+        size_t consumed = 0;
+        if (!blocks(text.data(), body, bytes, consumed))
+        {
+            return false;
+        }
+        if (!DecodeScalar(text.data() + consumed, body - consumed, bytes + consumed / 4 * 3))
+        {
+            return false;
+        }
+
+        const uint8_t* last = reinterpret_cast<const uint8_t*>(text.data() + body);
+        uint8_t* tail = bytes + body / 4 * 3;
+        size_t padding = last[3] != '=' ? 0 : (last[2] != '=' ? 1 : 2);
+        uint32_t a = DECODE.values[last[0]];
+        uint32_t b = DECODE.values[last[1]];
+        uint32_t c = padding >= 2 ? 0 : DECODE.values[last[2]];
+        uint32_t d = padding >= 1 ? 0 : DECODE.values[last[3]];
+        if ((a | b | c | d) & 0x80)
+        {
+            return false;
+        }
+
+        // Bits that padding discards must be zero
+        uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+        if ((padding == 1 && (triple & 0xff) != 0) || (padding == 2 && (triple & 0xffff) != 0))
+        {
+            return false;
+        }
+
+        tail[0] = static_cast<uint8_t>(triple >> 16);
+        if (padding < 2)
+        {
+            tail[1] = static_cast<uint8_t>(triple >> 8);
+        }
+        if (padding < 1)
+        {
+            tail[2] = static_cast<uint8_t>(triple);
+        }
+        outLength = body / 4 * 3 + 3 - padding;
+        return true;
+    }
+}
+
+size_t Base64::Encode(const void* data, size_t length, char* out)
+{
+    return EncodeWith(Active().encode, data, length, out);
+}
+
+std::string Base64::Encode(const void* data, size_t length)
+{
+    std::string result(EncodedLength(length), '\0');
+    if (length > 0)
+    {
+        Encode(data, length, &result[0]);
+    }
+    return result;
+}
+
+bool Base64::Decode(std::string_view text, void* out, size_t& outLength)
+{
+    return DecodeWith(Active().decode, text, out, outLength);
+}
+
+Base64::Kernel Base64::ActiveKernel()
+{
+    return Active().kernel;
+}
+
+bool Base64::Supported(Kernel kernel)
+{
+    return kernel <= ActiveKernel();
+}
+
+const char* Base64::KernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Avx2:
+        return "avx2";
+    case Kernel::Sse41:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
+
+size_t Base64::Encode(Kernel kernel, const void* data, size_t length, char* out)
+{
+    return EncodeWith(EncoderFor(kernel), data, length, out);
+}
+
+bool Base64::Decode(Kernel kernel, std::string_view text, void* out, size_t& outLength)
+{
+    return DecodeWith(DecoderFor(kernel), text, out, outLength);
+}
\ No newline at end of file
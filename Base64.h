@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Standard-alphabet base64 (RFC 4648) with SSE4.1 and AVX2 kernels chosen
+// at first use from what the CPU supports, and a scalar fallback.
+//
+// Decoding is strict: the length must be a multiple of four, padding may
+// only end the text, unused trailing bits must be zero and whitespace is not
+// accepted, so every byte string has exactly one accepted encoding. Output
+// goes to a caller-provided buffer of at least DecodedMaxLength bytes.
+class Base64
+{
+public:
+    enum class Kernel
+    {
+        Scalar,
+        Sse41,
+        Avx2
+    };
+
+    static size_t EncodedLength(size_t length) { return (length + 2) / 3 * 4; }
+    static size_t DecodedMaxLength(size_t length) { return length / 4 * 3; }
+
+    // Writes EncodedLength(length) characters and returns that count
+    static size_t Encode(const void* data, size_t length, char* out);
+    static std::string Encode(const void* data, size_t length);
+
+    // Returns false on any malformed input; outLength is then unspecified
+    static bool Decode(std::string_view text, void* out, size_t& outLength);
+
+    // The fastest kernel this CPU supports; used by Encode and Decode
+    static Kernel ActiveKernel();
+    static bool Supported(Kernel kernel);
+    static const char* KernelName(Kernel kernel);
+
+    // Forces a kernel, for benchmarks; it must be Supported
+    static size_t Encode(Kernel kernel, const void* data, size_t length, char* out);
+    static bool Decode(Kernel kernel, std::string_view text, void* out, size_t& outLength);
+};
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "CredentialManager.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+
+namespace
+{
+    // A credential that keeps failing to refresh would log every retry
+    LogLimiter g_refreshFailureLog;
+
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // File behind a keytab name, or empty for MEMORY: and other kinds
+    std::string KeytabPath(const std::string& keytab)
+    {
+        if (keytab.compare(0, 5, "FILE:") == 0)
+        {
+            return keytab.substr(5);
+        }
+        if (keytab.compare(0, 7, "WRFILE:") == 0)
+        {
+            return keytab.substr(7);
+        }
+        size_t colon = keytab.find(':');
+        // "C:\..." is a Windows path, not a keytab type
+        return colon == std::string::npos || colon == 1 ? keytab : std::string();
+    }
+
+    bool StatKeytab(const std::string& path, int64_t& modified, uint64_t& size)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return false;
+        }
+        uint64_t length = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+        modified = static_cast<int64_t>(time.time_since_epoch().count());
+        size = length;
+        return true;
+    }
+
+    const char* Describe(const AcceptorIdentity& identity)
+    {
+        return identity.principal.empty() ? "the default principal" : identity.principal.c_str();
+    }
+}
+
+CredentialManager::CredentialManager(AuthProvider& provider, std::chrono::seconds refreshInterval)
+    : m_provider(provider)
+    , m_refreshInterval(refreshInterval)
+    , m_running(false)
+    , m_refreshes(0)
+    , m_failures(0)
+    , m_keytabChanges(0)
+{
+}
+
+CredentialManager::~CredentialManager()
+{
+    Stop();
+}
+
+bool CredentialManager::ParseIdentities(const std::string& list, const std::string& defaultKeytab,
+    std::vector<AcceptorIdentity>& identities)
+{
+    identities.clear();
+    std::string_view rest = list;
+    while (!rest.empty())
+    {
+        size_t comma = rest.find(',');
+        std::string_view item = Trim(rest.substr(0, comma));
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+        AcceptorIdentity identity;
+        size_t equals = item.find('=');
+        std::string_view name = Trim(item.substr(0, equals));
+        std::string_view keytab = equals == std::string_view::npos ? std::string_view() : Trim(item.substr(equals + 1));
+        ServicePrincipal principal;
+        if (!ServicePrincipal::Parse(name, principal) || (equals != std::string_view::npos && keytab.empty()))
+        {
+            return false;
+        }
+        identity.principal = std::string(name);
+        identity.keytab = keytab.empty() ? defaultKeytab : std::string(keytab);
+        identities.push_back(std::move(identity));
+    }
+
+    if (identities.empty())
+    {
+        AcceptorIdentity identity;
+        identity.keytab = defaultKeytab;
+        identities.push_back(std::move(identity));
+    }
+    return true;
+}
+
+bool CredentialManager::Initialize(const std::vector<AcceptorIdentity>& identities)
+{
+    std::lock_guard<std::mutex> lock(m_refreshMutex);
+    m_identities.clear();
+    m_keytabs.clear();
+
+    auto set = std::make_shared<CredentialSet>();
+    Clock::time_point now = Clock::now();
+    for (const AcceptorIdentity& name : identities)
+    {
+        Identity identity;
+        identity.name = name;
+        if (!name.principal.empty())
+        {
+            ServicePrincipal::Parse(name.principal, identity.principal);
+        }
+
+        // The default keytab of the library is named by KRB5_KTNAME, when set
+        const char* environment = getenv("KRB5_KTNAME");
+        std::string path = KeytabPath(!name.keytab.empty() ? name.keytab : environment ? environment : "");
+        if (!path.empty())
+        {
+            auto known = std::find_if(m_keytabs.begin(), m_keytabs.end(),
+                [&](const KeytabState& keytab) { return keytab.path == path; });
+            if (known == m_keytabs.end())
+            {
+                KeytabState keytab;
+                keytab.path = path;
+                StatKeytab(path, keytab.modified, keytab.size);
+                known = m_keytabs.insert(m_keytabs.end(), keytab);
+            }
+            identity.keytab = static_cast<int>(known - m_keytabs.begin());
+        }
+
+        std::shared_ptr<AcceptorCredential> credential = m_provider.AcquireCredential(name);
+        if (!credential)
+        {
+            Log::Write(LogLevel::Error) << L"Failed to acquire acceptor credentials for " << Describe(name);
+            return false;
+        }
+        identity.acquired = now;
+        m_identities.push_back(std::move(identity));
+        set->credentials.push_back(std::move(credential));
+    }
+
+    std::atomic_store(&m_current, std::shared_ptr<const CredentialSet>(std::move(set)));
+    if (m_identities.size() > 1)
+    {
+        Log::Write(LogLevel::Info) << L"Accepting as " << m_identities.size() << L" identities";
+    }
+    return true;
+}
+
+void CredentialManager::Start(KeytabFunction keytabChanged)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running)
+    {
+        return;
+    }
+    m_keytabChanged = std::move(keytabChanged);
+    m_running = true;
+    m_thread = std::thread(&CredentialManager::RefreshThread, this);
+}
+
+void CredentialManager::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+        {
+            return;
+        }
+        m_running = false;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void CredentialManager::Release()
+{
+    std::atomic_store(&m_current, std::shared_ptr<const CredentialSet>());
+}
+
+std::shared_ptr<AcceptorCredential> CredentialManager::Select(const TokenFacts& facts) const
+{
+    std::shared_ptr<const CredentialSet> set = std::atomic_load(&m_current);
+    if (!set || set->credentials.empty())
+    {
+        return nullptr;
+    }
+
+    // Identities are fixed once the set exists, so they are read without a lock
+    if (facts.hasApReq && m_identities.size() > 1)
+    {
+        for (size_t i = 0; i < m_identities.size(); i++)
+        {
+            if (!m_identities[i].name.principal.empty() && m_identities[i].principal.Matches(facts))
+            {
+                return set->credentials[i];
+            }
+        }
+    }
+    return set->credentials[0];
+}
+
+bool CredentialManager::Refresh()
+{
+    std::lock_guard<std::mutex> lock(m_refreshMutex);
+    return RefreshLocked(std::vector<bool>(m_identities.size(), true), Clock::now());
+}
+
+CredentialStats CredentialManager::GetStats() const
+{
+    CredentialStats stats;
+    stats.refreshes = m_refreshes.load(std::memory_order_relaxed);
+    stats.failures = m_failures.load(std::memory_order_relaxed);
+    stats.keytabChanges = m_keytabChanges.load(std::memory_order_relaxed);
+
+    std::shared_ptr<const CredentialSet> set = std::atomic_load(&m_current);
+    if (set)
+    {
+        stats.identities = set->credentials.size();
+        Clock::time_point now = Clock::now();
+        for (const auto& credential : set->credentials)
+        {
+            if (credential->expiry != Clock::time_point::max())
+            {
+                int64_t seconds = (std::max)(static_cast<int64_t>(
+                    std::chrono::duration_cast<std::chrono::seconds>(credential->expiry - now).count()), int64_t(0));
+                stats.expiresInSeconds = stats.expiresInSeconds < 0 ? seconds : (std::min)(stats.expiresInSeconds, seconds);
+            }
+        }
+    }
+    return stats;
+}
+
+bool CredentialManager::RefreshDue(const Identity& identity, const AcceptorCredential& credential, Clock::time_point now) const
+{
+    if (now < identity.retryAt)
+    {
+        return false;
+    }
+    if (m_refreshInterval.count() > 0 && now - identity.acquired >= m_refreshInterval)
+    {
+        return true;
+    }
+    return credential.expiry != Clock::time_point::max() &&
+        credential.expiry - now <= std::chrono::seconds(REFRESH_MARGIN_SECONDS);
+}
+
+bool CredentialManager::RefreshLocked(const std::vector<bool>& due, Clock::time_point now)
+{
+    std::shared_ptr<const CredentialSet> current = std::atomic_load(&m_current);
+    if (!current)
+    {
+        return false;
+    }
+
+    // Acquired outside any lock legs take; they keep using the current set meanwhile
+    auto next = std::make_shared<CredentialSet>(*current);
+    bool changed = false;
+    bool succeeded = true;
+    for (size_t i = 0; i < m_identities.size(); i++)
+    {
+        if (!due[i])
+        {
+            continue;
+        }
+
+        Identity& identity = m_identities[i];
+        std::shared_ptr<AcceptorCredential> credential = m_provider.AcquireCredential(identity.name);
+        if (!credential)
+        {
+            m_failures.fetch_add(1, std::memory_order_relaxed);
+            identity.retryAt = now + std::chrono::seconds(RETRY_SECONDS);
+            Log::Write(LogLevel::Warning, g_refreshFailureLog) << L"Failed to refresh acceptor credentials for "
+                << Describe(identity.name) << L"; keeping the current ones and retrying in " << RETRY_SECONDS << L" s";
+            succeeded = false;
+            continue;
+        }
+
+        m_refreshes.fetch_add(1, std::memory_order_relaxed);
+        identity.acquired = now;
+        identity.retryAt = Clock::time_point();
+        next->credentials[i] = std::move(credential);
+        changed = true;
+        Log::Write(LogLevel::Info) << L"Refreshed acceptor credentials for " << Describe(identity.name);
+    }
+
+    if (changed)
+    {
+        std::atomic_store(&m_current, std::shared_ptr<const CredentialSet>(std::move(next)));
+    }
+    return succeeded;
+}
+
+bool CredentialManager::KeytabChanged(std::vector<bool>& due)
+{
+    bool changed = false;
+    for (size_t k = 0; k < m_keytabs.size(); k++)
+    {
+        KeytabState& keytab = m_keytabs[k];
+        int64_t modified = 0;
+        uint64_t size = 0;
+        // A keytab missing for a moment (replaced by rename) is looked at again next poll
+        if (!StatKeytab(keytab.path, modified, size) || (modified == keytab.modified && size == keytab.size))
+        {
+            continue;
+        }
+
+        keytab.modified = modified;
+        keytab.size = size;
+        changed = true;
+        m_keytabChanges.fetch_add(1, std::memory_order_relaxed);
+        Log::Write(LogLevel::Info) << L"Keytab " << keytab.path << L" changed";
+        for (size_t i = 0; i < m_identities.size(); i++)
+        {
+            if (m_identities[i].keytab == static_cast<int>(k))
+            {
+                due[i] = true;
+                m_identities[i].retryAt = Clock::time_point();
+            }
+        }
+    }
+    return changed;
+}
+
+void CredentialManager::RefreshThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running)
+    {
+        m_condition.wait_for(lock, std::chrono::seconds(KEYTAB_POLL_SECONDS));
+        if (!m_running)
+        {
+            break;
+        }
+        lock.unlock();
+
+        bool keytabChanged = false;
+        {
+            std::lock_guard<std::mutex> refreshLock(m_refreshMutex);
+            std::shared_ptr<const CredentialSet> current = std::atomic_load(&m_current);
+            if (current)
+            {
+                Clock::time_point now = Clock::now();
+                std::vector<bool> due(m_identities.size(), false);
+                bool any = false;
+                for (size_t i = 0; i < m_identities.size(); i++)
+                {
+                    due[i] = RefreshDue(m_identities[i], *current->credentials[i], now);
+                    any = any || due[i];
+                }
+                keytabChanged = KeytabChanged(due);
+                if (any || keytabChanged)
+                {
+                    RefreshLocked(due, now);
+                }
+            }
+        }
+
+        // Outside the refresh lock, since the callback may take its time
+        if (keytabChanged && m_keytabChanged)
+        {
+            m_keytabChanged();
+        }
+        lock.lock();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "AuthProvider.h"
+#include "TokenScreen.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CredentialStats
+{
+    uint64_t refreshes = 0;         // credentials re-acquired and published
+    uint64_t failures = 0;          // acquisitions that failed; the credential in use was kept
+    uint64_t keytabChanges = 0;     // rewritten keytabs picked up
+    size_t identities = 0;
+    int64_t expiresInSeconds = -1;  // until the earliest credential expires; -1 when none does
+};
+
+// Acceptor credentials for every identity the service answers as, kept fresh
+// in the background. The current set is replaced whole and read with
+// atomic_load, as SessionCookies does with its keys: a leg takes a reference
+// to the credential it needs and runs with it, so a refresh never waits for
+// legs in flight and they never wait for a refresh. A replaced credential is
+// released by whichever holder drops it last.
+//
+// The refresh thread re-acquires a credential when the refresh interval has
+// passed, when it is within REFRESH_MARGIN_SECONDS of expiring, or when the
+// keytab it came from has been rewritten (key or machine password
+// rotation). A failed acquisition keeps the credential in use and is tried
+// again after RETRY_SECONDS.
+class CredentialManager
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on the refresh thread after a keytab changed, once the new
+    // credentials are published
+    using KeytabFunction = std::function<void()>;
+
+    // refreshInterval of zero re-acquires only near expiry or on a keytab change
+    CredentialManager(AuthProvider& provider, std::chrono::seconds refreshInterval);
+    ~CredentialManager();
+
+    CredentialManager(const CredentialManager&) = delete;
+    CredentialManager& operator=(const CredentialManager&) = delete;
+
+    // Comma-separated "service/host[@REALM][=keytab]" names; an identity
+    // without a keytab uses defaultKeytab. An empty list is one identity for
+    // any principal in defaultKeytab. False on a malformed name.
+    static bool ParseIdentities(const std::string& list, const std::string& defaultKeytab,
+        std::vector<AcceptorIdentity>& identities);
+
+    // Acquires a credential for every identity; false if any fails
+    bool Initialize(const std::vector<AcceptorIdentity>& identities);
+
+    void Start(KeytabFunction keytabChanged);
+    void Stop();
+
+    // Drops the published credentials; legs still running keep theirs
+    void Release();
+
+    // The credential of the identity a token's ticket names, else of the
+    // first identity; null before Initialize or after Release
+    std::shared_ptr<AcceptorCredential> Select(const TokenFacts& facts) const;
+
+    // Re-acquires every credential now; false if any acquisition failed
+    bool Refresh();
+
+    CredentialStats GetStats() const;
+
+    static constexpr int REFRESH_MARGIN_SECONDS = 300;
+    static constexpr int RETRY_SECONDS = 30;
+    static constexpr int KEYTAB_POLL_SECONDS = 30;
+
+private:
+    struct Identity
+    {
+        AcceptorIdentity name;
+        ServicePrincipal principal;     // unused when name.principal is empty
+        int keytab = -1;                // index into m_keytabs; -1 when the keytab is not a file
+        Clock::time_point acquired;
+        Clock::time_point retryAt;
+    };
+
+    // credentials[i] belongs to m_identities[i]
+    struct CredentialSet
+    {
+        std::vector<std::shared_ptr<AcceptorCredential>> credentials;
+    };
+
+    // A keytab file as last seen
+    struct KeytabState
+    {
+        std::string path;
+        int64_t modified = 0;
+        uint64_t size = 0;
+    };
+
+    // Identity is due for a refresh at now; a keytab change forces one
+    bool RefreshDue(const Identity& identity, const AcceptorCredential& credential, Clock::time_point now) const;
+
+    // Re-acquires the identities whose flag is set and publishes the result
+    bool RefreshLocked(const std::vector<bool>& due, Clock::time_point now);
+
+    // True when a keytab's modification time or size differs from the last look
+    bool KeytabChanged(std::vector<bool>& due);
+
+    void RefreshThread();
+
+    AuthProvider& m_provider;
+    std::chrono::seconds m_refreshInterval;
+    std::vector<Identity> m_identities;
+
+    std::vector<KeytabState> m_keytabs;     // files behind the identities' keytabs
+
+    std::mutex m_refreshMutex;              // one refresh at a time
+    std::shared_ptr<const CredentialSet> m_current;     // replaced whole, read with atomic_load
+
+    KeytabFunction m_keytabChanged;
+    bool m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_refreshes;
+    std::atomic<uint64_t> m_failures;
+    std::atomic<uint64_t> m_keytabChanges;
+};
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "Der.h"
+#include <cstring>
+
+bool DerReader::ReadHeader(uint8_t& tag, size_t& length, const uint8_t*& contents) const
+{
+    const uint8_t* position = m_position;
+    if (m_end - position < 2)
+    {
+        return false;
+    }
+
+    tag = *position++;
+    if ((tag & 0x1f) == 0x1f)
+    {
+        return false;
+    }
+
+    uint8_t first = *position++;
+    if (first < 0x80)
+    {
+        length = first;
+    }
+    else
+    {
+        // Long form; DER forbids it below 128 and forbids leading zeros
+        size_t count = first & 0x7f;
+        if (count == 0 || count > 4 || static_cast<size_t>(m_end - position) < count || position[0] == 0)
+        {
+            return false;
+        }
+        length = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            length = (length << 8) | *position++;
+        }
+        if (length < 0x80)
+        {
+            return false;
+        }
+    }
+
+    if (length > static_cast<size_t>(m_end - position))
+    {
+        return false;
+    }
+    contents = position;
+    return true;
+}
+
+bool DerReader::ReadLong(uint8_t tag, DerReader& contents)
+{
+    uint8_t actual = 0;
+    size_t length = 0;
+    const uint8_t* start = nullptr;
+    if (!ReadHeader(actual, length, start) || actual != tag)
+    {
+        return false;
+    }
+    contents = DerReader(start, length);
+    m_position = start + length;
+    return true;
+}
+
+bool DerReader::ReadOptional(uint8_t tag, DerReader& contents, bool& present)
+{
+    present = PeekTag() == tag;
+    return !present || Read(tag, contents);
+}
+
+bool DerReader::Skip()
+{
+    uint8_t tag = 0;
+    size_t length = 0;
+    const uint8_t* start = nullptr;
+    if (!ReadHeader(tag, length, start))
+    {
+        return false;
+    }
+    m_position = start + length;
+    return true;
+}
+
+bool DerReader::ReadInteger(int64_t& value)
+{
+    DerReader contents;
+    if (!Read(INTEGER, contents) || contents.Size() == 0 || contents.Size() > 8)
+    {
+        return false;
+    }
+
+    const uint8_t* bytes = contents.Data();
+    uint64_t result = (bytes[0] & 0x80) ? ~0ull : 0;
+    for (size_t i = 0; i < contents.Size(); i++)
+    {
+        result = (result << 8) | bytes[i];
+    }
+    value = static_cast<int64_t>(result);
+    return true;
+}
+
+bool DerReader::ReadTaggedInteger(int number, int64_t& value)
+{
+    DerReader field;
+    return Read(Context(number), field) && field.ReadInteger(value) && field.Empty();
+}
+
+bool DerReader::ReadTagged(int number, uint8_t tag, DerReader& contents)
+{
+    DerReader field;
+    return Read(Context(number), field) && field.Read(tag, contents) && field.Empty();
+}
+
+void DerWriter::Prepend(const void* data, size_t length)
+{
+    if (m_overflow || static_cast<size_t>(m_position - m_begin) < length)
+    {
+        m_overflow = true;
+        return;
+    }
+    m_position -= length;
+    memcpy(m_position, data, length);
+}
+
+void DerWriter::Wrap(uint8_t tag, size_t mark)
+{
+    size_t length = Size() - mark;
+    uint8_t header[6];
+    size_t headerLength = 0;
+    if (length < 0x80)
+    {
+        header[headerLength++] = static_cast<uint8_t>(length);
+    }
+    else
+    {
+        uint8_t lengthBytes[4];
+        size_t count = 0;
+        for (size_t remaining = length; remaining > 0; remaining >>= 8)
+        {
+            lengthBytes[count++] = static_cast<uint8_t>(remaining);
+        }
+        header[headerLength++] = static_cast<uint8_t>(0x80 | count);
+        while (count > 0)
+        {
+            header[headerLength++] = lengthBytes[--count];
+        }
+    }
+
+    Prepend(header, headerLength);
+    Prepend(&tag, 1);
+}
+
+void DerWriter::PrependInteger(int64_t value)
+{
+    // Minimal two's complement: drop leading bytes that only repeat the sign
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (56 - 8 * i));
+    }
+    size_t skip = 0;
+    while (skip < 7 && ((bytes[skip] == 0x00 && !(bytes[skip + 1] & 0x80)) ||
+                        (bytes[skip] == 0xff && (bytes[skip + 1] & 0x80))))
+    {
+        skip++;
+    }
+
+    size_t mark = Mark();
+    Prepend(bytes + skip, 8 - skip);
+    Wrap(DerReader::INTEGER, mark);
+}
+
+void DerWriter::PrependTaggedInteger(int number, int64_t value)
+{
+    size_t mark = Mark();
+    PrependInteger(value);
+    Wrap(DerReader::Context(number), mark);
+}
\ No newline at end of file
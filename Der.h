@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Bounds-checked DER reader over a byte range. Every element read yields a
+// reader over its contents that points into the same buffer, so walking a
+// token copies and allocates nothing. Only single-byte tags and definite
+// lengths of up to four length bytes are accepted, which covers everything
+// in SPNEGO and Kerberos messages; anything else fails the read.
+class DerReader
+{
+public:
+    // Universal tags used by the Kerberos and SPNEGO grammars
+    static constexpr uint8_t INTEGER = 0x02;
+    static constexpr uint8_t BIT_STRING = 0x03;
+    static constexpr uint8_t OCTET_STRING = 0x04;
+    static constexpr uint8_t OID = 0x06;
+    static constexpr uint8_t ENUMERATED = 0x0a;
+    static constexpr uint8_t GENERALIZED_TIME = 0x18;
+    static constexpr uint8_t GENERAL_STRING = 0x1b;
+    static constexpr uint8_t SEQUENCE = 0x30;
+
+    static constexpr uint8_t Context(int number) { return static_cast<uint8_t>(0xa0 | number); }
+    static constexpr uint8_t Application(int number) { return static_cast<uint8_t>(0x60 | number); }
+
+    DerReader()
+        : m_position(nullptr)
+        , m_end(nullptr)
+    {
+    }
+
+    DerReader(const uint8_t* data, size_t length)
+        : m_position(data)
+        , m_end(data + length)
+    {
+    }
+
+    const uint8_t* Data() const { return m_position; }
+    size_t Size() const { return static_cast<size_t>(m_end - m_position); }
+    bool Empty() const { return m_position == m_end; }
+
+    // True if the remaining bytes are exactly these, as when matching an OID's contents
+    bool Equals(const uint8_t* bytes, size_t length) const
+    {
+        return Size() == length && memcmp(m_position, bytes, length) == 0;
+    }
+
+    // Tag of the next element, or -1 when there is none
+    int PeekTag() const { return m_position < m_end ? *m_position : -1; }
+
+    // Reads the next element if it has this tag. On failure nothing is consumed.
+    // Short lengths, most of any Kerberos message, are decoded inline.
+    bool Read(uint8_t tag, DerReader& contents)
+    {
+        if (m_end - m_position >= 2 && m_position[0] == tag && m_position[1] < 0x80 &&
+            m_position[1] <= static_cast<size_t>(m_end - m_position - 2) && (tag & 0x1f) != 0x1f)
+        {
+            contents = DerReader(m_position + 2, m_position[1]);
+            m_position += 2 + m_position[1];
+            return true;
+        }
+        return ReadLong(tag, contents);
+    }
+
+    // Reads an optional [number] EXPLICIT field; absent is not an error
+    bool ReadOptional(uint8_t tag, DerReader& contents, bool& present);
+
+    // Skips the next element, whatever its tag
+    bool Skip();
+
+    // Reads an INTEGER of up to eight bytes, sign-extended
+    bool ReadInteger(int64_t& value);
+
+    // Reads a [number] EXPLICIT INTEGER, as Kerberos wraps most fields
+    bool ReadTaggedInteger(int number, int64_t& value);
+
+    // Reads a [number] EXPLICIT wrapper around a primitive of the given tag
+    bool ReadTagged(int number, uint8_t tag, DerReader& contents);
+
+private:
+    bool ReadLong(uint8_t tag, DerReader& contents);
+    bool ReadHeader(uint8_t& tag, size_t& length, const uint8_t*& contents) const;
+
+    const uint8_t* m_position;
+    const uint8_t* m_end;
+};
+
+// Builds DER back to front into a caller-provided buffer, so each header is
+// written after its contents and their length are known. The encoding ends
+// at the end of the buffer; Data() is its first byte.
+class DerWriter
+{
+public:
+    DerWriter(uint8_t* buffer, size_t capacity)
+        : m_begin(buffer)
+        , m_position(buffer + capacity)
+        , m_end(buffer + capacity)
+        , m_overflow(false)
+    {
+    }
+
+    const uint8_t* Data() const { return m_position; }
+    size_t Size() const { return static_cast<size_t>(m_end - m_position); }
+    bool Overflowed() const { return m_overflow; }
+
+    // Bytes written so far; wrap everything since a mark with Wrap
+    size_t Mark() const { return Size(); }
+
+    void Prepend(const void* data, size_t length);
+
+    // Wraps what was written since mark in a tag and length
+    void Wrap(uint8_t tag, size_t mark);
+
+    void PrependInteger(int64_t value);
+    void PrependTaggedInteger(int number, int64_t value);
+
+private:
+    uint8_t* m_begin;
+    uint8_t* m_position;
+    uint8_t* m_end;
+    bool m_overflow;
+};
\ No newline at end of file
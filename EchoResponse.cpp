@@ -0,0 +1,43 @@
+#include "EchoResponse.h"
+#include <cstring>
+
+void WriteEchoResponse(const HttpRequest& request, HttpResponse& response)
+{
+    response.AppendBodyReference("Echo Response\n=============\nMethod: ");
+    response.AppendBodyReference(request.methodName);
+    response.AppendBodyReference("\nURL: ");
+    response.AppendBodyReference(request.path);
+    response.AppendBodyReference("\nHeaders:\n");
+
+    for (size_t i = 0; i < request.headerCount; i++)
+    {
+        const HttpHeader& header = request.headers[i];
+        response.AppendBodyReference("  ");
+
+        // In a raw request buffer "name: value" is usually already contiguous
+        const char* separator = header.name.data() + header.name.size();
+        if (header.value.data() == separator + 2 && memcmp(separator, ": ", 2) == 0)
+        {
+            response.AppendBodyReference(std::string_view(header.name.data(), header.name.size() + 2 + header.value.size()));
+        }
+        else
+        {
+            response.AppendBodyReference(header.name);
+            response.AppendBodyReference(": ");
+            response.AppendBodyReference(header.value);
+        }
+        response.AppendBodyReference("\n");
+    }
+
+    // Small bodies are already buffered; large ones stream through the transport
+    if (!request.body.empty())
+    {
+        response.AppendBodyReference("Body:\n");
+        response.AppendBodyReference(request.body);
+    }
+    else if (request.bodyStreamed)
+    {
+        response.AppendBodyReference("Body:\n");
+        response.relayRequestBody = true;
+    }
+}
\ No newline at end of file
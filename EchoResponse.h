@@ -0,0 +1,10 @@
+#pragma once
+
+#include "HttpMessage.h"
+
+// Writes the echo body (method, URL, request headers and the request body)
+// into the response.
+// Request text is referenced rather than copied, so the response is only
+// valid while the request is; every transport sends before it reuses the
+// request buffer.
+void WriteEchoResponse(const HttpRequest& request, HttpResponse& response);
\ No newline at end of file
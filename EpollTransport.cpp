@@ -0,0 +1,462 @@
+#include "EpollTransport.h"
+#include "ListenSocket.h"
+#include "Log.h"
+#include "WorkerPool.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    // Repeats for as long as the process is out of descriptors
+    LogLimiter g_acceptFailureLog;
+
+    // Loop counters have a single writer, so a plain store is enough
+    inline void Count(std::atomic<uint64_t>& counter, uint64_t amount = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+}
+
+EpollTransport::EpollTransport(const ServerConfig& config)
+    : m_config(config)
+    , m_loopCount(config.workerThreads ? config.workerThreads : WorkerPool::DefaultThreadCount())
+    , m_handler(nullptr)
+    , m_running(false)
+    , m_paused(false)
+{
+}
+
+EpollTransport::~EpollTransport()
+{
+    Stop();
+}
+
+bool EpollTransport::Initialize()
+{
+    for (size_t i = 0; i < m_loopCount; i++)
+    {
+        auto loop = std::make_unique<EventLoop>();
+        loop->index = i;
+        loop->scratch.sink = this;
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        loop->listenFd = CreateListenSocket(m_config.port);
+        EventLoop* raw = loop.get();
+        m_loops.push_back(std::move(loop));
+
+        if (raw->epollFd < 0 || raw->wakeFd < 0 || raw->listenFd < 0)
+        {
+            Log::Write(LogLevel::Error) << L"Failed to create event loop " << i;
+            CloseLoops();
+            return false;
+        }
+
+        // The listener and wake descriptors are tagged with the address of their
+        // field; everything else carries a Connection pointer
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &raw->listenFd;
+        epoll_ctl(raw->epollFd, EPOLL_CTL_ADD, raw->listenFd, &event);
+        event.data.ptr = &raw->wakeFd;
+        epoll_ctl(raw->epollFd, EPOLL_CTL_ADD, raw->wakeFd, &event);
+    }
+    return true;
+}
+
+bool EpollTransport::Start(RequestHandler* handler)
+{
+    if (m_running || m_loops.empty())
+    {
+        return false;
+    }
+
+    m_handler = handler;
+    m_running = true;
+    m_paused = false;
+    for (auto& loop : m_loops)
+    {
+        loop->thread = std::thread(&EpollTransport::LoopThread, this, loop.get());
+    }
+
+    Log::Write(LogLevel::Info) << L"epoll transport listening on port " << m_config.port
+                               << L" with " << m_loops.size() << L" event loops";
+    return true;
+}
+
+void EpollTransport::Stop()
+{
+    if (m_running.exchange(false))
+    {
+        for (auto& loop : m_loops)
+        {
+            uint64_t one = 1;
+            ssize_t ignored = write(loop->wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+        for (auto& loop : m_loops)
+        {
+            if (loop->thread.joinable())
+            {
+                loop->thread.join();
+            }
+        }
+    }
+    CloseLoops();
+}
+
+void EpollTransport::CloseLoops()
+{
+    for (auto& loop : m_loops)
+    {
+        ReleaseDeferred(loop.get());
+        for (auto& entry : loop->connections)
+        {
+            close(entry.first);
+        }
+        loop->connections.clear();
+
+        if (loop->listenFd >= 0) close(loop->listenFd);
+        if (loop->wakeFd >= 0) close(loop->wakeFd);
+        if (loop->epollFd >= 0) close(loop->epollFd);
+    }
+    m_loops.clear();
+}
+
+TransportStats EpollTransport::GetStats() const
+{
+    TransportStats stats;
+    for (const auto& loop : m_loops)
+    {
+        stats.requests += loop->requests.load(std::memory_order_relaxed);
+        stats.syscalls += loop->syscalls.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void EpollTransport::Pause()
+{
+    // Stop accepting; connections already open keep being served
+    m_paused = true;
+    for (auto& loop : m_loops)
+    {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, loop->listenFd, nullptr);
+    }
+}
+
+void EpollTransport::Resume()
+{
+    if (!m_paused.exchange(false))
+    {
+        return;
+    }
+
+    for (auto& loop : m_loops)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &loop->listenFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &event);
+    }
+}
+
+void EpollTransport::LoopThread(EventLoop* loop)
+{
+    epoll_event events[MAX_EVENTS];
+
+    while (m_running)
+    {
+        int count = epoll_wait(loop->epollFd, events, MAX_EVENTS, -1);
+        Count(loop->syscalls);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            Log::Write(LogLevel::Error) << L"epoll_wait failed: " << strerror(errno);
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            void* tag = events[i].data.ptr;
+            if (tag == &loop->listenFd)
+            {
+                AcceptConnections(loop);
+                continue;
+            }
+            if (tag == &loop->wakeFd)
+            {
+                uint64_t value;
+                ssize_t ignored = read(loop->wakeFd, &value, sizeof(value));
+                (void)ignored;
+                CompleteDeferred(loop);
+                continue;
+            }
+
+            Connection* connection = static_cast<Connection*>(tag);
+            uint32_t flags = events[i].events;
+            if (flags & EPOLLERR)
+            {
+                CloseConnection(loop, connection);
+                continue;
+            }
+            if ((flags & EPOLLOUT) && !OnWritable(loop, connection))
+            {
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            {
+                OnReadable(loop, connection);
+            }
+        }
+    }
+
+    // Give responses that are already queued one chance to go out
+    for (auto& entry : loop->connections)
+    {
+        Flush(loop, entry.second.get());
+    }
+}
+
+void EpollTransport::AcceptConnections(EventLoop* loop)
+{
+    for (;;)
+    {
+        sockaddr_storage peer;
+        socklen_t peerLength = sizeof(peer);
+        int fd = accept4(loop->listenFd, reinterpret_cast<sockaddr*>(&peer), &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        Count(loop->syscalls);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                Log::Write(LogLevel::Warning, g_acceptFailureLog) << L"accept4 failed: " << strerror(errno);
+            }
+            return;
+        }
+
+        uint64_t id = (static_cast<uint64_t>(loop->index) << 48) | ++loop->nextConnection;
+        auto connection = std::make_unique<Connection>(fd, id, ClientAddressKey(reinterpret_cast<const sockaddr*>(&peer)));
+
+        // Edge-triggered for both directions: no epoll_ctl calls while the
+        // connection lives, at the price of always reading until EAGAIN
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection.get();
+        Count(loop->syscalls);
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            continue;
+        }
+        loop->connections.emplace(fd, std::move(connection));
+    }
+}
+
+bool EpollTransport::OnReadable(EventLoop* loop, Connection* connection)
+{
+    for (;;)
+    {
+        // Edge-triggered: keep reading until the socket reports EAGAIN
+        while (!connection->CloseAfterWrite())
+        {
+            if (connection->OutputBlocked() || connection->Deferred())
+            {
+                connection->readBlocked = true;
+                break;
+            }
+
+            size_t available = 0;
+            char* space = connection->ReadSpace(available);
+            if (!space)
+            {
+                // Only an over-long request can fill the buffer without blocking output
+                connection->SetCloseAfterWrite();
+                break;
+            }
+
+            ssize_t received = recv(connection->fd, space, available, 0);
+            Count(loop->syscalls);
+            if (received > 0)
+            {
+                connection->CommitRead(static_cast<size_t>(received));
+                ProcessRequests(loop, connection);
+            }
+            else if (received == 0)
+            {
+                connection->SetCloseAfterWrite();
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            else
+            {
+                CloseConnection(loop, connection);
+                return false;
+            }
+        }
+
+        if (!Flush(loop, connection))
+        {
+            CloseConnection(loop, connection);
+            return false;
+        }
+        if (!connection->PendingOutput().empty())
+        {
+            return true; // EPOLLOUT resumes us once the socket drains
+        }
+        if (connection->CloseAfterWrite())
+        {
+            CloseConnection(loop, connection);
+            return false;
+        }
+        if (!connection->readBlocked || connection->Deferred())
+        {
+            return true; // a deferred request resumes reading when its response arrives
+        }
+
+        // Responses drained: serve requests still buffered, then read again
+        connection->readBlocked = false;
+        ProcessRequests(loop, connection);
+    }
+}
+
+bool EpollTransport::OnWritable(EventLoop* loop, Connection* connection)
+{
+    if (connection->PendingOutput().empty())
+    {
+        return true;
+    }
+
+    if (!Flush(loop, connection))
+    {
+        CloseConnection(loop, connection);
+        return false;
+    }
+    if (!connection->PendingOutput().empty())
+    {
+        return true;
+    }
+    if (connection->CloseAfterWrite())
+    {
+        CloseConnection(loop, connection);
+        return false;
+    }
+    if (connection->readBlocked)
+    {
+        return OnReadable(loop, connection);
+    }
+    return true;
+}
+
+void EpollTransport::ProcessRequests(EventLoop* loop, Connection* connection)
+{
+    size_t served = connection->ProcessRequests(m_handler, loop->scratch, m_running);
+    Count(loop->requests, served);
+}
+
+void EpollTransport::Complete(DeferredRequest* deferred)
+{
+    // The connection id carries the index of the loop that owns it
+    EventLoop* loop = m_loops[deferred->request.connectionId >> 48].get();
+    while (!loop->completions.TryPush(deferred))
+    {
+        std::this_thread::yield();
+    }
+    if (!loop->wakePending.exchange(true))
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(loop->wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void EpollTransport::CompleteDeferred(EventLoop* loop)
+{
+    // Cleared first, so a response queued while draining wakes the loop again
+    loop->wakePending = false;
+
+    DeferredRequest* deferred = nullptr;
+    while (loop->completions.TryPop(deferred))
+    {
+        // The connection may have closed, and its descriptor been reused,
+        // while the request was away
+        auto found = loop->connections.find(static_cast<int>(deferred->tag));
+        Connection* connection = nullptr;
+        if (found != loop->connections.end() && found->second->Id() == deferred->request.connectionId && found->second->Deferred())
+        {
+            connection = found->second.get();
+            connection->CompleteDeferred(deferred->response);
+        }
+        m_handler->Release(deferred);
+
+        if (connection)
+        {
+            // Serve what was pipelined behind it, then read again
+            connection->readBlocked = false;
+            ProcessRequests(loop, connection);
+            OnReadable(loop, connection);
+        }
+    }
+}
+
+void EpollTransport::ReleaseDeferred(EventLoop* loop)
+{
+    DeferredRequest* deferred = nullptr;
+    while (loop->completions.TryPop(deferred))
+    {
+        m_handler->Release(deferred);
+    }
+}
+
+bool EpollTransport::Flush(EventLoop* loop, Connection* connection)
+{
+    for (;;)
+    {
+        std::string_view output = connection->PendingOutput();
+        if (output.empty())
+        {
+            return true;
+        }
+
+        ssize_t sent = send(connection->fd, output.data(), output.size(), MSG_NOSIGNAL);
+        Count(loop->syscalls);
+        if (sent > 0)
+        {
+            connection->ConsumeOutput(static_cast<size_t>(sent));
+        }
+        else if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+void EpollTransport::CloseConnection(EventLoop* loop, Connection* connection)
+{
+    int fd = connection->fd;
+    close(fd);
+    loop->connections.erase(fd);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Transport.h"
+#include "HttpConnection.h"
+#include "StageQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Non-blocking HTTP/1.1 server for Linux. Each event loop owns an epoll
+// instance and an SO_REUSEPORT listening socket, so the kernel spreads new
+// connections across loops and a connection never changes threads.
+// Keep-alive and pipelining are supported; responses to pipelined requests
+// are batched into one send. Responses the handler defers come back through
+// a per-loop completion queue and the loop's wake descriptor.
+class EpollTransport : public Transport, public ResponseSink
+{
+public:
+    explicit EpollTransport(const ServerConfig& config);
+    ~EpollTransport() override;
+
+    bool Initialize() override;
+    bool Start(RequestHandler* handler) override;
+    void Stop() override;
+    void Pause() override;
+    void Resume() override;
+    const wchar_t* Name() const override { return L"epoll"; }
+    TransportStats GetStats() const override;
+
+    // Called on a handler thread; queues the response for the owning loop
+    void Complete(DeferredRequest* deferred) override;
+
+private:
+    struct Connection : HttpConnection
+    {
+        Connection(int socket, uint64_t id, uint64_t client) : HttpConnection(id, static_cast<uint64_t>(socket), client), fd(socket) {}
+
+        int fd;
+        bool readBlocked = false;   // stopped reading before EAGAIN; resume once output drains
+    };
+
+    struct EventLoop
+    {
+        size_t index = 0;
+        int epollFd = -1;
+        int listenFd = -1;
+        int wakeFd = -1;
+        uint64_t nextConnection = 0;
+        std::thread thread;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        RequestScratch scratch;
+        StageQueue<DeferredRequest*> completions{ COMPLETION_QUEUE };
+        std::atomic<bool> wakePending{ false };     // a wake is already on its way
+
+        // Written only by the loop thread
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> syscalls{ 0 };
+    };
+
+    void LoopThread(EventLoop* loop);
+    void AcceptConnections(EventLoop* loop);
+    bool OnReadable(EventLoop* loop, Connection* connection);
+    bool OnWritable(EventLoop* loop, Connection* connection);
+    void ProcessRequests(EventLoop* loop, Connection* connection);
+    void CompleteDeferred(EventLoop* loop);
+    void ReleaseDeferred(EventLoop* loop);
+    bool Flush(EventLoop* loop, Connection* connection);
+    void CloseConnection(EventLoop* loop, Connection* connection);
+    void CloseLoops();
+
+    ServerConfig m_config;
+    size_t m_loopCount;
+    RequestHandler* m_handler;
+    std::vector<std::unique_ptr<EventLoop>> m_loops;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_paused;
+
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr size_t COMPLETION_QUEUE = 4096;   // deferred responses waiting for a loop; producers yield when full
+};
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "GssapiAuthProvider.h"
+#include "Base64.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Pac.h"
+#include "Trace.h"
+#include <gssapi/gssapi_krb5.h>
+#if __has_include(<gssapi/gssapi_ext.h>)
+#include <gssapi/gssapi_ext.h>
+#endif
+#include <algorithm>
+
+namespace
+{
+    // Every bad or replayed token fails here
+    LogLimiter g_acceptFailureLog;
+
+    class GssapiCredential : public AcceptorCredential
+    {
+    public:
+        ~GssapiCredential() override
+        {
+            OM_uint32 minor = 0;
+            gss_release_cred(&minor, &cred);
+        }
+
+        gss_cred_id_t cred = GSS_C_NO_CREDENTIAL;
+    };
+}
+
+GssapiAuthProvider::GssapiAuthProvider(const std::wstring& keytab, bool querySids)
+    : m_keytab(keytab.begin(), keytab.end())
+    , m_querySids(querySids)
+{
+}
+
+GssapiAuthProvider::~GssapiAuthProvider()
+{
+    Cleanup();
+}
+
+bool GssapiAuthProvider::Initialize()
+{
+    // The acceptor identity is process-wide; every later acquire reads this keytab
+    if (!m_keytab.empty())
+    {
+        OM_uint32 major = krb5_gss_register_acceptor_identity(m_keytab.c_str());
+        if (GSS_ERROR(major))
+        {
+            Log::Write(LogLevel::Error) << L"Failed to register keytab: " << m_keytab;
+            return false;
+        }
+    }
+
+    Log::Write(LogLevel::Info) << L"Kerberos authentication initialized successfully (GSSAPI)";
+    return true;
+}
+
+std::shared_ptr<AcceptorCredential> GssapiAuthProvider::AcquireCredential(const AcceptorIdentity& identity)
+{
+    OM_uint32 minor = 0;
+    OM_uint32 major = 0;
+
+    // No name: accept for any service principal the keytab holds
+    gss_name_t name = GSS_C_NO_NAME;
+    if (!identity.principal.empty())
+    {
+        gss_buffer_desc text = { identity.principal.size(), const_cast<char*>(identity.principal.data()) };
+        major = gss_import_name(&minor, &text, GSS_KRB5_NT_PRINCIPAL_NAME, &name);
+        if (GSS_ERROR(major))
+        {
+            LogStatus(Log::Write(LogLevel::Error), L"gss_import_name", major, minor);
+            return nullptr;
+        }
+    }
+
+    auto credential = std::make_shared<GssapiCredential>();
+    OM_uint32 lifetime = GSS_C_INDEFINITE;
+    if (!identity.keytab.empty() && identity.keytab != m_keytab)
+    {
+        // Keytabs other than the registered one are named per credential
+        gss_key_value_element_desc element = { "keytab", identity.keytab.c_str() };
+        gss_key_value_set_desc store = { 1, &element };
+        major = gss_acquire_cred_from(&minor, name, GSS_C_INDEFINITE, GSS_C_NO_OID_SET, GSS_C_ACCEPT, &store,
+            &credential->cred, nullptr, &lifetime);
+    }
+    else
+    {
+        major = gss_acquire_cred(&minor, name, GSS_C_INDEFINITE, GSS_C_NO_OID_SET, GSS_C_ACCEPT,
+            &credential->cred, nullptr, &lifetime);
+    }
+    if (name != GSS_C_NO_NAME)
+    {
+        OM_uint32 ignored = 0;
+        gss_release_name(&ignored, &name);
+    }
+    if (GSS_ERROR(major))
+    {
+        LogStatus(Log::Write(LogLevel::Error), L"gss_acquire_cred", major, minor);
+        credential->cred = GSS_C_NO_CREDENTIAL;
+        return nullptr;
+    }
+
+    // Keytab credentials are usually indefinite; a lifetime is tracked for a refresh before it runs out
+    if (lifetime != GSS_C_INDEFINITE)
+    {
+        credential->expiry = Clock::now() + std::chrono::seconds(lifetime);
+    }
+    return credential;
+}
+
+void GssapiAuthProvider::Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length,
+    bool continuing, PendingContext& context, AuthResult& result, Clock::time_point& expiry)
+{
+    gss_ctx_id_t handle = continuing ? reinterpret_cast<gss_ctx_id_t>(context.lower) : GSS_C_NO_CONTEXT;
+
+    gss_buffer_desc input;
+    input.length = length;
+    input.value = const_cast<unsigned char*>(token);
+    gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+    gss_name_t client = GSS_C_NO_NAME;
+    OM_uint32 flags = 0;
+    OM_uint32 lifetime = 0;
+    OM_uint32 minor = 0;
+
+    // A later leg continues the context this connection left in the table; it
+    // was taken out, so no lock is held here
+    auto acceptStart = std::chrono::steady_clock::now();
+    gss_cred_id_t cred = static_cast<const GssapiCredential&>(credential).cred;
+    OM_uint32 major = gss_accept_sec_context(&minor, &handle, cred, &input, GSS_C_NO_CHANNEL_BINDINGS,
+        &client, nullptr, &output, &flags, &lifetime, nullptr);
+    Metrics::Record(MetricStage::Accept, acceptStart, std::chrono::steady_clock::now());
+
+    if (!GSS_ERROR(major) && output.length > 0)
+    {
+        result.outputToken = Base64::Encode(static_cast<const unsigned char*>(output.value), output.length);
+    }
+    gss_release_buffer(&minor, &output);
+
+    if (GSS_ERROR(major))
+    {
+        LogStatus(Log::Write(LogLevel::Warning, g_acceptFailureLog), L"gss_accept_sec_context", major, minor);
+        if (handle != GSS_C_NO_CONTEXT)
+        {
+            gss_delete_sec_context(&minor, &handle, GSS_C_NO_BUFFER);
+        }
+    }
+    else if (major & GSS_S_CONTINUE_NEEDED)
+    {
+        // Hand the context back to be parked until the client's next token
+        context.lower = reinterpret_cast<uintptr_t>(handle);
+        context.upper = 0;
+        result.status = AuthStatus::ContinueNeeded;
+    }
+    else
+    {
+        {
+            StageTimer timer(MetricStage::Principal);
+            TraceCall call("gss_display_name");
+            gss_buffer_desc name = GSS_C_EMPTY_BUFFER;
+            if (gss_display_name(&minor, client, &name, nullptr) == GSS_S_COMPLETE)
+            {
+                result.principal.assign(static_cast<const char*>(name.value), name.length);
+                gss_release_buffer(&minor, &name);
+            }
+        }
+
+        // Group membership for the authorization policy, from the ticket's PAC
+        result.sids.clear();
+#if __has_include(<gssapi/gssapi_ext.h>)
+        if (m_querySids)
+        {
+            StageTimer timer(MetricStage::Principal);
+            TraceCall call("gss_get_name_attribute");
+            char attributeName[] = "urn:mspac:logon-info";
+            gss_buffer_desc attribute = { sizeof(attributeName) - 1, attributeName };
+            gss_buffer_desc value = GSS_C_EMPTY_BUFFER;
+            int authenticated = 0;
+            int more = -1;
+            if (gss_get_name_attribute(&minor, client, &attribute, &authenticated, nullptr, &value, nullptr, &more) ==
+                GSS_S_COMPLETE)
+            {
+                // Unauthenticated means the library could not check the PAC against the ticket
+                if (authenticated)
+                {
+                    Pac::ReadLogonSids(static_cast<const uint8_t*>(value.value), value.length, result.sids);
+                }
+                gss_release_buffer(&minor, &value);
+            }
+        }
+#endif
+
+        // Cached results must not outlive the ticket
+        if (lifetime != GSS_C_INDEFINITE)
+        {
+            expiry = (std::min)(expiry, Clock::now() + std::chrono::seconds(lifetime));
+        }
+
+        gss_delete_sec_context(&minor, &handle, GSS_C_NO_BUFFER);
+        result.status = AuthStatus::Success;
+    }
+
+    if (client != GSS_C_NO_NAME)
+    {
+        gss_release_name(&minor, &client);
+    }
+}
+
+void GssapiAuthProvider::ReleaseContext(const PendingContext& context)
+{
+    gss_ctx_id_t handle = reinterpret_cast<gss_ctx_id_t>(context.lower);
+    OM_uint32 minor = 0;
+    gss_delete_sec_context(&minor, &handle, GSS_C_NO_BUFFER);
+}
+
+void GssapiAuthProvider::Cleanup()
+{
+    // Credentials are released by their last holder
+}
+
+void GssapiAuthProvider::LogStatus(LogLine line, const wchar_t* call, OM_uint32 major, OM_uint32 minor)
+{
+    if (!line)
+    {
+        return;
+    }
+
+    // Both the GSS-level and the mechanism-level messages, as the library words them
+    line << call << L" failed: 0x" << std::hex << major << std::dec;
+    const int types[] = { GSS_C_GSS_CODE, GSS_C_MECH_CODE };
+    const OM_uint32 codes[] = { major, minor };
+    for (int i = 0; i < 2; i++)
+    {
+        OM_uint32 context = 0;
+        do
+        {
+            OM_uint32 status = 0;
+            gss_buffer_desc text = GSS_C_EMPTY_BUFFER;
+            if (GSS_ERROR(gss_display_status(&status, codes[i], types[i], GSS_C_NO_OID, &context, &text)))
+            {
+                break;
+            }
+            line << "; " << std::string_view(static_cast<const char*>(text.value), text.length);
+            gss_release_buffer(&status, &text);
+        } while (context != 0);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "AuthProvider.h"
+#include "Log.h"
+#include <gssapi/gssapi.h>
+#include <string>
+
+// Negotiate through MIT or Heimdal GSSAPI, accepting with the keys in a
+// keytab. SPNEGO and raw Kerberos tokens are both taken, since the default
+// acceptor credential covers every mechanism the library offers.
+class GssapiAuthProvider : public AuthProvider
+{
+public:
+    // keytab is a path or a krb5 keytab name (FILE:..., MEMORY:...); empty
+    // uses KRB5_KTNAME or the library's default keytab. querySids also
+    // returns the SIDs in the ticket's PAC with the principal, where the
+    // library exposes it as a name attribute.
+    GssapiAuthProvider(const std::wstring& keytab, bool querySids);
+    ~GssapiAuthProvider() override;
+
+    bool Initialize() override;
+
+    // An identity with its own keytab is acquired from that keytab
+    // (gss_acquire_cred_from); otherwise from the registered default one
+    std::shared_ptr<AcceptorCredential> AcquireCredential(const AcceptorIdentity& identity) override;
+    void Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length, bool continuing,
+        PendingContext& context, AuthResult& result, Clock::time_point& expiry) override;
+    void ReleaseContext(const PendingContext& context) override;
+    void Cleanup() override;
+    const wchar_t* Name() const override { return L"gssapi"; }
+
+private:
+    // Appends the library's messages for major/minor to line, if it is on
+    void LogStatus(LogLine line, const wchar_t* call, OM_uint32 major, OM_uint32 minor);
+
+    std::string m_keytab;
+    bool m_querySids;
+};
\ No newline at end of file
@@ -0,0 +1,342 @@
+#include "HttpConnection.h"
+#include "Metrics.h"
+#include "SlabPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+
+HttpConnection::HttpConnection(uint64_t id, uint64_t tag, uint64_t client)
+    : m_id(id)
+    , m_tag(tag)
+    , m_client(client)
+    , m_input(nullptr)
+    , m_inputSize(0)
+    , m_readStart(0)
+    , m_readEnd(0)
+    , m_scanned(0)
+    , m_outputOffset(0)
+    , m_closeAfterWrite(false)
+    , m_bodyRemaining(0)
+    , m_relayBody(false)
+    , m_closeAfterBody(false)
+    , m_deferred(false)
+    , m_deferredKeepAlive(false)
+    , m_deferredIncludeBody(false)
+    , m_deferredBody(0)
+    , m_sendTrace(0)
+{
+}
+
+HttpConnection::~HttpConnection()
+{
+    SlabPool::Buffers().Release(m_input);
+}
+
+bool HttpConnection::Reserve(size_t length)
+{
+    if (m_inputSize - m_readEnd >= length)
+    {
+        return true;
+    }
+
+    if (m_readStart > 0)
+    {
+        memmove(m_input, m_input + m_readStart, m_readEnd - m_readStart);
+        m_readEnd -= m_readStart;
+        m_readStart = 0;
+        if (m_inputSize - m_readEnd >= length)
+        {
+            return true;
+        }
+    }
+
+    size_t needed = m_readEnd + length;
+    if (needed > MAX_READ_BUFFER)
+    {
+        return false;
+    }
+
+    size_t size = std::max(m_inputSize, READ_CHUNK);
+    while (size < needed)
+    {
+        size *= 2;
+    }
+
+    // Receive buffers come from the shared pool, so connection churn and
+    // occasional large requests recycle blocks instead of hitting the heap
+    size_t capacity = 0;
+    char* grown = static_cast<char*>(SlabPool::Buffers().Acquire(std::min(size, MAX_READ_BUFFER), capacity));
+    if (m_readEnd > 0)
+    {
+        memcpy(grown, m_input, m_readEnd);
+    }
+    SlabPool::Buffers().Release(m_input);
+    m_input = grown;
+    m_inputSize = std::min(capacity, MAX_READ_BUFFER);
+    return true;
+}
+
+char* HttpConnection::ReadSpace(size_t& available)
+{
+    Reserve(READ_CHUNK / 4);
+    available = m_inputSize - m_readEnd;
+    return available ? m_input + m_readEnd : nullptr;
+}
+
+void HttpConnection::Received(size_t length)
+{
+    // Bytes landing on an empty buffer start the next request's receive time
+    if (!HasBufferedInput())
+    {
+        m_requestStart = std::chrono::steady_clock::now();
+    }
+    Metrics::Count(MetricCounter::BytesReceived, length);
+}
+
+void HttpConnection::CommitRead(size_t length)
+{
+    Received(length);
+    m_readEnd += length;
+}
+
+bool HttpConnection::Append(const char* data, size_t length)
+{
+    Received(length);
+    return Store(data, length);
+}
+
+bool HttpConnection::Store(const char* data, size_t length)
+{
+    if (!Reserve(length))
+    {
+        return false;
+    }
+    memcpy(m_input + m_readEnd, data, length);
+    m_readEnd += length;
+    return true;
+}
+
+size_t HttpConnection::ProcessRequests(RequestHandler* handler, RequestScratch& scratch, bool keepAlive)
+{
+    size_t consumed = 0;
+    size_t served = Serve(m_input + m_readStart, m_readEnd - m_readStart, consumed, handler, scratch, keepAlive);
+
+    m_readStart += consumed;
+    if (m_readStart == m_readEnd)
+    {
+        m_readStart = 0;
+        m_readEnd = 0;
+
+        // A buffer grown for a large request goes back to the pool once drained
+        if (m_inputSize > READ_CHUNK)
+        {
+            SlabPool::Buffers().Release(m_input);
+            m_input = nullptr;
+            m_inputSize = 0;
+        }
+    }
+    return served;
+}
+
+size_t HttpConnection::ProcessFrom(const char* data, size_t length, RequestHandler* handler, RequestScratch& scratch, bool keepAlive)
+{
+    Received(length);
+    if (HasBufferedInput())
+    {
+        if (!Store(data, length))
+        {
+            SetCloseAfterWrite();
+            return 0;
+        }
+        return ProcessRequests(handler, scratch, keepAlive);
+    }
+
+    size_t consumed = 0;
+    size_t served = Serve(data, length, consumed, handler, scratch, keepAlive);
+    if (consumed < length && !m_closeAfterWrite && !Store(data + consumed, length - consumed))
+    {
+        SetCloseAfterWrite();
+    }
+    return served;
+}
+
+size_t HttpConnection::Serve(const char* data, size_t length, size_t& consumed, RequestHandler* handler, RequestScratch& scratch, bool keepAlive)
+{
+    size_t served = 0;
+    consumed = 0;
+
+    // Stop parsing pipelined requests while the peer is not reading responses
+    // or an earlier one is still with the handler
+    while (!m_closeAfterWrite && !m_deferred && !OutputBlocked() && consumed < length)
+    {
+        const char* start = data + consumed;
+        size_t available = length - consumed;
+
+        // The rest of a streamed body comes before the next request
+        if (m_bodyRemaining > 0)
+        {
+            consumed += StreamBody(start, available);
+            continue;
+        }
+
+        ParsedRequest parsed;
+        ParseStatus status = ParseRequestHead(start, available, scratch.headers, parsed, m_scanned);
+        if (status == ParseStatus::Incomplete)
+        {
+            m_scanned = available;
+            break;
+        }
+        if (status == ParseStatus::Invalid)
+        {
+            QueueError(400, "Bad Request");
+            break;
+        }
+        if (status == ParseStatus::TooLarge)
+        {
+            QueueError(431, "Request Header Fields Too Large");
+            break;
+        }
+        if (parsed.chunked)
+        {
+            QueueError(501, "Not Implemented");
+            break;
+        }
+
+        HttpRequest& request = parsed.request;
+        bool streamed = request.contentLength > MAX_BUFFERED_BODY;
+        size_t total = parsed.headBytes;
+        if (!streamed)
+        {
+            total += static_cast<size_t>(request.contentLength);
+            if (available < total)
+            {
+                m_scanned = parsed.headBytes - 4;
+                break;
+            }
+            request.body = std::string_view(start + parsed.headBytes, static_cast<size_t>(request.contentLength));
+        }
+        request.bodyStreamed = streamed;
+        request.connectionId = m_id;
+        request.clientAddress = m_client;
+        request.received = m_requestStart;
+        request.traceId = Trace::BeginRequest();
+
+        // Anything pipelined behind this request was already here
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Metrics::Record(MetricStage::Receive, now - m_requestStart);
+        Trace::Span(request.traceId, "receive", m_requestStart, now);
+        m_requestStart = now;
+
+        HttpResponse& response = scratch.response;
+        response.Reset();
+        RequestDisposition disposition;
+        {
+            TraceScope trace(request.traceId);
+            disposition = handler->SubmitRequest(request, response, scratch.sink, m_tag);
+        }
+        m_sendTrace = request.traceId;
+
+        bool includeBody = request.method != HttpMethod::Head;
+        uint64_t streamedBody = streamed ? request.contentLength : 0;
+        consumed += total;
+        m_scanned = 0;
+        served++;
+        if (disposition == RequestDisposition::Deferred)
+        {
+            // The handler copied the request, so its bytes can go; a streamed
+            // body waits in the buffer (or the socket) for the response
+            m_deferred = true;
+            m_deferredKeepAlive = keepAlive && parsed.keepAlive;
+            m_deferredIncludeBody = includeBody;
+            m_deferredBody = streamedBody;
+            break;
+        }
+        FinishResponse(response, keepAlive && parsed.keepAlive, includeBody, streamedBody);
+    }
+    return served;
+}
+
+void HttpConnection::CompleteDeferred(const HttpResponse& response)
+{
+    m_deferred = false;
+    FinishResponse(response, m_deferredKeepAlive, m_deferredIncludeBody, m_deferredBody);
+}
+
+void HttpConnection::FinishResponse(const HttpResponse& response, bool keepAlive, bool includeBody, uint64_t streamedBody)
+{
+    bool persist = keepAlive && !response.closeConnection;
+    uint64_t relayed = streamedBody > 0 && response.relayRequestBody && includeBody ? streamedBody : 0;
+    StartSend();
+    AppendResponse(response, persist, includeBody, m_output, relayed);
+
+    if (streamedBody > 0)
+    {
+        // The connection stays open until the body has passed through
+        m_bodyRemaining = streamedBody;
+        m_relayBody = relayed > 0;
+        m_closeAfterBody = !persist;
+    }
+    else if (!persist)
+    {
+        m_closeAfterWrite = true;
+    }
+}
+
+size_t HttpConnection::StreamBody(const char* data, size_t length)
+{
+    size_t piece = static_cast<size_t>(std::min<uint64_t>(m_bodyRemaining, length));
+    if (m_relayBody)
+    {
+        StartSend();
+        m_output.append(data, piece);
+    }
+
+    m_bodyRemaining -= piece;
+    if (m_bodyRemaining == 0 && m_closeAfterBody)
+    {
+        m_closeAfterWrite = true;
+    }
+    return piece;
+}
+
+void HttpConnection::QueueError(int statusCode, const char* reason)
+{
+    HttpResponse response;
+    response.SetStatus(statusCode, reason);
+    response.AppendBodyReference(reason);
+    StartSend();
+    AppendResponse(response, false, true, m_output);
+    m_closeAfterWrite = true;
+}
+
+std::string_view HttpConnection::PendingOutput() const
+{
+    return std::string_view(m_output).substr(m_outputOffset);
+}
+
+void HttpConnection::StartSend()
+{
+    if (m_output.empty())
+    {
+        m_sendStart = std::chrono::steady_clock::now();
+    }
+}
+
+void HttpConnection::ConsumeOutput(size_t length)
+{
+    if (m_output.empty())
+    {
+        return;
+    }
+
+    Metrics::Count(MetricCounter::BytesSent, length);
+    m_outputOffset += length;
+    if (m_outputOffset >= m_output.size())
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Metrics::Record(MetricStage::Send, now - m_sendStart);
+        Trace::Span(m_sendTrace, "send", m_sendStart, now);
+        m_output.clear();
+        m_outputOffset = 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "HttpParser.h"
+#include "Transport.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Per-thread scratch space reused for every request an event loop serves
+struct RequestScratch
+{
+    RequestScratch() { response.Reserve(); }
+
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    HttpResponse response;
+    ResponseSink* sink = nullptr;   // where the handler sends deferred responses; null = answer inline
+};
+
+// HTTP/1.1 framing shared by the socket transports. Buffers received bytes,
+// serves each complete (possibly pipelined) request through the handler and
+// accumulates the serialized responses until the transport sends them.
+//
+// A request the handler defers stops the connection there: pipelined
+// requests behind it stay buffered until the transport passes the response
+// to CompleteDeferred on the connection's own thread.
+class HttpConnection
+{
+public:
+    // tag is handed to the handler with deferred requests and comes back with
+    // their responses; transports use it to find the connection again. client
+    // is the peer's ClientAddressKey, passed on with every request.
+    explicit HttpConnection(uint64_t id, uint64_t tag = 0, uint64_t client = 0);
+    ~HttpConnection();
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    uint64_t Id() const { return m_id; }
+
+    // Receive side. ReadSpace returns room to recv() into directly, or nullptr
+    // when the buffer is at its limit; Append copies from a transport buffer.
+    char* ReadSpace(size_t& available);
+    void CommitRead(size_t length);
+    bool Append(const char* data, size_t length);
+    bool HasBufferedInput() const { return m_readEnd > m_readStart; }
+    size_t BufferedInput() const { return m_readEnd - m_readStart; }
+
+    // Serves complete requests until one is incomplete, the connection has to
+    // close, or more than WRITE_HIGH_WATER bytes are waiting to be sent.
+    // Returns the number of requests served.
+    size_t ProcessRequests(RequestHandler* handler, RequestScratch& scratch, bool keepAlive);
+
+    // Like Append followed by ProcessRequests, but parses straight out of data
+    // when nothing is buffered and copies only an incomplete tail
+    size_t ProcessFrom(const char* data, size_t length, RequestHandler* handler, RequestScratch& scratch, bool keepAlive);
+
+    // A request is with the handler; transports stop reading until it returns
+    bool Deferred() const { return m_deferred; }
+    void CompleteDeferred(const HttpResponse& response);
+
+    // Send side
+    std::string_view PendingOutput() const;
+    void ConsumeOutput(size_t length);
+    bool OutputBlocked() const { return m_output.size() - m_outputOffset > WRITE_HIGH_WATER; }
+
+    // Set once a response demands it, a request was malformed, or the peer
+    // finished sending; the transport closes after flushing the output
+    bool CloseAfterWrite() const { return m_closeAfterWrite; }
+    void SetCloseAfterWrite() { m_closeAfterWrite = true; }
+
+    // Bodies up to MAX_BUFFERED_BODY reach the handler whole. Larger ones are
+    // marked bodyStreamed and pass through the connection a read at a time:
+    // appended to the response if the handler asked to relay them, dropped
+    // otherwise. MAX_READ_BUFFER leaves room for receives that complete
+    // after the transport has stopped reading (io_uring multishot).
+    static constexpr size_t READ_CHUNK = 16384;
+    static constexpr size_t MAX_BUFFERED_BODY = 64 * 1024;
+    static constexpr size_t MAX_READ_BUFFER = 1024 * 1024;
+    static constexpr size_t WRITE_HIGH_WATER = 256 * 1024;
+
+private:
+    size_t Serve(const char* data, size_t length, size_t& consumed, RequestHandler* handler, RequestScratch& scratch, bool keepAlive);
+    void FinishResponse(const HttpResponse& response, bool keepAlive, bool includeBody, uint64_t streamedBody);
+    size_t StreamBody(const char* data, size_t length);
+    void QueueError(int statusCode, const char* reason);
+    bool Reserve(size_t length);
+    bool Store(const char* data, size_t length);
+    void Received(size_t length);
+    void StartSend();
+
+    uint64_t m_id;
+    uint64_t m_tag;
+    uint64_t m_client;
+    char* m_input;          // block from SlabPool::Buffers()
+    size_t m_inputSize;
+    size_t m_readStart;     // first byte not yet consumed by a request
+    size_t m_readEnd;       // end of received data
+    size_t m_scanned;       // bytes after m_readStart already searched for a head
+    std::string m_output;
+    size_t m_outputOffset;
+    bool m_closeAfterWrite;
+    uint64_t m_bodyRemaining;   // bytes of a streamed body still to arrive
+    bool m_relayBody;           // append them to the output rather than drop them
+    bool m_closeAfterBody;      // the streamed request's response closes the connection
+    bool m_deferred;
+    bool m_deferredKeepAlive;   // framing of the deferred request, applied to its response
+    bool m_deferredIncludeBody;
+    uint64_t m_deferredBody;    // its streamed body length; 0 when the body was buffered
+    std::chrono::steady_clock::time_point m_requestStart;   // first bytes of the next request arrived
+    std::chrono::steady_clock::time_point m_sendStart;      // output went from empty to pending
+    uint64_t m_sendTrace;   // traced request whose response was queued last, or 0
+};
\ No newline at end of file
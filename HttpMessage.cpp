@@ -0,0 +1,194 @@
+#include "HttpMessage.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpMethod ParseHttpMethod(std::string_view name)
+{
+    if (name == "GET") return HttpMethod::Get;
+    if (name == "HEAD") return HttpMethod::Head;
+    if (name == "POST") return HttpMethod::Post;
+    if (name == "PUT") return HttpMethod::Put;
+    if (name == "DELETE") return HttpMethod::Delete;
+    if (name == "OPTIONS") return HttpMethod::Options;
+    return HttpMethod::Other;
+}
+
+std::string_view HttpRequest::FindHeader(std::string_view name) const
+{
+    for (size_t i = 0; i < headerCount; i++)
+    {
+        if (EqualsIgnoreCase(headers[i].name, name))
+        {
+            return headers[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+void HttpResponse::Reset()
+{
+    statusCode = 200;
+    reason = "OK";
+    contentType = "text/plain";
+    closeConnection = false;
+    relayRequestBody = false;
+    m_headers.clear();
+    m_headerText.clear();
+    m_chunks.clear();
+    m_bodyText.clear();
+    m_bodyLength = 0;
+}
+
+void HttpResponse::Reserve()
+{
+    m_headers.reserve(HTTP_RESPONSE_HEADERS);
+    m_headerText.reserve(HTTP_RESPONSE_TEXT);
+    m_chunks.reserve(HTTP_RESPONSE_CHUNKS);
+    m_bodyText.reserve(HTTP_RESPONSE_TEXT);
+}
+
+void HttpResponse::SetStatus(int code, std::string_view reasonPhrase)
+{
+    statusCode = code;
+    reason = reasonPhrase;
+}
+
+void HttpResponse::AddHeader(std::string_view name, std::string_view value, std::string_view valueSuffix)
+{
+    Header header;
+    header.nameOffset = m_headerText.size();
+    header.nameLength = name.size();
+    m_headerText.append(name);
+    header.valueOffset = m_headerText.size();
+    header.valueLength = value.size() + valueSuffix.size();
+    m_headerText.append(value);
+    m_headerText.append(valueSuffix);
+    m_headers.push_back(header);
+}
+
+std::string_view HttpResponse::HeaderName(size_t index) const
+{
+    const Header& header = m_headers[index];
+    return std::string_view(m_headerText).substr(header.nameOffset, header.nameLength);
+}
+
+std::string_view HttpResponse::HeaderValue(size_t index) const
+{
+    const Header& header = m_headers[index];
+    return std::string_view(m_headerText).substr(header.valueOffset, header.valueLength);
+}
+
+void HttpResponse::AppendBody(std::string_view text)
+{
+    if (text.empty())
+    {
+        return;
+    }
+
+    // Consecutive copies share one chunk
+    if (!m_chunks.empty() && !m_chunks.back().data)
+    {
+        m_chunks.back().length += text.size();
+    }
+    else
+    {
+        m_chunks.push_back(Chunk{ nullptr, m_bodyText.size(), text.size() });
+    }
+    m_bodyText.append(text);
+    m_bodyLength += text.size();
+}
+
+void HttpResponse::AppendBodyReference(std::string_view text)
+{
+    if (text.empty())
+    {
+        return;
+    }
+
+    // A reference that continues the previous one in memory extends it
+    if (!m_chunks.empty() && m_chunks.back().data &&
+        m_chunks.back().data + m_chunks.back().length == text.data())
+    {
+        m_chunks.back().length += text.size();
+    }
+    else
+    {
+        m_chunks.push_back(Chunk{ text.data(), 0, text.size() });
+    }
+    m_bodyLength += text.size();
+}
+
+std::string_view HttpResponse::BodyChunk(size_t index) const
+{
+    const Chunk& chunk = m_chunks[index];
+    if (chunk.data)
+    {
+        return std::string_view(chunk.data, chunk.length);
+    }
+    return std::string_view(m_bodyText).substr(chunk.offset, chunk.length);
+}
+
+uint64_t ClientAddressKey(const sockaddr* address)
+{
+    if (!address)
+    {
+        return 0;
+    }
+
+    const uint8_t* bytes = nullptr;
+    if (address->sa_family == AF_INET)
+    {
+        bytes = reinterpret_cast<const uint8_t*>(&reinterpret_cast<const sockaddr_in*>(address)->sin_addr);
+    }
+    else if (address->sa_family == AF_INET6)
+    {
+        const uint8_t* v6 = reinterpret_cast<const uint8_t*>(&reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr);
+        static const uint8_t MAPPED[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+        if (memcmp(v6, MAPPED, sizeof(MAPPED)) != 0)
+        {
+            // The /64 prefix with its top bit set, which no global unicast
+            // prefix has, keeps these apart from IPv4 keys
+            uint64_t prefix = 0;
+            for (size_t i = 0; i < 8; i++)
+            {
+                prefix = (prefix << 8) | v6[i];
+            }
+            return prefix | (uint64_t(1) << 63);
+        }
+        bytes = v6 + 12;
+    }
+    else
+    {
+        return 0;
+    }
+
+    return (uint64_t(1) << 32) | (uint64_t(bytes[0]) << 24) | (uint64_t(bytes[1]) << 16) | (uint64_t(bytes[2]) << 8) | bytes[3];
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct sockaddr;
+
+enum class HttpMethod
+{
+    Get,
+    Head,
+    Post,
+    Put,
+    Delete,
+    Options,
+    Other
+};
+
+struct HttpHeader
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// Transport-neutral view of a received request. Every string_view points into
+// memory owned by the transport and stays valid until the handler returns.
+struct HttpRequest
+{
+    HttpMethod method = HttpMethod::Other;
+    std::string_view methodName;
+    std::string_view path;
+    std::string_view query;
+    const HttpHeader* headers = nullptr;
+    size_t headerCount = 0;
+    uint64_t contentLength = 0;
+    std::string_view body;
+    bool bodyStreamed = false;  // too large to buffer: body is empty and the transport
+                                // relays or discards the entity after the handler returns
+    uint64_t connectionId = 0;
+    uint64_t clientAddress = 0; // ClientAddressKey of the peer; 0 when the transport does not know it
+    std::chrono::steady_clock::time_point received;     // first bytes of the request arrived
+    uint64_t traceId = 0;       // Trace request id; 0 when it is not traced
+
+    // Case-insensitive lookup; returns an empty view when the header is absent
+    std::string_view FindHeader(std::string_view name) const;
+};
+
+// Initial capacity of a reused response; it grows past these when needed
+constexpr size_t HTTP_RESPONSE_HEADERS = 16;
+constexpr size_t HTTP_RESPONSE_CHUNKS = 256;
+constexpr size_t HTTP_RESPONSE_TEXT = 4096;
+
+// Response produced by a RequestHandler. The transport adds framing headers
+// (Content-Length, Connection) itself.
+//
+// Header text and copied body text live in buffers that keep their capacity
+// across Reset, so a response object reused per worker stops allocating once
+// warm. The body is a list of chunks: copied text, or references to memory
+// that outlives the send (literals, the request being served), which HTTP.sys
+// sends as separate data chunks without copying.
+struct HttpResponse
+{
+    int statusCode = 200;
+    std::string_view reason = "OK";
+    std::string_view contentType = "text/plain";
+    bool closeConnection = false;
+    bool relayRequestBody = false;  // follow the body with a streamed request entity
+
+    void Reset();
+    void Reserve();
+    void SetStatus(int code, std::string_view reasonPhrase);
+
+    // The value is the concatenation of both parts
+    void AddHeader(std::string_view name, std::string_view value, std::string_view valueSuffix = std::string_view());
+    size_t HeaderCount() const { return m_headers.size(); }
+    std::string_view HeaderName(size_t index) const;
+    std::string_view HeaderValue(size_t index) const;
+
+    void AppendBody(std::string_view text);
+    void AppendBodyReference(std::string_view text);
+    size_t BodyLength() const { return m_bodyLength; }
+    size_t BodyChunkCount() const { return m_chunks.size(); }
+    std::string_view BodyChunk(size_t index) const;
+
+private:
+    struct Header
+    {
+        size_t nameOffset;
+        size_t nameLength;
+        size_t valueOffset;
+        size_t valueLength;
+    };
+
+    // data is null for text copied into m_bodyText, found at offset
+    struct Chunk
+    {
+        const char* data;
+        size_t offset;
+        size_t length;
+    };
+
+    std::vector<Header> m_headers;
+    std::string m_headerText;
+    std::vector<Chunk> m_chunks;
+    std::string m_bodyText;
+    size_t m_bodyLength = 0;
+};
+
+HttpMethod ParseHttpMethod(std::string_view name);
+bool EqualsIgnoreCase(std::string_view a, std::string_view b);
+
+// A peer address folded into 64 bits for per-client state: an IPv4 address
+// (also when mapped into IPv6) as is, an IPv6 address by its /64 prefix,
+// which is what one host or subscriber is usually given. Never 0, except
+// for a null or unknown address.
+uint64_t ClientAddressKey(const sockaddr* address);
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "HttpParser.h"
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+    bool IsTokenChar(char c)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        {
+            return true;
+        }
+        return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+    }
+
+    std::string_view TrimWhitespace(std::string_view value)
+    {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+        return value;
+    }
+
+    // True when the comma-separated header value contains the token
+    bool HasToken(std::string_view value, std::string_view token)
+    {
+        while (!value.empty())
+        {
+            size_t comma = value.find(',');
+            if (EqualsIgnoreCase(TrimWhitespace(value.substr(0, comma)), token))
+            {
+                return true;
+            }
+            if (comma == std::string_view::npos)
+            {
+                break;
+            }
+            value.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    // Adds one Transfer-Encoding field's codings to those before it; false when
+    // a coding follows chunked, which must be applied once and last
+    bool AddTransferCodings(std::string_view value, bool& chunked)
+    {
+        while (!value.empty())
+        {
+            size_t comma = value.find(',');
+            std::string_view coding = TrimWhitespace(value.substr(0, comma));
+            if (!coding.empty())
+            {
+                if (chunked)
+                {
+                    return false;
+                }
+                chunked = EqualsIgnoreCase(coding, "chunked");
+            }
+            if (comma == std::string_view::npos)
+            {
+                break;
+            }
+            value.remove_prefix(comma + 1);
+        }
+        return true;
+    }
+
+    bool ParseContentLength(std::string_view value, uint64_t& length)
+    {
+        if (value.empty())
+        {
+            return false;
+        }
+        auto result = std::from_chars(value.data(), value.data() + value.size(), length);
+        return result.ec == std::errc() && result.ptr == value.data() + value.size();
+    }
+
+    void AppendNumber(std::string& out, uint64_t value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
+}
+
+ParseStatus ParseRequestHead(const char* data, size_t length, HttpHeader* headers, ParsedRequest& parsed, size_t searchFrom)
+{
+    // Locate the blank line that ends the head before parsing anything
+    std::string_view buffer(data, length);
+    size_t headEnd = buffer.find("\r\n\r\n", searchFrom >= 3 ? searchFrom - 3 : 0);
+    if (headEnd == std::string_view::npos)
+    {
+        return length > HTTP_MAX_HEAD_SIZE ? ParseStatus::TooLarge : ParseStatus::Incomplete;
+    }
+    if (headEnd + 4 > HTTP_MAX_HEAD_SIZE)
+    {
+        return ParseStatus::TooLarge;
+    }
+
+    parsed = ParsedRequest();
+    parsed.headBytes = headEnd + 4;
+    HttpRequest& request = parsed.request;
+    std::string_view head = buffer.substr(0, headEnd + 2);
+
+    // Request line: METHOD SP request-target SP HTTP-version CRLF
+    size_t lineEnd = head.find("\r\n");
+    std::string_view line = head.substr(0, lineEnd);
+    head.remove_prefix(lineEnd + 2);
+
+    size_t space = line.find(' ');
+    if (space == 0 || space == std::string_view::npos)
+    {
+        return ParseStatus::Invalid;
+    }
+    request.methodName = line.substr(0, space);
+    for (char c : request.methodName)
+    {
+        if (!IsTokenChar(c))
+        {
+            return ParseStatus::Invalid;
+        }
+    }
+    request.method = ParseHttpMethod(request.methodName);
+    line.remove_prefix(space + 1);
+
+    space = line.find(' ');
+    if (space == 0 || space == std::string_view::npos)
+    {
+        return ParseStatus::Invalid;
+    }
+    std::string_view target = line.substr(0, space);
+    std::string_view version = line.substr(space + 1);
+
+    bool http11;
+    if (version == "HTTP/1.1")
+        http11 = true;
+    else if (version == "HTTP/1.0")
+        http11 = false;
+    else
+        return ParseStatus::Invalid;
+
+    // Absolute-form targets are reduced to their path, as HTTP.sys does
+    if (target.front() != '/' && target != "*")
+    {
+        size_t scheme = target.find("://");
+        if (scheme == std::string_view::npos)
+        {
+            return ParseStatus::Invalid;
+        }
+        size_t pathStart = target.find('/', scheme + 3);
+        target = pathStart == std::string_view::npos ? std::string_view("/") : target.substr(pathStart);
+    }
+
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string_view::npos)
+    {
+        request.query = target.substr(question + 1);
+    }
+
+    // Header fields
+    bool hasContentLength = false;
+    bool hasTransferEncoding = false;
+    std::string_view connection;
+    size_t count = 0;
+
+    while (!head.empty())
+    {
+        lineEnd = head.find("\r\n");
+        line = head.substr(0, lineEnd);
+        head.remove_prefix(lineEnd + 2);
+
+        // Obsolete line folding is rejected rather than unfolded
+        if (line.empty() || line.front() == ' ' || line.front() == '\t')
+        {
+            return ParseStatus::Invalid;
+        }
+
+        size_t colon = line.find(':');
+        if (colon == 0 || colon == std::string_view::npos)
+        {
+            return ParseStatus::Invalid;
+        }
+
+        std::string_view name = line.substr(0, colon);
+        for (char c : name)
+        {
+            if (!IsTokenChar(c))
+            {
+                return ParseStatus::Invalid;
+            }
+        }
+        std::string_view value = TrimWhitespace(line.substr(colon + 1));
+
+        if (count == HTTP_MAX_HEADERS)
+        {
+            return ParseStatus::TooLarge;
+        }
+        headers[count++] = HttpHeader{ name, value };
+
+        if (EqualsIgnoreCase(name, "Content-Length"))
+        {
+            uint64_t contentLength;
+            if (!ParseContentLength(value, contentLength) ||
+                (hasContentLength && contentLength != request.contentLength))
+            {
+                return ParseStatus::Invalid;
+            }
+            request.contentLength = contentLength;
+            hasContentLength = true;
+        }
+        else if (EqualsIgnoreCase(name, "Transfer-Encoding"))
+        {
+            // Split fields form one list; anything after chunked leaves the
+            // body's end to the other coding, which a proxy may read differently
+            hasTransferEncoding = true;
+            if (!AddTransferCodings(value, parsed.chunked))
+            {
+                return ParseStatus::Invalid;
+            }
+        }
+        else if (EqualsIgnoreCase(name, "Connection"))
+        {
+            connection = value;
+        }
+    }
+
+    // Both framings at once is a request-smuggling vector
+    if (hasContentLength && hasTransferEncoding)
+    {
+        return ParseStatus::Invalid;
+    }
+    // Without chunked last the body has no length we can find (RFC 9112 6.3)
+    if (hasTransferEncoding && !parsed.chunked)
+    {
+        return ParseStatus::Invalid;
+    }
+
+    request.headers = headers;
+    request.headerCount = count;
+    parsed.keepAlive = http11 ? !HasToken(connection, "close") : HasToken(connection, "keep-alive");
+    return ParseStatus::Complete;
+}
+
+void AppendResponse(const HttpResponse& response, bool keepAlive, bool includeBody, std::string& out, uint64_t relayedLength)
+{
+    out.append("HTTP/1.1 ");
+    AppendNumber(out, static_cast<uint64_t>(response.statusCode));
+    out.push_back(' ');
+    out.append(response.reason);
+    out.append("\r\nContent-Type: ");
+    out.append(response.contentType);
+    out.append("\r\nContent-Length: ");
+    AppendNumber(out, response.BodyLength() + relayedLength);
+    out.append("\r\n");
+
+    for (size_t i = 0; i < response.HeaderCount(); i++)
+    {
+        out.append(response.HeaderName(i));
+        out.append(": ");
+        out.append(response.HeaderValue(i));
+        out.append("\r\n");
+    }
+
+    if (!keepAlive)
+    {
+        out.append("Connection: close\r\n");
+    }
+    out.append("\r\n");
+
+    if (includeBody)
+    {
+        for (size_t i = 0; i < response.BodyChunkCount(); i++)
+        {
+            out.append(response.BodyChunk(i));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "HttpMessage.h"
+#include <cstddef>
+#include <string>
+
+// HTTP/1.1 wire format for the socket-based transports (HTTP.sys does its
+// own parsing). The parser never allocates: the request it fills points into
+// the caller's buffer.
+
+enum class ParseStatus
+{
+    Complete,
+    Incomplete,
+    Invalid,
+    TooLarge
+};
+
+struct ParsedRequest
+{
+    HttpRequest request;
+    size_t headBytes = 0;       // request line and headers, including the blank line
+    bool keepAlive = true;
+    bool chunked = false;
+};
+
+constexpr size_t HTTP_MAX_HEADERS = 64;
+constexpr size_t HTTP_MAX_HEAD_SIZE = 16384;
+
+// Parses the request head at the start of data. headers must have room for
+// HTTP_MAX_HEADERS entries. searchFrom lets callers skip bytes already known
+// not to contain the end of the head when more data arrives.
+ParseStatus ParseRequestHead(const char* data, size_t length, HttpHeader* headers, ParsedRequest& parsed, size_t searchFrom = 0);
+
+// Appends the status line, headers and (unless includeBody is false, as for
+// HEAD) the body to out. relayedLength is the number of bytes the caller will
+// send after the body; it is counted in Content-Length.
+void AppendResponse(const HttpResponse& response, bool keepAlive, bool includeBody, std::string& out, uint64_t relayedLength = 0);
\ No newline at end of file
@@ -1,18 +1,82 @@
 #include "HttpServer.h"
+#include "AccessPolicy.h"
+#include "AdmissionControl.h"
+#include "EchoResponse.h"
 #include "KerberosAuth.h"
-#include <iostream>
-#include <sstream>
+#include "Limits.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "PrincipalQuotas.h"
+#include "PrincipalTable.h"
+#include "RequestArena.h"
+#include "RequestTask.h"
+#include "SessionCookie.h"
+#include "SlabPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <thread>
+
+// A Negotiate request on its way through the auth and handler stages
+struct PipelineJob : ResumableRequest
+{
+    // Copies the request's text into storage and points request at it
+    void Capture(const HttpRequest& source);
+
+    ResponseSink* sink = nullptr;
+    std::chrono::steady_clock::time_point deadline;
+    AuthResult auth;
+    std::string storage;
+    std::vector<HttpHeader> headers;
+};
 
-#pragma comment(lib, "httpapi.lib")
+void PipelineJob::Capture(const HttpRequest& source)
+{
+    size_t total = source.methodName.size() + source.path.size() + source.query.size() + source.body.size();
+    for (size_t i = 0; i < source.headerCount; i++)
+    {
+        total += source.headers[i].name.size() + source.headers[i].value.size();
+    }
+
+    // Reserved up front, so views taken while appending stay valid
+    storage.clear();
+    storage.reserve(total);
+    auto copy = [this](std::string_view text)
+    {
+        size_t offset = storage.size();
+        storage.append(text.data(), text.size());
+        return std::string_view(storage.data() + offset, text.size());
+    };
+
+    request = source;
+    request.methodName = copy(source.methodName);
+    request.path = copy(source.path);
+    request.query = copy(source.query);
+    request.body = copy(source.body);
+
+    headers.clear();
+    for (size_t i = 0; i < source.headerCount; i++)
+    {
+        std::string_view name = copy(source.headers[i].name);
+        headers.push_back(HttpHeader{ name, copy(source.headers[i].value) });
+    }
+    request.headers = headers.data();
+    request.headerCount = headers.size();
+}
 
 const std::string HttpServer::UNAUTHORIZED_RESPONSE = "HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Negotiate\r\nContent-Length: 12\r\n\r\nUnauthorized";
 const std::string HttpServer::SERVER_ERROR_RESPONSE = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 21\r\n\r\nInternal Server Error";
 
-HttpServer::HttpServer(int port)
-    : m_port(port)
-    , m_hReqQueue(nullptr)
+HttpServer::HttpServer(const ServerConfig& config)
+    : m_config(config)
+    , m_pipelineOpen(false)
+    , m_queueDeadline(config.queueDeadlineMs)
+    , m_retryAfter(std::to_string(config.retryAfterSeconds))
+    , m_deferred(0)
+    , m_shedFull(0)
+    , m_shedDeadline(0)
+    , m_metricsPath(config.metricsPath.begin(), config.metricsPath.end())
+    , m_tracePath(config.tracePath.begin(), config.tracePath.end())
     , m_running(false)
-    , m_paused(false)
 {
 }
 
@@ -23,278 +87,804 @@ HttpServer::~HttpServer()
 
 bool HttpServer::Initialize()
 {
-    // Initialize HTTP Server API
-    ULONG result = HttpInitialize(HTTPAPI_VERSION_2, HTTP_INITIALIZE_SERVER, nullptr);
-    if (result != NO_ERROR)
+    Trace::Configure(m_config);
+    if (!Trace::Enabled())
     {
-        std::wcout << L"HttpInitialize failed with error: " << result << std::endl;
+        m_tracePath.clear();
+    }
+
+    m_transport = CreateTransport(m_config);
+    if (!m_transport || !m_transport->Initialize())
+    {
+        Log::Write(LogLevel::Error) << L"Failed to initialize HTTP transport";
+        m_transport.reset();
         return false;
     }
 
-    // Create request queue
-    result = HttpCreateHttpHandle(&m_hReqQueue, 0);
-    if (result != NO_ERROR)
+    // Initialize Kerberos authentication
+    m_kerberosAuth = std::make_unique<KerberosAuth>(m_config);
+    if (!m_kerberosAuth->Initialize())
     {
-        std::wcout << L"HttpCreateHttpHandle failed with error: " << result << std::endl;
-        HttpTerminate(HTTP_INITIALIZE_SERVER, nullptr);
+        Log::Write(LogLevel::Error) << L"Failed to initialize Kerberos authentication";
+        m_transport.reset();
         return false;
     }
 
-    // Create URL
-    std::wstring url = L"http://+:" + std::to_wstring(m_port) + L"/";
-    
-    // Add URL to queue
-    result = HttpAddUrl(m_hReqQueue, url.c_str(), nullptr);
-    if (result != NO_ERROR)
+    m_sessionCookies = std::make_unique<SessionCookies>(
+        std::chrono::seconds(m_config.sessionLifetimeSeconds),
+        std::chrono::seconds(m_config.sessionKeyRotationSeconds));
+    if (!m_sessionCookies->Initialize())
     {
-        std::wcout << L"HttpAddUrl failed with error: " << result << std::endl;
-        std::wcout << L"Make sure to run as Administrator or reserve the URL with: " << std::endl;
-        std::wcout << L"netsh http add urlacl url=" << url << L" user=Everyone" << std::endl;
-        CloseHandle(m_hReqQueue);
-        HttpTerminate(HTTP_INITIALIZE_SERVER, nullptr);
+        m_transport.reset();
         return false;
     }
 
-    // Initialize Kerberos authentication
-    m_kerberosAuth = std::make_unique<KerberosAuth>();
-    if (!m_kerberosAuth->Initialize())
+    m_principals = std::make_unique<PrincipalTable>(m_config.principalLimit);
+    m_quotas = std::make_unique<PrincipalQuotas>(*m_principals);
+    m_admission = std::make_unique<AdmissionControl>(ADMISSION_CLIENTS, ADMISSION_REJECTED_TOKENS);
+    if (!ReloadLimits())
     {
-        std::wcout << L"Failed to initialize Kerberos authentication" << std::endl;
-        CloseHandle(m_hReqQueue);
-        HttpTerminate(HTTP_INITIALIZE_SERVER, nullptr);
+        m_transport.reset();
         return false;
     }
 
+    if (!m_config.authzRules.empty())
+    {
+        m_accessPolicy = std::make_unique<AccessPolicy>(*m_principals, std::chrono::seconds(m_config.authzMembershipSeconds));
+        if (!m_accessPolicy->Load(std::string(m_config.authzRules.begin(), m_config.authzRules.end())))
+        {
+            m_transport.reset();
+            return false;
+        }
+    }
+
+    CreatePipeline();
     return true;
 }
 
+void HttpServer::CreatePipeline()
+{
+    // A queue depth of 0 keeps authentication on the transport's threads
+    if (m_config.stageQueueDepth == 0)
+    {
+        return;
+    }
+
+    // Auth threads mostly wait on the provider or a domain controller, so
+    // there are more of them than processors
+    size_t processors = (std::max)(std::thread::hardware_concurrency(), 1u);
+    size_t authThreads = m_config.authThreads ? m_config.authThreads : 2 * processors;
+    size_t handlerThreads = m_config.handlerThreads ? m_config.handlerThreads : (std::max)(processors / 2, size_t(1));
+    m_authStage = std::make_unique<StagePool>(authThreads, m_config.stageQueueDepth);
+    m_handlerStage = std::make_unique<StagePool>(handlerThreads, m_config.stageQueueDepth);
+
+    // Enough jobs to fill both queues with every stage thread busy; jobs whose
+    // responses are waiting to be sent come out of the same budget
+    size_t jobCount = m_authStage->GetStats().capacity + m_handlerStage->GetStats().capacity + authThreads + handlerThreads;
+    m_freeJobs = std::make_unique<StageQueue<PipelineJob*>>(jobCount);
+    m_jobs.reserve(jobCount);
+    for (size_t i = 0; i < jobCount; i++)
+    {
+        m_jobs.push_back(std::make_unique<PipelineJob>());
+        m_freeJobs->TryPush(m_jobs.back().get());
+    }
+}
+
 void HttpServer::Start()
 {
-    m_running = true;
-    m_paused = false;
-    m_workerThread = std::thread(&HttpServer::WorkerThread, this);
-    std::wcout << L"HTTP Server started on port " << m_port << std::endl;
+    if (!m_transport || m_running.exchange(true))
+    {
+        return;
+    }
+
+    if (m_authStage)
+    {
+        m_authStage->Start(ResumeRequest);
+        m_handlerStage->Start(ResumeRequest);
+        m_pipelineOpen = true;
+        Log::Write(LogLevel::Info) << L"Request pipeline: " << m_authStage->ThreadCount() << L" auth threads, "
+                                   << m_handlerStage->ThreadCount() << L" handler threads, " << m_authStage->GetStats().capacity
+                                   << L" queued requests per stage, 503 after " << m_queueDeadline.count() << L" ms";
+    }
+
+    if (!m_config.captureFile.empty() && m_capture.Start(m_config.captureFile, m_config.captureTokens))
+    {
+        Log::Write(LogLevel::Info) << L"Capturing requests to " << m_config.captureFile << L" (Negotiate tokens: "
+                                   << m_config.captureTokens << L")";
+    }
+
+    m_transport->Start(this);
+    Log::Write(LogLevel::Info) << L"HTTP Server started on port " << m_config.port
+                               << L" using the " << m_transport->Name() << L" transport";
+
+    if (!m_metricsPath.empty())
+    {
+        Log::Write(LogLevel::Info) << L"Metrics served at " << m_config.metricsPath;
+    }
+    if (Trace::Enabled())
+    {
+        LogLine line = Log::Write(LogLevel::Info);
+        if (m_config.traceSampleEvery > 1)
+        {
+            line << L"Tracing one in " << m_config.traceSampleEvery << L" requests";
+        }
+        else
+        {
+            line << L"Tracing every request";
+        }
+        if (m_config.traceThresholdUs > 0)
+        {
+            line << L", exporting those over " << m_config.traceThresholdUs << L" us";
+        }
+        if (!m_tracePath.empty())
+        {
+            line << L"; trace served at " << m_config.tracePath;
+        }
+    }
+    if (!m_config.metricsSharedMemory.empty() && m_sharedMetrics.Start(m_config.metricsSharedMemory, m_config.metricsIntervalMs))
+    {
+        Log::Write(LogLevel::Info) << L"Metrics published to shared memory " << m_config.metricsSharedMemory << L" every "
+                                   << m_config.metricsIntervalMs << L" ms";
+    }
 }
 
 void HttpServer::Stop()
 {
-    m_running = false;
-    
-    if (m_workerThread.joinable())
+    if (!m_running.exchange(false))
     {
-        m_workerThread.join();
+        return;
     }
 
-    if (m_hReqQueue)
+    // New Negotiate requests are answered inline from here on; the stages
+    // finish what they hold while the transport can still send it
+    m_pipelineOpen = false;
+    if (m_authStage)
     {
-        CloseHandle(m_hReqQueue);
-        m_hReqQueue = nullptr;
+        m_authStage->Stop();
+        m_handlerStage->Stop();
+    }
+    m_transport->Stop();
+    m_sharedMetrics.Stop();
+    if (m_capture.Active())
+    {
+        m_capture.Stop();
+        TrafficCaptureStats capture = m_capture.GetStats();
+        Log::Write(LogLevel::Info) << L"Captured " << capture.records << L" requests (" << capture.bytes / 1024 << L" KB) to "
+                                   << m_config.captureFile << L", " << capture.dropped << L" dropped";
     }
 
-    HttpTerminate(HTTP_INITIALIZE_SERVER, nullptr);
-    std::wcout << L"HTTP Server stopped" << std::endl;
+    PipelineStats pipeline = GetPipelineStats();
+    if (pipeline.enabled)
+    {
+        Log::Write(LogLevel::Info) << L"Pipeline: " << pipeline.deferred << L" deferred; auth queue peak " << pipeline.auth.peakDepth
+                                   << L" of " << pipeline.auth.capacity << L", handler queue peak " << pipeline.handler.peakDepth << L" of "
+                                   << pipeline.handler.capacity << L"; shed " << pipeline.shedFull << L" on a full queue, "
+                                   << pipeline.shedDeadline << L" past the deadline";
+    }
+    AuthStats auth = m_kerberosAuth->GetStats();
+    Log::Write(LogLevel::Info) << L"Authentication (" << m_kerberosAuth->ProviderName() << L"): " << auth.legs << L" legs, "
+                                << auth.succeeded << L" succeeded, " << auth.continued << L" continued, " << auth.failed << L" failed, "
+                                << (auth.legs ? auth.providerNanoseconds / auth.legs / 1000 : 0) << L" us per leg";
+    uint64_t nativeTokens = auth.native.accepted + auth.native.rejected + auth.native.fallbacks;
+    if (nativeTokens > 0)
+    {
+        Log::Write(LogLevel::Info) << L"Native AP-REQ: " << auth.native.accepted << L" accepted, " << auth.native.rejected << L" rejected ("
+                                   << auth.native.replays << L" replays), " << auth.native.fallbacks << L" passed to the provider ("
+                                   << auth.native.replayCacheFull << L" for a full replay cache), "
+                                   << auth.nativeNanoseconds / nativeTokens << L" ns per token";
+    }
+    if (auth.credentials.refreshes > 0 || auth.credentials.failures > 0 || auth.credentials.keytabChanges > 0)
+    {
+        Log::Write(LogLevel::Info) << L"Credentials: " << auth.credentials.refreshes << L" refreshed, " << auth.credentials.failures
+                                   << L" failed refreshes, " << auth.credentials.keytabChanges << L" keytab changes";
+    }
+    const TokenScreenStats& screen = auth.screen;
+    uint64_t screened = screen.kerberos + screen.ntlm + screen.other + screen.malformed;
+    if (screened > 0)
+    {
+        uint64_t tickets = screen.aes256 + screen.aes128 + screen.rc4 + screen.otherEtype;
+        Log::Write(LogLevel::Info) << L"Token screen: " << screen.kerberos << L" Kerberos (" << screen.aes256 << L" aes256, "
+                                   << screen.aes128 << L" aes128, " << screen.rc4 << L" rc4, " << screen.otherEtype << L" other, "
+                                   << (tickets ? screen.ticketBytes / tickets : 0) << L" bytes per ticket), " << screen.ntlm << L" NTLM ("
+                                   << auth.slowLaneShed << L" shed), " << screen.other << L" other; rejected " << screen.malformed
+                                   << L" malformed, " << screen.wrongRealm << L" wrong realm, " << screen.wrongService << L" wrong SPN; "
+                                   << auth.screenNanoseconds / screened << L" ns per token";
+    }
+    TokenCacheStats cache = m_kerberosAuth->GetTokenCacheStats();
+    Log::Write(LogLevel::Info) << L"Token cache: " << cache.hits << L" hits, " << cache.misses << L" misses, "
+                               << cache.coalesced << L" coalesced, " << cache.evictions << L" evictions";
+    AdmissionStats admission = m_admission->GetStats();
+    Log::Write(LogLevel::Info) << L"Admission: " << admission.admitted << L" admitted, " << admission.throttled << L" throttled, "
+                               << admission.repeated << L" repeats of " << admission.rejected << L" rejected tokens answered untried, "
+                               << admission.evicted << L" client evictions";
+    QuotaStats quotas = m_quotas->GetStats();
+    Log::Write(LogLevel::Info) << L"Quotas: " << quotas.admitted << L" admitted, " << quotas.overConcurrency << L" over concurrency, "
+                               << quotas.overRate << L" over rate; " << quotas.assigned << L" quota assignments, "
+                               << quotas.overflow << L" requests without a principal ID";
+    SessionCookieStats sessions = m_sessionCookies->GetStats();
+    Log::Write(LogLevel::Info) << L"Session cookies: " << sessions.issued << L" issued, " << sessions.accepted << L" accepted, "
+                               << sessions.rejected << L" rejected, " << sessions.expired << L" expired, "
+                               << sessions.rotations << L" key rotations";
+    {
+        PrincipalTableStats principals = m_principals->GetStats();
+        LogLine line = Log::Write(LogLevel::Info);
+        line << L"Principals: " << principals.principals << L" of " << principals.capacity << L" interned in "
+             << principals.realms << L" realms, " << principals.refused << L" refused";
+        uint32_t busiest = m_principals->Busiest();
+        if (busiest != PrincipalTable::NO_PRINCIPAL)
+        {
+            line << L"; busiest " << m_principals->Name(busiest) << L" with " << m_principals->Requests(busiest) << L" requests";
+        }
+    }
+    if (m_accessPolicy)
+    {
+        AccessPolicyStats authz = m_accessPolicy->GetStats();
+        Log::Write(LogLevel::Info) << L"Authorization: " << authz.allowed << L" allowed, " << authz.denied << L" denied, "
+                                   << authz.unknown << L" sent back for groups; " << authz.groupSets << L" distinct memberships";
+    }
+    SlabPoolStats buffers = SlabPool::Buffers().GetStats();
+    Log::Write(LogLevel::Info) << L"Buffer pool: " << buffers.acquired << L" acquired, " << buffers.reused << L" reused, "
+                               << buffers.cachedBytes / 1024 << L" KB cached";
+    Log::Write(LogLevel::Info) << L"HTTP Server stopped";
 }
 
 void HttpServer::Pause()
 {
-    m_paused = true;
-    std::wcout << L"HTTP Server paused" << std::endl;
+    if (m_transport)
+    {
+        m_transport->Pause();
+    }
+    Log::Write(LogLevel::Info) << L"HTTP Server paused";
 }
 
 void HttpServer::Resume()
 {
-    m_paused = false;
-    std::wcout << L"HTTP Server resumed" << std::endl;
+    if (m_transport)
+    {
+        m_transport->Resume();
+    }
+    Log::Write(LogLevel::Info) << L"HTTP Server resumed";
 }
 
-void HttpServer::WorkerThread()
+bool HttpServer::ReloadLimits()
 {
-    const DWORD requestBufferSize = sizeof(HTTP_REQUEST) + 2048;
-    std::unique_ptr<BYTE[]> requestBuffer(new BYTE[requestBufferSize]);
-    PHTTP_REQUEST pRequest = reinterpret_cast<PHTTP_REQUEST>(requestBuffer.get());
+    if (!m_admission || !m_quotas)
+    {
+        return false;
+    }
+
+    Limits limits = DefaultLimits(m_config);
+    if (!m_config.limitsFile.empty() &&
+        !LoadLimits(std::string(m_config.limitsFile.begin(), m_config.limitsFile.end()), limits, limits))
+    {
+        return false;
+    }
+    if (!m_quotas->SetLimits(limits.quotas))
+    {
+        Log::Write(LogLevel::Error) << L"Limits reloaded too often; keeping the current ones, retry in "
+            << PrincipalQuotas::RETIRE_SECONDS << L" s";
+        return false;
+    }
+    m_admission->SetLimits(limits.admission);
 
-    while (m_running)
     {
-        if (m_paused)
+        AdmissionLimits applied = m_admission->GetLimits();
+        LogLine line = Log::Write(LogLevel::Info);
+        line << L"Admission: ";
+        if (applied.clientRate > 0)
         {
-            Sleep(100);
-            continue;
+            line << applied.clientRate << L" Negotiate tokens per second per client, bursts of " << applied.clientBurst;
         }
-
-        HTTP_REQUEST_ID requestId = HTTP_NULL_ID;
-        DWORD bytesReturned;
-
-        ULONG result = HttpReceiveHttpRequest(
-            m_hReqQueue,
-            requestId,
-            0,
-            pRequest,
-            requestBufferSize,
-            &bytesReturned,
-            nullptr
-        );
-
-        if (result == NO_ERROR)
+        else
+        {
+            line << L"no rate limit per client";
+        }
+        if (applied.rejectSeconds > 0)
+        {
+            line << L"; failed tokens answered 401 untried for " << applied.rejectSeconds << L" s";
+        }
+        if (!m_config.limitsFile.empty())
+        {
+            line << L" (" << m_config.limitsFile << L")";
+        }
+    }
+    {
+        QuotaLimits applied = m_quotas->GetLimits();
+        LogLine line = Log::Write(LogLevel::Info);
+        line << L"Quotas: ";
+        if (applied.standard.concurrency > 0)
         {
-            ProcessRequest(pRequest->RequestId, pRequest);
+            line << applied.standard.concurrency << L" requests per principal at once";
         }
-        else if (result == ERROR_MORE_DATA)
+        else
         {
-            // Request is larger than our buffer, but for this echo server, we'll just handle what we can
-            ProcessRequest(pRequest->RequestId, pRequest);
+            line << L"no concurrency limit per principal";
         }
-        else if (result != ERROR_CONNECTION_INVALID)
+        if (applied.standard.rate > 0)
         {
-            std::wcout << L"HttpReceiveHttpRequest failed with error: " << result << std::endl;
+            line << L", " << applied.standard.rate << L" per " << applied.windowSeconds << L" s";
         }
+        line << L"; " << applied.subjects.size() << L" with quotas of their own";
     }
+    return true;
 }
 
-bool HttpServer::ProcessRequest(HTTP_REQUEST_ID requestId, PHTTP_REQUEST pRequest)
+PipelineStats HttpServer::GetPipelineStats() const
 {
-    // Check authentication
-    if (!HandleAuthentication(pRequest))
-    {
-        // Send 401 Unauthorized with WWW-Authenticate header
-        HTTP_RESPONSE response;
-        ZeroMemory(&response, sizeof(response));
-        
-        response.StatusCode = 401;
-        response.pReason = "Unauthorized";
-        response.ReasonLength = static_cast<USHORT>(strlen("Unauthorized"));
-
-        // Add WWW-Authenticate header
-        HTTP_UNKNOWN_HEADER authHeader;
-        authHeader.pName = "WWW-Authenticate";
-        authHeader.NameLength = static_cast<USHORT>(strlen("WWW-Authenticate"));
-        authHeader.pRawValue = "Negotiate";
-        authHeader.RawValueLength = static_cast<USHORT>(strlen("Negotiate"));
-
-        response.Headers.pUnknownHeaders = &authHeader;
-        response.Headers.UnknownHeaderCount = 1;
-
-        std::string body = "Authentication required";
-        HTTP_DATA_CHUNK dataChunk;
-        dataChunk.DataChunkType = HttpDataChunkFromMemory;
-        dataChunk.FromMemory.pBuffer = const_cast<char*>(body.c_str());
-        dataChunk.FromMemory.BufferLength = static_cast<ULONG>(body.length());
-
-        response.EntityChunkCount = 1;
-        response.pEntityChunks = &dataChunk;
-
-        DWORD bytesSent;
-        HttpSendHttpResponse(m_hReqQueue, requestId, 0, &response, nullptr, &bytesSent, nullptr, 0, nullptr, nullptr);
-        return false;
+    PipelineStats stats;
+    if (!m_authStage)
+    {
+        return stats;
+    }
+
+    stats.enabled = true;
+    stats.auth = m_authStage->GetStats();
+    stats.handler = m_handlerStage->GetStats();
+    stats.authThreads = m_authStage->ThreadCount();
+    stats.handlerThreads = m_handlerStage->ThreadCount();
+    stats.deferred = m_deferred.load(std::memory_order_relaxed);
+    stats.shedFull = m_shedFull.load(std::memory_order_relaxed);
+    stats.shedDeadline = m_shedDeadline.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HttpServer::ProcessRequest(const HttpRequest& request, HttpResponse& response)
+{
+    // Per-request scratch comes from the worker's arena and is reclaimed here
+    ArenaScope scope;
+
+    // Check authentication: a valid session cookie skips Negotiate entirely.
+    // The result is reused per thread so that path does not allocate.
+    thread_local AuthResult auth;
+    auth.status = AuthStatus::Failed;
+    auth.outputToken.clear();
+    auth.principal.clear();
+    bool session = AuthenticateSession(request, auth);
+    if (!session)
+    {
+        auth = HandleAuthentication(request);
+    }
+    if (auth.status != AuthStatus::Success)
+    {
+        WriteResponse(request, auth, session, response);
+    }
+    else if (AcquireQuota(request, auth, session, response))
+    {
+        WriteResponse(request, auth, session, response);
+        m_quotas->Release(auth.principalId);
     }
+}
 
-    // Read request body if present
-    std::string requestBody;
-    if (pRequest->BytesReceived < pRequest->EntityChunkCount && pRequest->EntityChunkCount > 0)
+RequestDisposition HttpServer::SubmitRequest(const HttpRequest& request, HttpResponse& response, ResponseSink* sink, uint64_t tag)
+{
+    Metrics::Count(MetricCounter::Requests);
+    RequestDisposition disposition = Route(request, response, sink, tag);
+    if (disposition == RequestDisposition::Completed)
     {
-        // For simplicity, we'll just echo back the URL and headers info
-        // In a real implementation, you'd read the full request body
+        Metrics::CountStatus(response.statusCode);
+        Trace::EndRequest(request.traceId, request.received, response.statusCode);
     }
+    return disposition;
+}
 
-    // Create echo response
-    std::stringstream ss;
-    ss << "Echo Response\n";
-    ss << "=============\n";
-    ss << "Method: ";
-    
-    switch (pRequest->Verb)
+RequestDisposition HttpServer::Route(const HttpRequest& request, HttpResponse& response, ResponseSink* sink, uint64_t tag)
+{
+    // Scrapes never authenticate; the exposition holds no principals
+    if (!m_metricsPath.empty() && request.path == m_metricsPath &&
+        (request.method == HttpMethod::Get || request.method == HttpMethod::Head))
+    {
+        WriteMetrics(response);
+        return RequestDisposition::Completed;
+    }
+    if (!m_tracePath.empty() && request.path == m_tracePath &&
+        (request.method == HttpMethod::Get || request.method == HttpMethod::Head))
     {
-    case HttpVerbGET: ss << "GET"; break;
-    case HttpVerbPOST: ss << "POST"; break;
-    case HttpVerbPUT: ss << "PUT"; break;
-    case HttpVerbDELETE: ss << "DELETE"; break;
-    default: ss << "OTHER"; break;
+        WriteTrace(response);
+        return RequestDisposition::Completed;
     }
-    
-    ss << "\n";
-    ss << "URL: " << std::string(pRequest->CookedUrl.pAbsPath, pRequest->CookedUrl.AbsPathLength / sizeof(wchar_t)) << "\n";
-    ss << "Headers:\n";
-    
-    // Echo known headers
-    for (int i = 0; i < HttpHeaderRequestMaximum; i++)
+    if (m_capture.Active())
     {
-        if (pRequest->Headers.KnownHeaders[i].pRawValue)
+        m_capture.Record(request);
+    }
+
+    // Tokens face admission before they are decoded or queued for an auth thread
+    std::string_view authorization = request.FindHeader("Authorization");
+    bool negotiate = authorization.substr(0, 9) == "Negotiate";
+    if (negotiate && !Admit(request, authorization, response))
+    {
+        return RequestDisposition::Completed;
+    }
+
+    // Only Negotiate can wait on the provider; everything else is answered here
+    if (!sink || !m_pipelineOpen.load(std::memory_order_relaxed) || !negotiate)
+    {
+        ProcessRequest(request, response);
+        return RequestDisposition::Completed;
+    }
+
+    PipelineJob* job = nullptr;
+    if (!m_freeJobs->TryPop(job))
+    {
+        m_shedFull.fetch_add(1, std::memory_order_relaxed);
+        WriteOverloaded(response);
+        return RequestDisposition::Completed;
+    }
+
+    job->Capture(request);
+    job->response.Reset();
+    job->tag = tag;
+    job->sink = sink;
+    job->deadline = std::chrono::steady_clock::now() + m_queueDeadline;
+
+    // The handler starts on an auth thread; if it cannot get there it never runs
+    job->continuation = RunPipeline(job).Detach();
+    if (!m_authStage->Post(job))
+    {
+        job->continuation.destroy();
+        m_freeJobs->TryPush(job);
+        m_shedFull.fetch_add(1, std::memory_order_relaxed);
+        WriteOverloaded(response);
+        return RequestDisposition::Completed;
+    }
+
+    m_deferred.fetch_add(1, std::memory_order_relaxed);
+    return RequestDisposition::Deferred;
+}
+
+void HttpServer::Release(DeferredRequest* deferred)
+{
+    // The transport has the response; RunPipeline finishes from here
+    static_cast<PipelineJob*>(deferred)->continuation.resume();
+}
+
+bool HttpServer::ShedIfLate(PipelineJob* job)
+{
+    // Nobody is likely to be waiting for an answer this late; a quick 503
+    // frees the thread for requests that still have a chance
+    if (std::chrono::steady_clock::now() <= job->deadline)
+    {
+        return false;
+    }
+
+    m_shedDeadline.fetch_add(1, std::memory_order_relaxed);
+    WriteOverloaded(job->response);
+    return true;
+}
+
+RequestTask HttpServer::RunPipeline(PipelineJob* job)
+{
+    // Trace scopes are per thread, so none may span a co_await
+    uint64_t trace = job->request.traceId;
+    if (trace)
+    {
+        Trace::Span(trace, "auth queue", job->deadline - m_queueDeadline, std::chrono::steady_clock::now());
+    }
+
+    // Starts on an auth thread, which may block on the provider
+    if (!ShedIfLate(job))
+    {
+        // An admitted request holds its principal's quota until it is answered
+        bool admitted = false;
         {
-            ss << "  " << i << ": " << std::string(pRequest->Headers.KnownHeaders[i].pRawValue, 
-                                                  pRequest->Headers.KnownHeaders[i].RawValueLength) << "\n";
+            TraceScope traceScope(trace);
+            job->auth = HandleAuthentication(job->request);
+            if (job->auth.status != AuthStatus::Success)
+            {
+                WriteResponse(job->request, job->auth, false, job->response);
+            }
+            else
+            {
+                admitted = AcquireQuota(job->request, job->auth, false, job->response);
+            }
         }
+        if (admitted)
+        {
+            std::chrono::steady_clock::time_point queued = trace ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            bool resumed = co_await ResumeOn(*m_handlerStage, job);
+            if (trace)
+            {
+                Trace::Span(trace, "handler queue", queued, std::chrono::steady_clock::now());
+            }
+            if (!resumed)
+            {
+                m_shedFull.fetch_add(1, std::memory_order_relaxed);
+                WriteOverloaded(job->response);
+            }
+            else if (!ShedIfLate(job))
+            {
+                ArenaScope scope;
+                TraceScope traceScope(trace);
+                WriteResponse(job->request, job->auth, false, job->response);
+            }
+            m_quotas->Release(job->auth.principalId);
+        }
+    }
+
+    Metrics::CountStatus(job->response.statusCode);
+    Trace::EndRequest(trace, job->request.received, job->response.statusCode);
+    co_await SendResponse(job->sink, job);
+
+    // Resumed by Release on whichever thread the transport gave the job back
+    job->sink = nullptr;
+    m_freeJobs->TryPush(job);
+}
+
+void HttpServer::WriteOverloaded(HttpResponse& response)
+{
+    response.Reset();
+    response.SetStatus(503, "Service Unavailable");
+    response.AddHeader("Retry-After", m_retryAfter);
+    response.AppendBodyReference("Server busy");
+}
+
+void HttpServer::WriteTrace(HttpResponse& response)
+{
+    // Only stage names, timings and status codes: nothing identifies a client
+    std::string text;
+    Trace::WriteChromeTrace(text);
+    response.contentType = "application/json";
+    response.AppendBody(text);
+}
+
+void HttpServer::WriteMetrics(HttpResponse& response)
+{
+    // Reused per thread; the body is copied into the response
+    thread_local std::string text;
+    text.clear();
+    Metrics::FormatPrometheus(Metrics::Snapshot(), text);
+
+    PipelineStats pipeline = GetPipelineStats();
+    if (pipeline.enabled)
+    {
+        Metrics::AppendSample(text, "pipeline_deferred_total", "counter", "Negotiate requests sent through the stages", pipeline.deferred);
+        Metrics::AppendSample(text, "pipeline_shed_full_total", "counter", "503s for a full stage queue", pipeline.shedFull);
+        Metrics::AppendSample(text, "pipeline_shed_deadline_total", "counter", "503s for requests queued past the deadline", pipeline.shedDeadline);
+        Metrics::AppendSample(text, "auth_queue_depth", "gauge", "Requests waiting for an auth thread", pipeline.auth.depth);
+        Metrics::AppendSample(text, "handler_queue_depth", "gauge", "Requests waiting for a handler thread", pipeline.handler.depth);
+    }
+
+    AuthStats auth = m_kerberosAuth->GetStats();
+    Metrics::AppendSample(text, "auth_legs_total", "counter", "Tokens handed to the provider", auth.legs);
+    Metrics::AppendSample(text, "auth_succeeded_total", "counter", "Provider legs that completed the handshake", auth.succeeded);
+    Metrics::AppendSample(text, "auth_continued_total", "counter", "Provider legs answered with another challenge", auth.continued);
+    Metrics::AppendSample(text, "auth_failed_total", "counter", "Tokens rejected or undecodable", auth.failed);
+    Metrics::AppendSample(text, "auth_slow_lane_shed_total", "counter", "NTLM legs refused for a full slow lane", auth.slowLaneShed);
+    Metrics::AppendSample(text, "native_accepted_total", "counter", "AP-REQs accepted in process", auth.native.accepted);
+    Metrics::AppendSample(text, "native_rejected_total", "counter", "AP-REQs rejected in process", auth.native.rejected);
+    Metrics::AppendSample(text, "pending_handshakes", "gauge", "Handshakes waiting for their next leg", m_kerberosAuth->PendingHandshakes());
+    Metrics::AppendSample(text, "credential_refreshes_total", "counter", "Acceptor credentials re-acquired", auth.credentials.refreshes);
+    Metrics::AppendSample(text, "credential_refresh_failures_total", "counter", "Acceptor credential refreshes that failed", auth.credentials.failures);
+    Metrics::AppendSample(text, "keytab_changes_total", "counter", "Rewritten keytabs picked up", auth.credentials.keytabChanges);
+    if (auth.credentials.expiresInSeconds >= 0)
+    {
+        Metrics::AppendSample(text, "credential_expiry_seconds", "gauge", "Seconds until the earliest acceptor credential expires",
+            static_cast<uint64_t>(auth.credentials.expiresInSeconds));
     }
 
-    // Echo unknown headers
-    for (USHORT i = 0; i < pRequest->Headers.UnknownHeaderCount; i++)
+    TokenCacheStats cache = m_kerberosAuth->GetTokenCacheStats();
+    Metrics::AppendSample(text, "token_cache_hits_total", "counter", "First legs answered from the token cache", cache.hits);
+    Metrics::AppendSample(text, "token_cache_misses_total", "counter", "First legs verified by the provider", cache.misses);
+    Metrics::AppendSample(text, "token_cache_coalesced_total", "counter", "First legs that waited on an identical one", cache.coalesced);
+    Metrics::AppendSample(text, "token_cache_evictions_total", "counter", "Token cache evictions", cache.evictions);
+
+    SessionCookieStats sessions = m_sessionCookies->GetStats();
+    Metrics::AppendSample(text, "session_cookies_issued_total", "counter", "Session cookies issued", sessions.issued);
+    Metrics::AppendSample(text, "session_cookies_accepted_total", "counter", "Requests authenticated by a session cookie", sessions.accepted);
+
+    AdmissionStats admission = m_admission->GetStats();
+    Metrics::AppendSample(text, "admission_admitted_total", "counter", "Negotiate requests admitted to authentication", admission.admitted);
+    Metrics::AppendSample(text, "admission_throttled_total", "counter", "Negotiate requests answered 429 for their client's rate", admission.throttled);
+    Metrics::AppendSample(text, "admission_repeated_total", "counter", "Recently rejected tokens answered 401 untried", admission.repeated);
+    Metrics::AppendSample(text, "admission_rejected_tokens_total", "counter", "Failed tokens remembered for a while", admission.rejected);
+    Metrics::AppendSample(text, "admission_evictions_total", "counter", "Client buckets taken over before they refilled", admission.evicted);
+
+    QuotaStats quotas = m_quotas->GetStats();
+    Metrics::AppendSample(text, "quota_admitted_total", "counter", "Authenticated requests within their principal's quota", quotas.admitted);
+    Metrics::AppendSample(text, "quota_concurrency_total", "counter", "429s for a principal's requests in progress", quotas.overConcurrency);
+    Metrics::AppendSample(text, "quota_rate_total", "counter", "429s for a principal's sliding-window rate", quotas.overRate);
+    Metrics::AppendSample(text, "quota_overflow_total", "counter", "Requests charged to the quota shared by principals without an ID", quotas.overflow);
+
+    if (m_accessPolicy)
     {
-        ss << "  " << std::string(pRequest->Headers.pUnknownHeaders[i].pName,
-                                  pRequest->Headers.pUnknownHeaders[i].NameLength) << ": "
-           << std::string(pRequest->Headers.pUnknownHeaders[i].pRawValue,
-                          pRequest->Headers.pUnknownHeaders[i].RawValueLength) << "\n";
+        AccessPolicyStats authz = m_accessPolicy->GetStats();
+        Metrics::AppendSample(text, "authz_allowed_total", "counter", "Authenticated requests the authorization policy allowed", authz.allowed);
+        Metrics::AppendSample(text, "authz_denied_total", "counter", "Authenticated requests answered 403", authz.denied);
+        Metrics::AppendSample(text, "authz_unknown_total", "counter", "Session requests sent back to Negotiate for their groups", authz.unknown);
     }
 
-    return SendResponse(requestId, pRequest, ss.str());
+    PrincipalTableStats principals = m_principals->GetStats();
+    Metrics::AppendSample(text, "principals_interned", "gauge", "Authenticated principals given an ID", principals.principals);
+    Metrics::AppendSample(text, "principals_refused_total", "counter", "Authentications that found the principal table full", principals.refused);
+
+    Metrics::AppendSample(text, "buffer_pool_cached_bytes", "gauge", "Bytes held by the buffer pool", SlabPool::Buffers().GetStats().cachedBytes);
+
+    TransportStats transport = m_transport->GetStats();
+    Metrics::AppendSample(text, "transport_requests_total", "counter", "Requests parsed by the transport", transport.requests);
+    Metrics::AppendSample(text, "transport_syscalls_total", "counter", "System calls made by the transport", transport.syscalls);
+
+    TraceStats trace = Trace::GetStats();
+    Metrics::AppendSample(text, "trace_requests_total", "counter", "Requests picked for tracing", trace.requests);
+    Metrics::AppendSample(text, "trace_spans_total", "counter", "Trace spans recorded, including overwritten ones", trace.spans);
+
+    TrafficCaptureStats capture = m_capture.GetStats();
+    Metrics::AppendSample(text, "capture_records_total", "counter", "Requests recorded to the traffic capture", capture.records);
+    Metrics::AppendSample(text, "capture_dropped_total", "counter", "Requests the traffic capture fell behind on", capture.dropped);
+
+    LogStats log = Log::GetStats();
+    Metrics::AppendSample(text, "log_written_total", "counter", "Log lines written to the sink", log.written);
+    Metrics::AppendSample(text, "log_dropped_total", "counter", "Log lines lost to a full thread buffer", log.dropped);
+    Metrics::AppendSample(text, "log_suppressed_total", "counter", "Repeated log lines held back by sampling or rate limits", log.suppressed);
+
+    response.contentType = "text/plain; version=0.0.4";
+    response.AppendBody(text);
 }
 
-bool HttpServer::SendResponse(HTTP_REQUEST_ID requestId, PHTTP_REQUEST pRequest, const std::string& responseBody)
+void HttpServer::WriteResponse(const HttpRequest& request, const AuthResult& auth, bool session, HttpResponse& response)
 {
-    HTTP_RESPONSE response;
-    ZeroMemory(&response, sizeof(response));
+    StageTimer timer(MetricStage::Format);
+    if (auth.status == AuthStatus::Overloaded)
+    {
+        WriteOverloaded(response);
+        return;
+    }
+    if (auth.status != AuthStatus::Success)
+    {
+        // Send 401 Unauthorized with WWW-Authenticate header; a handshake that
+        // needs another leg carries the server's token
+        response.SetStatus(401, "Unauthorized");
+        if (auth.status == AuthStatus::ContinueNeeded && !auth.outputToken.empty())
+        {
+            response.AddHeader("WWW-Authenticate", "Negotiate ", auth.outputToken);
+        }
+        else
+        {
+            response.AddHeader("WWW-Authenticate", "Negotiate");
+        }
+        response.AppendBodyReference("Authentication required");
+        return;
+    }
 
-    response.StatusCode = 200;
-    response.pReason = "OK";
-    response.ReasonLength = static_cast<USHORT>(strlen("OK"));
+    // Final leg token for mutual authentication
+    if (!auth.outputToken.empty())
+    {
+        response.AddHeader("WWW-Authenticate", "Negotiate ", auth.outputToken);
+    }
+
+    m_principals->Touch(auth.principalId, request.received);
+    if (m_accessPolicy)
+    {
+        // A session cookie brings the ID alone; the table has the name
+        std::string_view name = auth.principal.empty() ? m_principals->Name(auth.principalId) : std::string_view(auth.principal);
+        AccessDecision decision = m_accessPolicy->Authorize(auth.principalId, name, session ? nullptr : &auth.sids,
+            request.path, request.received);
+        if (decision == AccessDecision::Unknown)
+        {
+            response.SetStatus(401, "Unauthorized");
+            response.AddHeader("WWW-Authenticate", "Negotiate");
+            response.AppendBodyReference("Authentication required");
+            return;
+        }
+        if (decision == AccessDecision::Deny)
+        {
+            response.SetStatus(403, "Forbidden");
+            response.AppendBodyReference("Forbidden");
+            return;
+        }
+    }
 
-    // Set content type
-    response.Headers.KnownHeaders[HttpHeaderContentType].pRawValue = "text/plain";
-    response.Headers.KnownHeaders[HttpHeaderContentType].RawValueLength = static_cast<USHORT>(strlen("text/plain"));
+    if (!session)
+    {
+        std::string cookie = m_sessionCookies->Issue(auth.principal, auth.principalId, m_principals->Epoch());
+        if (!cookie.empty())
+        {
+            response.AddHeader("Set-Cookie", cookie);
+        }
+    }
 
-    // Set content length
-    std::string contentLength = std::to_string(responseBody.length());
-    response.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue = contentLength.c_str();
-    response.Headers.KnownHeaders[HttpHeaderContentLength].RawValueLength = static_cast<USHORT>(contentLength.length());
+    WriteEchoResponse(request, response);
+}
 
-    // Set response body
-    HTTP_DATA_CHUNK dataChunk;
-    dataChunk.DataChunkType = HttpDataChunkFromMemory;
-    dataChunk.FromMemory.pBuffer = const_cast<char*>(responseBody.c_str());
-    dataChunk.FromMemory.BufferLength = static_cast<ULONG>(responseBody.length());
+bool HttpServer::Admit(const HttpRequest& request, std::string_view authorization, HttpResponse& response)
+{
+    std::string_view token = authorization.length() > 10 ? authorization.substr(10) : std::string_view();
+    Admission admission = m_admission->Admit(request.clientAddress, token, request.received);
+    if (admission == Admission::Admit)
+    {
+        return true;
+    }
 
-    response.EntityChunkCount = 1;
-    response.pEntityChunks = &dataChunk;
+    // Answered from literals: a flood of these costs no allocation
+    if (admission == Admission::Throttle)
+    {
+        // The bucket gains at least a token a second
+        response.SetStatus(429, "Too Many Requests");
+        response.AddHeader("Retry-After", "1");
+        response.AppendBodyReference("Too many authentication attempts");
+    }
+    else
+    {
+        response.SetStatus(401, "Unauthorized");
+        response.AddHeader("WWW-Authenticate", "Negotiate");
+        response.AppendBodyReference("Authentication required");
+    }
+    return false;
+}
 
-    DWORD bytesSent;
-    ULONG result = HttpSendHttpResponse(m_hReqQueue, requestId, 0, &response, nullptr, &bytesSent, nullptr, 0, nullptr, nullptr);
+bool HttpServer::AcquireQuota(const HttpRequest& request, const AuthResult& auth, bool session, HttpResponse& response)
+{
+    QuotaDecision decision = m_quotas->Acquire(auth.principalId, session ? nullptr : &auth.sids, request.received);
+    if (decision == QuotaDecision::Admit)
+    {
+        return true;
+    }
 
-    return result == NO_ERROR;
+    // A request in progress ends, or the window slides, within about a second
+    // for any quota worth setting
+    response.SetStatus(429, "Too Many Requests");
+    response.AddHeader("Retry-After", "1");
+    if (!session && !auth.outputToken.empty())
+    {
+        response.AddHeader("WWW-Authenticate", "Negotiate ", auth.outputToken);
+    }
+    response.AppendBodyReference(decision == QuotaDecision::Concurrency ? "Too many requests in progress" : "Request quota exceeded");
+    return false;
 }
 
-bool HttpServer::HandleAuthentication(PHTTP_REQUEST pRequest)
+AuthResult HttpServer::HandleAuthentication(const HttpRequest& request)
 {
     // Look for Authorization header
-    if (!pRequest->Headers.KnownHeaders[HttpHeaderAuthorization].pRawValue)
+    std::string_view authHeader = request.FindHeader("Authorization");
+    if (authHeader.empty())
     {
-        return false; // No authorization header
+        return AuthResult(); // No authorization header
     }
 
-    std::string authHeader(
-        pRequest->Headers.KnownHeaders[HttpHeaderAuthorization].pRawValue,
-        pRequest->Headers.KnownHeaders[HttpHeaderAuthorization].RawValueLength
-    );
-
     // Check if it's Negotiate authentication
     if (authHeader.substr(0, 9) != "Negotiate")
     {
-        return false;
+        return AuthResult();
     }
 
-    // Extract the token
-    std::string token;
+    // Extract the token; it stays a view into the request
+    std::string_view token;
     if (authHeader.length() > 10)
     {
         token = authHeader.substr(10); // Skip "Negotiate "
     }
 
     // Authenticate with Kerberos
-    return m_kerberosAuth->AuthenticateToken(token);
+    AuthResult result = m_kerberosAuth->AuthenticateToken(request.connectionId, token);
+    if (result.status == AuthStatus::Success)
+    {
+        result.principalId = m_principals->Intern(result.principal);
+    }
+    else if (result.badToken)
+    {
+        m_admission->Reject(token, request.received);
+    }
+    return result;
+}
+
+bool HttpServer::AuthenticateSession(const HttpRequest& request, AuthResult& result)
+{
+    // A client that sends Negotiate is (re)authenticating; honour that
+    if (!m_sessionCookies->Enabled() || !request.FindHeader("Authorization").empty())
+    {
+        return false;
+    }
+
+    std::string_view cookieHeader = request.FindHeader("Cookie");
+    if (cookieHeader.empty() ||
+        !m_sessionCookies->Verify(cookieHeader, m_principals->Epoch(), result.principalId, result.principal))
+    {
+        return false;
+    }
+
+    // Only a cookie issued while the table was full comes back with the name
+    if (result.principalId == PrincipalTable::NO_PRINCIPAL)
+    {
+        result.principalId = m_principals->Intern(result.principal);
+    }
+    result.status = AuthStatus::Success;
+    return true;
 }
\ No newline at end of file
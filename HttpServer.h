@@ -1,18 +1,50 @@
 #pragma once
 
-#include <windows.h>
-#include <http.h>
 #include <string>
 #include <memory>
-#include <thread>
 #include <atomic>
+#include <chrono>
+#include <vector>
+#include "ServerConfig.h"
+#include "RequestTask.h"
+#include "SharedMetrics.h"
+#include "StagePool.h"
+#include "TrafficTrace.h"
+#include "Transport.h"
 
+class AccessPolicy;
+class AdmissionControl;
 class KerberosAuth;
+class PrincipalQuotas;
+class PrincipalTable;
+class SessionCookies;
+struct AuthResult;
+struct PipelineJob;
 
-class HttpServer
+struct PipelineStats
+{
+    bool enabled = false;
+    StageStats auth;
+    StageStats handler;
+    size_t authThreads = 0;
+    size_t handlerThreads = 0;
+    uint64_t deferred = 0;      // requests sent through the stages
+    uint64_t shedFull = 0;      // answered 503 because a stage queue was full
+    uint64_t shedDeadline = 0;  // answered 503 because they waited past the queue deadline
+};
+
+// Request handling; the network side is a Transport chosen from the
+// configuration. A request is routed (the metrics and trace paths answer
+// without credentials), admitted (AdmissionControl, before any token is
+// decoded), authenticated (a session cookie on the transport's thread, a
+// Negotiate token on the auth stage), held to its principal's quota
+// (PrincipalQuotas), authorized (AccessPolicy) and answered by the handler
+// stage. Each step's rules are documented with its component; refusals are
+// 429, 401, 403 or, when a stage is overloaded, 503 with Retry-After.
+class HttpServer : public RequestHandler
 {
 public:
-    HttpServer(int port);
+    explicit HttpServer(const ServerConfig& config);
     ~HttpServer();
 
     bool Initialize();
@@ -21,19 +53,63 @@ public:
     void Pause();
     void Resume();
 
+    void ProcessRequest(const HttpRequest& request, HttpResponse& response) override;
+    RequestDisposition SubmitRequest(const HttpRequest& request, HttpResponse& response, ResponseSink* sink, uint64_t tag) override;
+    void Release(DeferredRequest* deferred) override;
+
+    PipelineStats GetPipelineStats() const;
+
+    // Re-reads the limits file and applies it, admission limits and quotas;
+    // false, keeping the limits in force, when it has an error or the quotas
+    // were reloaded too often to take another yet
+    bool ReloadLimits();
+
 private:
-    void WorkerThread();
-    bool ProcessRequest(HTTP_REQUEST_ID requestId, PHTTP_REQUEST pRequest);
-    bool SendResponse(HTTP_REQUEST_ID requestId, PHTTP_REQUEST pRequest, const std::string& responseBody);
-    bool HandleAuthentication(PHTTP_REQUEST pRequest);
+    RequestDisposition Route(const HttpRequest& request, HttpResponse& response, ResponseSink* sink, uint64_t tag);
+    void WriteMetrics(HttpResponse& response);
+    void WriteTrace(HttpResponse& response);
+    bool Admit(const HttpRequest& request, std::string_view authorization, HttpResponse& response);
+    bool AcquireQuota(const HttpRequest& request, const AuthResult& auth, bool session, HttpResponse& response);
+    AuthResult HandleAuthentication(const HttpRequest& request);
+    bool AuthenticateSession(const HttpRequest& request, AuthResult& result);
+    void WriteResponse(const HttpRequest& request, const AuthResult& auth, bool session, HttpResponse& response);
+    void WriteOverloaded(HttpResponse& response);
 
-    int m_port;
-    HANDLE m_hReqQueue;
+    void CreatePipeline();
+    RequestTask RunPipeline(PipelineJob* job);
+    bool ShedIfLate(PipelineJob* job);
+
+    ServerConfig m_config;
     std::unique_ptr<KerberosAuth> m_kerberosAuth;
-    std::thread m_workerThread;
+    std::unique_ptr<SessionCookies> m_sessionCookies;
+    std::unique_ptr<AdmissionControl> m_admission;
+    std::unique_ptr<PrincipalTable> m_principals;
+    std::unique_ptr<PrincipalQuotas> m_quotas;
+    std::unique_ptr<AccessPolicy> m_accessPolicy;       // null = any authenticated principal may request any path
+
+    // Declared before the transport, which can still hand jobs back while it stops
+    std::vector<std::unique_ptr<PipelineJob>> m_jobs;
+    std::unique_ptr<StageQueue<PipelineJob*>> m_freeJobs;
+    std::unique_ptr<StagePool> m_authStage;
+    std::unique_ptr<StagePool> m_handlerStage;
+    std::atomic<bool> m_pipelineOpen;
+    std::chrono::milliseconds m_queueDeadline;
+    std::string m_retryAfter;
+    std::atomic<uint64_t> m_deferred;
+    std::atomic<uint64_t> m_shedFull;
+    std::atomic<uint64_t> m_shedDeadline;
+
+    std::string m_metricsPath;      // empty = not served
+    std::string m_tracePath;        // empty = not served, or tracing is off
+    SharedMetrics m_sharedMetrics;
+    TrafficCapture m_capture;
+
+    std::unique_ptr<Transport> m_transport;
     std::atomic<bool> m_running;
-    std::atomic<bool> m_paused;
     
+    static constexpr size_t ADMISSION_CLIENTS = 262144;        // client buckets, 16 bytes each
+    static constexpr size_t ADMISSION_REJECTED_TOKENS = 65536; // rejected-token digests, 8 bytes each
+
     static const std::string UNAUTHORIZED_RESPONSE;
     static const std::string SERVER_ERROR_RESPONSE;
 };
\ No newline at end of file
@@ -0,0 +1,561 @@
+#include "HttpSysTransport.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "SlabPool.h"
+#include "Trace.h"
+#include <charconv>
+
+#pragma comment(lib, "httpapi.lib")
+
+namespace
+{
+    // Fails once per request while the queue is in trouble
+    LogLimiter g_receiveFailureLog;
+
+    // Names for HTTP_HEADER_ID request header slots, in enum order
+    const char* const KNOWN_HEADER_NAMES[HttpHeaderRequestMaximum] =
+    {
+        "Cache-Control", "Connection", "Date", "Keep-Alive", "Pragma", "Trailer",
+        "Transfer-Encoding", "Upgrade", "Via", "Warning", "Allow", "Content-Length",
+        "Content-Type", "Content-Encoding", "Content-Language", "Content-Location",
+        "Content-MD5", "Content-Range", "Expires", "Last-Modified", "Accept",
+        "Accept-Charset", "Accept-Encoding", "Accept-Language", "Authorization",
+        "Cookie", "Expect", "From", "Host", "If-Match", "If-Modified-Since",
+        "If-None-Match", "If-Range", "If-Unmodified-Since", "Max-Forwards",
+        "Proxy-Authorization", "Referer", "Range", "TE", "Translate", "User-Agent"
+    };
+
+    std::string_view VerbName(PHTTP_REQUEST pRequest)
+    {
+        switch (pRequest->Verb)
+        {
+        case HttpVerbOPTIONS: return "OPTIONS";
+        case HttpVerbGET: return "GET";
+        case HttpVerbHEAD: return "HEAD";
+        case HttpVerbPOST: return "POST";
+        case HttpVerbPUT: return "PUT";
+        case HttpVerbDELETE: return "DELETE";
+        case HttpVerbTRACE: return "TRACE";
+        case HttpVerbCONNECT: return "CONNECT";
+        default: break;
+        }
+
+        if (pRequest->pUnknownVerb)
+        {
+            return std::string_view(pRequest->pUnknownVerb, pRequest->UnknownVerbLength);
+        }
+        return "OTHER";
+    }
+
+    // Converts into a reused buffer so steady-state requests do not allocate
+    void WideToUtf8(PCWSTR source, USHORT byteLength, std::string& target)
+    {
+        int length = byteLength / sizeof(WCHAR);
+        if (!source || length == 0)
+        {
+            target.clear();
+            return;
+        }
+
+        int needed = WideCharToMultiByte(CP_UTF8, 0, source, length, nullptr, 0, nullptr, nullptr);
+        target.resize(needed);
+        WideCharToMultiByte(CP_UTF8, 0, source, length, &target[0], needed, nullptr, nullptr);
+    }
+}
+
+HttpSysTransport::HttpSysTransport(const ServerConfig& config)
+    : m_port(config.port)
+    , m_hReqQueue(nullptr)
+    , m_httpInitialized(false)
+    , m_handler(nullptr)
+    , m_workerPool(config.workerThreads)
+    , m_running(false)
+    , m_paused(false)
+{
+}
+
+HttpSysTransport::~HttpSysTransport()
+{
+    Stop();
+}
+
+bool HttpSysTransport::Initialize()
+{
+    // Initialize HTTP Server API
+    ULONG result = HttpInitialize(HTTPAPI_VERSION_2, HTTP_INITIALIZE_SERVER, nullptr);
+    if (result != NO_ERROR)
+    {
+        Log::Write(LogLevel::Error) << L"HttpInitialize failed with error: " << result;
+        return false;
+    }
+    m_httpInitialized = true;
+
+    // Create request queue
+    result = HttpCreateHttpHandle(&m_hReqQueue, 0);
+    if (result != NO_ERROR)
+    {
+        Log::Write(LogLevel::Error) << L"HttpCreateHttpHandle failed with error: " << result;
+        m_hReqQueue = nullptr;
+        return false;
+    }
+
+    // Create URL
+    std::wstring url = L"http://+:" + std::to_wstring(m_port) + L"/";
+
+    // Add URL to queue
+    result = HttpAddUrl(m_hReqQueue, url.c_str(), nullptr);
+    if (result != NO_ERROR)
+    {
+        Log::Write(LogLevel::Error) << L"HttpAddUrl failed with error: " << result;
+        Log::Write(LogLevel::Error) << L"Make sure to run as Administrator or reserve the URL with: netsh http add urlacl url="
+                                    << url << L" user=Everyone";
+        return false;
+    }
+
+    // Route queue completions to the worker pool
+    if (!m_workerPool.Initialize() || !m_workerPool.Associate(m_hReqQueue))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_workerPool.ThreadCount(); i++)
+    {
+        auto context = std::make_unique<ReceiveContext>();
+        context->bufferSize = REQUEST_BUFFER_SIZE;
+        context->buffer.reset(new BYTE[REQUEST_BUFFER_SIZE]);
+        context->headers.reserve(HttpHeaderRequestMaximum + 16);
+        context->chunks.reserve(HTTP_RESPONSE_CHUNKS);
+        context->response.Reserve();
+        m_receiveContexts.push_back(std::move(context));
+    }
+
+    return true;
+}
+
+bool HttpSysTransport::Start(RequestHandler* handler)
+{
+    m_handler = handler;
+    m_running = true;
+    m_paused = false;
+    m_workerPool.Start([this](size_t workerIndex, const IoCompletion& completion)
+    {
+        OnCompletion(workerIndex, completion);
+    });
+
+    for (auto& context : m_receiveContexts)
+    {
+        PostReceive(context.get());
+    }
+
+    Log::Write(LogLevel::Info) << L"HTTP.sys transport listening on port " << m_port
+                               << L" with " << m_workerPool.ThreadCount() << L" worker threads";
+    return true;
+}
+
+void HttpSysTransport::Stop()
+{
+    if (m_running.exchange(false))
+    {
+        // Completions no longer re-arm their receive. Cancel the receives that are
+        // still pending and let in-flight requests finish sending; repeat the cancel
+        // in case a worker re-armed just before it saw the flag change.
+        const ULONGLONG deadline = GetTickCount64() + STOP_DRAIN_TIMEOUT_MS;
+        do
+        {
+            CancelIoEx(m_hReqQueue, nullptr);
+        } while (!m_workerPool.WaitForDrain(100) && GetTickCount64() < deadline);
+
+        if (m_workerPool.InFlight() != 0)
+        {
+            Log::Write(LogLevel::Warning) << L"Stopping with " << m_workerPool.InFlight() << L" requests still in flight";
+        }
+
+        m_workerPool.Stop();
+    }
+
+    if (m_hReqQueue)
+    {
+        CloseHandle(m_hReqQueue);
+        m_hReqQueue = nullptr;
+    }
+
+    if (m_httpInitialized)
+    {
+        HttpTerminate(HTTP_INITIALIZE_SERVER, nullptr);
+        m_httpInitialized = false;
+    }
+}
+
+void HttpSysTransport::Pause()
+{
+    m_paused = true;
+}
+
+void HttpSysTransport::Resume()
+{
+    std::vector<ReceiveContext*> parked;
+    {
+        std::lock_guard<std::mutex> lock(m_parkedMutex);
+        m_paused = false;
+        parked.swap(m_parkedReceives);
+    }
+
+    for (ReceiveContext* context : parked)
+    {
+        PostReceive(context);
+    }
+}
+
+bool HttpSysTransport::PostReceive(ReceiveContext* context)
+{
+    context->Reset();
+    m_workerPool.BeginOperation();
+
+    ULONG result = HttpReceiveHttpRequest(
+        m_hReqQueue,
+        HTTP_NULL_ID,
+        0,
+        reinterpret_cast<PHTTP_REQUEST>(context->buffer.get()),
+        context->bufferSize,
+        nullptr,
+        &context->overlapped
+    );
+
+    // Anything other than these means no completion packet will be queued
+    if (result != ERROR_IO_PENDING && result != NO_ERROR && result != ERROR_MORE_DATA)
+    {
+        m_workerPool.EndOperation();
+        if (m_running)
+        {
+            Log::Write(LogLevel::Warning, g_receiveFailureLog) << L"HttpReceiveHttpRequest failed with error: " << result;
+        }
+        return false;
+    }
+    return true;
+}
+
+void HttpSysTransport::OnCompletion(size_t workerIndex, const IoCompletion& completion)
+{
+    ReceiveContext* context = static_cast<ReceiveContext*>(completion.operation);
+    PHTTP_REQUEST pRequest = reinterpret_cast<PHTTP_REQUEST>(context->buffer.get());
+
+    if (completion.status == NO_ERROR)
+    {
+        DispatchRequest(context, pRequest);
+    }
+    else if (completion.status == ERROR_MORE_DATA)
+    {
+        // The head did not fit; receive the same request again into a larger buffer
+        if (ReceiveLargeRequest(context, completion.bytesTransferred))
+        {
+            DispatchRequest(context, reinterpret_cast<PHTTP_REQUEST>(context->largeRequest));
+        }
+        SlabPool::Buffers().Release(context->largeRequest);
+        context->largeRequest = nullptr;
+    }
+    else if (completion.status != ERROR_OPERATION_ABORTED && completion.status != ERROR_CONNECTION_INVALID)
+    {
+        Log::Write(LogLevel::Warning, g_receiveFailureLog) << L"HttpReceiveHttpRequest failed with error: " << completion.status;
+    }
+
+    // Re-arm before releasing this operation so the in-flight count only reaches
+    // zero once the queue is really idle
+    if (m_running)
+    {
+        std::unique_lock<std::mutex> lock(m_parkedMutex);
+        if (m_paused)
+        {
+            m_parkedReceives.push_back(context);
+        }
+        else
+        {
+            lock.unlock();
+            PostReceive(context);
+        }
+    }
+
+    m_workerPool.EndOperation();
+}
+
+bool HttpSysTransport::ReceiveLargeRequest(ReceiveContext* context, DWORD requiredSize)
+{
+    // Only the request id is valid in a buffer that came back with ERROR_MORE_DATA
+    HTTP_REQUEST_ID requestId = reinterpret_cast<PHTTP_REQUEST>(context->buffer.get())->RequestId;
+    if (requiredSize > MAX_REQUEST_BUFFER_SIZE)
+    {
+        context->response.Reset();
+        context->response.SetStatus(431, "Request Header Fields Too Large");
+        context->response.AppendBodyReference("Request Header Fields Too Large");
+        context->response.closeConnection = true;
+        SendResponse(context->response, context->chunks, nullptr, requestId, true, false);
+        return false;
+    }
+
+    context->largeRequest = static_cast<BYTE*>(SlabPool::Buffers().Acquire(requiredSize));
+
+    ULONG bytesReceived = 0;
+    ULONG result = HttpReceiveHttpRequest(
+        m_hReqQueue,
+        requestId,
+        0,
+        reinterpret_cast<PHTTP_REQUEST>(context->largeRequest),
+        requiredSize,
+        &bytesReceived,
+        nullptr
+    );
+    if (result != NO_ERROR)
+    {
+        Log::Write(LogLevel::Warning, g_receiveFailureLog) << L"HttpReceiveHttpRequest failed with error: " << result;
+        HttpCancelHttpRequest(m_hReqQueue, requestId, nullptr);
+        return false;
+    }
+    return true;
+}
+
+void HttpSysTransport::DispatchRequest(ReceiveContext* context, PHTTP_REQUEST pRequest)
+{
+    // HTTP.sys hands over whole requests, so the receive stage here is the
+    // conversion and any body read
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+    Metrics::Count(MetricCounter::BytesReceived, pRequest->BytesReceived);
+
+    HttpRequest request;
+    request.methodName = VerbName(pRequest);
+    request.method = ParseHttpMethod(request.methodName);
+    request.connectionId = pRequest->ConnectionId;
+    request.clientAddress = ClientAddressKey(pRequest->Address.pRemoteAddress);
+    request.received = received;
+    request.traceId = Trace::BeginRequest();
+
+    WideToUtf8(pRequest->CookedUrl.pAbsPath, pRequest->CookedUrl.AbsPathLength, context->path);
+    request.path = context->path;
+
+    // The cooked query string keeps its leading '?'
+    WideToUtf8(pRequest->CookedUrl.pQueryString, pRequest->CookedUrl.QueryStringLength, context->query);
+    request.query = context->query;
+    if (!request.query.empty() && request.query.front() == '?')
+    {
+        request.query.remove_prefix(1);
+    }
+
+    context->headers.clear();
+    for (int i = 0; i < HttpHeaderRequestMaximum; i++)
+    {
+        const HTTP_KNOWN_HEADER& header = pRequest->Headers.KnownHeaders[i];
+        if (header.pRawValue)
+        {
+            context->headers.push_back(HttpHeader{ KNOWN_HEADER_NAMES[i], std::string_view(header.pRawValue, header.RawValueLength) });
+        }
+    }
+    for (USHORT i = 0; i < pRequest->Headers.UnknownHeaderCount; i++)
+    {
+        const HTTP_UNKNOWN_HEADER& header = pRequest->Headers.pUnknownHeaders[i];
+        context->headers.push_back(HttpHeader{
+            std::string_view(header.pName, header.NameLength),
+            std::string_view(header.pRawValue, header.RawValueLength) });
+    }
+    request.headers = context->headers.data();
+    request.headerCount = context->headers.size();
+
+    std::string_view contentLength = request.FindHeader("Content-Length");
+    std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), request.contentLength);
+
+    // A body that fits the body buffer reaches the handler whole; a larger or
+    // chunked one is left in HTTP.sys and relayed after the response head
+    if (pRequest->Flags & HTTP_REQUEST_FLAG_MORE_ENTITY_BODY_EXISTS)
+    {
+        context->bodyBuffer = static_cast<BYTE*>(SlabPool::Buffers().Acquire(BODY_BUFFER_SIZE));
+        ULONG length = 0;
+        if (request.contentLength == 0 || request.contentLength > BODY_BUFFER_SIZE)
+        {
+            request.bodyStreamed = true;
+        }
+        else if (ReadEntityBody(context, pRequest->RequestId, length))
+        {
+            request.body = std::string_view(reinterpret_cast<const char*>(context->bodyBuffer), length);
+        }
+        else
+        {
+            HttpCancelHttpRequest(m_hReqQueue, pRequest->RequestId, nullptr);
+            SlabPool::Buffers().Release(context->bodyBuffer);
+            context->bodyBuffer = nullptr;
+            return;
+        }
+    }
+
+    // A deferred request took a copy, so the receive is re-armed right away
+    // and the response is sent from Complete; it counts as in flight until then
+    context->response.Reset();
+    m_workerPool.BeginOperation();
+    TraceScope trace(request.traceId);
+    Metrics::Record(MetricStage::Receive, received, std::chrono::steady_clock::now());
+    if (m_handler->SubmitRequest(request, context->response, this, pRequest->RequestId) == RequestDisposition::Completed)
+    {
+        bool includeBody = request.method != HttpMethod::Head;
+        bool relayBody = request.bodyStreamed && context->response.relayRequestBody && includeBody;
+        SendResponse(context->response, context->chunks, context->bodyBuffer, pRequest->RequestId, includeBody, relayBody);
+        m_workerPool.EndOperation();
+    }
+
+    SlabPool::Buffers().Release(context->bodyBuffer);
+    context->bodyBuffer = nullptr;
+}
+
+void HttpSysTransport::Complete(DeferredRequest* deferred)
+{
+    thread_local std::vector<HTTP_DATA_CHUNK> chunks;
+
+    const HttpRequest& request = deferred->request;
+    bool includeBody = request.method != HttpMethod::Head;
+    bool relayBody = request.bodyStreamed && deferred->response.relayRequestBody && includeBody;
+    BYTE* bodyBuffer = relayBody ? static_cast<BYTE*>(SlabPool::Buffers().Acquire(BODY_BUFFER_SIZE)) : nullptr;
+    {
+        TraceScope trace(request.traceId);
+        SendResponse(deferred->response, chunks, bodyBuffer, deferred->tag, includeBody, relayBody);
+    }
+
+    SlabPool::Buffers().Release(bodyBuffer);
+    m_handler->Release(deferred);
+    m_workerPool.EndOperation();
+}
+
+bool HttpSysTransport::ReadEntityBody(ReceiveContext* context, HTTP_REQUEST_ID requestId, ULONG& length)
+{
+    length = 0;
+    while (length < BODY_BUFFER_SIZE)
+    {
+        ULONG received = 0;
+        ULONG result = HttpReceiveRequestEntityBody(m_hReqQueue, requestId, 0,
+            context->bodyBuffer + length, BODY_BUFFER_SIZE - length, &received, nullptr);
+        if (result == ERROR_HANDLE_EOF)
+        {
+            return true;
+        }
+        if (result != NO_ERROR)
+        {
+            return false;
+        }
+        length += received;
+    }
+    return true;
+}
+
+bool HttpSysTransport::SendResponse(const HttpResponse& source, std::vector<HTTP_DATA_CHUNK>& chunks, BYTE* bodyBuffer,
+    HTTP_REQUEST_ID requestId, bool includeBody, bool relayBody)
+{
+    StageTimer timer(MetricStage::Send);
+    HTTP_RESPONSE response;
+    ZeroMemory(&response, sizeof(response));
+
+    response.StatusCode = static_cast<USHORT>(source.statusCode);
+    response.pReason = source.reason.data();
+    response.ReasonLength = static_cast<USHORT>(source.reason.size());
+
+    // Set content type
+    response.Headers.KnownHeaders[HttpHeaderContentType].pRawValue = source.contentType.data();
+    response.Headers.KnownHeaders[HttpHeaderContentType].RawValueLength = static_cast<USHORT>(source.contentType.size());
+
+    // Set content length; a relayed body has none, so HTTP.sys sends it chunked
+    char contentLength[24];
+    if (!relayBody)
+    {
+        auto converted = std::to_chars(contentLength, contentLength + sizeof(contentLength), source.BodyLength());
+        response.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue = contentLength;
+        response.Headers.KnownHeaders[HttpHeaderContentLength].RawValueLength = static_cast<USHORT>(converted.ptr - contentLength);
+    }
+
+    // Everything else goes out as unknown headers
+    HTTP_UNKNOWN_HEADER unknownHeaders[MAX_RESPONSE_HEADERS];
+    USHORT headerCount = 0;
+    for (size_t i = 0; i < source.HeaderCount() && headerCount < MAX_RESPONSE_HEADERS; i++)
+    {
+        std::string_view name = source.HeaderName(i);
+        std::string_view value = source.HeaderValue(i);
+        unknownHeaders[headerCount].pName = name.data();
+        unknownHeaders[headerCount].NameLength = static_cast<USHORT>(name.size());
+        unknownHeaders[headerCount].pRawValue = value.data();
+        unknownHeaders[headerCount].RawValueLength = static_cast<USHORT>(value.size());
+        headerCount++;
+    }
+    response.Headers.pUnknownHeaders = unknownHeaders;
+    response.Headers.UnknownHeaderCount = headerCount;
+
+    // One data chunk per body chunk; referenced request bytes are still in
+    // the receive context's buffer, which is not re-posted until the send
+    // returns, or in the deferred request's copy
+    chunks.clear();
+    if (includeBody)
+    {
+        for (size_t i = 0; i < source.BodyChunkCount(); i++)
+        {
+            std::string_view text = source.BodyChunk(i);
+            HTTP_DATA_CHUNK chunk;
+            chunk.DataChunkType = HttpDataChunkFromMemory;
+            chunk.FromMemory.pBuffer = const_cast<char*>(text.data());
+            chunk.FromMemory.BufferLength = static_cast<ULONG>(text.size());
+            chunks.push_back(chunk);
+        }
+        response.EntityChunkCount = static_cast<USHORT>(chunks.size());
+        response.pEntityChunks = chunks.empty() ? nullptr : chunks.data();
+    }
+
+    ULONG flags = source.closeConnection ? HTTP_SEND_RESPONSE_FLAG_DISCONNECT : 0;
+    if (relayBody)
+    {
+        flags = HTTP_SEND_RESPONSE_FLAG_MORE_DATA;
+    }
+    DWORD bytesSent;
+    ULONG result = HttpSendHttpResponse(m_hReqQueue, requestId, flags, &response, nullptr, &bytesSent, nullptr, 0, nullptr, nullptr);
+    if (result != NO_ERROR)
+    {
+        return false;
+    }
+    Metrics::Count(MetricCounter::BytesSent, bytesSent);
+
+    return !relayBody || RelayEntityBody(bodyBuffer, requestId, source.closeConnection);
+}
+
+bool HttpSysTransport::RelayEntityBody(BYTE* bodyBuffer, HTTP_REQUEST_ID requestId, bool disconnect)
+{
+    // One body buffer in flight at a time: each piece is sent before the next
+    // is received, so memory per request stays at BODY_BUFFER_SIZE
+    for (;;)
+    {
+        ULONG received = 0;
+        ULONG result = HttpReceiveRequestEntityBody(m_hReqQueue, requestId, 0,
+            bodyBuffer, BODY_BUFFER_SIZE, &received, nullptr);
+        if (result == ERROR_HANDLE_EOF)
+        {
+            break;
+        }
+        if (result != NO_ERROR)
+        {
+            HttpCancelHttpRequest(m_hReqQueue, requestId, nullptr);
+            return false;
+        }
+        if (received == 0)
+        {
+            continue;
+        }
+
+        HTTP_DATA_CHUNK chunk;
+        chunk.DataChunkType = HttpDataChunkFromMemory;
+        chunk.FromMemory.pBuffer = bodyBuffer;
+        chunk.FromMemory.BufferLength = received;
+        ULONG bytesSent;
+        result = HttpSendResponseEntityBody(m_hReqQueue, requestId, HTTP_SEND_RESPONSE_FLAG_MORE_DATA,
+            1, &chunk, &bytesSent, nullptr, 0, nullptr, nullptr);
+        if (result != NO_ERROR)
+        {
+            HttpCancelHttpRequest(m_hReqQueue, requestId, nullptr);
+            return false;
+        }
+        Metrics::Count(MetricCounter::BytesSent, bytesSent);
+    }
+
+    // The final call carries no data and ends the chunked body
+    ULONG flags = disconnect ? HTTP_SEND_RESPONSE_FLAG_DISCONNECT : 0;
+    ULONG bytesSent;
+    ULONG result = HttpSendResponseEntityBody(m_hReqQueue, requestId, flags, 0, nullptr, &bytesSent, nullptr, 0, nullptr, nullptr);
+    return result == NO_ERROR;
+}
\ No newline at end of file
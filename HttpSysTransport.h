@@ -0,0 +1,75 @@
+#pragma once
+
+#include <windows.h>
+#include <http.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include "Transport.h"
+#include "WorkerPool.h"
+
+// HTTP.sys request queue drained by a completion-port worker pool. Deferred
+// responses are sent from the handler thread that completes them, since
+// HTTP.sys takes a response for any request id from any thread.
+class HttpSysTransport : public Transport, public ResponseSink
+{
+public:
+    explicit HttpSysTransport(const ServerConfig& config);
+    ~HttpSysTransport() override;
+
+    bool Initialize() override;
+    bool Start(RequestHandler* handler) override;
+    void Stop() override;
+    void Pause() override;
+    void Resume() override;
+    const wchar_t* Name() const override { return L"httpsys"; }
+
+    void Complete(DeferredRequest* deferred) override;
+
+private:
+    // One overlapped receive per worker; each owns its request buffer and
+    // the scratch space used to present the request to the handler. Heads
+    // larger than the buffer (up to MAX_REQUEST_BUFFER_SIZE) and request
+    // bodies are read into blocks borrowed from SlabPool::Buffers() for the
+    // duration of one request.
+    struct ReceiveContext : IoOperation
+    {
+        std::unique_ptr<BYTE[]> buffer;
+        DWORD bufferSize;
+        BYTE* largeRequest = nullptr;
+        BYTE* bodyBuffer = nullptr;
+        std::vector<HttpHeader> headers;
+        std::string path;
+        std::string query;
+        HttpResponse response;
+        std::vector<HTTP_DATA_CHUNK> chunks;
+    };
+
+    bool PostReceive(ReceiveContext* context);
+    void OnCompletion(size_t workerIndex, const IoCompletion& completion);
+    bool ReceiveLargeRequest(ReceiveContext* context, DWORD requiredSize);
+    void DispatchRequest(ReceiveContext* context, PHTTP_REQUEST pRequest);
+    bool ReadEntityBody(ReceiveContext* context, HTTP_REQUEST_ID requestId, ULONG& length);
+    bool SendResponse(const HttpResponse& source, std::vector<HTTP_DATA_CHUNK>& chunks, BYTE* bodyBuffer,
+        HTTP_REQUEST_ID requestId, bool includeBody, bool relayBody);
+    bool RelayEntityBody(BYTE* bodyBuffer, HTTP_REQUEST_ID requestId, bool disconnect);
+
+    int m_port;
+    HANDLE m_hReqQueue;
+    bool m_httpInitialized;
+    RequestHandler* m_handler;
+    WorkerPool m_workerPool;
+    std::vector<std::unique_ptr<ReceiveContext>> m_receiveContexts;
+    std::mutex m_parkedMutex;
+    std::vector<ReceiveContext*> m_parkedReceives;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_paused;
+
+    static constexpr DWORD REQUEST_BUFFER_SIZE = sizeof(HTTP_REQUEST) + 2048;
+    static constexpr DWORD MAX_REQUEST_BUFFER_SIZE = sizeof(HTTP_REQUEST) + 65536;
+    static constexpr ULONG BODY_BUFFER_SIZE = 64 * 1024;   // largest body given to the handler whole; the relay chunk size
+    static constexpr DWORD STOP_DRAIN_TIMEOUT_MS = 5000;
+    static constexpr size_t MAX_RESPONSE_HEADERS = 8;
+};
\ No newline at end of file
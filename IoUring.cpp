@@ -0,0 +1,190 @@
+#include "IoUring.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+IoUring::IoUring()
+    : m_fd(-1)
+    , m_sqRing(MAP_FAILED)
+    , m_sqRingSize(0)
+    , m_sqHead(nullptr)
+    , m_sqTail(nullptr)
+    , m_sqMask(0)
+    , m_sqEntries(0)
+    , m_sqes(nullptr)
+    , m_sqesSize(0)
+    , m_sqeTail(0)
+    , m_sqeSubmitted(0)
+    , m_cqRing(MAP_FAILED)
+    , m_cqRingSize(0)
+    , m_cqHead(nullptr)
+    , m_cqTail(nullptr)
+    , m_cqMask(0)
+    , m_cqes(nullptr)
+    , m_cqLocalHead(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    Close();
+}
+
+int IoUring::Setup(unsigned entries, io_uring_params& params)
+{
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    return fd < 0 ? -errno : fd;
+}
+
+int IoUring::Initialize(unsigned entries, io_uring_params& params)
+{
+    int fd = Setup(entries, params);
+    if (fd < 0)
+    {
+        return fd;
+    }
+    m_fd = fd;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cqRingSize > m_sqRingSize)
+            m_sqRingSize = m_cqRingSize;
+        m_cqRingSize = m_sqRingSize;
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+    {
+        int error = -errno;
+        Close();
+        return error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_cqRing = m_sqRing;
+    }
+    else
+    {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+        {
+            int error = -errno;
+            Close();
+            return error;
+        }
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        int error = -errno;
+        Close();
+        return error;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+
+    // SQEs are always used in ring order, so the indirection array is fixed
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; i++)
+    {
+        array[i] = i;
+    }
+    m_sqeTail = *m_sqTail;
+    m_sqeSubmitted = m_sqeTail;
+
+    char* cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    m_cqLocalHead = *m_cqHead;
+    return 0;
+}
+
+void IoUring::Close()
+{
+    if (m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+    {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = MAP_FAILED;
+    if (m_sqRing != MAP_FAILED)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = MAP_FAILED;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+io_uring_sqe* IoUring::GetSqe()
+{
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_sqEntries)
+    {
+        return nullptr;
+    }
+
+    io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+    m_sqeTail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned IoUring::SpaceLeft() const
+{
+    return m_sqEntries - (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+}
+
+int IoUring::Submit(unsigned waitFor)
+{
+    unsigned toSubmit = m_sqeTail - m_sqeSubmitted;
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    m_sqeSubmitted = m_sqeTail;
+
+    unsigned flags = waitFor ? IORING_ENTER_GETEVENTS : 0;
+    int result = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, toSubmit, waitFor, flags, nullptr, 0));
+    return result < 0 ? -errno : result;
+}
+
+io_uring_cqe* IoUring::PeekCqe()
+{
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    if (m_cqLocalHead == tail)
+    {
+        return nullptr;
+    }
+    return &m_cqes[m_cqLocalHead & m_cqMask];
+}
+
+void IoUring::AdvanceCq()
+{
+    m_cqLocalHead++;
+    __atomic_store_n(m_cqHead, m_cqLocalHead, __ATOMIC_RELEASE);
+}
+
+int IoUring::Register(unsigned opcode, const void* arg, unsigned count)
+{
+    int result = static_cast<int>(syscall(__NR_io_uring_register, m_fd, opcode, arg, count));
+    return result < 0 ? -errno : result;
+}
\ No newline at end of file
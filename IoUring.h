@@ -0,0 +1,62 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring binding over the raw system calls: ring setup and mapping,
+// SQE allocation, submission and CQE iteration. Covers what IoUringTransport
+// needs without depending on liburing. Not thread-safe; one owner thread.
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Returns a negative errno on failure
+    int Initialize(unsigned entries, io_uring_params& params);
+    void Close();
+
+    // Next free submission entry, zeroed; nullptr when the queue is full
+    io_uring_sqe* GetSqe();
+
+    // Hands queued entries to the kernel and waits for at least waitFor
+    // completions. One io_uring_enter call; returns a negative errno on failure.
+    int Submit(unsigned waitFor);
+    unsigned Pending() const { return m_sqeTail - m_sqeSubmitted; }
+    unsigned SpaceLeft() const;
+
+    // Completion entries are consumed in order: Peek, handle, Advance
+    io_uring_cqe* PeekCqe();
+    void AdvanceCq();
+
+    int Register(unsigned opcode, const void* arg, unsigned count);
+    int Fd() const { return m_fd; }
+
+    static int Setup(unsigned entries, io_uring_params& params);
+
+private:
+    int m_fd;
+
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned m_sqeTail;
+    unsigned m_sqeSubmitted;
+
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe* m_cqes;
+    unsigned m_cqLocalHead;
+};
\ No newline at end of file
@@ -0,0 +1,816 @@
+#include "IoUringTransport.h"
+#include "ListenSocket.h"
+#include "Log.h"
+#include "WorkerPool.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace
+{
+    // Repeats for as long as the process is out of descriptors
+    LogLimiter g_acceptFailureLog;
+
+    // user_data layout: operation in the top byte, then a 24-bit connection
+    // generation and the registered file slot
+    enum Operation : uint64_t
+    {
+        OP_ACCEPT = 1,
+        OP_WAKE,
+        OP_RECV,
+        OP_SEND,
+        OP_SHUTDOWN,
+        OP_CLOSE,
+        OP_CANCEL,
+        OP_PROVIDE
+    };
+
+    inline uint64_t MakeTag(Operation operation, uint32_t generation = 0, uint32_t slot = 0)
+    {
+        return (static_cast<uint64_t>(operation) << 56) | (static_cast<uint64_t>(generation & 0xFFFFFF) << 32) | slot;
+    }
+
+    // Loop counters have a single writer, so a plain store is enough
+    inline void Count(std::atomic<uint64_t>& counter, uint64_t amount = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void Wake(int wakeFd)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Registering a buffer ring can succeed on kernels (or sandboxes) that
+    // then never hand its buffers out, so do one buffer-selecting read
+    // through a scratch ring and check that a buffer actually came back
+    bool BufferRingDelivers()
+    {
+        IoUring ring;
+        io_uring_params params = {};
+        if (ring.Initialize(4, params) < 0)
+        {
+            return false;
+        }
+
+        const size_t ringSize = 4096;
+        void* memory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return false;
+        }
+
+        bool delivered = false;
+        int pipeFds[2];
+        io_uring_buf_reg registration = {};
+        registration.ring_addr = reinterpret_cast<uint64_t>(memory);
+        registration.ring_entries = 1;
+        if (ring.Register(IORING_REGISTER_PBUF_RING, &registration, 1) >= 0 && pipe(pipeFds) == 0)
+        {
+            char buffer[16];
+            io_uring_buf_ring* bufferRing = static_cast<io_uring_buf_ring*>(memory);
+            bufferRing->bufs[0].addr = reinterpret_cast<uint64_t>(buffer);
+            bufferRing->bufs[0].len = sizeof(buffer);
+            bufferRing->bufs[0].bid = 0;
+            __atomic_store_n(&bufferRing->tail, static_cast<uint16_t>(1), __ATOMIC_RELEASE);
+
+            if (write(pipeFds[1], "x", 1) == 1)
+            {
+                io_uring_sqe* sqe = ring.GetSqe();
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = pipeFds[0];
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->len = sizeof(buffer);
+                sqe->buf_group = 0;
+                if (ring.Submit(1) >= 0)
+                {
+                    io_uring_cqe* cqe = ring.PeekCqe();
+                    delivered = cqe && cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER);
+                }
+            }
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+        }
+
+        ring.Close();
+        munmap(memory, ringSize);
+        return delivered;
+    }
+}
+
+IoUringTransport::IoUringTransport(const ServerConfig& config)
+    : m_config(config)
+    , m_loopCount(config.workerThreads ? config.workerThreads : WorkerPool::DefaultThreadCount())
+    , m_handler(nullptr)
+    , m_useBufferRing(false)
+    , m_running(false)
+    , m_paused(false)
+{
+}
+
+IoUringTransport::~IoUringTransport()
+{
+    Stop();
+}
+
+bool IoUringTransport::IsSupported()
+{
+    // Multishot recv and provided buffer rings arrived in 6.0
+    utsname name;
+    int major = 0;
+    int minor = 0;
+    if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6)
+    {
+        return false;
+    }
+
+    // Setup fails when io_uring is disabled by sysctl or a seccomp policy
+    IoUring ring;
+    io_uring_params params = {};
+    if (ring.Initialize(8, params) < 0)
+    {
+        return false;
+    }
+
+    const unsigned probeOps = 256;
+    std::vector<char> storage(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op));
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (ring.Register(IORING_REGISTER_PROBE, probe, probeOps) < 0)
+    {
+        return false;
+    }
+
+    const uint8_t required[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SHUTDOWN,
+        IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL, IORING_OP_READ
+    };
+    for (uint8_t op : required)
+    {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IoUringTransport::Initialize()
+{
+    m_useBufferRing = BufferRingDelivers();
+    if (!m_useBufferRing)
+    {
+        Log::Write(LogLevel::Warning) << L"io_uring buffer rings are not usable here; providing buffers with IORING_OP_PROVIDE_BUFFERS";
+    }
+
+    for (size_t i = 0; i < m_loopCount; i++)
+    {
+        auto loop = std::make_unique<EventLoop>();
+        loop->index = i;
+        loop->scratch.sink = this;
+        loop->listenFd = CreateListenSocket(m_config.port);
+        // Blocking descriptors: io_uring waits on them internally, while a
+        // non-blocking one would complete the read or accept with -EAGAIN
+        loop->wakeFd = eventfd(0, EFD_CLOEXEC);
+        EventLoop* raw = loop.get();
+        m_loops.push_back(std::move(loop));
+
+        if (raw->listenFd < 0 || raw->wakeFd < 0 || !SetupRing(raw))
+        {
+            Log::Write(LogLevel::Error) << L"Failed to create io_uring event loop " << i;
+            CloseLoops();
+            return false;
+        }
+        fcntl(raw->listenFd, F_SETFL, fcntl(raw->listenFd, F_GETFL) & ~O_NONBLOCK);
+    }
+    return true;
+}
+
+bool IoUringTransport::SetupRing(EventLoop* loop)
+{
+    // Created disabled so the loop thread, not this one, becomes the single issuer
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_R_DISABLED | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+        IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = COMPLETION_DEPTH;
+    int result = loop->ring.Initialize(QUEUE_DEPTH, params);
+    if (result == -EINVAL)
+    {
+        // Deferred task running needs 6.1
+        params = {};
+        params.flags = IORING_SETUP_R_DISABLED | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = COMPLETION_DEPTH;
+        result = loop->ring.Initialize(QUEUE_DEPTH, params);
+    }
+    if (result < 0)
+    {
+        Log::Write(LogLevel::Error) << L"io_uring_setup failed: " << strerror(-result);
+        return false;
+    }
+
+    // Empty registered file table that accepts fill
+    io_uring_rsrc_register files = {};
+    files.nr = MAX_CONNECTIONS;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    result = loop->ring.Register(IORING_REGISTER_FILES2, &files, sizeof(files));
+    if (result < 0)
+    {
+        Log::Write(LogLevel::Error) << L"io_uring file table registration failed: " << strerror(-result);
+        return false;
+    }
+
+    loop->buffers = static_cast<char*>(mmap(nullptr, static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (loop->buffers == MAP_FAILED)
+    {
+        loop->buffers = nullptr;
+        return false;
+    }
+
+    if (m_useBufferRing)
+    {
+        loop->bufferRingSize = BUFFER_COUNT * sizeof(io_uring_buf);
+        void* memory = mmap(nullptr, loop->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return false;
+        }
+        loop->bufferRing = static_cast<io_uring_buf_ring*>(memory);
+
+        io_uring_buf_reg registration = {};
+        registration.ring_addr = reinterpret_cast<uint64_t>(memory);
+        registration.ring_entries = BUFFER_COUNT;
+        registration.bgid = BUFFER_GROUP;
+        result = loop->ring.Register(IORING_REGISTER_PBUF_RING, &registration, 1);
+        if (result < 0)
+        {
+            Log::Write(LogLevel::Error) << L"io_uring buffer ring registration failed: " << strerror(-result);
+            return false;
+        }
+
+        for (unsigned i = 0; i < BUFFER_COUNT; i++)
+        {
+            RecycleBuffer(loop, static_cast<uint16_t>(i));
+        }
+    }
+    loop->connections.resize(MAX_CONNECTIONS);
+    return true;
+}
+
+bool IoUringTransport::Start(RequestHandler* handler)
+{
+    if (m_running || m_loops.empty())
+    {
+        return false;
+    }
+
+    m_handler = handler;
+    m_running = true;
+    m_paused = false;
+    for (auto& loop : m_loops)
+    {
+        loop->thread = std::thread(&IoUringTransport::LoopThread, this, loop.get());
+    }
+
+    Log::Write(LogLevel::Info) << L"io_uring transport listening on port " << m_config.port
+                               << L" with " << m_loops.size() << L" event loops";
+    return true;
+}
+
+void IoUringTransport::Stop()
+{
+    if (m_running.exchange(false))
+    {
+        for (auto& loop : m_loops)
+        {
+            Wake(loop->wakeFd);
+        }
+        for (auto& loop : m_loops)
+        {
+            if (loop->thread.joinable())
+            {
+                loop->thread.join();
+            }
+        }
+    }
+    CloseLoops();
+}
+
+void IoUringTransport::CloseLoops()
+{
+    for (auto& loop : m_loops)
+    {
+        ReleaseDeferred(loop.get());
+
+        // Tearing down the ring cancels outstanding requests and closes every
+        // socket in the registered file table
+        loop->ring.Close();
+        loop->connections.clear();
+
+        if (loop->bufferRing) munmap(loop->bufferRing, loop->bufferRingSize);
+        if (loop->buffers) munmap(loop->buffers, static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+        if (loop->listenFd >= 0) close(loop->listenFd);
+        if (loop->wakeFd >= 0) close(loop->wakeFd);
+    }
+    m_loops.clear();
+}
+
+TransportStats IoUringTransport::GetStats() const
+{
+    TransportStats stats;
+    for (const auto& loop : m_loops)
+    {
+        stats.requests += loop->requests.load(std::memory_order_relaxed);
+        stats.syscalls += loop->syscalls.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void IoUringTransport::Pause()
+{
+    // The loops cancel their accepts; open connections keep being served
+    m_paused = true;
+    for (auto& loop : m_loops)
+    {
+        Wake(loop->wakeFd);
+    }
+}
+
+void IoUringTransport::Resume()
+{
+    if (!m_paused.exchange(false))
+    {
+        return;
+    }
+
+    for (auto& loop : m_loops)
+    {
+        Wake(loop->wakeFd);
+    }
+}
+
+void IoUringTransport::LoopThread(EventLoop* loop)
+{
+    int result = loop->ring.Register(IORING_REGISTER_ENABLE_RINGS, nullptr, 0);
+    if (result < 0)
+    {
+        Log::Write(LogLevel::Error) << L"Failed to enable io_uring event loop " << loop->index << L": " << strerror(-result);
+        return;
+    }
+
+    if (!loop->bufferRing)
+    {
+        // Hand the whole buffer pool to the kernel in one request
+        io_uring_sqe* sqe = NextSqe(loop);
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = BUFFER_COUNT;
+        sqe->addr = reinterpret_cast<uint64_t>(loop->buffers);
+        sqe->len = BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = MakeTag(OP_PROVIDE);
+    }
+
+    ArmWake(loop);
+    if (!m_paused)
+    {
+        ArmAccept(loop);
+    }
+
+    while (m_running)
+    {
+        // One system call submits everything queued by the previous batch and
+        // waits for the next completion
+        result = loop->ring.Submit(1);
+        Count(loop->syscalls);
+        if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY)
+        {
+            Log::Write(LogLevel::Error) << L"io_uring_enter failed: " << strerror(-result);
+            break;
+        }
+
+        while (io_uring_cqe* cqe = loop->ring.PeekCqe())
+        {
+            HandleCompletion(loop, cqe);
+            loop->ring.AdvanceCq();
+        }
+    }
+}
+
+void IoUringTransport::HandleCompletion(EventLoop* loop, const io_uring_cqe* cqe)
+{
+    Operation operation = static_cast<Operation>(cqe->user_data >> 56);
+    if (operation == OP_ACCEPT)
+    {
+        OnAccept(loop, cqe);
+        return;
+    }
+    if (operation == OP_WAKE)
+    {
+        OnWake(loop);
+        return;
+    }
+    if (operation == OP_CANCEL || operation == OP_PROVIDE)
+    {
+        return;
+    }
+
+    uint32_t slot = static_cast<uint32_t>(cqe->user_data);
+    uint32_t generation = static_cast<uint32_t>(cqe->user_data >> 32) & 0xFFFFFF;
+    Connection* connection = nullptr;
+    if (slot < loop->connections.size() && loop->connections[slot] && loop->connections[slot]->generation == generation)
+    {
+        connection = loop->connections[slot].get();
+    }
+
+    if (!connection)
+    {
+        // A receive that raced with the close of its connection
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            RecycleBuffer(loop, static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+
+    switch (operation)
+    {
+    case OP_RECV:
+        OnReceive(loop, connection, cqe);
+        break;
+    case OP_SEND:
+        OnSend(loop, connection, cqe->res);
+        break;
+    case OP_CLOSE:
+        loop->connections[slot].reset();
+        if (loop->acceptStarved)
+        {
+            loop->acceptStarved = false;
+            if (!loop->acceptArmed && m_running && !m_paused)
+            {
+                ArmAccept(loop);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void IoUringTransport::OnAccept(EventLoop* loop, const io_uring_cqe* cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        loop->acceptArmed = false;
+    }
+
+    if (cqe->res >= 0)
+    {
+        uint32_t slot = static_cast<uint32_t>(cqe->res);
+        uint32_t generation = ++loop->nextGeneration & 0xFFFFFF;
+        uint64_t id = (static_cast<uint64_t>(loop->index) << 48) | ++loop->nextConnection;
+        uint64_t client = ClientAddressKey(reinterpret_cast<const sockaddr*>(&loop->peer));
+        loop->connections[slot] = std::make_unique<Connection>(slot, generation, id, client);
+        ArmReceive(loop, loop->connections[slot].get());
+    }
+    else if (cqe->res == -ENFILE)
+    {
+        // Every file slot is taken; accepting resumes when a connection closes
+        loop->acceptStarved = true;
+    }
+    else if (cqe->res != -ECANCELED)
+    {
+        Log::Write(LogLevel::Warning, g_acceptFailureLog) << L"io_uring accept failed: " << strerror(-cqe->res);
+    }
+
+    if (!loop->acceptArmed && !loop->acceptStarved && m_running && !m_paused)
+    {
+        ArmAccept(loop);
+    }
+}
+
+void IoUringTransport::OnReceive(EventLoop* loop, Connection* connection, const io_uring_cqe* cqe)
+{
+    bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    if (!more)
+    {
+        connection->recvArmed = false;
+    }
+
+    int result = cqe->res;
+    if (result > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+    {
+        uint16_t bufferId = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        const char* data = loop->buffers + static_cast<size_t>(bufferId) * BUFFER_SIZE;
+        if (!connection->closing && !connection->CloseAfterWrite())
+        {
+            if (!connection->sendInFlight && !connection->Deferred())
+            {
+                Count(loop->requests, connection->ProcessFrom(data, static_cast<size_t>(result), m_handler, loop->scratch, m_running));
+            }
+            else if (!connection->Append(data, static_cast<size_t>(result)))
+            {
+                connection->SetCloseAfterWrite();
+            }
+            else if (connection->BufferedInput() > RECV_PAUSE_THRESHOLD && connection->recvArmed && !connection->recvPaused)
+            {
+                // The peer is pipelining faster than it reads responses, or
+                // faster than the handler answers
+                connection->recvPaused = true;
+                Cancel(loop, MakeTag(OP_RECV, connection->generation, connection->slot));
+            }
+        }
+        RecycleBuffer(loop, bufferId);
+
+        if (!more && !connection->closing && !connection->recvPaused)
+        {
+            ArmReceive(loop, connection);
+        }
+    }
+    else if (result == 0)
+    {
+        connection->peerClosed = true;
+    }
+    else if (result == -ENOBUFS)
+    {
+        // Provided buffers ran out; they are recycled as completions are handled
+        if (!connection->closing)
+        {
+            ArmReceive(loop, connection);
+        }
+    }
+    else if (result != -ECANCELED)
+    {
+        connection->SetCloseAfterWrite();
+    }
+
+    ContinueConnection(loop, connection);
+}
+
+void IoUringTransport::OnSend(EventLoop* loop, Connection* connection, int result)
+{
+    connection->sendInFlight = false;
+    if (result < 0)
+    {
+        connection->ConsumeOutput(connection->PendingOutput().size());
+        connection->SetCloseAfterWrite();
+    }
+    else
+    {
+        connection->ConsumeOutput(static_cast<size_t>(result));
+    }
+
+    // A linked shutdown and close follow the final send
+    if (!connection->closing)
+    {
+        ContinueConnection(loop, connection);
+    }
+}
+
+void IoUringTransport::OnWake(EventLoop* loop)
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    ArmWake(loop);
+    CompleteDeferred(loop);
+    if (m_paused && loop->acceptArmed)
+    {
+        Cancel(loop, MakeTag(OP_ACCEPT));
+    }
+    else if (!m_paused && !loop->acceptArmed && !loop->acceptStarved)
+    {
+        ArmAccept(loop);
+    }
+}
+
+void IoUringTransport::Complete(DeferredRequest* deferred)
+{
+    // The connection id carries the index of the loop that owns it
+    EventLoop* loop = m_loops[deferred->request.connectionId >> 48].get();
+    while (!loop->completions.TryPush(deferred))
+    {
+        std::this_thread::yield();
+    }
+    if (!loop->wakePending.exchange(true))
+    {
+        Wake(loop->wakeFd);
+    }
+}
+
+void IoUringTransport::CompleteDeferred(EventLoop* loop)
+{
+    // Cleared first, so a response queued while draining wakes the loop again
+    loop->wakePending = false;
+
+    DeferredRequest* deferred = nullptr;
+    while (loop->completions.TryPop(deferred))
+    {
+        uint32_t slot = static_cast<uint32_t>(deferred->tag);
+        uint32_t generation = static_cast<uint32_t>(deferred->tag >> 32);
+        Connection* connection = nullptr;
+        if (slot < loop->connections.size() && loop->connections[slot] && loop->connections[slot]->generation == generation &&
+            !loop->connections[slot]->closing && loop->connections[slot]->Deferred())
+        {
+            connection = loop->connections[slot].get();
+            connection->CompleteDeferred(deferred->response);
+        }
+        m_handler->Release(deferred);
+
+        if (connection)
+        {
+            ContinueConnection(loop, connection);
+        }
+    }
+}
+
+void IoUringTransport::ReleaseDeferred(EventLoop* loop)
+{
+    DeferredRequest* deferred = nullptr;
+    while (loop->completions.TryPop(deferred))
+    {
+        m_handler->Release(deferred);
+    }
+}
+
+void IoUringTransport::ContinueConnection(EventLoop* loop, Connection* connection)
+{
+    if (connection->closing || connection->sendInFlight)
+    {
+        return;
+    }
+
+    // Requests that arrived while the previous send was in flight
+    if (connection->HasBufferedInput() && !connection->CloseAfterWrite())
+    {
+        Count(loop->requests, connection->ProcessRequests(m_handler, loop->scratch, m_running));
+    }
+    if (connection->peerClosed && connection->PendingOutput().empty() && !connection->Deferred())
+    {
+        connection->SetCloseAfterWrite();
+    }
+
+    if (!connection->PendingOutput().empty())
+    {
+        StartSend(loop, connection);
+    }
+    else if (connection->CloseAfterWrite())
+    {
+        StartClose(loop, connection);
+    }
+    else if (connection->recvPaused && !connection->recvArmed && connection->BufferedInput() <= RECV_PAUSE_THRESHOLD)
+    {
+        ArmReceive(loop, connection);
+    }
+}
+
+io_uring_sqe* IoUringTransport::NextSqe(EventLoop* loop)
+{
+    io_uring_sqe* sqe = loop->ring.GetSqe();
+    while (!sqe)
+    {
+        // Submission queue full: hand it to the kernel without waiting
+        loop->ring.Submit(0);
+        Count(loop->syscalls);
+        sqe = loop->ring.GetSqe();
+    }
+    return sqe;
+}
+
+void IoUringTransport::ReserveSqes(EventLoop* loop, unsigned count)
+{
+    // Linked requests have to reach the kernel in the same submission
+    if (loop->ring.SpaceLeft() < count)
+    {
+        loop->ring.Submit(0);
+        Count(loop->syscalls);
+    }
+}
+
+void IoUringTransport::ArmAccept(EventLoop* loop)
+{
+    io_uring_sqe* sqe = NextSqe(loop);
+    // One connection per accept: a multishot accept cannot report each
+    // peer's address, which admission control keys on, and the re-arm
+    // rides along with the next submission anyway
+    loop->peerLength = sizeof(loop->peer);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listenFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&loop->peer);
+    sqe->addr2 = reinterpret_cast<uint64_t>(&loop->peerLength);
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = MakeTag(OP_ACCEPT);
+    loop->acceptArmed = true;
+}
+
+void IoUringTransport::ArmReceive(EventLoop* loop, Connection* connection)
+{
+    io_uring_sqe* sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = static_cast<int>(connection->slot);
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = MakeTag(OP_RECV, connection->generation, connection->slot);
+    connection->recvArmed = true;
+    connection->recvPaused = false;
+}
+
+void IoUringTransport::ArmWake(EventLoop* loop)
+{
+    io_uring_sqe* sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop->wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&loop->wakeValue);
+    sqe->len = sizeof(loop->wakeValue);
+    sqe->user_data = MakeTag(OP_WAKE);
+}
+
+void IoUringTransport::Cancel(EventLoop* loop, uint64_t userData)
+{
+    io_uring_sqe* sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = MakeTag(OP_CANCEL);
+}
+
+void IoUringTransport::StartSend(EventLoop* loop, Connection* connection)
+{
+    bool last = connection->CloseAfterWrite();
+    ReserveSqes(loop, last ? 3 : 1);
+
+    // MSG_WAITALL has the kernel retry short sends, so one completion covers
+    // the whole buffer; the output is left untouched until it arrives
+    std::string_view output = connection->PendingOutput();
+    io_uring_sqe* sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = static_cast<int>(connection->slot);
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = reinterpret_cast<uint64_t>(output.data());
+    sqe->len = static_cast<uint32_t>(output.size());
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = MakeTag(OP_SEND, connection->generation, connection->slot);
+    connection->sendInFlight = true;
+
+    if (last)
+    {
+        // Hard links run the shutdown and close even if the send fails
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        StartClose(loop, connection);
+    }
+}
+
+void IoUringTransport::StartClose(EventLoop* loop, Connection* connection)
+{
+    ReserveSqes(loop, 2);
+    connection->closing = true;
+
+    // Shutting down also ends the multishot receive
+    io_uring_sqe* sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = static_cast<int>(connection->slot);
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->len = SHUT_RDWR;
+    sqe->user_data = MakeTag(OP_SHUTDOWN, connection->generation, connection->slot);
+
+    sqe = NextSqe(loop);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = connection->slot + 1;
+    sqe->user_data = MakeTag(OP_CLOSE, connection->generation, connection->slot);
+}
+
+void IoUringTransport::RecycleBuffer(EventLoop* loop, uint16_t bufferId)
+{
+    char* buffer = loop->buffers + static_cast<size_t>(bufferId) * BUFFER_SIZE;
+    if (!loop->bufferRing)
+    {
+        // Goes out with the next submission; only failures produce a completion
+        io_uring_sqe* sqe = NextSqe(loop);
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = BUFFER_SIZE;
+        sqe->off = bufferId;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = MakeTag(OP_PROVIDE);
+        return;
+    }
+
+    // The ring tail shares storage with the first entry's reserved field, so
+    // entries are filled field by field
+    io_uring_buf* entry = &loop->bufferRing->bufs[loop->bufferTail & (BUFFER_COUNT - 1)];
+    entry->addr = reinterpret_cast<uint64_t>(buffer);
+    entry->len = BUFFER_SIZE;
+    entry->bid = bufferId;
+    loop->bufferTail++;
+    __atomic_store_n(&loop->bufferRing->tail, loop->bufferTail, __ATOMIC_RELEASE);
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Transport.h"
+#include "HttpConnection.h"
+#include "IoUring.h"
+#include "StageQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+// HTTP/1.1 server for Linux 6.0+ built on io_uring. Each loop thread owns a
+// ring and an SO_REUSEPORT listener, like EpollTransport, but the socket work
+// is completion-based:
+//   - an accept per loop, re-armed with each completion so the kernel can
+//     report the peer's address, installs connections straight into the
+//     ring's registered file table, so sockets never get a regular descriptor
+//   - one multishot recv per connection picks buffers from a provided buffer
+//     ring; requests are parsed in place and the buffer is handed back
+//   - each connection has at most one send in flight; the last one is linked
+//     to a shutdown and close, so closing costs no extra submission round
+// A loop enters the kernel once per batch of completions, which both submits
+// new work and waits for more. Deferred responses come back through a
+// per-loop completion queue and the loop's wake read.
+class IoUringTransport : public Transport, public ResponseSink
+{
+public:
+    explicit IoUringTransport(const ServerConfig& config);
+    ~IoUringTransport() override;
+
+    // Probes the running kernel for every feature the transport depends on
+    static bool IsSupported();
+
+    bool Initialize() override;
+    bool Start(RequestHandler* handler) override;
+    void Stop() override;
+    void Pause() override;
+    void Resume() override;
+    const wchar_t* Name() const override { return L"io_uring"; }
+    TransportStats GetStats() const override;
+
+    // Called on a handler thread; queues the response for the owning loop
+    void Complete(DeferredRequest* deferred) override;
+
+private:
+    struct Connection : HttpConnection
+    {
+        Connection(uint32_t fileSlot, uint32_t gen, uint64_t id, uint64_t client)
+            : HttpConnection(id, (static_cast<uint64_t>(gen) << 32) | fileSlot, client), slot(fileSlot), generation(gen) {}
+
+        uint32_t slot;              // index in the registered file table
+        uint32_t generation;        // tells stale completions for a reused slot apart
+        bool recvArmed = false;
+        bool recvPaused = false;    // recv cancelled until buffered input drains
+        bool sendInFlight = false;
+        bool peerClosed = false;    // EOF seen; close once buffered requests are answered
+        bool closing = false;       // shutdown and close submitted; freed when the close completes
+    };
+
+    struct EventLoop
+    {
+        size_t index = 0;
+        int listenFd = -1;
+        int wakeFd = -1;
+        uint64_t wakeValue = 0;
+        uint64_t nextConnection = 0;
+        uint32_t nextGeneration = 0;
+        bool acceptArmed = false;
+        bool acceptStarved = false; // file table was full; re-arm on the next close
+        sockaddr_storage peer = {}; // written by the armed accept
+        socklen_t peerLength = 0;
+        std::thread thread;
+        IoUring ring;
+
+        io_uring_buf_ring* bufferRing = nullptr;                 // null when buffers are provided by request
+        size_t bufferRingSize = 0;
+        char* buffers = nullptr;
+        uint16_t bufferTail = 0;
+
+        std::vector<std::unique_ptr<Connection>> connections;   // by file slot
+        RequestScratch scratch;
+        StageQueue<DeferredRequest*> completions{ COMPLETION_QUEUE };
+        std::atomic<bool> wakePending{ false };     // a wake is already on its way
+
+        // Written only by the loop thread
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> syscalls{ 0 };
+    };
+
+    bool SetupRing(EventLoop* loop);     // runs in Initialize; the loop thread enables the ring
+    void LoopThread(EventLoop* loop);
+    void HandleCompletion(EventLoop* loop, const io_uring_cqe* cqe);
+    void OnAccept(EventLoop* loop, const io_uring_cqe* cqe);
+    void OnReceive(EventLoop* loop, Connection* connection, const io_uring_cqe* cqe);
+    void OnSend(EventLoop* loop, Connection* connection, int result);
+    void OnWake(EventLoop* loop);
+    void CompleteDeferred(EventLoop* loop);
+    void ReleaseDeferred(EventLoop* loop);
+
+    io_uring_sqe* NextSqe(EventLoop* loop);
+    void ReserveSqes(EventLoop* loop, unsigned count);
+    void ArmAccept(EventLoop* loop);
+    void ArmReceive(EventLoop* loop, Connection* connection);
+    void ArmWake(EventLoop* loop);
+    void Cancel(EventLoop* loop, uint64_t userData);
+    void ContinueConnection(EventLoop* loop, Connection* connection);
+    void StartSend(EventLoop* loop, Connection* connection);
+    void StartClose(EventLoop* loop, Connection* connection);
+    void RecycleBuffer(EventLoop* loop, uint16_t bufferId);
+    void CloseLoops();
+
+    ServerConfig m_config;
+    size_t m_loopCount;
+    RequestHandler* m_handler;
+    bool m_useBufferRing;       // provided buffer ring, or IORING_OP_PROVIDE_BUFFERS where rings do not work
+    std::vector<std::unique_ptr<EventLoop>> m_loops;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_paused;
+
+    static constexpr unsigned QUEUE_DEPTH = 4096;
+    static constexpr unsigned COMPLETION_DEPTH = 16384;
+    static constexpr unsigned MAX_CONNECTIONS = 16384;      // registered file slots per loop
+    static constexpr unsigned BUFFER_COUNT = 512;           // provided buffers per loop, power of two
+    static constexpr unsigned BUFFER_SIZE = 8192;
+    static constexpr size_t RECV_PAUSE_THRESHOLD = 64 * 1024;  // buffered input that stops recv while a send or deferred request is outstanding
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    static constexpr size_t COMPLETION_QUEUE = 4096;   // deferred responses waiting for a loop; producers yield when full
+};
\ No newline at end of file
@@ -1,17 +1,77 @@
 #include "KerberosAuth.h"
-#include <iostream>
-#include <sstream>
-#include <iomanip>
+#include "Base64.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "RequestArena.h"
+#include "Trace.h"
+#include <algorithm>
+#include <thread>
 
-#pragma comment(lib, "secur32.lib")
+namespace
+{
+    // Clients sending garbage do so with every request
+    LogLimiter g_decodeFailureLog;
+
+    std::vector<std::string> DistinctKeytabs(const std::vector<AcceptorIdentity>& identities)
+    {
+        std::vector<std::string> keytabs;
+        for (const AcceptorIdentity& identity : identities)
+        {
+            if (!identity.keytab.empty() && std::find(keytabs.begin(), keytabs.end(), identity.keytab) == keytabs.end())
+            {
+                keytabs.push_back(identity.keytab);
+            }
+        }
+        return keytabs;
+    }
+}
 
-KerberosAuth::KerberosAuth()
-    : m_bCredsInitialized(false)
-    , m_bContextInitialized(false)
-    , m_pSSPI(nullptr)
+KerberosAuth::KerberosAuth(const ServerConfig& config)
+    : m_provider(CreateAuthProvider(config))
+    , m_keytab(config.keytab.begin(), config.keytab.end())
+    , m_acceptors(config.acceptors.begin(), config.acceptors.end())
+    , m_servicePrincipals(config.servicePrincipals.begin(), config.servicePrincipals.end())
+    , m_slowLaneLimit(config.slowLaneLimit)
+    , m_slowLaneInFlight(0)
+    , m_requestedProvider(config.authProvider)
+    , m_bInitialized(false)
+    , m_legs(0)
+    , m_succeeded(0)
+    , m_continued(0)
+    , m_failed(0)
+    , m_slowLaneShed(0)
+    , m_providerNanoseconds(0)
+    , m_nativeNanoseconds(0)
+    , m_screenNanoseconds(0)
 {
-    ZeroMemory(&m_hCreds, sizeof(m_hCreds));
-    ZeroMemory(&m_hContext, sizeof(m_hContext));
+    if (m_slowLaneLimit == 0)
+    {
+        m_slowLaneLimit = (std::max)(std::thread::hardware_concurrency() / 4, 1u);
+    }
+
+    if (m_provider)
+    {
+        m_credentials = std::make_unique<CredentialManager>(*m_provider, std::chrono::seconds(config.credentialRefreshSeconds));
+    }
+
+    // Mock tokens carry no real ticket, so the mock provider answers for every one
+    if (config.nativeApReq && (!m_keytab.empty() || !m_acceptors.empty()) && config.authProvider != L"mock")
+    {
+        m_nativeVerifier = std::make_unique<ApReqVerifier>(config.replayRate * 2 * CLOCK_SKEW_SECONDS, std::chrono::seconds(CLOCK_SKEW_SECONDS),
+            !config.authzRules.empty());
+    }
+
+    m_pendingContexts = std::make_unique<SecurityContextTable>(
+        config.authContextLimit,
+        std::chrono::seconds(config.authContextTtlSeconds),
+        [this](const PendingContext& pending)
+        {
+            m_provider->ReleaseContext(pending);
+        });
+
+    m_tokenCache = std::make_unique<TokenCache>(
+        config.tokenCacheEntries,
+        std::chrono::seconds(config.tokenReplayWindowSeconds));
 }
 
 KerberosAuth::~KerberosAuth()
@@ -21,198 +81,277 @@ KerberosAuth::~KerberosAuth()
 
 bool KerberosAuth::Initialize()
 {
-    // Initialize the security function table
-    m_pSSPI = InitSecurityInterface();
-    if (!m_pSSPI)
+    if (!m_screen.Configure(m_servicePrincipals))
+    {
+        Log::Write(LogLevel::Error) << L"Invalid service principal list: "
+            << std::wstring(m_servicePrincipals.begin(), m_servicePrincipals.end());
+        return false;
+    }
+    if (m_screen.ServiceCount() > 0)
+    {
+        Log::Write(LogLevel::Info) << L"Accepting Kerberos tickets for " << m_screen.ServiceCount() << L" service principals";
+    }
+
+    std::vector<AcceptorIdentity> identities;
+    if (!CredentialManager::ParseIdentities(m_acceptors, m_keytab, identities))
     {
-        std::wcout << L"Failed to initialize security interface" << std::endl;
+        Log::Write(LogLevel::Error) << L"Invalid acceptor list: " << m_acceptors;
         return false;
     }
 
-    // Acquire credentials handle for the server
-    TimeStamp tsExpiry;
-    SECURITY_STATUS ss = m_pSSPI->AcquireCredentialsHandle(
-        nullptr,                    // Principal (use default)
-        const_cast<SEC_WCHAR*>(NEGOSSP_NAME),  // Package name (Negotiate)
-        SECPKG_CRED_INBOUND,        // Credentials use
-        nullptr,                    // Logon ID
-        nullptr,                    // Auth data
-        nullptr,                    // Get key function
-        nullptr,                    // Get key argument
-        &m_hCreds,                  // Credentials handle
-        &tsExpiry                   // Expiry time
-    );
+    // Without usable keys the native verifier is dropped and the provider sees every token
+    m_nativeKeytabs = DistinctKeytabs(identities);
+    if (m_nativeVerifier && (m_nativeKeytabs.empty() || !m_nativeVerifier->Load(m_nativeKeytabs)))
+    {
+        Log::Write(LogLevel::Info) << L"Native AP-REQ verification disabled";
+        m_nativeVerifier.reset();
+    }
 
-    if (ss != SEC_E_OK)
+    if (!m_provider)
+    {
+        // An explicitly requested provider must exist; without one the server
+        // still runs, but every Negotiate token the native verifier cannot
+        // handle is rejected
+        if (!m_requestedProvider.empty())
+        {
+            return false;
+        }
+        if (m_nativeVerifier)
+        {
+            Log::Write(LogLevel::Error) << L"No Kerberos backend is available on this platform; only AES AP-REQs can be verified";
+        }
+        else
+        {
+            Log::Write(LogLevel::Error) << L"No Kerberos backend is available on this platform; Negotiate requests will be rejected";
+        }
+        return true;
+    }
+
+    if (!m_provider->Initialize() || !m_credentials->Initialize(identities))
     {
-        std::wcout << L"AcquireCredentialsHandle failed with error: 0x" << std::hex << ss << std::endl;
         return false;
     }
 
-    m_bCredsInitialized = true;
-    std::wcout << L"Kerberos authentication initialized successfully" << std::endl;
+    // A rotated keytab is picked up by the provider's new credentials and the
+    // native verifier alike; either keeps what it had if the reload fails
+    m_credentials->Start([this]()
+    {
+        if (m_nativeVerifier)
+        {
+            m_nativeVerifier->Load(m_nativeKeytabs);
+        }
+    });
+    m_bInitialized = true;
     return true;
 }
 
-bool KerberosAuth::AuthenticateToken(const std::string& base64Token)
+AuthResult KerberosAuth::AuthenticateToken(uint64_t connectionId, std::string_view base64Token)
 {
-    if (!m_bCredsInitialized)
+    ArenaScope scope;
+
+    // Continuation legs belong to one connection's context and are never cached
+    PendingContext pending;
+    if (m_pendingContexts->Take(connectionId, pending))
     {
-        std::wcout << L"Credentials not initialized" << std::endl;
-        return false;
+        TokenCache::Clock::time_point expiry;
+        return AcceptToken(connectionId, base64Token, &pending, expiry);
+    }
+
+    return m_tokenCache->Verify(base64Token, [&](TokenCache::Clock::time_point& expiry)
+    {
+        return AcceptToken(connectionId, base64Token, nullptr, expiry);
+    });
+}
+
+AuthResult KerberosAuth::AcceptToken(uint64_t connectionId, std::string_view base64Token, const PendingContext* pending,
+    TokenCache::Clock::time_point& expiry)
+{
+    AuthResult result;
+    if (!m_bInitialized && !m_nativeVerifier)
+    {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    PendingContext context;
+    if (pending)
+    {
+        context = *pending;
     }
 
     // Decode the base64 token
-    std::vector<BYTE> tokenData = Base64Decode(base64Token);
-    if (tokenData.empty())
+    auto decodeStart = std::chrono::steady_clock::now();
+    unsigned char* tokenData = RequestArena::ForThread().AllocateArray<unsigned char>(Base64::DecodedMaxLength(base64Token.size()));
+    size_t tokenLength = 0;
+    bool decoded = Base64::Decode(base64Token, tokenData, tokenLength);
+    Metrics::Record(MetricStage::Decode, decodeStart, std::chrono::steady_clock::now());
+    if (!decoded || tokenLength == 0)
     {
-        std::wcout << L"Failed to decode authentication token" << std::endl;
-        return false;
+        Log::Write(LogLevel::Warning, g_decodeFailureLog) << L"Failed to decode authentication token";
+        if (pending)
+        {
+            m_provider->ReleaseContext(context);
+        }
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        result.badToken = true;
+        return result;
     }
 
-    // Setup input buffer
-    SecBuffer inSecBuffer;
-    inSecBuffer.BufferType = SECBUFFER_TOKEN;
-    inSecBuffer.cbBuffer = static_cast<ULONG>(tokenData.size());
-    inSecBuffer.pvBuffer = tokenData.data();
-
-    SecBufferDesc inSecBufferDesc;
-    inSecBufferDesc.ulVersion = SECBUFFER_VERSION;
-    inSecBufferDesc.cBuffers = 1;
-    inSecBufferDesc.pBuffers = &inSecBuffer;
-
-    // Setup output buffer
-    const DWORD dwMaxTokenSize = 12288; // Typical max token size
-    std::vector<BYTE> outTokenBuffer(dwMaxTokenSize);
-    
-    SecBuffer outSecBuffer;
-    outSecBuffer.BufferType = SECBUFFER_TOKEN;
-    outSecBuffer.cbBuffer = dwMaxTokenSize;
-    outSecBuffer.pvBuffer = outTokenBuffer.data();
-
-    SecBufferDesc outSecBufferDesc;
-    outSecBufferDesc.ulVersion = SECBUFFER_VERSION;
-    outSecBufferDesc.cBuffers = 1;
-    outSecBufferDesc.pBuffers = &outSecBuffer;
-
-    DWORD dwContextAttributes;
-    TimeStamp tsExpiry;
-
-    // Accept the security context
-    SECURITY_STATUS ss = m_pSSPI->AcceptSecurityContext(
-        &m_hCreds,                  // Credentials handle
-        m_bContextInitialized ? &m_hContext : nullptr,  // Existing context
-        &inSecBufferDesc,           // Input buffer
-        ASC_REQ_CONNECTION,         // Context requirements
-        SECURITY_NATIVE_DREP,       // Target data representation
-        &m_hContext,                // New context handle
-        &outSecBufferDesc,          // Output buffer
-        &dwContextAttributes,       // Context attributes
-        &tsExpiry                   // Context expiry
-    );
-
-    m_bContextInitialized = true;
-
-    if (ss == SEC_E_OK)
-    {
-        std::wcout << L"Authentication successful" << std::endl;
-        
-        // Get the authenticated user name
-        SecPkgContext_Names names;
-        if (m_pSSPI->QueryContextAttributes(&m_hContext, SECPKG_ATTR_NAMES, &names) == SEC_E_OK)
+    // Malformed tokens and tickets for other services stop here, before any crypto
+    auto screenStart = std::chrono::steady_clock::now();
+    TokenFacts facts;
+    TokenScreen::Verdict verdict = m_screen.Screen(tokenData, tokenLength, facts);
+    auto screenEnd = std::chrono::steady_clock::now();
+    m_screenNanoseconds.fetch_add(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(screenEnd - screenStart).count()), std::memory_order_relaxed);
+    Trace::Span("screen", screenStart, screenEnd);
+    if (verdict != TokenScreen::Verdict::Pass && verdict != TokenScreen::Verdict::SlowLane)
+    {
+        if (pending)
         {
-            std::wcout << L"Authenticated user: " << names.sUserName << std::endl;
-            m_pSSPI->FreeContextBuffer(names.sUserName);
+            m_provider->ReleaseContext(context);
         }
-        
-        return true;
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        result.badToken = true;
+        return result;
     }
-    else if (ss == SEC_I_CONTINUE_NEEDED)
+
+    // First legs in the common shape never reach the provider
+    if (m_nativeVerifier && !pending && facts.hasApReq && KerberosCrypto::IsSupported(facts.etype))
     {
-        std::wcout << L"Authentication requires continuation (multi-step)" << std::endl;
-        // In a real implementation, you would send the output token back to the client
-        return false; // For simplicity, we'll treat this as failure
+        auto nativeStart = std::chrono::steady_clock::now();
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t ticketEnd = 0;
+        ApReqOutcome outcome = m_nativeVerifier->Verify(tokenData, tokenLength, now, result, ticketEnd);
+        auto nativeEnd = std::chrono::steady_clock::now();
+        auto nativeElapsed = nativeEnd - nativeStart;
+        Metrics::Record(MetricStage::Accept, nativeStart, nativeEnd);
+        m_nativeNanoseconds.fetch_add(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(nativeElapsed).count()), std::memory_order_relaxed);
+
+        if (outcome == ApReqOutcome::Accepted)
+        {
+            // Cached results must not outlive the ticket
+            expiry = (std::min)(expiry, TokenCache::Clock::now() + std::chrono::seconds((std::max)(ticketEnd - now, int64_t(0))));
+            return result;
+        }
+        if (outcome == ApReqOutcome::Rejected)
+        {
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+            AuthResult rejected;
+            rejected.badToken = true;
+            return rejected;
+        }
     }
-    else
+    if (!m_bInitialized)
     {
-        std::wcout << L"AcceptSecurityContext failed with error: 0x" << std::hex << ss << std::endl;
-        return false;
+        // Nothing behind the native verifier to take the token
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return AuthResult();
     }
-}
 
-void KerberosAuth::Cleanup()
-{
-    if (m_bContextInitialized)
+    // A continuation leg stays with the credential its handshake started with,
+    // even if a refresh has replaced it since
+    std::shared_ptr<AcceptorCredential> credential = pending ? context.credential : nullptr;
+    if (!credential)
     {
-        m_pSSPI->DeleteSecurityContext(&m_hContext);
-        m_bContextInitialized = false;
+        credential = m_credentials->Select(facts);
     }
-
-    if (m_bCredsInitialized)
+    if (!credential)
     {
-        m_pSSPI->FreeCredentialsHandle(&m_hCreds);
-        m_bCredsInitialized = false;
+        if (pending)
+        {
+            m_provider->ReleaseContext(context);
+        }
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return AuthResult();
     }
-}
 
-std::vector<BYTE> KerberosAuth::Base64Decode(const std::string& encoded)
-{
-    std::vector<BYTE> result;
-    
-    // Remove any whitespace
-    std::string cleanEncoded;
-    for (char c : encoded)
+    // NTLM can wait on a domain controller for each leg, so it only gets a
+    // few workers; the rest stay free for Kerberos
+    bool slowLane = verdict == TokenScreen::Verdict::SlowLane;
+    if (slowLane && m_slowLaneInFlight.fetch_add(1, std::memory_order_relaxed) >= m_slowLaneLimit)
     {
-        if (!isspace(c))
-            cleanEncoded += c;
+        m_slowLaneInFlight.fetch_sub(1, std::memory_order_relaxed);
+        m_slowLaneShed.fetch_add(1, std::memory_order_relaxed);
+        if (pending)
+        {
+            m_provider->ReleaseContext(context);
+        }
+        // A 401 would only bring the handshake straight back to the full lane
+        AuthResult shed;
+        shed.status = AuthStatus::Overloaded;
+        return shed;
     }
 
-    // Simple base64 decode (basic implementation)
-    const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    
-    std::vector<int> T(256, -1);
-    for (int i = 0; i < 64; i++)
-        T[chars[i]] = i;
-
-    int pad = cleanEncoded.size() % 4;
-    if (pad)
-        cleanEncoded.append(4 - pad, '=');
-
-    for (size_t i = 0; i < cleanEncoded.size(); i += 4)
+    auto start = std::chrono::steady_clock::now();
+    m_provider->Accept(*credential, tokenData, tokenLength, pending != nullptr, context, result, expiry);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    if (slowLane)
     {
-        int n = T[cleanEncoded[i]] << 18 | T[cleanEncoded[i + 1]] << 12 | T[cleanEncoded[i + 2]] << 6 | T[cleanEncoded[i + 3]];
-        result.push_back((n >> 16) & 0xFF);
-        if (cleanEncoded[i + 2] != '=')
-            result.push_back((n >> 8) & 0xFF);
-        if (cleanEncoded[i + 3] != '=')
-            result.push_back(n & 0xFF);
+        m_slowLaneInFlight.fetch_sub(1, std::memory_order_relaxed);
     }
+    m_providerNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+    m_legs.fetch_add(1, std::memory_order_relaxed);
 
+    switch (result.status)
+    {
+    case AuthStatus::Success:
+        m_succeeded.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case AuthStatus::ContinueNeeded:
+        // Park the context until the client answers with the next token
+        context.credential = std::move(credential);
+        m_pendingContexts->Put(connectionId, context);
+        m_continued.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        // Blame the token only when it is one client's own: an NTLM or SPNEGO
+        // opening leg can be byte for byte the same for every client
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        result.badToken = pending != nullptr || facts.hasApReq;
+        break;
+    }
     return result;
 }
 
-std::string KerberosAuth::Base64Encode(const std::vector<BYTE>& data)
+AuthStats KerberosAuth::GetStats() const
 {
-    const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::string result;
-    
-    int val = 0, valb = -6;
-    for (BYTE c : data)
-    {
-        val = (val << 8) + c;
-        valb += 8;
-        while (valb >= 0)
-        {
-            result.push_back(chars[(val >> valb) & 0x3F]);
-            valb -= 6;
-        }
+    AuthStats stats;
+    stats.legs = m_legs.load(std::memory_order_relaxed);
+    stats.succeeded = m_succeeded.load(std::memory_order_relaxed);
+    stats.continued = m_continued.load(std::memory_order_relaxed);
+    stats.failed = m_failed.load(std::memory_order_relaxed);
+    stats.slowLaneShed = m_slowLaneShed.load(std::memory_order_relaxed);
+    stats.providerNanoseconds = m_providerNanoseconds.load(std::memory_order_relaxed);
+    if (m_nativeVerifier)
+    {
+        stats.native = m_nativeVerifier->GetStats();
+    }
+    stats.nativeNanoseconds = m_nativeNanoseconds.load(std::memory_order_relaxed);
+    stats.screen = m_screen.GetStats();
+    stats.screenNanoseconds = m_screenNanoseconds.load(std::memory_order_relaxed);
+    if (m_credentials)
+    {
+        stats.credentials = m_credentials->GetStats();
+    }
+    return stats;
+}
+
+void KerberosAuth::Cleanup()
+{
+    m_pendingContexts->Clear();
+    m_tokenCache->Clear();
+    if (m_credentials)
+    {
+        m_credentials->Stop();
+        m_credentials->Release();
+    }
+
+    if (m_provider && m_bInitialized)
+    {
+        m_provider->Cleanup();
+        m_bInitialized = false;
     }
-    
-    if (valb > -6)
-        result.push_back(chars[((val << 8) >> (valb + 8)) & 0x3F]);
-        
-    while (result.size() % 4)
-        result.push_back('=');
-        
-    return result;
 }
\ No newline at end of file
@@ -1,30 +1,93 @@
 #pragma once
 
-#define SECURITY_WIN32
-#include <windows.h>
-#include <sspi.h>
-#include <security.h>
+#include "ApReqVerifier.h"
+#include "AuthProvider.h"
+#include "AuthResult.h"
+#include "CredentialManager.h"
+#include "ServerConfig.h"
+#include "SecurityContextTable.h"
+#include "TokenCache.h"
+#include "TokenScreen.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Counters kept for every provider, so backends can be compared like for like
+struct AuthStats
+{
+    uint64_t legs = 0;              // tokens handed to the provider (cache hits excluded)
+    uint64_t succeeded = 0;
+    uint64_t continued = 0;         // legs answered with another challenge
+    uint64_t failed = 0;            // rejected by the provider, undecodable, or no provider to pass it to
+    uint64_t slowLaneShed = 0;      // NTLM legs refused because the slow lane was full
+    uint64_t providerNanoseconds = 0;   // total time spent inside the provider
+    ApReqStats native;                  // first legs seen by the native verifier
+    uint64_t nativeNanoseconds = 0;
+    TokenScreenStats screen;            // every decoded leg, including those turned away before the provider
+    uint64_t screenNanoseconds = 0;
+    CredentialStats credentials;
+};
+
+// Negotiate front end shared by all providers: decodes tokens into the
+// request arena, answers repeated first legs from the token cache, screens
+// out malformed and misaddressed tokens, tries the native AP-REQ verifier
+// when a keytab is configured, keeps NTLM to a bounded slow lane, parks
+// unfinished handshakes per connection and counts what the provider does.
+// Provider credentials come from a CredentialManager, which refreshes them
+// (and the native verifier's keys) in the background.
 class KerberosAuth
 {
 public:
-    KerberosAuth();
+    explicit KerberosAuth(const ServerConfig& config);
     ~KerberosAuth();
 
     bool Initialize();
-    bool AuthenticateToken(const std::string& base64Token);
+
+    // Runs one leg of the handshake on the connection. First legs go through
+    // the verified-token cache; continuation legs always reach the provider.
+    AuthResult AuthenticateToken(uint64_t connectionId, std::string_view base64Token);
     void Cleanup();
 
+    size_t PendingHandshakes() const { return m_pendingContexts->Size(); }
+    TokenCacheStats GetTokenCacheStats() const { return m_tokenCache->GetStats(); }
+    AuthStats GetStats() const;
+    const wchar_t* ProviderName() const { return m_provider ? m_provider->Name() : L"none"; }
+
 private:
-    bool InitializeSecurityContext();
-    std::vector<BYTE> Base64Decode(const std::string& encoded);
-    std::string Base64Encode(const std::vector<BYTE>& data);
-
-    CredHandle m_hCreds;
-    CtxtHandle m_hContext;
-    bool m_bCredsInitialized;
-    bool m_bContextInitialized;
-    PSecurityFunctionTable m_pSSPI;
+    // One provider call. pending is the context of an earlier leg, or null;
+    // expiry is lowered to the ticket's expiry when it is known. The decoded
+    // token comes from the thread's request arena.
+    AuthResult AcceptToken(uint64_t connectionId, std::string_view base64Token, const PendingContext* pending,
+        TokenCache::Clock::time_point& expiry);
+
+    // Allowed clock skew of the native verifier (MIT's default). Its replay
+    // cache holds twice that many seconds of -replayrate authenticators.
+    static constexpr int CLOCK_SKEW_SECONDS = 300;
+
+    std::unique_ptr<AuthProvider> m_provider;
+    std::unique_ptr<CredentialManager> m_credentials;
+    std::unique_ptr<ApReqVerifier> m_nativeVerifier;
+    std::vector<std::string> m_nativeKeytabs;   // reloaded when one of them changes
+    std::string m_keytab;
+    std::string m_acceptors;
+    std::string m_servicePrincipals;
+    TokenScreen m_screen;
+    size_t m_slowLaneLimit;
+    std::atomic<size_t> m_slowLaneInFlight;
+    std::unique_ptr<SecurityContextTable> m_pendingContexts;   // handshakes waiting for their next leg
+    std::unique_ptr<TokenCache> m_tokenCache;
+    std::wstring m_requestedProvider;
+    bool m_bInitialized;
+
+    std::atomic<uint64_t> m_legs;
+    std::atomic<uint64_t> m_succeeded;
+    std::atomic<uint64_t> m_continued;
+    std::atomic<uint64_t> m_failed;
+    std::atomic<uint64_t> m_slowLaneShed;
+    std::atomic<uint64_t> m_providerNanoseconds;
+    std::atomic<uint64_t> m_nativeNanoseconds;
+    std::atomic<uint64_t> m_screenNanoseconds;
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "KerberosCrypto.h"
+#include "Sha256.h"
+#include <cstring>
+
+namespace
+{
+    // n-fold of the 5-byte usage constants, computed once for the low key
+    // usages (RFC 4120 uses 1-26) rather than for every session key
+    constexpr uint32_t FOLDED_USAGES = 32;
+
+    struct FoldedConstants
+    {
+        uint8_t encryption[FOLDED_USAGES][Aes::BLOCK_SIZE];
+        uint8_t integrity[FOLDED_USAGES][Aes::BLOCK_SIZE];
+
+        FoldedConstants()
+        {
+            for (uint32_t usage = 0; usage < FOLDED_USAGES; usage++)
+            {
+                uint8_t constant[5] = { 0, 0, 0, static_cast<uint8_t>(usage), 0xaa };
+                KerberosCrypto::NFold(constant, sizeof(constant), encryption[usage], Aes::BLOCK_SIZE);
+                constant[4] = 0x55;
+                KerberosCrypto::NFold(constant, sizeof(constant), integrity[usage], Aes::BLOCK_SIZE);
+            }
+        }
+    };
+
+    void FoldUsage(uint32_t usage, uint8_t kind, uint8_t* folded)
+    {
+        if (usage < FOLDED_USAGES)
+        {
+            static const FoldedConstants constants;
+            memcpy(folded, kind == 0xaa ? constants.encryption[usage] : constants.integrity[usage], Aes::BLOCK_SIZE);
+            return;
+        }
+        uint8_t constant[5] = { static_cast<uint8_t>(usage >> 24), static_cast<uint8_t>(usage >> 16),
+            static_cast<uint8_t>(usage >> 8), static_cast<uint8_t>(usage), kind };
+        KerberosCrypto::NFold(constant, sizeof(constant), folded, Aes::BLOCK_SIZE);
+    }
+}
+
+bool KerberosCrypto::IsSupported(int32_t etype)
+{
+    return etype == AES128_CTS_HMAC_SHA1_96 || etype == AES256_CTS_HMAC_SHA1_96;
+}
+
+size_t KerberosCrypto::KeySize(int32_t etype)
+{
+    switch (etype)
+    {
+    case AES128_CTS_HMAC_SHA1_96:
+        return 16;
+    case AES256_CTS_HMAC_SHA1_96:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+void KerberosCrypto::NFold(const uint8_t* in, size_t inLength, uint8_t* out, size_t outLength)
+{
+    // Rotate the input right by 13 bits per copy and add the copies into the
+    // output with ones'-complement addition, over lcm(inLength, outLength) bytes
+    size_t a = inLength;
+    size_t b = outLength;
+    while (b != 0)
+    {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    size_t lcm = inLength / a * outLength;
+
+    memset(out, 0, outLength);
+    unsigned carry = 0;
+    size_t inBits = inLength * 8;
+    for (size_t i = lcm; i-- > 0;)
+    {
+        size_t msbit = ((inBits - 1) + ((inBits + 13) * (i / inLength)) + ((inLength - (i % inLength)) * 8)) % inBits;
+        unsigned value = ((static_cast<unsigned>(in[((inLength - 1) - (msbit >> 3)) % inLength]) << 8) |
+                          in[(inLength - (msbit >> 3)) % inLength]) >> ((msbit & 7) + 1);
+        carry += (value & 0xff) + out[i % outLength];
+        out[i % outLength] = static_cast<uint8_t>(carry);
+        carry >>= 8;
+    }
+
+    // End-around carry
+    while (carry != 0)
+    {
+        for (size_t i = outLength; i-- > 0 && carry != 0;)
+        {
+            carry += out[i];
+            out[i] = static_cast<uint8_t>(carry);
+            carry >>= 8;
+        }
+    }
+}
+
+bool KerberosCrypto::DeriveKey(const uint8_t* base, size_t keyLength, const uint8_t* constant, size_t constantLength,
+    uint8_t* out)
+{
+    Aes cipher;
+    if (!cipher.SetKey(base, keyLength))
+    {
+        return false;
+    }
+    uint8_t block[Aes::BLOCK_SIZE];
+    NFold(constant, constantLength, block, sizeof(block));
+    DeriveKey(cipher, keyLength, block, out);
+    return true;
+}
+
+void KerberosCrypto::DeriveKey(const Aes& base, size_t keyLength, const uint8_t* folded, uint8_t* out)
+{
+    // For AES, random-to-key is the identity
+    uint8_t block[Aes::BLOCK_SIZE];
+    memcpy(block, folded, sizeof(block));
+    for (size_t produced = 0; produced < keyLength; produced += Aes::BLOCK_SIZE)
+    {
+        base.EncryptBlock(block, block);
+        memcpy(out + produced, block, Aes::BLOCK_SIZE);
+    }
+}
+
+KerberosUsageKey::KerberosUsageKey()
+    : m_initialized(false)
+{
+}
+
+bool KerberosUsageKey::Initialize(int32_t etype, const uint8_t* baseKey, size_t keyLength, uint32_t usage)
+{
+    m_initialized = false;
+    if (KerberosCrypto::KeySize(etype) != keyLength)
+    {
+        return false;
+    }
+
+    // Both keys come from the same base key schedule
+    Aes base;
+    if (!base.SetKey(baseKey, keyLength))
+    {
+        return false;
+    }
+
+    uint8_t folded[Aes::BLOCK_SIZE];
+    uint8_t derived[KerberosCrypto::MAX_KEY_SIZE];
+    FoldUsage(usage, 0xaa, folded);
+    KerberosCrypto::DeriveKey(base, keyLength, folded, derived);
+    if (!m_encryption.SetKey(derived, keyLength))
+    {
+        return false;
+    }
+
+    FoldUsage(usage, 0x55, folded);
+    KerberosCrypto::DeriveKey(base, keyLength, folded, derived);
+    m_integrity = HmacSha1(derived, keyLength);
+    m_initialized = true;
+    return true;
+}
+
+bool KerberosUsageKey::Decrypt(const uint8_t* cipher, size_t length, uint8_t* scratch, const uint8_t*& plain,
+    size_t& plainLength) const
+{
+    if (!m_initialized || length < KerberosCrypto::CONFOUNDER_SIZE + KerberosCrypto::CHECKSUM_SIZE)
+    {
+        return false;
+    }
+
+    size_t encrypted = length - KerberosCrypto::CHECKSUM_SIZE;
+    m_encryption.DecryptCts(cipher, encrypted, scratch);
+
+    Sha1::Digest mac = m_integrity.Compute(scratch, encrypted);
+    if (!ConstantTimeEquals(mac.data(), cipher + encrypted, KerberosCrypto::CHECKSUM_SIZE))
+    {
+        return false;
+    }
+
+    plain = scratch + KerberosCrypto::CONFOUNDER_SIZE;
+    plainLength = encrypted - KerberosCrypto::CONFOUNDER_SIZE;
+    return true;
+}
+
+void KerberosUsageKey::Encrypt(const uint8_t* confounder, const uint8_t* plain, size_t length, uint8_t* scratch,
+    uint8_t* out) const
+{
+    memcpy(scratch, confounder, KerberosCrypto::CONFOUNDER_SIZE);
+    memcpy(scratch + KerberosCrypto::CONFOUNDER_SIZE, plain, length);
+
+    size_t encrypted = KerberosCrypto::CONFOUNDER_SIZE + length;
+    m_encryption.EncryptCts(scratch, encrypted, out);
+    Sha1::Digest mac = m_integrity.Compute(scratch, encrypted);
+    memcpy(out + encrypted, mac.data(), KerberosCrypto::CHECKSUM_SIZE);
+}
\ No newline at end of file
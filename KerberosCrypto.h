@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Aes.h"
+#include "Sha1.h"
+#include <cstddef>
+#include <cstdint>
+
+// The two Kerberos encryption types the native verifier implements:
+// aes128-cts-hmac-sha1-96 and aes256-cts-hmac-sha1-96 (RFC 3962 on the
+// simplified profile of RFC 3961). Everything else is left to the library.
+class KerberosCrypto
+{
+public:
+    static constexpr int32_t AES128_CTS_HMAC_SHA1_96 = 17;
+    static constexpr int32_t AES256_CTS_HMAC_SHA1_96 = 18;
+
+    static constexpr size_t CONFOUNDER_SIZE = 16;
+    static constexpr size_t CHECKSUM_SIZE = 12;
+    static constexpr size_t MAX_KEY_SIZE = 32;
+
+    // Key usages of RFC 4120 7.5.1 that an AP exchange touches
+    static constexpr uint32_t USAGE_TICKET = 2;
+    static constexpr uint32_t USAGE_AUTHENTICATOR = 11;
+    static constexpr uint32_t USAGE_AP_REP = 12;
+
+    static bool IsSupported(int32_t etype);
+
+    // Key length in bytes for a supported etype, otherwise 0
+    static size_t KeySize(int32_t etype);
+
+    // n-fold of RFC 3961 5.1
+    static void NFold(const uint8_t* in, size_t inLength, uint8_t* out, size_t outLength);
+
+    // DK(base, constant): the constant n-folded to a block and encrypted
+    // repeatedly under the base key until keyLength bytes are produced
+    static bool DeriveKey(const uint8_t* base, size_t keyLength, const uint8_t* constant, size_t constantLength, uint8_t* out);
+    // The same with the base key schedule and the n-folded constant at hand
+    static void DeriveKey(const Aes& base, size_t keyLength, const uint8_t* folded, uint8_t* out);
+
+    // Ciphertext overhead: confounder in front, truncated HMAC behind
+    static size_t EncryptedLength(size_t plainLength) { return CONFOUNDER_SIZE + plainLength + CHECKSUM_SIZE; }
+};
+
+// The encryption key Ke and integrity key Ki derived for one key usage, with
+// the AES schedule and the HMAC pads computed once. Keytab keys keep one of
+// these per entry for the ticket usage; session keys derive theirs per
+// message.
+class KerberosUsageKey
+{
+public:
+    KerberosUsageKey();
+
+    bool Initialize(int32_t etype, const uint8_t* baseKey, size_t keyLength, uint32_t usage);
+    bool Initialized() const { return m_initialized; }
+
+    // Decrypts into scratch (at least length bytes) and checks the HMAC in
+    // constant time. On success plain points past the confounder in scratch.
+    bool Decrypt(const uint8_t* cipher, size_t length, uint8_t* scratch, const uint8_t*& plain, size_t& plainLength) const;
+
+    // Writes EncryptedLength(length) bytes; scratch holds at least
+    // CONFOUNDER_SIZE + length bytes
+    void Encrypt(const uint8_t* confounder, const uint8_t* plain, size_t length, uint8_t* scratch, uint8_t* out) const;
+
+private:
+    Aes m_encryption;
+    HmacSha1 m_integrity;
+    bool m_initialized;
+};
\ No newline at end of file
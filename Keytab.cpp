@@ -0,0 +1,176 @@
+#include "Keytab.h"
+#include <cstdio>
+
+namespace
+{
+    // Big-endian fields of one entry, bounded by the entry's declared size
+    class EntryReader
+    {
+    public:
+        EntryReader(const uint8_t* data, size_t length)
+            : m_data(data)
+            , m_remaining(length)
+        {
+        }
+
+        size_t Remaining() const { return m_remaining; }
+
+        bool Read(uint32_t& value, size_t bytes)
+        {
+            if (m_remaining < bytes)
+            {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < bytes; i++)
+            {
+                value = (value << 8) | m_data[i];
+            }
+            m_data += bytes;
+            m_remaining -= bytes;
+            return true;
+        }
+
+        bool ReadCounted(const uint8_t*& bytes, size_t& length)
+        {
+            uint32_t count = 0;
+            if (!Read(count, 2) || m_remaining < count)
+            {
+                return false;
+            }
+            bytes = m_data;
+            length = count;
+            m_data += count;
+            m_remaining -= count;
+            return true;
+        }
+
+        bool ReadString(std::string& value)
+        {
+            const uint8_t* bytes = nullptr;
+            size_t length = 0;
+            if (!ReadCounted(bytes, length))
+            {
+                return false;
+            }
+            value.assign(reinterpret_cast<const char*>(bytes), length);
+            return true;
+        }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_remaining;
+    };
+
+    bool ParseEntry(const uint8_t* data, size_t length, KeytabEntry& entry)
+    {
+        EntryReader reader(data, length);
+        uint32_t componentCount = 0;
+        if (!reader.Read(componentCount, 2) || !reader.ReadString(entry.realm))
+        {
+            return false;
+        }
+
+        entry.components.resize(componentCount);
+        entry.principal.clear();
+        for (uint32_t i = 0; i < componentCount; i++)
+        {
+            if (!reader.ReadString(entry.components[i]))
+            {
+                return false;
+            }
+            if (i > 0)
+            {
+                entry.principal += '/';
+            }
+            entry.principal += entry.components[i];
+        }
+        entry.principal += '@';
+        entry.principal += entry.realm;
+
+        uint32_t nameType = 0;
+        uint32_t timestamp = 0;
+        uint32_t kvno8 = 0;
+        uint32_t keyType = 0;
+        const uint8_t* key = nullptr;
+        size_t keyLength = 0;
+        if (!reader.Read(nameType, 4) || !reader.Read(timestamp, 4) || !reader.Read(kvno8, 1) ||
+            !reader.Read(keyType, 2) || !reader.ReadCounted(key, keyLength))
+        {
+            return false;
+        }
+        entry.etype = static_cast<int32_t>(keyType);
+        entry.key.assign(key, key + keyLength);
+
+        // A 32-bit kvno follows when the 8-bit one overflowed; zero means absent
+        uint32_t kvno32 = 0;
+        entry.kvno = (reader.Remaining() >= 4 && reader.Read(kvno32, 4) && kvno32 != 0) ? kvno32 : kvno8;
+        return true;
+    }
+}
+
+bool Keytab::Parse(const uint8_t* data, size_t length, std::vector<KeytabEntry>& entries)
+{
+    if (length < 2 || data[0] != 0x05 || data[1] != 0x02)
+    {
+        return false;
+    }
+
+    size_t offset = 2;
+    while (length - offset >= 4)
+    {
+        int32_t size = static_cast<int32_t>((static_cast<uint32_t>(data[offset]) << 24) |
+            (static_cast<uint32_t>(data[offset + 1]) << 16) | (static_cast<uint32_t>(data[offset + 2]) << 8) |
+            data[offset + 3]);
+        offset += 4;
+        if (size == 0)
+        {
+            break;
+        }
+
+        // Negative sizes are holes left by deleted entries
+        size_t span = size < 0 ? static_cast<size_t>(-static_cast<int64_t>(size)) : static_cast<size_t>(size);
+        if (span > length - offset)
+        {
+            break;
+        }
+        if (size > 0)
+        {
+            KeytabEntry entry;
+            if (ParseEntry(data + offset, span, entry))
+            {
+                entries.push_back(std::move(entry));
+            }
+        }
+        offset += span;
+    }
+    return true;
+}
+
+bool Keytab::Load(const std::string& name, std::vector<KeytabEntry>& entries)
+{
+    std::string path = name;
+    if (path.compare(0, 5, "FILE:") == 0)
+    {
+        path.erase(0, 5);
+    }
+    else if (path.compare(0, 7, "WRFILE:") == 0)
+    {
+        path.erase(0, 7);
+    }
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<uint8_t> contents;
+    uint8_t chunk[4096];
+    size_t got = 0;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        contents.insert(contents.end(), chunk, chunk + got);
+    }
+    fclose(file);
+    return Parse(contents.data(), contents.size(), entries);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One key of a keytab: the service principal it belongs to, the key version
+// and the raw key bytes of one encryption type
+struct KeytabEntry
+{
+    std::string principal;      // "HTTP/host.example.com@EXAMPLE.COM"
+    std::string realm;
+    std::vector<std::string> components;
+    uint32_t kvno = 0;
+    int32_t etype = 0;
+    std::vector<uint8_t> key;
+};
+
+// Reads MIT/Heimdal keytab files (format 0x0502, the one ktutil, kadmin and
+// ktpass write). Deleted entries are skipped; so is a truncated last entry.
+class Keytab
+{
+public:
+    // Accepts a path or a "FILE:" / "WRFILE:" keytab name
+    static bool Load(const std::string& name, std::vector<KeytabEntry>& entries);
+    static bool Parse(const uint8_t* data, size_t length, std::vector<KeytabEntry>& entries);
+};
\ No newline at end of file
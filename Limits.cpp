@@ -0,0 +1,134 @@
+#include "Limits.h"
+#include "Log.h"
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    std::string_view Trim(std::string_view text)
+    {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+        {
+            return std::string_view();
+        }
+        size_t last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    bool ParseUnsigned(std::string_view text, unsigned& value)
+    {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+}
+
+Limits DefaultLimits(const ServerConfig& config)
+{
+    Limits limits;
+    limits.admission.clientRate = config.clientRate;
+    limits.admission.clientBurst = config.clientBurst;
+    limits.admission.rejectSeconds = config.rejectSeconds;
+    limits.quotas.standard.concurrency = config.userConcurrency;
+    limits.quotas.standard.rate = config.userRate;
+    limits.quotas.windowSeconds = config.userWindowSeconds;
+    return limits;
+}
+
+bool LoadLimits(const std::string& path, const Limits& defaults, Limits& limits)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        Log::Write(LogLevel::Error) << L"Cannot read limits " << path;
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    Limits loaded = defaults;
+    if (!ParseLimits(text.str(), loaded))
+    {
+        return false;
+    }
+    limits = loaded;
+    return true;
+}
+
+bool ParseLimits(std::string_view text, Limits& limits)
+{
+    size_t lineNumber = 0;
+    while (!text.empty())
+    {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        lineNumber++;
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t space = line.find_first_of(" \t");
+        std::string_view name = line.substr(0, space);
+        std::string_view value = space == std::string_view::npos ? std::string_view() : Trim(line.substr(space));
+        if (name == "quota")
+        {
+            // The subject is everything before the last two fields, so an
+            // SSPI name may have spaces
+            size_t rateStart = value.find_last_of(" \t");
+            std::string_view rest = rateStart == std::string_view::npos ? std::string_view() : Trim(value.substr(0, rateStart));
+            size_t concurrencyStart = rest.find_last_of(" \t");
+            std::string_view subject = concurrencyStart == std::string_view::npos ? std::string_view() : Trim(rest.substr(0, concurrencyStart));
+            QuotaRule rule;
+            if (subject.empty() || !ParseUnsigned(rest.substr(concurrencyStart + 1), rule.concurrency) ||
+                !ParseUnsigned(value.substr(rateStart + 1), rule.rate))
+            {
+                Log::Write(LogLevel::Error) << L"Limits line " << lineNumber << L": expected a subject and two numbers after quota";
+                return false;
+            }
+            limits.quotas.subjects.emplace_back(std::string(subject), rule);
+            continue;
+        }
+
+        unsigned* setting = nullptr;
+        if (name == "clientrate")
+        {
+            setting = &limits.admission.clientRate;
+        }
+        else if (name == "clientburst")
+        {
+            setting = &limits.admission.clientBurst;
+        }
+        else if (name == "rejectttl")
+        {
+            setting = &limits.admission.rejectSeconds;
+        }
+        else if (name == "userconcurrency")
+        {
+            setting = &limits.quotas.standard.concurrency;
+        }
+        else if (name == "userrate")
+        {
+            setting = &limits.quotas.standard.rate;
+        }
+        else if (name == "userwindow")
+        {
+            setting = &limits.quotas.windowSeconds;
+        }
+        else
+        {
+            Log::Write(LogLevel::Error) << L"Limits line " << lineNumber << L": unknown setting \"" << name << L"\"";
+            return false;
+        }
+
+        if (!ParseUnsigned(value, *setting))
+        {
+            Log::Write(LogLevel::Error) << L"Limits line " << lineNumber << L": expected a number after " << name;
+            return false;
+        }
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "AdmissionControl.h"
+#include "PrincipalQuotas.h"
+#include "ServerConfig.h"
+#include <string>
+#include <string_view>
+
+// Limits that can change while the service runs. They start from the command
+// line and are overridden by the limits file (-limits), one setting per line:
+//
+//     # name       value
+//     clientrate   20      # Negotiate tokens per second per client address
+//     clientburst  40
+//     rejectttl    10      # seconds a rejected token is answered 401 untried
+//     userconcurrency 8    # requests past authentication per principal at once
+//     userrate     600     # requests per principal per window
+//     userwindow   60      # seconds
+//
+//     # quota    subject                 at once   per window
+//     quota      svc-backup@EXAMPLE.COM  2         60
+//     quota      S-1-5-21-1004336348-1177238915-682003330-1105  32  6000
+//     quota      @PARTNER.ORG            4         100
+//
+// A quota line gives a principal, the principals of a realm or the members of
+// a group (by SID) their own limits in place of the user ones; 0 is no limit.
+// A principal's own line wins, then whichever of its realm and groups comes
+// first; a second line for the same subject is ignored.
+//
+// The file is read at start and again on SIGHUP (Linux) or the service's
+// paramchange control (Windows: sc control KerberosEchoService paramchange).
+// A setting the file no longer has goes back to its command line value; a
+// file with an error leaves the running limits as they were.
+struct Limits
+{
+    AdmissionLimits admission;
+    QuotaLimits quotas;
+};
+
+// The command line's limits
+Limits DefaultLimits(const ServerConfig& config);
+
+// defaults overridden by the file at path; false, with the reason logged, on
+// any error
+bool LoadLimits(const std::string& path, const Limits& defaults, Limits& limits);
+bool ParseLimits(std::string_view text, Limits& limits);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "ListenSocket.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int CreateListenSocket(int port)
+{
+    // Prefer a dual-stack socket, fall back to IPv4 only
+    bool ipv6 = true;
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        ipv6 = false;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd < 0)
+    {
+        Log::Write(LogLevel::Error) << L"socket failed: " << strerror(errno);
+        return -1;
+    }
+
+    int one = 1;
+    int zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+    {
+        Log::Write(LogLevel::Error) << L"SO_REUSEPORT failed: " << strerror(errno);
+        close(fd);
+        return -1;
+    }
+
+    int result;
+    if (ipv6)
+    {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(static_cast<uint16_t>(port));
+        result = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+    else
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        result = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+
+    if (result != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        Log::Write(LogLevel::Error) << L"Failed to listen on port " << port << L": " << strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+#pragma once
+
+// Creates a non-blocking, dual-stack TCP listener on port with SO_REUSEPORT,
+// so every event loop can own its own listener and the kernel spreads new
+// connections between them. Accepted sockets inherit TCP_NODELAY.
+// Returns -1 on failure.
+int CreateListenSocket(int port);
\ No newline at end of file
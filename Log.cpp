@@ -0,0 +1,731 @@
+#include "Log.h"
+#include "ServerConfig.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+    enum class SinkKind
+    {
+        Console,
+        File,
+        EventLog,
+        Journald
+    };
+
+    // One per thread that has logged; reused by a new thread once its owner
+    // has exited and the consumer has drained it
+    struct Ring
+    {
+        alignas(64) std::atomic<uint64_t> head{ 0 };    // written by the owning thread
+        alignas(64) std::atomic<uint64_t> tail{ 0 };    // written by the consumer
+        std::atomic<uint64_t> dropped{ 0 };
+        std::atomic<bool> owned{ true };
+        uint32_t threadId = 0;
+        LogRecord slots[Log::RING_SLOTS];
+    };
+
+    struct RingOwner
+    {
+        Ring* ring = nullptr;
+        ~RingOwner()
+        {
+            if (ring)
+            {
+                ring->owned.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    std::mutex g_registryMutex;
+    std::vector<Ring*> g_rings;
+    std::atomic<uint32_t> g_nextThreadId{ 1 };
+    thread_local RingOwner t_owner;
+
+    struct Consumer
+    {
+        SinkKind sink = SinkKind::Console;
+        std::wstring source;
+        std::string sourceUtf8;
+        FILE* file = nullptr;
+#ifdef _WIN32
+        HANDLE eventSource = nullptr;
+#else
+        int journal = -1;
+        sockaddr_un journalAddress = {};
+#endif
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+        uint64_t flushRequested = 0;
+        uint64_t flushed = 0;
+        std::condition_variable flushedCondition;
+        std::thread thread;
+        std::vector<LogRecord> batch;
+        std::string text;
+        uint64_t reportedDrops = 0;
+        std::atomic<uint64_t> written{ 0 };
+
+        ~Consumer()
+        {
+            // Only reached without Log::Stop when the process is exiting anyway
+            if (thread.joinable())
+            {
+                thread.detach();
+            }
+        }
+    };
+
+    Consumer g_consumer;
+
+    uint32_t ThreadId()
+    {
+        thread_local uint32_t id = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    int64_t NowMicroseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    Ring* ThreadRing()
+    {
+        if (t_owner.ring)
+        {
+            return t_owner.ring;
+        }
+
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        Ring* ring = nullptr;
+        for (Ring* candidate : g_rings)
+        {
+            if (!candidate->owned.load(std::memory_order_acquire) &&
+                candidate->tail.load(std::memory_order_acquire) == candidate->head.load(std::memory_order_relaxed))
+            {
+                ring = candidate;
+                break;
+            }
+        }
+        if (!ring)
+        {
+            ring = new Ring();
+            g_rings.push_back(ring);
+        }
+        ring->threadId = ThreadId();
+        ring->owned.store(true, std::memory_order_relaxed);
+        t_owner.ring = ring;
+        return ring;
+    }
+
+    void AppendUtf8(char* text, uint16_t& length, std::string_view piece)
+    {
+        size_t room = LOG_TEXT_BYTES - length;
+        if (piece.size() > room)
+        {
+            // Cut on a character boundary
+            size_t cut = room;
+            while (cut > 0 && (static_cast<unsigned char>(piece[cut]) & 0xC0) == 0x80)
+            {
+                cut--;
+            }
+            piece = piece.substr(0, cut);
+        }
+        memcpy(text + length, piece.data(), piece.size());
+        length = static_cast<uint16_t>(length + piece.size());
+    }
+
+    // wchar_t is UTF-16 on Windows and UTF-32 elsewhere
+    void AppendWide(char* text, uint16_t& length, std::wstring_view piece)
+    {
+        for (size_t i = 0; i < piece.size(); i++)
+        {
+            uint32_t code = static_cast<uint32_t>(piece[i]);
+            if (code >= 0xD800 && code < 0xDC00 && i + 1 < piece.size())
+            {
+                uint32_t low = static_cast<uint32_t>(piece[i + 1]);
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+
+            char bytes[4];
+            size_t count;
+            if (code < 0x80)
+            {
+                bytes[0] = static_cast<char>(code);
+                count = 1;
+            }
+            else if (code < 0x800)
+            {
+                bytes[0] = static_cast<char>(0xC0 | (code >> 6));
+                bytes[1] = static_cast<char>(0x80 | (code & 0x3F));
+                count = 2;
+            }
+            else if (code < 0x10000)
+            {
+                bytes[0] = static_cast<char>(0xE0 | (code >> 12));
+                bytes[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                bytes[2] = static_cast<char>(0x80 | (code & 0x3F));
+                count = 3;
+            }
+            else
+            {
+                bytes[0] = static_cast<char>(0xF0 | (code >> 18));
+                bytes[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                bytes[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                bytes[3] = static_cast<char>(0x80 | (code & 0x3F));
+                count = 4;
+            }
+            if (length + count > LOG_TEXT_BYTES)
+            {
+                return;
+            }
+            memcpy(text + length, bytes, count);
+            length = static_cast<uint16_t>(length + count);
+        }
+    }
+
+    std::wstring Utf8ToWide(std::string_view text)
+    {
+        std::wstring wide;
+        wide.reserve(text.size());
+        for (size_t i = 0; i < text.size();)
+        {
+            unsigned char lead = static_cast<unsigned char>(text[i]);
+            size_t count = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+            if (count > text.size() - i)
+            {
+                break;
+            }
+            uint32_t code = count == 1 ? lead : lead & (0x7F >> count);
+            for (size_t j = 1; j < count; j++)
+            {
+                code = (code << 6) | (static_cast<unsigned char>(text[i + j]) & 0x3F);
+            }
+            i += count;
+            if (sizeof(wchar_t) == 2 && code >= 0x10000)
+            {
+                code -= 0x10000;
+                wide.push_back(static_cast<wchar_t>(0xD800 + (code >> 10)));
+                wide.push_back(static_cast<wchar_t>(0xDC00 + (code & 0x3FF)));
+            }
+            else
+            {
+                wide.push_back(static_cast<wchar_t>(code));
+            }
+        }
+        return wide;
+    }
+
+    // The message plus the limiter's count, as every sink shows it
+    std::string_view Message(const LogRecord& record, char* buffer, size_t size)
+    {
+        if (record.suppressed == 0)
+        {
+            return std::string_view(record.text, record.length);
+        }
+        int length = snprintf(buffer, size, "%.*s (%u similar suppressed)", static_cast<int>(record.length), record.text,
+            record.suppressed);
+        return std::string_view(buffer, (std::min)(static_cast<size_t>((std::max)(length, 0)), size - 1));
+    }
+
+    // "2026-01-31T12:00:00.123456Z WARNING [7] message"
+    void AppendFileLine(std::string& out, const LogRecord& record)
+    {
+        time_t seconds = static_cast<time_t>(record.unixMicroseconds / 1000000);
+        tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char prefix[80];
+        size_t length = strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &utc);
+        snprintf(prefix + length, sizeof(prefix) - length, ".%06lldZ %s [%u] ",
+            static_cast<long long>(record.unixMicroseconds % 1000000), LEVEL_NAMES[static_cast<size_t>(record.level)],
+            record.threadId);
+
+        char buffer[LOG_TEXT_BYTES + 48];
+        out.append(prefix);
+        out.append(Message(record, buffer, sizeof(buffer)));
+        out.push_back('\n');
+    }
+
+    void WriteBatch(Consumer& consumer)
+    {
+        // Rings are drained one after another, so restore time order across threads
+        std::stable_sort(consumer.batch.begin(), consumer.batch.end(),
+            [](const LogRecord& a, const LogRecord& b) { return a.unixMicroseconds < b.unixMicroseconds; });
+
+        char buffer[LOG_TEXT_BYTES + 48];
+        switch (consumer.sink)
+        {
+        case SinkKind::Console:
+            for (const LogRecord& record : consumer.batch)
+            {
+                std::wcout << Utf8ToWide(Message(record, buffer, sizeof(buffer))) << L'\n';
+            }
+            std::wcout.flush();
+            break;
+        case SinkKind::File:
+            consumer.text.clear();
+            for (const LogRecord& record : consumer.batch)
+            {
+                AppendFileLine(consumer.text, record);
+            }
+            fwrite(consumer.text.data(), 1, consumer.text.size(), consumer.file);
+            fflush(consumer.file);
+            break;
+#ifdef _WIN32
+        case SinkKind::EventLog:
+            for (const LogRecord& record : consumer.batch)
+            {
+                WORD type = record.level == LogLevel::Error ? EVENTLOG_ERROR_TYPE :
+                    record.level == LogLevel::Warning ? EVENTLOG_WARNING_TYPE : EVENTLOG_INFORMATION_TYPE;
+                std::wstring message = Utf8ToWide(Message(record, buffer, sizeof(buffer)));
+                const wchar_t* strings[2] = { consumer.source.c_str(), message.c_str() };
+                ReportEventW(consumer.eventSource, type, 0, 0, nullptr, 2, 0, strings, nullptr);
+            }
+            break;
+#else
+        case SinkKind::Journald:
+            for (const LogRecord& record : consumer.batch)
+            {
+                // Native protocol, one datagram per entry; syslog priorities 7 (debug) to 3 (err)
+                static const int PRIORITIES[] = { 7, 6, 4, 3 };
+                consumer.text.assign("PRIORITY=");
+                consumer.text.push_back(static_cast<char>('0' + PRIORITIES[static_cast<size_t>(record.level)]));
+                consumer.text.append("\nSYSLOG_IDENTIFIER=").append(consumer.sourceUtf8);
+                consumer.text.append("\nMESSAGE=").append(Message(record, buffer, sizeof(buffer)));
+                std::replace(consumer.text.begin() + static_cast<std::ptrdiff_t>(consumer.text.rfind("MESSAGE=")),
+                    consumer.text.end(), '\n', ' ');
+                consumer.text.push_back('\n');
+                sendto(consumer.journal, consumer.text.data(), consumer.text.size(), MSG_NOSIGNAL,
+                    reinterpret_cast<const sockaddr*>(&consumer.journalAddress), sizeof(consumer.journalAddress));
+            }
+            break;
+#endif
+        default:
+            break;
+        }
+        consumer.written.fetch_add(consumer.batch.size(), std::memory_order_relaxed);
+    }
+
+    void Drain(Consumer& consumer)
+    {
+        consumer.batch.clear();
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(g_registryMutex);
+            for (Ring* ring : g_rings)
+            {
+                uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+                uint64_t head = ring->head.load(std::memory_order_acquire);
+                for (; tail != head; tail++)
+                {
+                    consumer.batch.push_back(ring->slots[tail % Log::RING_SLOTS]);
+                }
+                ring->tail.store(tail, std::memory_order_release);
+                dropped += ring->dropped.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (dropped > consumer.reportedDrops)
+        {
+            LogRecord record = {};
+            record.unixMicroseconds = NowMicroseconds();
+            record.level = LogLevel::Warning;
+            record.threadId = 0;
+            int length = snprintf(record.text, sizeof(record.text), "Log buffers full: %llu messages dropped (%llu in total)",
+                static_cast<unsigned long long>(dropped - consumer.reportedDrops), static_cast<unsigned long long>(dropped));
+            record.length = static_cast<uint16_t>((std::min)(static_cast<size_t>((std::max)(length, 0)), sizeof(record.text) - 1));
+            consumer.batch.push_back(record);
+            consumer.reportedDrops = dropped;
+        }
+
+        if (!consumer.batch.empty())
+        {
+            WriteBatch(consumer);
+        }
+    }
+
+    void ConsumerThread()
+    {
+        std::unique_lock<std::mutex> lock(g_consumer.mutex);
+        while (!g_consumer.stopping)
+        {
+            g_consumer.condition.wait_for(lock, std::chrono::milliseconds(Log::FLUSH_INTERVAL_MS),
+                [] { return g_consumer.stopping || g_consumer.flushRequested != g_consumer.flushed; });
+            uint64_t requested = g_consumer.flushRequested;
+            lock.unlock();
+            Drain(g_consumer);
+            lock.lock();
+            g_consumer.flushed = requested;
+            g_consumer.flushedCondition.notify_all();
+        }
+    }
+}
+
+std::atomic<LogLevel> Log::s_minimum{ LogLevel::Info };
+std::atomic<bool> Log::s_running{ false };
+std::atomic<uint32_t> Log::s_sampleEvery{ 1 };
+std::atomic<uint32_t> Log::s_ratePerSecond{ 0 };
+std::atomic<uint64_t> Log::s_suppressed{ 0 };
+
+bool Log::Start(const ServerConfig& config, const std::wstring& source)
+{
+    if (s_running.load())
+    {
+        return true;
+    }
+
+    if (config.logLevel == L"debug")
+    {
+        s_minimum = LogLevel::Debug;
+    }
+    else if (config.logLevel == L"warning")
+    {
+        s_minimum = LogLevel::Warning;
+    }
+    else if (config.logLevel == L"error")
+    {
+        s_minimum = LogLevel::Error;
+    }
+    else
+    {
+        s_minimum = LogLevel::Info;
+    }
+    s_sampleEvery = (std::max)(config.logSampleEvery, 1u);
+    s_ratePerSecond = config.logRatePerSecond;
+
+    Consumer& consumer = g_consumer;
+    consumer.source = source;
+    consumer.sourceUtf8.assign(source.begin(), source.end());
+    consumer.sink = SinkKind::Console;
+    bool opened = true;
+    if (config.logSink.empty() || config.logSink == L"console")
+    {
+    }
+#ifdef _WIN32
+    else if (config.logSink == L"eventlog")
+    {
+        consumer.eventSource = RegisterEventSourceW(nullptr, source.c_str());
+        opened = consumer.eventSource != nullptr;
+        if (opened)
+        {
+            consumer.sink = SinkKind::EventLog;
+        }
+    }
+    else
+    {
+        opened = _wfopen_s(&consumer.file, config.logSink.c_str(), L"ab") == 0;
+        if (opened)
+        {
+            consumer.sink = SinkKind::File;
+        }
+    }
+#else
+    else if (config.logSink == L"journald")
+    {
+        consumer.journal = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        consumer.journalAddress.sun_family = AF_UNIX;
+        strncpy(consumer.journalAddress.sun_path, "/run/systemd/journal/socket", sizeof(consumer.journalAddress.sun_path) - 1);
+        opened = consumer.journal >= 0 && access(consumer.journalAddress.sun_path, W_OK) == 0;
+        if (opened)
+        {
+            consumer.sink = SinkKind::Journald;
+        }
+        else if (consumer.journal >= 0)
+        {
+            close(consumer.journal);
+            consumer.journal = -1;
+        }
+    }
+    else
+    {
+        std::string path(config.logSink.begin(), config.logSink.end());
+        consumer.file = fopen(path.c_str(), "ab");
+        opened = consumer.file != nullptr;
+        if (opened)
+        {
+            consumer.sink = SinkKind::File;
+        }
+    }
+#endif
+    if (!opened)
+    {
+        std::wcout << L"Cannot open log sink " << config.logSink << L"; logging to the console" << std::endl;
+    }
+
+    consumer.stopping = false;
+    consumer.thread = std::thread(ConsumerThread);
+    s_running = true;
+    return opened;
+}
+
+void Log::Stop()
+{
+    if (!s_running.exchange(false))
+    {
+        return;
+    }
+
+    // Lines from here on go straight to the console; whatever is buffered is
+    // written out by the consumer's last pass
+    {
+        std::lock_guard<std::mutex> lock(g_consumer.mutex);
+        g_consumer.stopping = true;
+    }
+    g_consumer.condition.notify_all();
+    g_consumer.thread.join();
+    Drain(g_consumer);
+
+    if (g_consumer.file)
+    {
+        fclose(g_consumer.file);
+        g_consumer.file = nullptr;
+    }
+#ifdef _WIN32
+    if (g_consumer.eventSource)
+    {
+        DeregisterEventSource(g_consumer.eventSource);
+        g_consumer.eventSource = nullptr;
+    }
+#else
+    if (g_consumer.journal >= 0)
+    {
+        close(g_consumer.journal);
+        g_consumer.journal = -1;
+    }
+#endif
+    g_consumer.sink = SinkKind::Console;
+}
+
+void Log::Flush()
+{
+    if (!s_running.load())
+    {
+        std::wcout.flush();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(g_consumer.mutex);
+    uint64_t target = ++g_consumer.flushRequested;
+    g_consumer.condition.notify_one();
+    g_consumer.flushedCondition.wait(lock, [target] { return g_consumer.flushed >= target || g_consumer.stopping; });
+}
+
+LogStats Log::GetStats()
+{
+    LogStats stats;
+    stats.written = g_consumer.written.load(std::memory_order_relaxed);
+    stats.suppressed = s_suppressed.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (const Ring* ring : g_rings)
+    {
+        stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+LogLine Log::Write(LogLevel level)
+{
+    if (!Enabled(level))
+    {
+        return LogLine();
+    }
+
+    if (!s_running.load(std::memory_order_acquire))
+    {
+        thread_local LogRecord scratch;
+        scratch.level = level;
+        scratch.length = 0;
+        scratch.suppressed = 0;
+        return LogLine(&scratch, true);
+    }
+
+    LogRecord* record = Reserve();
+    if (record)
+    {
+        record->level = level;
+        record->suppressed = 0;
+    }
+    return LogLine(record, false);
+}
+
+LogLine Log::Write(LogLevel level, LogLimiter& limiter)
+{
+    uint32_t suppressed = 0;
+    if (!Enabled(level) || !limiter.Admit(suppressed))
+    {
+        return LogLine();
+    }
+
+    LogLine line = Write(level);
+    if (line.m_record)
+    {
+        line.m_record->suppressed = suppressed;
+    }
+    return line;
+}
+
+LogRecord* Log::Reserve()
+{
+    Ring* ring = ThreadRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= RING_SLOTS)
+    {
+        // Only this thread writes its drop count
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    LogRecord* record = &ring->slots[head % RING_SLOTS];
+    record->unixMicroseconds = NowMicroseconds();
+    record->threadId = ring->threadId;
+    record->length = 0;
+    return record;
+}
+
+void Log::Commit(LogRecord* record)
+{
+    Ring* ring = t_owner.ring;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    // Errors are worth waking the consumer for; everything else waits for its next pass
+    if (record->level == LogLevel::Error)
+    {
+        g_consumer.condition.notify_one();
+    }
+}
+
+void Log::WriteDirect(const LogRecord& record)
+{
+    char buffer[LOG_TEXT_BYTES + 48];
+    std::wcout << Utf8ToWide(Message(record, buffer, sizeof(buffer))) << std::endl;
+}
+
+bool LogLimiter::Admit(uint32_t& suppressed)
+{
+    uint32_t every = Log::s_sampleEvery.load(std::memory_order_relaxed);
+    bool admit = every <= 1 || m_seen.fetch_add(1, std::memory_order_relaxed) % every == 0;
+
+    uint32_t rate = Log::s_ratePerSecond.load(std::memory_order_relaxed);
+    if (admit && rate > 0)
+    {
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t current = m_second.load(std::memory_order_relaxed);
+        if (current != second && m_second.compare_exchange_strong(current, second, std::memory_order_relaxed))
+        {
+            m_inSecond.store(0, std::memory_order_relaxed);
+        }
+        admit = m_inSecond.fetch_add(1, std::memory_order_relaxed) < rate;
+    }
+
+    if (!admit)
+    {
+        m_held.fetch_add(1, std::memory_order_relaxed);
+        Log::s_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = m_held.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+LogLine::LogLine(LogRecord* record, bool direct)
+    : m_record(record)
+    , m_direct(direct)
+    , m_hex(false)
+{
+}
+
+LogLine::LogLine(LogLine&& other) noexcept
+    : m_record(other.m_record)
+    , m_direct(other.m_direct)
+    , m_hex(other.m_hex)
+{
+    other.m_record = nullptr;
+}
+
+LogLine::~LogLine()
+{
+    if (!m_record)
+    {
+        return;
+    }
+    if (m_direct)
+    {
+        Log::WriteDirect(*m_record);
+    }
+    else
+    {
+        Log::Commit(m_record);
+    }
+}
+
+LogLine& LogLine::operator<<(std::string_view text)
+{
+    if (m_record)
+    {
+        AppendUtf8(m_record->text, m_record->length, text);
+    }
+    return *this;
+}
+
+LogLine& LogLine::operator<<(std::wstring_view text)
+{
+    if (m_record)
+    {
+        AppendWide(m_record->text, m_record->length, text);
+    }
+    return *this;
+}
+
+LogLine& LogLine::operator<<(std::ios_base& (*manipulator)(std::ios_base&))
+{
+    if (manipulator == static_cast<std::ios_base& (*)(std::ios_base&)>(std::hex))
+    {
+        m_hex = true;
+    }
+    else if (manipulator == static_cast<std::ios_base& (*)(std::ios_base&)>(std::dec))
+    {
+        m_hex = false;
+    }
+    return *this;
+}
+
+void LogLine::AppendInteger(uint64_t value, bool negative)
+{
+    char digits[24];
+    char* end = digits;
+    if (negative)
+    {
+        *end++ = '-';
+    }
+    end = std::to_chars(end, digits + sizeof(digits), value, m_hex ? 16 : 10).ptr;
+    AppendUtf8(m_record->text, m_record->length, std::string_view(digits, static_cast<size_t>(end - digits)));
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+struct ServerConfig;
+
+enum class LogLevel : uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+struct LogStats
+{
+    uint64_t written = 0;       // records the background thread wrote out
+    uint64_t dropped = 0;       // lost to a full thread buffer
+    uint64_t suppressed = 0;    // held back by sampling or a rate limit
+};
+
+// One fixed-size slot of a thread's ring: the text is UTF-8 and cut off at
+// LOG_TEXT_BYTES
+constexpr size_t LOG_RECORD_BYTES = 256;
+constexpr size_t LOG_TEXT_BYTES = LOG_RECORD_BYTES - 24;
+
+struct LogRecord
+{
+    int64_t unixMicroseconds;
+    uint32_t threadId;
+    uint32_t suppressed;        // similar records the limiter held back before this one
+    uint16_t length;
+    LogLevel level;
+    char text[LOG_TEXT_BYTES];
+};
+
+static_assert(sizeof(LogRecord) == LOG_RECORD_BYTES, "log records are one slot each");
+
+// Per-call-site throttle for messages that repeat with every bad request
+// (auth failures, accept errors). Of the messages reaching it, one in
+// -logsample passes, and at most -lograte per second; the next one that
+// passes carries the count held back in between.
+class LogLimiter
+{
+public:
+    bool Admit(uint32_t& suppressed);
+
+private:
+    std::atomic<uint64_t> m_seen{ 0 };
+    std::atomic<int64_t> m_second{ 0 };
+    std::atomic<uint32_t> m_inSecond{ 0 };
+    std::atomic<uint32_t> m_held{ 0 };
+};
+
+class LogLine;
+
+// Leveled logger. Producers format straight into a slot of their own
+// thread's single-producer ring, so logging takes no lock and never waits on
+// I/O; a background thread drains every ring in batches to the configured
+// sink: the console, a file, the Windows Event Log or journald. A full ring
+// drops the record and counts it; the drops are reported in the log itself.
+// Before Start and after Stop, lines are written to the console directly.
+class Log
+{
+public:
+    // sink comes from config.logSink; source names the event source and the
+    // journald identifier
+    static bool Start(const ServerConfig& config, const std::wstring& source);
+    static void Stop();
+
+    // Returns once everything logged before the call has reached the sink
+    static void Flush();
+
+    static LogLine Write(LogLevel level);
+    static LogLine Write(LogLevel level, LogLimiter& limiter);
+
+    static bool Enabled(LogLevel level) { return level >= s_minimum.load(std::memory_order_relaxed); }
+    static LogStats GetStats();
+
+    static constexpr size_t RING_SLOTS = 256;
+    static constexpr unsigned FLUSH_INTERVAL_MS = 50;
+
+private:
+    friend class LogLine;
+    friend class LogLimiter;
+
+    static LogRecord* Reserve();
+    static void Commit(LogRecord* record);
+    static void WriteDirect(const LogRecord& record);
+
+    static std::atomic<LogLevel> s_minimum;
+    static std::atomic<bool> s_running;
+    static std::atomic<uint32_t> s_sampleEvery;
+    static std::atomic<uint32_t> s_ratePerSecond;
+    static std::atomic<uint64_t> s_suppressed;
+};
+
+// A line being formatted; it is handed to the logger when it goes out of
+// scope. Streams like std::wcout: wide and UTF-8 text, integers, std::hex and
+// std::dec.
+class LogLine
+{
+public:
+    LogLine() : m_record(nullptr), m_direct(false), m_hex(false) {}
+    LogLine(LogRecord* record, bool direct);
+    ~LogLine();
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+    LogLine(LogLine&& other) noexcept;
+
+    // False when nothing will be written, so callers can skip costly formatting
+    explicit operator bool() const { return m_record != nullptr; }
+
+    LogLine& operator<<(std::string_view text);
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text ? text : ""); }
+    LogLine& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogLine& operator<<(std::wstring_view text);
+    LogLine& operator<<(const wchar_t* text) { return *this << std::wstring_view(text ? text : L""); }
+    LogLine& operator<<(const std::wstring& text) { return *this << std::wstring_view(text); }
+    LogLine& operator<<(std::ios_base& (*manipulator)(std::ios_base&));
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+        !std::is_same_v<T, char> && !std::is_same_v<T, wchar_t>>>
+    LogLine& operator<<(T value)
+    {
+        if (m_record)
+        {
+            if constexpr (std::is_signed_v<T>)
+            {
+                AppendInteger(static_cast<uint64_t>(value < 0 ? -static_cast<int64_t>(value) : value), value < 0);
+            }
+            else
+            {
+                AppendInteger(static_cast<uint64_t>(value), false);
+            }
+        }
+        return *this;
+    }
+
+private:
+    friend class Log;
+
+    void AppendInteger(uint64_t value, bool negative);
+
+    LogRecord* m_record;    // null when the level is off, the limiter said no, or the ring is full
+    bool m_direct;          // m_record is a thread-local scratch record written out at once
+    bool m_hex;
+};
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+    const char* const METRIC_PREFIX = "kerberos_echo_";
+
+    const char* const STAGE_NAMES[METRIC_STAGE_COUNT] = { "receive", "decode", "accept", "principal", "format", "send" };
+
+    // Prometheus bucket boundaries, in nanoseconds: 1-2.5-5 steps from 1 us to 10 s
+    const uint64_t EXPORTED_BOUNDS[] = {
+        1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+        1000000000, 2500000000, 5000000000, 10000000000
+    };
+
+    void AppendFormat(std::string& out, const char* format, ...)
+    {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (length > 0)
+        {
+            out.append(line, (std::min)(static_cast<size_t>(length), sizeof(line) - 1));
+        }
+    }
+
+    void AppendHeader(std::string& out, const char* name, const char* type, const char* help)
+    {
+        AppendFormat(out, "# HELP %s%s %s\n# TYPE %s%s %s\n", METRIC_PREFIX, name, help, METRIC_PREFIX, name, type);
+    }
+}
+
+const char* Metrics::StageName(MetricStage stage)
+{
+    return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+std::mutex Metrics::s_registryMutex;
+std::vector<Metrics::ThreadShard*> Metrics::s_shards;
+
+Metrics::ThreadShard& Metrics::RegisterThread()
+{
+    ThreadShard* shard = new ThreadShard();
+    {
+        std::lock_guard<std::mutex> lock(s_registryMutex);
+        s_shards.push_back(shard);
+    }
+    t_shard = shard;
+    return *shard;
+}
+
+void Metrics::CountStatus(int statusCode)
+{
+    if (statusCode >= 500)
+    {
+        Count(MetricCounter::Status5xx);
+    }
+    else if (statusCode >= 400)
+    {
+        Count(MetricCounter::Status4xx);
+    }
+    else if (statusCode >= 300)
+    {
+        Count(MetricCounter::Status3xx);
+    }
+    else
+    {
+        Count(MetricCounter::Status2xx);
+    }
+}
+
+MetricsSnapshot Metrics::Snapshot()
+{
+    MetricsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (const ThreadShard* shard : s_shards)
+    {
+        for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++)
+        {
+            snapshot.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t stage = 0; stage < METRIC_STAGE_COUNT; stage++)
+        {
+            const StageShard& source = shard->stages[stage];
+            HistogramSnapshot& target = snapshot.stages[stage];
+            target.count += source.count.load(std::memory_order_relaxed);
+            target.sum += source.sum.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < METRIC_BUCKET_COUNT; i++)
+            {
+                target.buckets[i] += source.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    snapshot.threads = s_shards.size();
+    return snapshot;
+}
+
+uint64_t Metrics::BucketUpperBound(size_t index)
+{
+    if (index < METRIC_SUB_BUCKETS)
+    {
+        return index;
+    }
+    size_t shift = index / METRIC_SUB_BUCKETS - 1;
+    uint64_t lower = static_cast<uint64_t>(METRIC_SUB_BUCKETS + index % METRIC_SUB_BUCKETS) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t HistogramSnapshot::Percentile(double q) const
+{
+    // Counts are summed from the buckets, so a snapshot taken mid-record
+    // still lands inside the histogram
+    uint64_t total = 0;
+    for (uint64_t bucket : buckets)
+    {
+        total += bucket;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < METRIC_BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return Metrics::BucketUpperBound(i);
+        }
+    }
+    return Metrics::BucketUpperBound(METRIC_BUCKET_COUNT - 1);
+}
+
+void Metrics::AppendSample(std::string& out, const char* name, const char* type, const char* help, uint64_t value)
+{
+    AppendHeader(out, name, type, help);
+    AppendFormat(out, "%s%s %llu\n", METRIC_PREFIX, name, static_cast<unsigned long long>(value));
+}
+
+void Metrics::FormatPrometheus(const MetricsSnapshot& snapshot, std::string& out)
+{
+    AppendSample(out, "requests_total", "counter", "Requests handed to the server",
+        snapshot.counters[static_cast<size_t>(MetricCounter::Requests)]);
+
+    AppendHeader(out, "responses_total", "counter", "Responses by status class");
+    const char* const classes[] = { "2xx", "3xx", "4xx", "5xx" };
+    for (size_t i = 0; i < 4; i++)
+    {
+        AppendFormat(out, "%sresponses_total{code=\"%s\"} %llu\n", METRIC_PREFIX, classes[i],
+            static_cast<unsigned long long>(snapshot.counters[static_cast<size_t>(MetricCounter::Status2xx) + i]));
+    }
+
+    AppendSample(out, "received_bytes_total", "counter", "Bytes received by the socket transports",
+        snapshot.counters[static_cast<size_t>(MetricCounter::BytesReceived)]);
+    AppendSample(out, "sent_bytes_total", "counter", "Bytes sent by the socket transports",
+        snapshot.counters[static_cast<size_t>(MetricCounter::BytesSent)]);
+
+    AppendHeader(out, "stage_duration_seconds", "histogram", "Time spent in each request stage");
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; stage++)
+    {
+        // Fine buckets are folded into the exported ones by their upper bound
+        const HistogramSnapshot& histogram = snapshot.stages[stage];
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (uint64_t bound : EXPORTED_BOUNDS)
+        {
+            while (bucket < METRIC_BUCKET_COUNT && BucketUpperBound(bucket) <= bound)
+            {
+                cumulative += histogram.buckets[bucket++];
+            }
+            AppendFormat(out, "%sstage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", METRIC_PREFIX,
+                STAGE_NAMES[stage], static_cast<double>(bound) / 1e9, static_cast<unsigned long long>(cumulative));
+        }
+        while (bucket < METRIC_BUCKET_COUNT)
+        {
+            cumulative += histogram.buckets[bucket++];
+        }
+        AppendFormat(out, "%sstage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", METRIC_PREFIX,
+            STAGE_NAMES[stage], static_cast<unsigned long long>(cumulative));
+        AppendFormat(out, "%sstage_duration_seconds_sum{stage=\"%s\"} %.9f\n", METRIC_PREFIX, STAGE_NAMES[stage],
+            static_cast<double>(histogram.sum) / 1e9);
+        AppendFormat(out, "%sstage_duration_seconds_count{stage=\"%s\"} %llu\n", METRIC_PREFIX, STAGE_NAMES[stage],
+            static_cast<unsigned long long>(cumulative));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "Trace.h"
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Request stages with a latency histogram each
+enum class MetricStage
+{
+    Receive,        // first bytes of a request available to the request reaching the handler
+    Decode,         // base64 token decode
+    Accept,         // AcceptSecurityContext, gss_accept_sec_context or the native AP-REQ verifier
+    Principal,      // looking up the client's name on an accepted context
+    Format,         // building the response
+    Send,           // response queued to the transport having taken all of it
+    Count
+};
+
+enum class MetricCounter
+{
+    Requests,
+    Status2xx,
+    Status3xx,
+    Status4xx,
+    Status5xx,
+    BytesReceived,
+    BytesSent,
+    Count
+};
+
+constexpr size_t METRIC_STAGE_COUNT = static_cast<size_t>(MetricStage::Count);
+constexpr size_t METRIC_COUNTER_COUNT = static_cast<size_t>(MetricCounter::Count);
+
+// HDR-style log-linear buckets over nanoseconds: exact below 16, then 16
+// sub-buckets per power of two (at most 1/16 relative error) up to 2^40 ns
+constexpr size_t METRIC_SUB_BUCKET_BITS = 4;
+constexpr size_t METRIC_SUB_BUCKETS = size_t(1) << METRIC_SUB_BUCKET_BITS;
+constexpr size_t METRIC_MAX_BIT = 40;
+constexpr size_t METRIC_BUCKET_COUNT = (METRIC_MAX_BIT - METRIC_SUB_BUCKET_BITS + 2) * METRIC_SUB_BUCKETS;
+
+struct HistogramSnapshot
+{
+    uint64_t count = 0;
+    uint64_t sum = 0;           // nanoseconds
+    uint64_t buckets[METRIC_BUCKET_COUNT] = {};
+
+    // Upper bound of the bucket holding the q-th quantile (0 to 1), in nanoseconds
+    uint64_t Percentile(double q) const;
+};
+
+struct MetricsSnapshot
+{
+    uint64_t counters[METRIC_COUNTER_COUNT] = {};
+    HistogramSnapshot stages[METRIC_STAGE_COUNT];
+    size_t threads = 0;         // shards summed
+};
+
+// Process-wide counters and stage latency histograms. Every thread records
+// into its own cache-line-aligned shard, which only that thread writes, so
+// recording is a thread-local lookup and a few plain relaxed stores: no
+// locked instruction and no line shared with another writer. Snapshot sums
+// the shards on demand; a reader may see an event's bucket before its count,
+// which only matters to the last digit of a live scrape.
+class Metrics
+{
+public:
+    static void Count(MetricCounter counter, uint64_t amount = 1)
+    {
+        Bump(Shard().counters[static_cast<size_t>(counter)], amount);
+    }
+
+    static void Record(MetricStage stage, uint64_t nanoseconds)
+    {
+        StageShard& histogram = Shard().stages[static_cast<size_t>(stage)];
+        Bump(histogram.buckets[BucketIndex(nanoseconds)], 1);
+        Bump(histogram.count, 1);
+        Bump(histogram.sum, nanoseconds);
+    }
+
+    static void Record(MetricStage stage, std::chrono::steady_clock::duration elapsed)
+    {
+        Record(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    // Also a span of the request the thread is working for, if it is traced
+    static void Record(MetricStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        Record(stage, end - start);
+        if (Trace::Current())
+        {
+            Trace::Span(StageName(stage), start, end);
+        }
+    }
+
+    // Lower-case label, as in the Prometheus text and trace spans
+    static const char* StageName(MetricStage stage);
+
+    // Counts the response's status class
+    static void CountStatus(int statusCode);
+
+    static MetricsSnapshot Snapshot();
+
+    // Prometheus text exposition of a snapshot, appended to out
+    static void FormatPrometheus(const MetricsSnapshot& snapshot, std::string& out);
+
+    // One unlabelled sample in the same format, for values kept elsewhere;
+    // type is "counter" or "gauge"
+    static void AppendSample(std::string& out, const char* name, const char* type, const char* help, uint64_t value);
+
+    static size_t BucketIndex(uint64_t nanoseconds)
+    {
+        if (nanoseconds < METRIC_SUB_BUCKETS)
+        {
+            return static_cast<size_t>(nanoseconds);
+        }
+        size_t bit = static_cast<size_t>(std::bit_width(nanoseconds)) - 1;
+        if (bit > METRIC_MAX_BIT)
+        {
+            return METRIC_BUCKET_COUNT - 1;
+        }
+        size_t shift = bit - METRIC_SUB_BUCKET_BITS;
+        return (bit - METRIC_SUB_BUCKET_BITS + 1) * METRIC_SUB_BUCKETS + ((nanoseconds >> shift) & (METRIC_SUB_BUCKETS - 1));
+    }
+
+    // Largest value that lands in the bucket
+    static uint64_t BucketUpperBound(size_t index);
+
+private:
+    struct StageShard
+    {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> buckets[METRIC_BUCKET_COUNT];
+    };
+
+    struct alignas(64) ThreadShard
+    {
+        std::atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+        alignas(64) StageShard stages[METRIC_STAGE_COUNT];
+    };
+
+    // Single writer: a load and a store, never a read-modify-write
+    static void Bump(std::atomic<uint64_t>& value, uint64_t amount)
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static ThreadShard& Shard()
+    {
+        ThreadShard* shard = t_shard;
+        return shard ? *shard : RegisterThread();
+    }
+
+    static ThreadShard& RegisterThread();
+
+    static inline thread_local ThreadShard* t_shard = nullptr;
+
+    // Every shard ever registered; never freed, so a thread's counts outlive it
+    static std::mutex s_registryMutex;
+    static std::vector<ThreadShard*> s_shards;
+};
+
+// Records the time from construction to destruction against a stage (and
+// the current request's trace)
+class StageTimer
+{
+public:
+    explicit StageTimer(MetricStage stage) : m_stage(stage), m_start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { Metrics::Record(m_stage, m_start, std::chrono::steady_clock::now()); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    MetricStage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "MockAuthProvider.h"
+#include "Der.h"
+#include "TokenScreen.h"
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const uint8_t KRB5_OID[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+    const uint8_t TOK_ID_AP_REQ[] = { 0x01, 0x00 };
+
+    // Ticket "ciphertext" of a mock token: the marker, the principal, then padding
+    const char TICKET_MARKER[] = "MOCK:";
+    constexpr size_t TICKET_MARKER_LENGTH = sizeof(TICKET_MARKER) - 1;
+
+    constexpr int64_t AES256_CTS_HMAC_SHA1 = 18;
+    constexpr int64_t NT_SRV_INST = 2;
+
+    void PrependString(DerWriter& writer, uint8_t tag, std::string_view text)
+    {
+        size_t mark = writer.Mark();
+        writer.Prepend(text.data(), text.size());
+        writer.Wrap(tag, mark);
+    }
+
+    // EncryptedData ::= SEQUENCE { etype [0], kvno [1] OPTIONAL, cipher [2] OCTET STRING }
+    void PrependEncryptedData(DerWriter& writer, int number, int64_t kvno, const void* cipher, size_t length)
+    {
+        size_t mark = writer.Mark();
+        size_t cipherMark = writer.Mark();
+        writer.Prepend(cipher, length);
+        writer.Wrap(DerReader::OCTET_STRING, cipherMark);
+        writer.Wrap(DerReader::Context(2), cipherMark);
+        if (kvno >= 0)
+        {
+            writer.PrependTaggedInteger(1, kvno);
+        }
+        writer.PrependTaggedInteger(0, AES256_CTS_HMAC_SHA1);
+        writer.Wrap(DerReader::SEQUENCE, mark);
+        writer.Wrap(DerReader::Context(number), mark);
+    }
+
+    size_t WriteToken(DerWriter& writer, std::string_view principal, uint64_t nonce, size_t padding)
+    {
+        uint8_t authenticator[16] = {};
+        for (int i = 0; i < 8; i++)
+        {
+            authenticator[i] = static_cast<uint8_t>(nonce >> (8 * i));
+        }
+        PrependEncryptedData(writer, 4, -1, authenticator, sizeof(authenticator));
+
+        // Ticket ::= [APPLICATION 1] SEQUENCE { tkt-vno [0], realm [1], sname [2], enc-part [3] }
+        std::string cipher(TICKET_MARKER);
+        cipher.append(principal.data(), principal.size());
+        cipher.append(padding + 1, '\0');
+        size_t ticketMark = writer.Mark();
+        PrependEncryptedData(writer, 3, 1, cipher.data(), cipher.size());
+        size_t nameMark = writer.Mark();
+        PrependString(writer, DerReader::GENERAL_STRING, "replay");
+        PrependString(writer, DerReader::GENERAL_STRING, "HTTP");
+        writer.Wrap(DerReader::SEQUENCE, nameMark);
+        writer.Wrap(DerReader::Context(1), nameMark);
+        writer.PrependTaggedInteger(0, NT_SRV_INST);
+        writer.Wrap(DerReader::SEQUENCE, nameMark);
+        writer.Wrap(DerReader::Context(2), nameMark);
+        size_t realmMark = writer.Mark();
+        PrependString(writer, DerReader::GENERAL_STRING, MockAuthProvider::REALM);
+        writer.Wrap(DerReader::Context(1), realmMark);
+        writer.PrependTaggedInteger(0, 5);
+        writer.Wrap(DerReader::SEQUENCE, ticketMark);
+        writer.Wrap(DerReader::Application(1), ticketMark);
+        writer.Wrap(DerReader::Context(3), ticketMark);
+
+        // AP-REQ ::= [APPLICATION 14] SEQUENCE { pvno [0], msg-type [1], ap-options [2], ticket [3], authenticator [4] }
+        const uint8_t options[] = { 0, 0, 0, 0, 0 };
+        size_t optionsMark = writer.Mark();
+        writer.Prepend(options, sizeof(options));
+        writer.Wrap(DerReader::BIT_STRING, optionsMark);
+        writer.Wrap(DerReader::Context(2), optionsMark);
+        writer.PrependTaggedInteger(1, 14);
+        writer.PrependTaggedInteger(0, 5);
+        writer.Wrap(DerReader::SEQUENCE, 0);
+        writer.Wrap(DerReader::Application(14), 0);
+
+        // GSS framing: [APPLICATION 0] { mech OID, TOK_ID, AP-REQ }
+        writer.Prepend(TOK_ID_AP_REQ, sizeof(TOK_ID_AP_REQ));
+        size_t oidMark = writer.Mark();
+        writer.Prepend(KRB5_OID, sizeof(KRB5_OID));
+        writer.Wrap(DerReader::OID, oidMark);
+        writer.Wrap(DerReader::Application(0), 0);
+        return writer.Size();
+    }
+}
+
+MockAuthProvider::MockAuthProvider(unsigned acceptMicros)
+    : m_acceptMicros(acceptMicros)
+{
+}
+
+void MockAuthProvider::Accept(const AcceptorCredential&, const unsigned char* token, size_t length, bool continuing,
+    PendingContext&, AuthResult& result, Clock::time_point&)
+{
+    // Spins rather than sleeps, so the leg costs CPU the way real crypto does
+    if (m_acceptMicros > 0)
+    {
+        Clock::time_point until = Clock::now() + std::chrono::microseconds(m_acceptMicros);
+        while (Clock::now() < until)
+        {
+        }
+    }
+
+    TokenFacts facts;
+    result.status = AuthStatus::Failed;
+    if (continuing || !TokenScreen::Parse(token, length, facts) || !facts.hasApReq || facts.realm != REALM ||
+        facts.ticketCipher.substr(0, TICKET_MARKER_LENGTH) != TICKET_MARKER)
+    {
+        return;
+    }
+
+    std::string_view principal = facts.ticketCipher.substr(TICKET_MARKER_LENGTH);
+    principal = principal.substr(0, principal.find('\0'));
+    if (principal.empty())
+    {
+        return;
+    }
+    result.principal.assign(principal.data(), principal.size());
+    result.sids.clear();
+    result.status = AuthStatus::Success;
+}
+
+std::string MockAuthProvider::BuildToken(std::string_view principal, uint64_t nonce, size_t size)
+{
+    // Built once unpadded to learn the overhead, then again padded out to size
+    std::vector<uint8_t> buffer(principal.size() + 256);
+    DerWriter probe(buffer.data(), buffer.size());
+    size_t bare = WriteToken(probe, principal, nonce, 0);
+    size_t padding = size > bare ? size - bare : 0;
+
+    buffer.resize(principal.size() + padding + 256);
+    DerWriter writer(buffer.data(), buffer.size());
+    WriteToken(writer, principal, nonce, padding);
+    if (writer.Overflowed())
+    {
+        return std::string();
+    }
+    return std::string(reinterpret_cast<const char*>(writer.Data()), writer.Size());
+}
\ No newline at end of file
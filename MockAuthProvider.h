@@ -0,0 +1,39 @@
+#pragma once
+
+#include "AuthProvider.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Deterministic stand-in for a security package, for load tests and traffic
+// replays on a machine with no KDC or keytab. It accepts the synthetic
+// AP-REQs BuildToken makes, which traffic captures put in place of real
+// tokens: the client principal travels in the ticket, so a token always gets
+// the same answer, and anything else is rejected. Each leg can be made to
+// burn a fixed amount of CPU, standing in for a real provider's crypto.
+class MockAuthProvider : public AuthProvider
+{
+public:
+    explicit MockAuthProvider(unsigned acceptMicros);
+
+    bool Initialize() override { return true; }
+    std::shared_ptr<AcceptorCredential> AcquireCredential(const AcceptorIdentity&) override
+    {
+        return std::make_shared<AcceptorCredential>();
+    }
+    void Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length, bool continuing,
+        PendingContext& context, AuthResult& result, Clock::time_point& expiry) override;
+    void ReleaseContext(const PendingContext&) override {}
+    void Cleanup() override {}
+    const wchar_t* Name() const override { return L"mock"; }
+
+    // GSS-framed Kerberos AP-REQ for HTTP/replay@MOCK.TEST carrying principal,
+    // padded to about size bytes; nonce tells apart tokens for one principal
+    static std::string BuildToken(std::string_view principal, uint64_t nonce, size_t size);
+
+    static constexpr const char* REALM = "MOCK.TEST";
+
+private:
+    unsigned m_acceptMicros;
+};
\ No newline at end of file
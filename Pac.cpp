@@ -0,0 +1,301 @@
+#include "Pac.h"
+#include <algorithm>
+
+namespace
+{
+    // Little-endian NDR (the only representation a PAC uses), with alignment
+    // relative to the start of the buffer
+    class NdrReader
+    {
+    public:
+        NdrReader(const uint8_t* data, size_t length)
+            : m_data(data)
+            , m_length(length)
+            , m_position(0)
+        {
+        }
+
+        bool Skip(size_t bytes)
+        {
+            if (m_length - m_position < bytes)
+            {
+                return false;
+            }
+            m_position += bytes;
+            return true;
+        }
+
+        bool Align(size_t boundary)
+        {
+            size_t padding = (boundary - m_position % boundary) % boundary;
+            return Skip(padding);
+        }
+
+        bool Read8(uint8_t& value)
+        {
+            if (m_length - m_position < 1)
+            {
+                return false;
+            }
+            value = m_data[m_position++];
+            return true;
+        }
+
+        bool Read32(uint32_t& value)
+        {
+            if (!Align(4) || m_length - m_position < 4)
+            {
+                return false;
+            }
+            const uint8_t* bytes = m_data + m_position;
+            value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+            m_position += 4;
+            return true;
+        }
+
+        // Deferred RPC_UNICODE_STRING buffer: maximum count, offset, actual count, then UTF-16
+        bool SkipString(uint32_t pointer)
+        {
+            uint32_t maximum = 0;
+            uint32_t offset = 0;
+            uint32_t actual = 0;
+            return pointer == 0 || (Read32(maximum) && Read32(offset) && Read32(actual) && actual <= maximum &&
+                Skip(static_cast<size_t>(actual) * 2));
+        }
+
+        // Deferred RPC_SID: sub-authority count (conformance), revision, count,
+        // 48-bit big-endian identifier authority and the sub-authorities
+        bool ReadSid(uint32_t pointer, std::string& sid)
+        {
+            sid.clear();
+            if (pointer == 0)
+            {
+                return true;
+            }
+
+            uint32_t conformance = 0;
+            uint8_t revision = 0;
+            uint8_t count = 0;
+            if (!Read32(conformance) || !Read8(revision) || !Read8(count) || count != conformance ||
+                count > Pac::MAX_SUB_AUTHORITIES || m_length - m_position < 6)
+            {
+                return false;
+            }
+            uint64_t authority = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                authority = (authority << 8) | m_data[m_position++];
+            }
+
+            sid = "S-" + std::to_string(revision) + "-" + std::to_string(authority);
+            for (uint8_t i = 0; i < count; i++)
+            {
+                uint32_t subAuthority = 0;
+                if (!Read32(subAuthority))
+                {
+                    return false;
+                }
+                sid += '-';
+                sid += std::to_string(subAuthority);
+            }
+            return true;
+        }
+
+        // Deferred array of GROUP_MEMBERSHIP { RelativeId, Attributes }
+        bool ReadGroups(uint32_t pointer, uint32_t count, std::vector<uint32_t>& rids)
+        {
+            rids.clear();
+            uint32_t conformance = 0;
+            if (pointer == 0)
+            {
+                return true;
+            }
+            if (!Read32(conformance) || conformance != count || (m_length - m_position) / 8 < count)
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t rid = 0;
+                uint32_t attributes = 0;
+                if (!Read32(rid) || !Read32(attributes))
+                {
+                    return false;
+                }
+                rids.push_back(rid);
+            }
+            return true;
+        }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_length;
+        size_t m_position;
+    };
+
+    void AppendRelative(const std::string& domain, uint32_t rid, std::vector<std::string>& sids)
+    {
+        if (!domain.empty())
+        {
+            sids.push_back(domain + "-" + std::to_string(rid));
+        }
+    }
+}
+
+bool Pac::ReadSids(const uint8_t* pac, size_t length, std::vector<std::string>& sids)
+{
+    // PACTYPE { cBuffers, Version, PAC_INFO_BUFFER { ulType, cbBufferSize, Offset (64-bit) }[] }
+    NdrReader reader(pac, length);
+    uint32_t count = 0;
+    uint32_t version = 0;
+    if (!reader.Read32(count) || !reader.Read32(version) || version != 0 || (length - 8) / 16 < count)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t type = 0;
+        uint32_t size = 0;
+        uint32_t offsetLow = 0;
+        uint32_t offsetHigh = 0;
+        if (!reader.Read32(type) || !reader.Read32(size) || !reader.Read32(offsetLow) || !reader.Read32(offsetHigh))
+        {
+            return false;
+        }
+        if (type == LOGON_INFO)
+        {
+            if (offsetHigh != 0 || offsetLow > length || length - offsetLow < size)
+            {
+                return false;
+            }
+            return ReadLogonSids(pac + offsetLow, size, sids);
+        }
+    }
+    return false;
+}
+
+bool Pac::ReadLogonSids(const uint8_t* info, size_t length, std::vector<std::string>& sids)
+{
+    // Common type header (version 1, little-endian, 8 bytes) and private header
+    if (length < 16 || info[0] != 0x01 || info[1] != 0x10)
+    {
+        return false;
+    }
+    NdrReader reader(info, length);
+    uint32_t referent = 0;
+    if (!reader.Skip(16) || !reader.Read32(referent) || referent == 0)
+    {
+        return false;
+    }
+
+    // KERB_VALIDATION_INFO: six FILETIMEs, then six RPC_UNICODE_STRINGs
+    // { Length, MaximumLength, Buffer } whose buffers follow the structure
+    uint32_t names[6] = {};
+    if (!reader.Skip(48))
+    {
+        return false;
+    }
+    for (uint32_t& pointer : names)
+    {
+        if (!reader.Skip(4) || !reader.Read32(pointer))
+        {
+            return false;
+        }
+    }
+
+    uint32_t userId = 0;
+    uint32_t primaryGroupId = 0;
+    uint32_t groupCount = 0;
+    uint32_t groupIds = 0;
+    uint32_t logonServer = 0;
+    uint32_t logonDomainName = 0;
+    uint32_t logonDomainId = 0;
+    uint32_t sidCount = 0;
+    uint32_t extraSids = 0;
+    uint32_t resourceDomainSid = 0;
+    uint32_t resourceGroupCount = 0;
+    uint32_t resourceGroupIds = 0;
+    if (!reader.Skip(4) ||                      // LogonCount, BadPasswordCount
+        !reader.Read32(userId) || !reader.Read32(primaryGroupId) || !reader.Read32(groupCount) ||
+        !reader.Read32(groupIds) ||
+        !reader.Skip(20) ||                     // UserFlags, UserSessionKey
+        !reader.Skip(4) || !reader.Read32(logonServer) || !reader.Skip(4) || !reader.Read32(logonDomainName) ||
+        !reader.Read32(logonDomainId) ||
+        !reader.Skip(40) ||                     // Reserved1, UserAccountControl, SubAuthStatus, logon times, counts
+        !reader.Read32(sidCount) || !reader.Read32(extraSids) || !reader.Read32(resourceDomainSid) ||
+        !reader.Read32(resourceGroupCount) || !reader.Read32(resourceGroupIds))
+    {
+        return false;
+    }
+
+    // Deferred pointees, in the order their pointers appear
+    std::vector<uint32_t> groups;
+    std::string domain;
+    for (uint32_t pointer : names)
+    {
+        if (!reader.SkipString(pointer))
+        {
+            return false;
+        }
+    }
+    if (!reader.ReadGroups(groupIds, groupCount, groups) || !reader.SkipString(logonServer) ||
+        !reader.SkipString(logonDomainName) || !reader.ReadSid(logonDomainId, domain))
+    {
+        return false;
+    }
+
+    std::vector<std::string> found;
+    AppendRelative(domain, userId, found);
+    AppendRelative(domain, primaryGroupId, found);
+    for (uint32_t rid : groups)
+    {
+        AppendRelative(domain, rid, found);
+    }
+
+    // KERB_SID_AND_ATTRIBUTES { Sid, Attributes }[], then each SID
+    if (extraSids != 0)
+    {
+        uint32_t conformance = 0;
+        if (!reader.Read32(conformance) || conformance != sidCount || (length / 8) < sidCount)
+        {
+            return false;
+        }
+        std::vector<uint32_t> pointers(sidCount);
+        for (uint32_t& pointer : pointers)
+        {
+            uint32_t attributes = 0;
+            if (!reader.Read32(pointer) || !reader.Read32(attributes))
+            {
+                return false;
+            }
+        }
+        for (uint32_t pointer : pointers)
+        {
+            std::string sid;
+            if (!reader.ReadSid(pointer, sid))
+            {
+                return false;
+            }
+            if (!sid.empty())
+            {
+                found.push_back(std::move(sid));
+            }
+        }
+    }
+
+    std::string resourceDomain;
+    if (!reader.ReadSid(resourceDomainSid, resourceDomain) ||
+        !reader.ReadGroups(resourceGroupIds, resourceGroupCount, groups))
+    {
+        return false;
+    }
+    for (uint32_t rid : groups)
+    {
+        AppendRelative(resourceDomain, rid, found);
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    sids.insert(sids.end(), found.begin(), found.end());
+    return true;
+}
\ No newline at end of file
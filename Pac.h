@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads the security identifiers Active Directory puts in the PAC of a
+// ticket (MS-PAC): the KERB_VALIDATION_INFO of the logon information buffer,
+// an NDR type serialization. Only SIDs are taken, in their "S-1-5-21-..."
+// form: the user's, its groups in the logon domain, the extra SIDs
+// (universal groups of other domains, well-known SIDs) and the resource
+// groups. The PAC signatures are not checked; a PAC read from a ticket came
+// encrypted under the service key, which only the KDC holds besides us.
+class Pac
+{
+public:
+    // A whole PAC, as AD-WIN2K-PAC authorization data carries it; false if
+    // it is malformed or has no logon information
+    static bool ReadSids(const uint8_t* pac, size_t length, std::vector<std::string>& sids);
+
+    // The logon information buffer alone, as GSSAPI's urn:mspac:logon-info
+    // name attribute returns it
+    static bool ReadLogonSids(const uint8_t* info, size_t length, std::vector<std::string>& sids);
+
+    static constexpr uint32_t LOGON_INFO = 1;
+    static constexpr size_t MAX_SUB_AUTHORITIES = 15;
+};
\ No newline at end of file
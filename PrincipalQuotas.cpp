@@ -0,0 +1,236 @@
+#include "PrincipalQuotas.h"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    constexpr uint32_t WITH_SIDS = 0x10000;
+    constexpr uint32_t RULE_MASK = 0xFFFF;
+    constexpr unsigned GENERATION_SHIFT = 17;
+    constexpr unsigned MAX_WINDOW_SECONDS = 86400;
+    constexpr uint64_t COUNT_MASK = 0xFFFFFF;
+    constexpr uint64_t NUMBER_MASK = 0xFFFF;
+
+    std::string Lower(std::string_view text)
+    {
+        std::string lower(text);
+        for (char& c : lower)
+        {
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+        return lower;
+    }
+}
+
+PrincipalQuotas::PrincipalQuotas(const PrincipalTable& principals)
+    : m_principals(principals)
+    , m_capacity(principals.GetStats().capacity)
+    , m_current(nullptr)
+    , m_inFlight(new std::atomic<uint32_t>[m_capacity + 1])
+    , m_assigned(new std::atomic<uint32_t>[m_capacity + 1])
+    , m_window(new std::atomic<uint64_t>[m_capacity + 1])
+    , m_admitted(0)
+    , m_overConcurrency(0)
+    , m_overRate(0)
+    , m_assignedCount(0)
+    , m_overflow(0)
+{
+    for (size_t id = 0; id <= m_capacity; id++)
+    {
+        m_inFlight[id].store(0, std::memory_order_relaxed);
+        m_assigned[id].store(0, std::memory_order_relaxed);
+        m_window[id].store(0, std::memory_order_relaxed);
+    }
+    SetLimits(QuotaLimits());
+}
+
+bool PrincipalQuotas::SetLimits(const QuotaLimits& limits)
+{
+    return SetLimits(limits, Clock::now());
+}
+
+bool PrincipalQuotas::SetLimits(const QuotaLimits& limits, Clock::time_point now)
+{
+    std::unique_ptr<QuotaSet> set = std::make_unique<QuotaSet>();
+    QuotaLimits applied = limits;
+    applied.windowSeconds = (std::min)((std::max)(limits.windowSeconds, 1u), MAX_WINDOW_SECONDS);
+    if (applied.subjects.size() > MAX_SUBJECTS)
+    {
+        applied.subjects.resize(MAX_SUBJECTS);
+    }
+    set->window = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(applied.windowSeconds)).count();
+    set->rules.reserve(applied.subjects.size() + 1);
+    set->rules.push_back(applied.standard);
+    for (auto& subject : applied.subjects)
+    {
+        // The first line for a subject wins
+        std::string key = Lower(subject.first);
+        if (set->subjects.emplace(key, static_cast<uint16_t>(set->rules.size())).second)
+        {
+            set->hasSids |= key.compare(0, 2, "s-") == 0;
+            set->rules.push_back(subject.second);
+        }
+    }
+    for (QuotaRule& rule : set->rules)
+    {
+        rule.rate = (std::min)(rule.rate, MAX_RATE);
+    }
+
+    std::lock_guard<std::mutex> lock(m_limitsMutex);
+    m_sets.erase(std::remove_if(m_sets.begin(), m_sets.end(), [now](const std::unique_ptr<QuotaSet>& old)
+        {
+            return old->retired != Clock::time_point::max() && now - old->retired >= std::chrono::seconds(RETIRE_SECONDS);
+        }), m_sets.end());
+    if (m_sets.size() >= MAX_LIMIT_SETS)
+    {
+        return false;
+    }
+
+    // Generation 0 is what unassigned principals carry
+    uint32_t generation = m_sets.empty() ? 1 : m_sets.back()->generation + 1;
+    set->generation = (generation & (UINT32_MAX >> GENERATION_SHIFT)) ? generation & (UINT32_MAX >> GENERATION_SHIFT) : 1;
+    if (!m_sets.empty())
+    {
+        m_sets.back()->retired = now;
+    }
+    m_limits = applied;
+    m_current.store(set.get(), std::memory_order_release);
+    m_sets.push_back(std::move(set));
+    return true;
+}
+
+QuotaLimits PrincipalQuotas::GetLimits() const
+{
+    std::lock_guard<std::mutex> lock(m_limitsMutex);
+    return m_limits;
+}
+
+QuotaDecision PrincipalQuotas::Acquire(uint32_t principal, const std::vector<std::string>* sids, Clock::time_point now)
+{
+    const QuotaSet* set = m_current.load(std::memory_order_acquire);
+    uint32_t slot = Slot(principal);
+    uint16_t ruleIndex = 0;
+    if (slot == OVERFLOW_SLOT)
+    {
+        // Nothing to match it on: principals without an ID share the standard quota
+        m_overflow.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        uint32_t assigned = m_assigned[slot].load(std::memory_order_relaxed);
+        uint32_t tag = set->generation << GENERATION_SHIFT;
+        if ((assigned & ~(WITH_SIDS | RULE_MASK)) != tag || (sids && set->hasSids && !(assigned & WITH_SIDS)))
+        {
+            assigned = tag | (sids ? WITH_SIDS : 0) | Assign(*set, slot, sids);
+            m_assigned[slot].store(assigned, std::memory_order_relaxed);
+            m_assignedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        ruleIndex = static_cast<uint16_t>(assigned & RULE_MASK);
+    }
+    const QuotaRule& rule = set->rules[ruleIndex];
+
+    // Counted whether or not there is a cap, so Release never has to know
+    uint32_t inFlight = m_inFlight[slot].fetch_add(1, std::memory_order_relaxed) + 1;
+    if (rule.concurrency != 0 && inFlight > rule.concurrency)
+    {
+        m_inFlight[slot].fetch_sub(1, std::memory_order_relaxed);
+        m_overConcurrency.fetch_add(1, std::memory_order_relaxed);
+        return QuotaDecision::Concurrency;
+    }
+    if (rule.rate != 0 && !TakeRate(slot, *set, rule.rate, now))
+    {
+        m_inFlight[slot].fetch_sub(1, std::memory_order_relaxed);
+        m_overRate.fetch_add(1, std::memory_order_relaxed);
+        return QuotaDecision::Rate;
+    }
+    m_admitted.fetch_add(1, std::memory_order_relaxed);
+    return QuotaDecision::Admit;
+}
+
+void PrincipalQuotas::Release(uint32_t principal)
+{
+    m_inFlight[Slot(principal)].fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint16_t PrincipalQuotas::Assign(const QuotaSet& set, uint32_t principal, const std::vector<std::string>* sids)
+{
+    if (set.subjects.empty())
+    {
+        return 0;
+    }
+    auto own = set.subjects.find(Lower(m_principals.Name(principal)));
+    if (own != set.subjects.end())
+    {
+        return own->second;
+    }
+
+    // Otherwise whichever of its realm and groups is listed first
+    uint16_t rule = 0;
+    auto consider = [&](const std::string& key)
+    {
+        auto known = set.subjects.find(key);
+        if (known != set.subjects.end() && (rule == 0 || known->second < rule))
+        {
+            rule = known->second;
+        }
+    };
+    std::string_view realm = m_principals.Realm(principal);
+    if (!realm.empty())
+    {
+        std::string key = "@";
+        consider(key.append(Lower(realm)));
+    }
+    if (sids && set.hasSids)
+    {
+        for (const std::string& sid : *sids)
+        {
+            consider(Lower(sid));
+        }
+    }
+    return rule;
+}
+
+bool PrincipalQuotas::TakeRate(uint32_t principal, const QuotaSet& set, unsigned rate, Clock::time_point now)
+{
+    int64_t ticks = now.time_since_epoch().count();
+    uint64_t number = static_cast<uint64_t>(ticks / set.window) & NUMBER_MASK;
+
+    // Share of the previous window still within one window of now, in 1/65536ths
+    uint64_t left = (static_cast<uint64_t>(set.window - ticks % set.window) << 16) / static_cast<uint64_t>(set.window);
+
+    uint64_t word = m_window[principal].load(std::memory_order_relaxed);
+    for (;;)
+    {
+        uint64_t current = (word >> 16) & COUNT_MASK;
+        uint64_t previous = word >> 40;
+        uint64_t stored = word & NUMBER_MASK;
+        if (stored != number)
+        {
+            previous = ((stored + 1) & NUMBER_MASK) == number ? current : 0;
+            current = 0;
+        }
+        if (((previous * left) >> 16) + current >= rate)
+        {
+            return false;
+        }
+        uint64_t next = (previous << 40) | ((current + 1) << 16) | number;
+        if (m_window[principal].compare_exchange_weak(word, next, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+}
+
+QuotaStats PrincipalQuotas::GetStats() const
+{
+    QuotaStats stats;
+    stats.admitted = m_admitted.load(std::memory_order_relaxed);
+    stats.overConcurrency = m_overConcurrency.load(std::memory_order_relaxed);
+    stats.overRate = m_overRate.load(std::memory_order_relaxed);
+    stats.assigned = m_assignedCount.load(std::memory_order_relaxed);
+    stats.overflow = m_overflow.load(std::memory_order_relaxed);
+    stats.bytes = (m_capacity + 1) * (sizeof(std::atomic<uint32_t>) * 2 + sizeof(std::atomic<uint64_t>));
+    std::lock_guard<std::mutex> lock(m_limitsMutex);
+    stats.limitSets = m_sets.size();
+    return stats;
+}
\ No newline at end of file
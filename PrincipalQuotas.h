@@ -0,0 +1,144 @@
+#pragma once
+
+#include "PrincipalTable.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct QuotaRule
+{
+    unsigned concurrency = 0;   // requests past authentication at once; 0 = no limit
+    unsigned rate = 0;          // requests per window; 0 = no limit
+};
+
+struct QuotaLimits
+{
+    QuotaRule standard;             // for principals no subject below matches
+    unsigned windowSeconds = 60;
+    std::vector<std::pair<std::string, QuotaRule>> subjects;   // principal, "@REALM" or SID, in file order
+};
+
+struct QuotaStats
+{
+    uint64_t admitted = 0;
+    uint64_t overConcurrency = 0;   // answered 429 with the principal's concurrency in use
+    uint64_t overRate = 0;          // answered 429 with the principal's window used up
+    uint64_t assigned = 0;          // principals matched against the subjects
+    uint64_t overflow = 0;          // requests charged to the slot shared by principals without an ID
+    size_t bytes = 0;               // per-principal state, allocated up front
+    size_t limitSets = 0;           // compiled limits kept, the current ones included
+};
+
+enum class QuotaDecision
+{
+    Admit,          // Release when the response is written
+    Concurrency,    // answer 429
+    Rate            // answer 429
+};
+
+// Post-authentication quotas per principal, so that one busy account cannot
+// take every handler thread: a cap on its requests in progress and a sliding
+// window rate. A request is checked once its principal is known and before it
+// is queued for the handler; an admitted one holds its concurrency until its
+// response is written.
+//
+// State is kept per PrincipalTable ID in columns allocated up front for the
+// table's capacity, 16 bytes a principal, and changed with atomics only:
+//
+//   - the requests in progress;
+//   - the window as one word: the window number (mod 2^16) and the counts of
+//     the current and the previous window, 24 bits each. A request is
+//     admitted while the previous count, weighted by how much of it still
+//     lies within one window of now, plus the current count stays under the
+//     rate, which approximates a true sliding window without keeping times;
+//   - the quota that applies, as an index into the compiled limits tagged
+//     with their generation.
+//
+// Which quota applies is worked out once per principal and generation: its
+// own name first, then the first of its SIDs or its realm listed, then the
+// standard quota. A session cookie carries no SIDs, so until the principal
+// negotiates again after a reload it is matched on its name and realm alone.
+// Principals without an ID (the table was full) have nothing to keep their
+// own state in and share one overflow slot under the standard quota, so a
+// flood of new names is held to what one ordinary principal may send rather
+// than let through unlimited.
+class PrincipalQuotas
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PrincipalQuotas(const PrincipalTable& principals);
+
+    // Takes effect for the next request; windows and requests in progress
+    // carry over. False, with the current limits kept, when MAX_LIMIT_SETS
+    // are still held back from reloads within the last RETIRE_SECONDS.
+    bool SetLimits(const QuotaLimits& limits);
+    bool SetLimits(const QuotaLimits& limits, Clock::time_point now);
+    QuotaLimits GetLimits() const;
+
+    // Decides on a request of principal, whose authentication just returned
+    // sids (null for a session cookie)
+    QuotaDecision Acquire(uint32_t principal, const std::vector<std::string>* sids, Clock::time_point now);
+    void Release(uint32_t principal);
+
+    // Requests of principal in progress; for NO_PRINCIPAL, those of every
+    // principal without an ID
+    uint32_t InFlight(uint32_t principal) const { return m_inFlight[Slot(principal)].load(std::memory_order_relaxed); }
+
+    QuotaStats GetStats() const;
+
+    static constexpr size_t MAX_SUBJECTS = 65535;
+    static constexpr unsigned MAX_RATE = 0xFFFFFF;  // a window count is 24 bits
+    static constexpr size_t MAX_LIMIT_SETS = 8;
+    static constexpr unsigned RETIRE_SECONDS = 10;
+
+    // No ID is ever 0, which leaves the first slot of each column free
+    static constexpr uint32_t OVERFLOW_SLOT = PrincipalTable::NO_PRINCIPAL;
+
+private:
+    // Compiled limits. An Acquire reads the set it loaded without holding
+    // anything, for well under a microsecond, so a replaced set is freed only
+    // once it has been retired for RETIRE_SECONDS.
+    struct QuotaSet
+    {
+        uint32_t generation = 0;
+        Clock::time_point retired = Clock::time_point::max();
+        int64_t window = 0;             // Clock ticks
+        std::vector<QuotaRule> rules;   // rules[0] is the standard quota
+        std::unordered_map<std::string, uint16_t> subjects;     // lower-cased subject to rule
+        bool hasSids = false;
+    };
+
+    // Column of principal: its ID, or the overflow slot
+    uint32_t Slot(uint32_t principal) const { return principal > m_capacity ? OVERFLOW_SLOT : principal; }
+
+    // Rule index of principal under set
+    uint16_t Assign(const QuotaSet& set, uint32_t principal, const std::vector<std::string>* sids);
+    bool TakeRate(uint32_t principal, const QuotaSet& set, unsigned rate, Clock::time_point now);
+
+    const PrincipalTable& m_principals;
+    size_t m_capacity;
+
+    mutable std::mutex m_limitsMutex;
+    QuotaLimits m_limits;
+    std::vector<std::unique_ptr<QuotaSet>> m_sets;
+    std::atomic<const QuotaSet*> m_current;
+
+    // Columns, indexed by ID, with the overflow slot first
+    std::unique_ptr<std::atomic<uint32_t>[]> m_inFlight;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_assigned;    // generation << 17 | with SIDs << 16 | rule
+    std::unique_ptr<std::atomic<uint64_t>[]> m_window;      // previous << 40 | current << 16 | window number
+
+    std::atomic<uint64_t> m_admitted;
+    std::atomic<uint64_t> m_overConcurrency;
+    std::atomic<uint64_t> m_overRate;
+    std::atomic<uint64_t> m_assignedCount;
+    std::atomic<uint64_t> m_overflow;
+};
\ No newline at end of file
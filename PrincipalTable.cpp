@@ -0,0 +1,194 @@
+#include "PrincipalTable.h"
+
+namespace
+{
+    // The realm of user@REALM, or the domain of SSPI's DOMAIN\user
+    std::string_view RealmOf(std::string_view principal)
+    {
+        size_t at = principal.rfind('@');
+        if (at != std::string_view::npos)
+        {
+            return principal.substr(at + 1);
+        }
+        size_t backslash = principal.find('\\');
+        return backslash == std::string_view::npos ? std::string_view() : principal.substr(0, backslash);
+    }
+
+    // Cookies are signed with keys that die with the process, so an epoch
+    // only has to be unique within it
+    std::atomic<uint64_t> g_lastEpoch{ 0 };
+}
+
+PrincipalTable::PrincipalTable(size_t capacity)
+    : m_capacity(capacity)
+    , m_epoch(g_lastEpoch.fetch_add(1, std::memory_order_relaxed) + 1)
+    , m_shards(new Shard[SHARD_COUNT])
+    , m_next(1)
+    , m_refused(0)
+    , m_names(new std::string[capacity + 1])
+    , m_realmOf(new uint16_t[capacity + 1]())
+    , m_lastSeen(new std::atomic<int64_t>[capacity + 1])
+    , m_requests(new std::atomic<uint64_t>[capacity + 1])
+    , m_groups(new std::atomic<const uint64_t*>[capacity + 1])
+    , m_groupsExpiry(new std::atomic<int64_t>[capacity + 1])
+    , m_realms(new std::string[MAX_REALMS])
+    , m_realmCount(1)
+{
+    for (size_t id = 0; id <= capacity; id++)
+    {
+        m_lastSeen[id].store(0, std::memory_order_relaxed);
+        m_requests[id].store(0, std::memory_order_relaxed);
+        m_groups[id].store(nullptr, std::memory_order_relaxed);
+        m_groupsExpiry[id].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t PrincipalTable::Intern(std::string_view principal)
+{
+    Shard& shard = m_shards[std::hash<std::string_view>()(principal) % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto known = shard.ids.find(principal);
+    if (known != shard.ids.end())
+    {
+        return known->second;
+    }
+
+    uint32_t id = m_next.load(std::memory_order_relaxed);
+    do
+    {
+        if (id > m_capacity)
+        {
+            m_refused.fetch_add(1, std::memory_order_relaxed);
+            return NO_PRINCIPAL;
+        }
+    } while (!m_next.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+
+    // Filled in before the ID is published through the shard
+    m_names[id].assign(principal.data(), principal.size());
+    m_realmOf[id] = InternRealm(RealmOf(principal));
+    shard.ids.emplace(m_names[id], id);
+    return id;
+}
+
+uint32_t PrincipalTable::Find(std::string_view principal) const
+{
+    const Shard& shard = m_shards[std::hash<std::string_view>()(principal) % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto known = shard.ids.find(principal);
+    return known == shard.ids.end() ? NO_PRINCIPAL : known->second;
+}
+
+uint16_t PrincipalTable::InternRealm(std::string_view realm)
+{
+    if (realm.empty())
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_realmMutex);
+    for (size_t i = 1; i < m_realmCount; i++)
+    {
+        if (m_realms[i] == realm)
+        {
+            return static_cast<uint16_t>(i);
+        }
+    }
+    if (m_realmCount == MAX_REALMS)
+    {
+        return 0;
+    }
+    m_realms[m_realmCount].assign(realm.data(), realm.size());
+    return static_cast<uint16_t>(m_realmCount++);
+}
+
+std::string_view PrincipalTable::DisplayName(uint32_t id) const
+{
+    std::string_view name = m_names[id];
+    size_t at = name.rfind('@');
+    if (at != std::string_view::npos)
+    {
+        return name.substr(0, at);
+    }
+    size_t backslash = name.find('\\');
+    return backslash == std::string_view::npos ? name : name.substr(backslash + 1);
+}
+
+PrincipalTable::Clock::time_point PrincipalTable::LastSeen(uint32_t id) const
+{
+    return Clock::time_point(Clock::duration(m_lastSeen[id].load(std::memory_order_relaxed)));
+}
+
+void PrincipalTable::Touch(uint32_t id, Clock::time_point when)
+{
+    if (id == NO_PRINCIPAL)
+    {
+        return;
+    }
+    m_requests[id].fetch_add(1, std::memory_order_relaxed);
+
+    // Requests of one principal on many threads would otherwise all write the
+    // same line; within a second the stored time is as good
+    int64_t ticks = when.time_since_epoch().count();
+    int64_t seen = m_lastSeen[id].load(std::memory_order_relaxed);
+    if (ticks - seen >= std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)).count())
+    {
+        m_lastSeen[id].store(ticks, std::memory_order_relaxed);
+    }
+}
+
+const uint64_t* PrincipalTable::Groups(uint32_t id, Clock::time_point now) const
+{
+    if (id == NO_PRINCIPAL || now.time_since_epoch().count() >= m_groupsExpiry[id].load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    return m_groups[id].load(std::memory_order_acquire);
+}
+
+void PrincipalTable::SetGroups(uint32_t id, const uint64_t* groups, Clock::time_point expiry)
+{
+    if (id == NO_PRINCIPAL)
+    {
+        return;
+    }
+    // The set first: a reader that sees the new expiry also sees it
+    m_groups[id].store(groups, std::memory_order_release);
+    m_groupsExpiry[id].store(expiry.time_since_epoch().count(), std::memory_order_release);
+}
+
+uint32_t PrincipalTable::Busiest() const
+{
+    uint32_t busiest = NO_PRINCIPAL;
+    uint64_t most = 0;
+    size_t size = Size();
+    for (size_t id = 1; id <= size; id++)
+    {
+        uint64_t requests = m_requests[id].load(std::memory_order_relaxed);
+        if (requests > most)
+        {
+            most = requests;
+            busiest = static_cast<uint32_t>(id);
+        }
+    }
+    return busiest;
+}
+
+size_t PrincipalTable::Size() const
+{
+    size_t next = m_next.load(std::memory_order_relaxed);
+    return next > m_capacity ? m_capacity : next - 1;
+}
+
+PrincipalTableStats PrincipalTable::GetStats() const
+{
+    PrincipalTableStats stats;
+    stats.capacity = m_capacity;
+    stats.refused = m_refused.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        stats.principals += m_shards[i].ids.size();
+    }
+    std::lock_guard<std::mutex> lock(m_realmMutex);
+    stats.realms = m_realmCount - 1;
+    return stats;
+}
\ No newline at end of file
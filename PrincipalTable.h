@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct PrincipalTableStats
+{
+    size_t principals = 0;
+    size_t capacity = 0;
+    size_t realms = 0;
+    uint64_t refused = 0;       // principals that found the table full and went without an ID
+};
+
+// Authenticated principals interned to compact IDs. A principal keeps its ID
+// for the life of the process, so an ID can stand for the name anywhere after
+// authentication: in a request's AuthResult, in a token cache entry, as the
+// key of per-user counters. IDs run from 1; 0 means none, for a principal
+// that found the table full.
+//
+// Names are looked up in 64 shards of a hash map, each behind its own mutex,
+// once per authentication. Everything else is kept per ID in columns
+// (structure of arrays) allocated up front for the capacity: the realm as an
+// index into a small realm table, the time last seen, a request count and
+// the group set an AccessPolicy resolved, with its expiry. The hot columns
+// are dense arrays of atomics, so reading or bumping one per request neither
+// locks nor touches the others, and a scan of one (the busiest principal)
+// walks contiguous memory. The display name is the user part of the name
+// ("alice" of alice@EXAMPLE.COM or EXAMPLE\alice).
+class PrincipalTable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PrincipalTable(size_t capacity);
+
+    // ID of principal, assigned on first sight; NO_PRINCIPAL when it is new
+    // and the table is full
+    uint32_t Intern(std::string_view principal);
+    uint32_t Find(std::string_view principal) const;
+
+    // Columns of an ID that Intern returned
+    std::string_view Name(uint32_t id) const { return m_names[id]; }
+    std::string_view DisplayName(uint32_t id) const;
+    std::string_view Realm(uint32_t id) const { return m_realms[m_realmOf[id]]; }
+    uint16_t RealmId(uint32_t id) const { return m_realmOf[id]; }
+    Clock::time_point LastSeen(uint32_t id) const;
+    uint64_t Requests(uint32_t id) const { return m_requests[id].load(std::memory_order_relaxed); }
+
+    // Counts a request of id at when; NO_PRINCIPAL is ignored
+    void Touch(uint32_t id, Clock::time_point when);
+
+    // Group set of id unless it is missing or expired at now. The set's
+    // owner keeps it alive for as long as the table.
+    const uint64_t* Groups(uint32_t id, Clock::time_point now) const;
+    void SetGroups(uint32_t id, const uint64_t* groups, Clock::time_point expiry);
+
+    // The ID with the most requests, or NO_PRINCIPAL when there are none
+    uint32_t Busiest() const;
+
+    // Tells this table's IDs from those of another table in the process, for
+    // a session cookie that carries an ID in place of the name
+    uint64_t Epoch() const { return m_epoch; }
+
+    size_t Size() const;
+    PrincipalTableStats GetStats() const;
+
+    static constexpr uint32_t NO_PRINCIPAL = 0;
+    static constexpr size_t SHARD_COUNT = 64;
+    static constexpr size_t MAX_REALMS = 256;      // realm 0 is "", and the one of every realm past the last
+
+private:
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, uint32_t> ids;     // keys point into m_names
+    };
+
+    uint16_t InternRealm(std::string_view realm);
+
+    size_t m_capacity;
+    uint64_t m_epoch;
+    std::unique_ptr<Shard[]> m_shards;
+    std::atomic<uint32_t> m_next;       // next ID to hand out
+    std::atomic<uint64_t> m_refused;
+
+    // Columns, indexed by ID
+    std::unique_ptr<std::string[]> m_names;
+    std::unique_ptr<uint16_t[]> m_realmOf;
+    std::unique_ptr<std::atomic<int64_t>[]> m_lastSeen;         // Clock ticks
+    std::unique_ptr<std::atomic<uint64_t>[]> m_requests;
+    std::unique_ptr<std::atomic<const uint64_t*>[]> m_groups;
+    std::unique_ptr<std::atomic<int64_t>[]> m_groupsExpiry;     // Clock ticks
+
+    mutable std::mutex m_realmMutex;
+    std::unique_ptr<std::string[]> m_realms;
+    size_t m_realmCount;
+};
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "ReplayCache.h"
+#include <algorithm>
+#include <cstring>
+
+ReplayCache::ReplayCache(size_t maxEntries, std::chrono::seconds window)
+    : m_epoch(Clock::now())
+    , m_shards(new Shard[SHARD_COUNT])
+    , m_shardSlots(PROBE_SLOTS)
+    , m_windowSeconds(static_cast<uint32_t>(window.count()))
+    , m_replays(0)
+    , m_full(0)
+{
+    // Twice the shard's share, so probes rarely meet a run of live entries
+    m_shardSlots = (std::max)(PROBE_SLOTS, 2 * maxEntries / SHARD_COUNT);
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        m_shards[i].slots.reset(new Slot[m_shardSlots]);
+    }
+}
+
+ReplayCheck ReplayCache::Insert(const Sha256::Digest& key)
+{
+    return Insert(key, Clock::now());
+}
+
+ReplayCheck ReplayCache::Insert(const Sha256::Digest& key, Clock::time_point now)
+{
+    // Bytes 0-7 pick the shard and the slot, 8-19 are what is compared
+    uint64_t hash;
+    uint64_t word;
+    uint32_t check;
+    memcpy(&hash, key.data(), sizeof(hash));
+    memcpy(&word, key.data() + 8, sizeof(word));
+    memcpy(&check, key.data() + 16, sizeof(check));
+
+    // Seconds from 1, so a slot never used reads as expired
+    uint32_t second = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - m_epoch).count()) + 1;
+    Shard& shard = m_shards[hash & (SHARD_COUNT - 1)];
+    size_t first = static_cast<size_t>((hash / SHARD_COUNT) % m_shardSlots);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot* free = nullptr;
+    for (size_t i = 0; i < PROBE_SLOTS; i++)
+    {
+        Slot& slot = shard.slots[(first + i) % m_shardSlots];
+        if (slot.expiry <= second)
+        {
+            free = free ? free : &slot;
+        }
+        else if (slot.key == word && slot.check == check)
+        {
+            m_replays.fetch_add(1, std::memory_order_relaxed);
+            return ReplayCheck::Replay;
+        }
+    }
+    if (!free)
+    {
+        m_full.fetch_add(1, std::memory_order_relaxed);
+        return ReplayCheck::Full;
+    }
+
+    // Rounded up a second, since the current one is already part gone
+    free->key = word;
+    free->check = check;
+    free->expiry = second + m_windowSeconds + 1;
+    return ReplayCheck::Fresh;
+}
\ No newline at end of file
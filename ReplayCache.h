@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Sha256.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+enum class ReplayCheck
+{
+    Fresh,      // recorded
+    Replay,     // recorded already, within the window
+    Full        // no room to record it; nothing can be said about it
+};
+
+// Authenticators seen within the clock-skew window, keyed by the SHA-256 of
+// their ciphertext (as MIT's replay cache does). A second presentation of the
+// same authenticator is a replay; anything older than the window would fail
+// the skew check anyway, so entries expire with it.
+//
+// The cache is a fixed table sized up front, sharded like TokenCache. Each
+// slot holds 96 bits of the digest and the second the entry expires; a slot
+// whose second has passed is free, so expiry costs nothing and nothing is
+// ever swept. An authenticator may sit in any of PROBE_SLOTS slots from its
+// hash. When all of them hold live entries the cache is Full: it never
+// forgets a live authenticator to make room, and the caller must not accept
+// the token on its own authority.
+class ReplayCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Room for maxEntries live authenticators at half load
+    ReplayCache(size_t maxEntries, std::chrono::seconds window);
+
+    ReplayCheck Insert(const Sha256::Digest& key);
+    ReplayCheck Insert(const Sha256::Digest& key, Clock::time_point now);
+
+    uint64_t Replays() const { return m_replays.load(std::memory_order_relaxed); }
+    uint64_t Full() const { return m_full.load(std::memory_order_relaxed); }
+    size_t Capacity() const { return m_shardSlots * SHARD_COUNT; }
+
+    static constexpr size_t SHARD_COUNT = 64;
+    static constexpr size_t PROBE_SLOTS = 16;
+
+private:
+    struct Slot
+    {
+        uint64_t key = 0;
+        uint32_t check = 0;
+        uint32_t expiry = 0;        // seconds since m_epoch; 0 = never used
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    Clock::time_point m_epoch;
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_shardSlots;
+    uint32_t m_windowSeconds;
+    std::atomic<uint64_t> m_replays;
+    std::atomic<uint64_t> m_full;
+};
\ No newline at end of file
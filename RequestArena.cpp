@@ -0,0 +1,85 @@
+#include "RequestArena.h"
+#include <algorithm>
+
+RequestArena::RequestArena()
+    : m_current(0)
+    , m_offset(0)
+    , m_used(0)
+    , m_peak(0)
+    , m_depth(0)
+    , m_spilled(false)
+{
+    m_blocks.reserve(8);
+    m_blocks.push_back(Block{ std::unique_ptr<unsigned char[]>(new unsigned char[INITIAL_BLOCK]), INITIAL_BLOCK });
+    m_stats.retained = INITIAL_BLOCK;
+}
+
+RequestArena& RequestArena::ForThread()
+{
+    thread_local RequestArena arena;
+    return arena;
+}
+
+void* RequestArena::Allocate(size_t size, size_t alignment)
+{
+    for (;;)
+    {
+        Block& block = m_blocks[m_current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+        size_t start = static_cast<size_t>(((base + m_offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base);
+        if (start <= block.size && size <= block.size - start)
+        {
+            m_offset = start + size;
+            m_used += size;
+            m_peak = std::max(m_peak, m_used);
+            return block.memory.get() + start;
+        }
+
+        // Spill into a new block big enough for this allocation
+        size_t blockSize = std::max(INITIAL_BLOCK, size + alignment);
+        m_blocks.push_back(Block{ std::unique_ptr<unsigned char[]>(new unsigned char[blockSize]), blockSize });
+        m_stats.spills++;
+        m_spilled = true;
+        m_current = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+}
+
+RequestArena::Mark RequestArena::Open()
+{
+    m_depth++;
+    return Mark{ m_current, m_offset, m_used };
+}
+
+void RequestArena::Close(const Mark& mark)
+{
+    if (--m_depth == 0)
+    {
+        m_stats.requests++;
+        m_stats.highWater = std::max(m_stats.highWater, m_peak);
+
+        // A request that spilled shows the retained block is too small for
+        // this workload; grow it (with headroom) for the next one
+        if (m_spilled)
+        {
+            size_t wanted = std::min(MAX_RETAINED, std::max(m_peak + m_peak / 4, m_blocks[0].size * 2));
+            if (wanted > m_blocks[0].size)
+            {
+                m_blocks[0] = Block{ std::unique_ptr<unsigned char[]>(new unsigned char[wanted]), wanted };
+                m_stats.retained = wanted;
+            }
+        }
+        m_peak = 0;
+        m_spilled = false;
+    }
+
+    m_blocks.resize(mark.block + 1);
+    m_current = mark.block;
+    m_offset = mark.offset;
+    m_used = mark.used;
+}
+
+RequestArenaStats RequestArena::GetStats() const
+{
+    return m_stats;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct RequestArenaStats
+{
+    uint64_t requests = 0;      // outermost scopes closed
+    uint64_t spills = 0;        // extra blocks allocated because the first was full
+    size_t retained = 0;        // size of the block kept between requests
+    size_t highWater = 0;       // most any request has used
+};
+
+// Bump allocator for memory that lives for one request: decoded tokens,
+// security package output buffers and similar scratch. Each worker thread
+// owns one (ForThread) and nothing is freed individually; ArenaScope rewinds
+// the arena when the work that opened it is done. The first block is kept
+// across requests and, whenever a request spilled into extra blocks, grows
+// to that request's footprint (up to MAX_RETAINED), so the size settles on
+// what the workload's tokens actually need and the steady state makes no
+// heap calls.
+class RequestArena
+{
+public:
+    RequestArena();
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* AllocateArray(size_t count)
+    {
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Open returns the current position; Close rewinds to it. Scopes must
+    // close in reverse order; closing the outermost one ends the request.
+    struct Mark
+    {
+        size_t block;
+        size_t offset;
+        size_t used;
+    };
+
+    Mark Open();
+    void Close(const Mark& mark);
+
+    size_t Used() const { return m_used; }
+    RequestArenaStats GetStats() const;
+
+    static RequestArena& ForThread();
+
+    static constexpr size_t INITIAL_BLOCK = 32 * 1024;
+    static constexpr size_t MAX_RETAINED = 256 * 1024;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;    // m_blocks[0] is retained
+    size_t m_current;               // block being bumped
+    size_t m_offset;                // next free byte in it
+    size_t m_used;                  // bytes handed out since the outermost mark
+    size_t m_peak;                  // most of them live at once in this request
+    size_t m_depth;                 // open scopes
+    bool m_spilled;                 // the current request needed an extra block
+    RequestArenaStats m_stats;
+};
+
+// Rewinds the thread's arena to where it was when the scope opened. Scopes
+// nest: the request pipeline opens one per request and KerberosAuth opens
+// one per handshake leg, so callers outside the pipeline do not leak.
+class ArenaScope
+{
+public:
+    ArenaScope()
+        : m_arena(RequestArena::ForThread())
+        , m_mark(m_arena.Open())
+    {
+    }
+
+    ~ArenaScope() { m_arena.Close(m_mark); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    RequestArena& Arena() { return m_arena; }
+
+private:
+    RequestArena& m_arena;
+    RequestArena::Mark m_mark;
+};
\ No newline at end of file
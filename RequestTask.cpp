@@ -0,0 +1,7 @@
+#include "RequestTask.h"
+
+SlabPool& RequestTask::Frames()
+{
+    static SlabPool pool(MAX_CACHED_FRAME_BYTES);
+    return pool;
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "SlabPool.h"
+#include "StagePool.h"
+#include "Transport.h"
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+
+// A deferred request that a suspended RequestTask is waiting on. Whoever
+// finishes the operation (a stage thread, the transport) resumes the
+// continuation on its own thread.
+struct ResumableRequest : DeferredRequest
+{
+    std::coroutine_handle<> continuation;
+};
+
+// Coroutine type for request handlers. A handler is written as straight-line
+// code that co_awaits the points where it would otherwise return to a thread
+// pool or wait for the transport; while suspended a request costs its frame,
+// not a thread. Frames come from a SlabPool, so a steady stream of requests
+// reuses the same few blocks.
+//
+// A task starts suspended: the caller takes its handle with Detach and decides
+// where it first runs, typically by posting it to a stage. Once started it
+// runs to the end and frees its own frame.
+class RequestTask
+{
+public:
+    struct promise_type
+    {
+        RequestTask get_return_object() { return RequestTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(size_t size) { return Frames().Acquire(size); }
+        static void operator delete(void* frame) { Frames().Release(frame); }
+    };
+
+    RequestTask(RequestTask&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    RequestTask(const RequestTask&) = delete;
+    RequestTask& operator=(const RequestTask&) = delete;
+    RequestTask& operator=(RequestTask&&) = delete;
+
+    // A task that was never started is destroyed with its owner
+    ~RequestTask()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    // Hands over the not-yet-started coroutine; resuming it runs the handler,
+    // destroying it discards the frame
+    std::coroutine_handle<> Detach()
+    {
+        std::coroutine_handle<> handle = m_handle;
+        m_handle = nullptr;
+        return handle;
+    }
+
+    // Pool the frames are allocated from
+    static SlabPool& Frames();
+
+    // Enough for a few thousand suspended handlers
+    static constexpr size_t MAX_CACHED_FRAME_BYTES = 4 * 1024 * 1024;
+
+private:
+    explicit RequestTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// co_await ResumeOn(stage, request): continues on one of the stage's threads.
+// Yields false, without suspending, when the stage's queue is full or it is
+// stopping; the caller still runs on its original thread and should shed.
+// Bind the result to a local before testing it: GCC 12 miscompiles a
+// co_await written directly in an if condition.
+class ResumeOn
+{
+public:
+    ResumeOn(StagePool& stage, ResumableRequest* request) : m_stage(stage), m_request(request), m_posted(false) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        // Another thread may resume the task, and with it reuse this awaiter,
+        // as soon as Post returns true, so the result is written first
+        m_request->continuation = handle;
+        m_posted = true;
+        if (!m_stage.Post(m_request))
+        {
+            m_posted = false;
+            return false;
+        }
+        return true;
+    }
+
+    bool await_resume() const noexcept { return m_posted; }
+
+private:
+    StagePool& m_stage;
+    ResumableRequest* m_request;
+    bool m_posted;
+};
+
+// co_await SendResponse(sink, request): hands request->response to the
+// transport and continues once the transport gives the request back through
+// RequestHandler::Release, which must resume the continuation. That may
+// happen on any thread, including inside Complete itself.
+class SendResponse
+{
+public:
+    SendResponse(ResponseSink* sink, ResumableRequest* request) : m_sink(sink), m_request(request) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_request->continuation = handle;
+        m_sink->Complete(m_request);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    ResponseSink* m_sink;
+    ResumableRequest* m_request;
+};
+
+// Stage handler for tasks suspended in ResumeOn
+inline void ResumeRequest(DeferredRequest* deferred)
+{
+    static_cast<ResumableRequest*>(deferred)->continuation.resume();
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include "SecureRandom.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#else
+#include <cerrno>
+#include <sys/random.h>
+#endif
+
+bool GenerateRandom(uint8_t* buffer, size_t length)
+{
+#ifdef _WIN32
+    return BCRYPT_SUCCESS(BCryptGenRandom(nullptr, buffer, static_cast<ULONG>(length), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#else
+    while (length > 0)
+    {
+        ssize_t got = getrandom(buffer, length, 0);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        buffer += got;
+        length -= static_cast<size_t>(got);
+    }
+    return true;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fills buffer from the operating system's CSPRNG (BCryptGenRandom or
+// getrandom); false if it is unavailable
+bool GenerateRandom(uint8_t* buffer, size_t length);
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "SecurityContextTable.h"
+#include <algorithm>
+
+SecurityContextTable::SecurityContextTable(size_t maxEntries, std::chrono::seconds ttl, ReleaseFunction release)
+    : m_shards(new Shard[SHARD_COUNT])
+    , m_shardLimit(std::max<size_t>(1, maxEntries / SHARD_COUNT))
+    , m_ttl(ttl)
+    , m_release(std::move(release))
+{
+}
+
+SecurityContextTable::~SecurityContextTable()
+{
+    Clear();
+}
+
+SlabPool& SecurityContextTable::EntryPool()
+{
+    static SlabPool pool(4 * 1024 * 1024);
+    return pool;
+}
+
+SecurityContextTable::Shard& SecurityContextTable::ShardFor(uint64_t connectionId)
+{
+    // Connection ids are sequential per listener, so mix before picking a shard
+    uint64_t hash = connectionId * 0x9E3779B97F4A7C15ull;
+    return m_shards[(hash >> 58) & (SHARD_COUNT - 1)];
+}
+
+bool SecurityContextTable::Take(uint64_t connectionId, PendingContext& context)
+{
+    Shard& shard = ShardFor(connectionId);
+    bool expired = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(connectionId);
+        if (it == shard.entries.end())
+        {
+            return false;
+        }
+
+        context = std::move(it->second.context);
+        expired = Clock::now() - it->second.lastUsed > m_ttl;
+        shard.entries.erase(it);
+    }
+
+    if (expired)
+    {
+        m_release(context);
+        return false;
+    }
+    return true;
+}
+
+void SecurityContextTable::Put(uint64_t connectionId, const PendingContext& context)
+{
+    Shard& shard = ShardFor(connectionId);
+    Clock::time_point now = Clock::now();
+    std::vector<PendingContext> evicted;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (now >= shard.nextSweep || shard.entries.size() >= m_shardLimit)
+        {
+            SweepLocked(shard, now, evicted);
+        }
+
+        if (shard.entries.size() >= m_shardLimit && shard.entries.find(connectionId) == shard.entries.end())
+        {
+            auto oldest = std::min_element(shard.entries.begin(), shard.entries.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUsed < b.second.lastUsed; });
+            evicted.push_back(oldest->second.context);
+            shard.entries.erase(oldest);
+        }
+
+        auto result = shard.entries.try_emplace(connectionId, Entry{ context, now });
+        if (!result.second)
+        {
+            evicted.push_back(result.first->second.context);
+            result.first->second = Entry{ context, now };
+        }
+    }
+
+    for (const PendingContext& stale : evicted)
+    {
+        m_release(stale);
+    }
+}
+
+void SecurityContextTable::Remove(uint64_t connectionId)
+{
+    PendingContext context;
+    if (Take(connectionId, context))
+    {
+        m_release(context);
+    }
+}
+
+void SecurityContextTable::Clear()
+{
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        EntryMap entries(m_shards[i].entries.get_allocator());
+        {
+            std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+            entries.swap(m_shards[i].entries);
+        }
+        for (const auto& entry : entries)
+        {
+            m_release(entry.second.context);
+        }
+    }
+}
+
+size_t SecurityContextTable::Size() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        total += m_shards[i].entries.size();
+    }
+    return total;
+}
+
+void SecurityContextTable::SweepLocked(Shard& shard, Clock::time_point now, std::vector<PendingContext>& evicted)
+{
+    for (auto it = shard.entries.begin(); it != shard.entries.end();)
+    {
+        if (now - it->second.lastUsed > m_ttl)
+        {
+            evicted.push_back(it->second.context);
+            it = shard.entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // A sweep at most every quarter TTL bounds how long dead handshakes linger
+    shard.nextSweep = now + m_ttl / 4;
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "SlabPool.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class AcceptorCredential;
+
+// Opaque handle of a half-finished SPNEGO handshake. SSPI's CtxtHandle is two
+// pointer-sized words; other backends can store a pointer in lower. The
+// credential the handshake started with stays alive while it is parked, so
+// the next leg continues with it even after a refresh replaced it.
+struct PendingContext
+{
+    uintptr_t lower = 0;
+    uintptr_t upper = 0;
+    std::shared_ptr<AcceptorCredential> credential;
+};
+
+// In-progress security contexts keyed by connection id. Multi-leg handshakes
+// take their context out for the duration of AcceptSecurityContext and put it
+// back when another leg is needed, so no lock is held while the security
+// package runs. Entries live in independently locked shards; each shard keeps
+// an even share of the entry limit, drops entries idle for longer than the
+// TTL, and evicts its oldest entry when full. Evicted contexts are released
+// outside the shard lock. Map nodes come from a slab pool shared by all
+// tables, so handshake churn recycles them instead of hitting the heap.
+class SecurityContextTable
+{
+public:
+    using ReleaseFunction = std::function<void(const PendingContext&)>;
+
+    SecurityContextTable(size_t maxEntries, std::chrono::seconds ttl, ReleaseFunction release);
+    ~SecurityContextTable();
+
+    // Removes and returns the context for connectionId, unless it has expired
+    bool Take(uint64_t connectionId, PendingContext& context);
+
+    // Stores a context until the next leg arrives. A context already stored
+    // for the connection is released.
+    void Put(uint64_t connectionId, const PendingContext& context);
+
+    void Remove(uint64_t connectionId);
+    void Clear();
+    size_t Size() const;
+
+    // Pool the map nodes of every table come from
+    static SlabPool& EntryPool();
+
+    static constexpr size_t SHARD_COUNT = 64;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        PendingContext context;
+        Clock::time_point lastUsed;
+    };
+
+    using EntryMap = std::unordered_map<uint64_t, Entry, std::hash<uint64_t>, std::equal_to<uint64_t>,
+        SlabAllocator<std::pair<const uint64_t, Entry>>>;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        EntryMap entries{ EntryMap::allocator_type(EntryPool()) };
+        Clock::time_point nextSweep;
+    };
+
+    Shard& ShardFor(uint64_t connectionId);
+    void SweepLocked(Shard& shard, Clock::time_point now, std::vector<PendingContext>& evicted);
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_shardLimit;
+    Clock::duration m_ttl;
+    ReleaseFunction m_release;
+};
\ No newline at end of file
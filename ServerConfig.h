@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Runtime settings shared by the service host and the HTTP server
+struct ServerConfig
+{
+    int port = 8080;
+    size_t workerThreads = 0;   // 0 = one worker (or event loop) per logical processor
+    size_t authContextLimit = 10000;        // SPNEGO handshakes waiting for their next leg
+    unsigned authContextTtlSeconds = 60;    // idle time before a pending handshake is dropped
+    size_t tokenCacheEntries = 10000;       // verified first-leg tokens kept for reuse
+    unsigned tokenReplayWindowSeconds = 0;  // how long a verified token is accepted again; 0 = every token is verified
+    unsigned sessionLifetimeSeconds = 900;  // signed session cookie lifetime; 0 = no cookies, Negotiate on every request
+    unsigned sessionKeyRotationSeconds = 3600;  // how often a new cookie signing key is generated
+    std::wstring transport;     // empty = platform default: "httpsys" on Windows, "epoll" elsewhere; "io_uring" on Linux 6.0+
+    std::wstring authProvider;  // empty = platform default: "sspi" on Windows, "gssapi" elsewhere when built with it; "mock" for replays
+    unsigned mockAuthMicros = 0;        // CPU time the mock provider spends on each leg
+    std::wstring keytab;        // service keys for GSSAPI and the native verifier; empty = KRB5_KTNAME or the library default
+    bool nativeApReq = true;    // verify plain AES AP-REQs in process with the keytab's keys before the provider
+    size_t replayRate = 1000;   // new AP-REQs per second the native verifier's replay cache has room for over the skew window; past that they go to the provider
+    std::wstring servicePrincipals; // comma-separated "service/host[@REALM]" AP-REQs must be for; empty = any
+    std::wstring acceptors;     // comma-separated "service/host[@REALM][=keytab]" identities to accept as, for virtual hosts; empty = one for the keytab above
+    unsigned credentialRefreshSeconds = 3600;   // how often acceptor credentials are re-acquired; 0 = only near expiry or when a keytab changes
+    std::wstring authzRules;    // URL authorization rules file; empty = any authenticated principal may request any path
+    unsigned authzMembershipSeconds = 300;  // how long a principal's group membership is reused before it is worked out again
+    size_t principalLimit = 100000; // principals given an ID for per-user state; later ones are served without one
+    unsigned clientRate = 0;    // Negotiate tokens per second one client address may send to the provider; 0 = no limit
+    unsigned clientBurst = 0;   // tokens a client may send at once before that rate applies; 0 = the rate
+    unsigned rejectSeconds = 10;    // how long a token that failed is answered 401 without another try; 0 = never
+    unsigned userConcurrency = 0;   // requests one principal may have past authentication at once; 0 = no limit
+    unsigned userRate = 0;      // requests one principal may make per window; 0 = no limit
+    unsigned userWindowSeconds = 60;    // the window of that rate, which slides
+    std::wstring limitsFile;    // overrides those six and sets quotas per principal or group, re-read on SIGHUP or the paramchange control; empty = none
+    size_t slowLaneLimit = 0;   // NTLM legs inside the provider at once; 0 = a quarter of the logical processors
+    size_t authThreads = 0;     // auth stage threads; 0 = two per logical processor
+    size_t handlerThreads = 0;  // handler stage threads; 0 = half the logical processors
+    size_t stageQueueDepth = 1024;  // requests each stage holds before answering 503; 0 = authenticate on the transport's threads
+    unsigned queueDeadlineMs = 2000;    // a request still queued after this long is answered 503
+    unsigned retryAfterSeconds = 1;     // Retry-After sent with 503
+    std::wstring metricsPath = L"/metrics"; // Prometheus scrape path, served without Negotiate; empty = not served
+    std::wstring metricsSharedMemory;   // name of a shared-memory snapshot for local agents; empty = none
+    unsigned metricsIntervalMs = 1000;  // how often that snapshot is refreshed
+    std::wstring logSink;       // "console", "eventlog" (Windows), "journald" (Linux) or a file path; empty = console, or the Event Log for the service
+    std::wstring logLevel;      // "debug", "info", "warning" or "error"; empty = info
+    unsigned logSampleEvery = 1;        // log one in N of each repeated auth or accept failure
+    unsigned logRatePerSecond = 20;     // most lines per second from each of those call sites; 0 = no limit
+    unsigned traceSampleEvery = 0;      // trace one request in N; 0 = off, or every request with a threshold
+    unsigned traceThresholdUs = 0;      // export only requests that took at least this long; 0 = all traced requests
+    size_t traceSpansPerThread = 16384; // spans each thread keeps (40 bytes each); the oldest are overwritten
+    std::wstring tracePath = L"/trace"; // Chrome trace download while tracing is on, served without Negotiate; empty = not served
+    std::wstring traceFile = L"trace.json";     // where SIGUSR1 writes the trace (Linux)
+    std::wstring captureFile;   // record received requests to this traffic trace for TrafficReplay; empty = off
+    std::wstring captureTokens = L"replace";    // Negotiate tokens in the capture: "keep", "redact" or "replace" with mock tokens
+};
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "SessionCookie.h"
+#include "Log.h"
+#include "SecureRandom.h"
+
+namespace
+{
+    const char HEX_DIGITS[] = "0123456789abcdef";
+    const char COOKIE_VERSION[] = "2";
+    constexpr size_t KEY_SIZE = 32;
+
+    void AppendHex(std::string& out, const void* data, size_t length)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < length; i++)
+        {
+            out.push_back(HEX_DIGITS[bytes[i] >> 4]);
+            out.push_back(HEX_DIGITS[bytes[i] & 0x0f]);
+        }
+    }
+
+    int HexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+    // Lower-case hex only, so every cookie has exactly one valid spelling
+    bool DecodeHex(std::string_view hex, uint8_t* out)
+    {
+        for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        {
+            int high = HexValue(hex[i]);
+            int low = HexValue(hex[i + 1]);
+            if (high < 0 || low < 0)
+            {
+                return false;
+            }
+            out[i / 2] = static_cast<uint8_t>((high << 4) | low);
+        }
+        return hex.size() % 2 == 0;
+    }
+
+    bool ParseUnsigned(std::string_view text, uint64_t& value)
+    {
+        if (text.empty() || text.size() > 19)
+        {
+            return false;
+        }
+        value = 0;
+        for (char c : text)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return true;
+    }
+
+    // Splits off the text before the next '.'
+    bool NextField(std::string_view& rest, std::string_view& field)
+    {
+        size_t dot = rest.find('.');
+        if (dot == std::string_view::npos)
+        {
+            return false;
+        }
+        field = rest.substr(0, dot);
+        rest.remove_prefix(dot + 1);
+        return true;
+    }
+
+    // Value of the named cookie in a "a=1; b=2" header
+    std::string_view FindCookie(std::string_view header, std::string_view name)
+    {
+        while (!header.empty())
+        {
+            size_t start = header.find_first_not_of("; ");
+            if (start == std::string_view::npos)
+            {
+                break;
+            }
+            header.remove_prefix(start);
+
+            size_t end = header.find(';');
+            std::string_view pair = header.substr(0, end);
+            if (pair.size() > name.size() && pair[name.size()] == '=' && pair.substr(0, name.size()) == name)
+            {
+                return pair.substr(name.size() + 1);
+            }
+            if (end == std::string_view::npos)
+            {
+                break;
+            }
+            header.remove_prefix(end + 1);
+        }
+        return std::string_view();
+    }
+}
+
+SessionCookies::SessionCookies(std::chrono::seconds lifetime, std::chrono::seconds rotationInterval)
+    : m_lifetime(lifetime)
+    , m_rotationInterval(rotationInterval)
+    , m_nextKeyId(1)
+    , m_issued(0)
+    , m_accepted(0)
+    , m_rejected(0)
+    , m_expired(0)
+    , m_rotations(0)
+{
+}
+
+bool SessionCookies::Initialize()
+{
+    if (!Enabled())
+    {
+        return true;
+    }
+
+    auto keys = std::make_shared<KeySet>();
+    if (!AddKey(*keys, Clock::now()))
+    {
+        Log::Write(LogLevel::Error) << L"Failed to generate a session cookie key";
+        return false;
+    }
+    std::atomic_store(&m_keys, std::shared_ptr<const KeySet>(std::move(keys)));
+    return true;
+}
+
+bool SessionCookies::AddKey(KeySet& keys, Clock::time_point now)
+{
+    uint8_t secret[KEY_SIZE];
+    if (!GenerateRandom(secret, sizeof(secret)))
+    {
+        return false;
+    }
+
+    keys.keys.insert(keys.keys.begin(), Key{ m_nextKeyId++, HmacSha256(secret, sizeof(secret)), now, Clock::time_point::max() });
+    return true;
+}
+
+std::shared_ptr<const SessionCookies::KeySet> SessionCookies::LoadKeys() const
+{
+    return std::atomic_load(&m_keys);
+}
+
+void SessionCookies::RotateKey()
+{
+    std::lock_guard<std::mutex> lock(m_rotateMutex);
+    RotateKeyLocked();
+}
+
+void SessionCookies::RotateKeyLocked()
+{
+    std::shared_ptr<const KeySet> current = LoadKeys();
+    if (!current)
+    {
+        return;
+    }
+
+    // Retired keys stay until every cookie they signed has expired
+    Clock::time_point now = Clock::now();
+    auto next = std::make_shared<KeySet>();
+    for (const Key& key : current->keys)
+    {
+        if (key.retired == Clock::time_point::max())
+        {
+            next->keys.push_back(key);
+            next->keys.back().retired = now;
+        }
+        else if (key.retired + m_lifetime > now)
+        {
+            next->keys.push_back(key);
+        }
+    }
+
+    if (!AddKey(*next, now))
+    {
+        Log::Write(LogLevel::Error) << L"Failed to generate a session cookie key; keeping the current one";
+        return;
+    }
+
+    std::atomic_store(&m_keys, std::shared_ptr<const KeySet>(std::move(next)));
+    m_rotations.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string SessionCookies::Issue(std::string_view principal, uint32_t principalId, uint64_t epoch)
+{
+    std::shared_ptr<const KeySet> keys = LoadKeys();
+    if (!keys || principal.empty() || principal.size() > MAX_PRINCIPAL_LENGTH)
+    {
+        return std::string();
+    }
+
+    Clock::time_point now = Clock::now();
+    if (m_rotationInterval.count() > 0 && now - keys->keys[0].created >= m_rotationInterval)
+    {
+        // Only the first thread to notice rotates
+        std::lock_guard<std::mutex> lock(m_rotateMutex);
+        keys = LoadKeys();
+        if (now - keys->keys[0].created >= m_rotationInterval)
+        {
+            RotateKeyLocked();
+            keys = LoadKeys();
+        }
+    }
+    const Key& key = keys->keys[0];
+
+    uint64_t expiry = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>((now + m_lifetime).time_since_epoch()).count());
+
+    std::string cookie;
+    cookie.reserve(COOKIE_NAME.size() + 128 + principal.size() * 2);
+    cookie.append(COOKIE_NAME).push_back('=');
+    size_t payloadStart = cookie.size();
+
+    uint8_t id[4] = { static_cast<uint8_t>(key.id >> 24), static_cast<uint8_t>(key.id >> 16),
+        static_cast<uint8_t>(key.id >> 8), static_cast<uint8_t>(key.id) };
+    cookie.append(COOKIE_VERSION).push_back('.');
+    AppendHex(cookie, id, sizeof(id));
+    cookie.push_back('.');
+    cookie.append(std::to_string(expiry)).push_back('.');
+    cookie.append(std::to_string(epoch)).push_back('.');
+    cookie.append(std::to_string(principalId)).push_back('.');
+    AppendHex(cookie, principal.data(), principal.size());
+
+    Sha256::Digest mac = key.mac.Compute(cookie.data() + payloadStart, cookie.size() - payloadStart);
+    cookie.push_back('.');
+    AppendHex(cookie, mac.data(), mac.size());
+
+    cookie.append("; Path=/; Max-Age=").append(std::to_string(m_lifetime.count()));
+    cookie.append("; HttpOnly; SameSite=Strict");
+
+    m_issued.fetch_add(1, std::memory_order_relaxed);
+    return cookie;
+}
+
+bool SessionCookies::Verify(std::string_view cookieHeader, uint64_t epoch, uint32_t& principalId, std::string& principal)
+{
+    std::shared_ptr<const KeySet> keys = LoadKeys();
+    if (!keys)
+    {
+        return false;
+    }
+
+    std::string_view value = FindCookie(cookieHeader, COOKIE_NAME);
+    if (value.empty())
+    {
+        return false;
+    }
+
+    // version.keyid.expiry.epoch.id.principal.mac; the MAC covers everything before it
+    std::string_view rest = value;
+    std::string_view version, keyId, expiryText, epochText, idText, principalHex;
+    size_t macStart = value.rfind('.');
+    if (macStart == std::string_view::npos || value.size() - macStart - 1 != Sha256::DIGEST_SIZE * 2 ||
+        !NextField(rest, version) || !NextField(rest, keyId) || !NextField(rest, expiryText) ||
+        !NextField(rest, epochText) || !NextField(rest, idText) ||
+        !NextField(rest, principalHex) || rest.size() != Sha256::DIGEST_SIZE * 2 ||
+        version != COOKIE_VERSION || keyId.size() != 8 || principalHex.empty() ||
+        principalHex.size() > MAX_PRINCIPAL_LENGTH * 2)
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint8_t idBytes[4];
+    uint8_t presented[Sha256::DIGEST_SIZE];
+    uint64_t expiry = 0;
+    uint64_t cookieEpoch = 0;
+    uint64_t cookieId = 0;
+    if (!DecodeHex(keyId, idBytes) || !DecodeHex(rest, presented) || !ParseUnsigned(expiryText, expiry) ||
+        !ParseUnsigned(epochText, cookieEpoch) || !ParseUnsigned(idText, cookieId) || cookieId > UINT32_MAX)
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint32_t id = (static_cast<uint32_t>(idBytes[0]) << 24) | (static_cast<uint32_t>(idBytes[1]) << 16) |
+        (static_cast<uint32_t>(idBytes[2]) << 8) | static_cast<uint32_t>(idBytes[3]);
+
+    const Key* key = nullptr;
+    for (const Key& candidate : keys->keys)
+    {
+        if (candidate.id == id)
+        {
+            key = &candidate;
+            break;
+        }
+    }
+
+    if (!key)
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Sha256::Digest expected = key->mac.Compute(value.data(), macStart);
+    if (!ConstantTimeEquals(presented, expected.data(), expected.size()))
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Clock::time_point now = Clock::now();
+    uint64_t nowSeconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count());
+    bool keyRetired = key->retired != Clock::time_point::max() && key->retired + m_lifetime <= now;
+    if (expiry <= nowSeconds || keyRetired)
+    {
+        m_expired.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // The MAC vouches for the ID as much as for the name
+    principalId = cookieEpoch == epoch ? static_cast<uint32_t>(cookieId) : PrincipalTable::NO_PRINCIPAL;
+    if (principalId == PrincipalTable::NO_PRINCIPAL)
+    {
+        principal.resize(principalHex.size() / 2);
+        if (!DecodeHex(principalHex, reinterpret_cast<uint8_t*>(&principal[0])))
+        {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    m_accepted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+SessionCookieStats SessionCookies::GetStats() const
+{
+    SessionCookieStats stats;
+    stats.issued = m_issued.load(std::memory_order_relaxed);
+    stats.accepted = m_accepted.load(std::memory_order_relaxed);
+    stats.rejected = m_rejected.load(std::memory_order_relaxed);
+    stats.expired = m_expired.load(std::memory_order_relaxed);
+    stats.rotations = m_rotations.load(std::memory_order_relaxed);
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "PrincipalTable.h"
+#include "Sha256.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SessionCookieStats
+{
+    uint64_t issued = 0;
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;      // malformed, unknown key or bad MAC
+    uint64_t expired = 0;
+    uint64_t rotations = 0;
+};
+
+// HMAC-signed session cookies issued after a successful Negotiate handshake,
+// so later requests on any connection skip the security package. A cookie
+// carries its key id, expiry and principal, both as its PrincipalTable ID
+// (with the table's epoch) and by name:
+//
+//     kes_session=2.<key id>.<expiry, unix seconds>.<epoch>.<principal ID>.<principal, hex>.<HMAC-SHA256, hex>
+//
+// A cookie whose ID belongs to the caller's table hands back the ID alone, so
+// a request on it neither decodes the name nor interns it again; the name is
+// for a principal that had no ID when the cookie was issued.
+//
+// Keys are random, held only in memory and replaced every rotation interval.
+// A replaced key keeps verifying until the last cookie it signed has expired,
+// so rotation never ends a session. A cookie that does not verify is ignored
+// and the client falls back to Negotiate.
+class SessionCookies
+{
+public:
+    using Clock = std::chrono::system_clock;
+
+    static constexpr std::string_view COOKIE_NAME = "kes_session";
+    static constexpr size_t MAX_PRINCIPAL_LENGTH = 256;
+
+    SessionCookies(std::chrono::seconds lifetime, std::chrono::seconds rotationInterval);
+
+    bool Initialize();
+    bool Enabled() const { return m_lifetime.count() > 0; }
+
+    // Set-Cookie value for a freshly authenticated principal, whose ID in the
+    // table of epoch is principalId (NO_PRINCIPAL for none); empty when
+    // cookies are disabled or the principal is too long to carry
+    std::string Issue(std::string_view principal, uint32_t principalId, uint64_t epoch);
+
+    // Looks for the session cookie in a Cookie header and checks it. A cookie
+    // issued with an ID under epoch sets principalId and leaves principal
+    // alone; any other sets principalId to NO_PRINCIPAL and principal to the
+    // name.
+    bool Verify(std::string_view cookieHeader, uint64_t epoch, uint32_t& principalId, std::string& principal);
+
+    void RotateKey();
+    SessionCookieStats GetStats() const;
+
+private:
+    struct Key
+    {
+        uint32_t id;
+        HmacSha256 mac;
+        Clock::time_point created;
+        Clock::time_point retired;  // max() while current
+    };
+
+    // keys[0] signs; the rest only verify
+    struct KeySet
+    {
+        std::vector<Key> keys;
+    };
+
+    bool AddKey(KeySet& keys, Clock::time_point now);
+    void RotateKeyLocked();
+    std::shared_ptr<const KeySet> LoadKeys() const;
+
+    std::chrono::seconds m_lifetime;
+    std::chrono::seconds m_rotationInterval;
+
+    std::mutex m_rotateMutex;
+    std::shared_ptr<const KeySet> m_keys;   // replaced whole, read with atomic_load
+    uint32_t m_nextKeyId;
+
+    std::atomic<uint64_t> m_issued;
+    std::atomic<uint64_t> m_accepted;
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_expired;
+    std::atomic<uint64_t> m_rotations;
+};
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include "Sha1.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SHA1_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA1_TARGET(features)
+#else
+#include <cpuid.h>
+#define SHA1_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace
+{
+    inline uint32_t RotateLeft(uint32_t value, int count)
+    {
+        return (value << count) | (value >> (32 - count));
+    }
+
+#ifdef SHA1_X86
+    // One block with the SHA extensions: sha1rnds4 does four rounds, the
+    // msg1/msg2 pair extends the schedule and sha1nexte carries E forward
+    SHA1_TARGET("sha,sse4.1")
+    void TransformShaNi(uint32_t* state, const uint8_t* block)
+    {
+        const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+        __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+        __m128i e1;
+        __m128i message0, message1, message2, message3;
+
+        // Rounds 0-3
+        message0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 0)), byteSwap);
+        e0 = _mm_add_epi32(e0, message0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        // Rounds 4-7
+        message1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16)), byteSwap);
+        e1 = _mm_sha1nexte_epu32(e1, message1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        message0 = _mm_sha1msg1_epu32(message0, message1);
+
+        // Rounds 8-11
+        message2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32)), byteSwap);
+        e0 = _mm_sha1nexte_epu32(e0, message2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        message1 = _mm_sha1msg1_epu32(message1, message2);
+        message0 = _mm_xor_si128(message0, message2);
+
+        // Rounds 12-15
+        message3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48)), byteSwap);
+        e1 = _mm_sha1nexte_epu32(e1, message3);
+        e0 = abcd;
+        message0 = _mm_sha1msg2_epu32(message0, message3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        message2 = _mm_sha1msg1_epu32(message2, message3);
+        message1 = _mm_xor_si128(message1, message3);
+
+        // Rounds 16-19
+        e0 = _mm_sha1nexte_epu32(e0, message0);
+        e1 = abcd;
+        message1 = _mm_sha1msg2_epu32(message1, message0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        message3 = _mm_sha1msg1_epu32(message3, message0);
+        message2 = _mm_xor_si128(message2, message0);
+
+        // Rounds 20-23
+        e1 = _mm_sha1nexte_epu32(e1, message1);
+        e0 = abcd;
+        message2 = _mm_sha1msg2_epu32(message2, message1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        message0 = _mm_sha1msg1_epu32(message0, message1);
+        message3 = _mm_xor_si128(message3, message1);
+
+        // Rounds 24-27
+        e0 = _mm_sha1nexte_epu32(e0, message2);
+        e1 = abcd;
+        message3 = _mm_sha1msg2_epu32(message3, message2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        message1 = _mm_sha1msg1_epu32(message1, message2);
+        message0 = _mm_xor_si128(message0, message2);
+
+        // Rounds 28-31
+        e1 = _mm_sha1nexte_epu32(e1, message3);
+        e0 = abcd;
+        message0 = _mm_sha1msg2_epu32(message0, message3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        message2 = _mm_sha1msg1_epu32(message2, message3);
+        message1 = _mm_xor_si128(message1, message3);
+
+        // Rounds 32-35
+        e0 = _mm_sha1nexte_epu32(e0, message0);
+        e1 = abcd;
+        message1 = _mm_sha1msg2_epu32(message1, message0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        message3 = _mm_sha1msg1_epu32(message3, message0);
+        message2 = _mm_xor_si128(message2, message0);
+
+        // Rounds 36-39
+        e1 = _mm_sha1nexte_epu32(e1, message1);
+        e0 = abcd;
+        message2 = _mm_sha1msg2_epu32(message2, message1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        message0 = _mm_sha1msg1_epu32(message0, message1);
+        message3 = _mm_xor_si128(message3, message1);
+
+        // Rounds 40-43
+        e0 = _mm_sha1nexte_epu32(e0, message2);
+        e1 = abcd;
+        message3 = _mm_sha1msg2_epu32(message3, message2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        message1 = _mm_sha1msg1_epu32(message1, message2);
+        message0 = _mm_xor_si128(message0, message2);
+
+        // Rounds 44-47
+        e1 = _mm_sha1nexte_epu32(e1, message3);
+        e0 = abcd;
+        message0 = _mm_sha1msg2_epu32(message0, message3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        message2 = _mm_sha1msg1_epu32(message2, message3);
+        message1 = _mm_xor_si128(message1, message3);
+
+        // Rounds 48-51
+        e0 = _mm_sha1nexte_epu32(e0, message0);
+        e1 = abcd;
+        message1 = _mm_sha1msg2_epu32(message1, message0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        message3 = _mm_sha1msg1_epu32(message3, message0);
+        message2 = _mm_xor_si128(message2, message0);
+
+        // Rounds 52-55
+        e1 = _mm_sha1nexte_epu32(e1, message1);
+        e0 = abcd;
+        message2 = _mm_sha1msg2_epu32(message2, message1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        message0 = _mm_sha1msg1_epu32(message0, message1);
+        message3 = _mm_xor_si128(message3, message1);
+
+        // Rounds 56-59
+        e0 = _mm_sha1nexte_epu32(e0, message2);
+        e1 = abcd;
+        message3 = _mm_sha1msg2_epu32(message3, message2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        message1 = _mm_sha1msg1_epu32(message1, message2);
+        message0 = _mm_xor_si128(message0, message2);
+
+        // Rounds 60-63
+        e1 = _mm_sha1nexte_epu32(e1, message3);
+        e0 = abcd;
+        message0 = _mm_sha1msg2_epu32(message0, message3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        message2 = _mm_sha1msg1_epu32(message2, message3);
+        message1 = _mm_xor_si128(message1, message3);
+
+        // Rounds 64-67
+        e0 = _mm_sha1nexte_epu32(e0, message0);
+        e1 = abcd;
+        message1 = _mm_sha1msg2_epu32(message1, message0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+        message3 = _mm_sha1msg1_epu32(message3, message0);
+        message2 = _mm_xor_si128(message2, message0);
+
+        // Rounds 68-71
+        e1 = _mm_sha1nexte_epu32(e1, message1);
+        e0 = abcd;
+        message2 = _mm_sha1msg2_epu32(message2, message1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        message3 = _mm_xor_si128(message3, message1);
+
+        // Rounds 72-75
+        e0 = _mm_sha1nexte_epu32(e0, message2);
+        e1 = abcd;
+        message3 = _mm_sha1msg2_epu32(message3, message2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+        // Rounds 76-79
+        e1 = _mm_sha1nexte_epu32(e1, message3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+        state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+    }
+
+    bool DetectShaNi()
+    {
+        unsigned leaf1[4];
+        unsigned leaf7[4];
+#ifdef _MSC_VER
+        int values[4];
+        __cpuid(values, 0);
+        if (values[0] < 7)
+        {
+            return false;
+        }
+        __cpuid(values, 1);
+        leaf1[2] = static_cast<unsigned>(values[2]);
+        __cpuidex(values, 7, 0);
+        leaf7[1] = static_cast<unsigned>(values[1]);
+#else
+        if (__get_cpuid_max(0, nullptr) < 7)
+        {
+            return false;
+        }
+        __cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+        __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+        // SHA (leaf 7 EBX bit 29) and SSE4.1 (leaf 1 ECX bit 19)
+        return (leaf7[1] & (1u << 29)) != 0 && (leaf1[2] & (1u << 19)) != 0;
+    }
+#else
+    bool DetectShaNi()
+    {
+        return false;
+    }
+#endif
+
+    bool UseShaNi()
+    {
+        static const bool available = DetectShaNi();
+        return available;
+    }
+}
+
+Sha1::Sha1()
+    : m_state{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 }
+    , m_bufferLength(0)
+    , m_totalLength(0)
+{
+}
+
+void Sha1::Update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_totalLength += length;
+
+    if (m_bufferLength > 0)
+    {
+        size_t take = BLOCK_SIZE - m_bufferLength;
+        if (take > length)
+        {
+            take = length;
+        }
+        memcpy(m_buffer + m_bufferLength, bytes, take);
+        m_bufferLength += take;
+        bytes += take;
+        length -= take;
+        if (m_bufferLength < BLOCK_SIZE)
+        {
+            return;
+        }
+        Transform(m_buffer);
+        m_bufferLength = 0;
+    }
+
+    while (length >= BLOCK_SIZE)
+    {
+        Transform(bytes);
+        bytes += BLOCK_SIZE;
+        length -= BLOCK_SIZE;
+    }
+
+    memcpy(m_buffer, bytes, length);
+    m_bufferLength = length;
+}
+
+Sha1::Digest Sha1::Finish()
+{
+    uint64_t bitLength = m_totalLength * 8;
+
+    uint8_t padding[BLOCK_SIZE * 2] = { 0x80 };
+    size_t padLength = (m_bufferLength < 56 ? 56 : 120) - m_bufferLength;
+    Update(padding, padLength);
+
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        lengthBytes[i] = static_cast<uint8_t>(bitLength >> (56 - 8 * i));
+    }
+    Update(lengthBytes, sizeof(lengthBytes));
+
+    Digest digest;
+    for (int i = 0; i < 5; i++)
+    {
+        digest[i * 4] = static_cast<uint8_t>(m_state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(m_state[i]);
+    }
+    return digest;
+}
+
+Sha1::Digest Sha1::Hash(const void* data, size_t length)
+{
+    Sha1 hash;
+    hash.Update(data, length);
+    return hash.Finish();
+}
+
+void Sha1::Transform(const uint8_t* block)
+{
+#ifdef SHA1_X86
+    if (UseShaNi())
+    {
+        TransformShaNi(m_state, block);
+        return;
+    }
+#endif
+
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+            (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 80; i++)
+    {
+        w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3], e = m_state[4];
+
+    // One loop per round function keeps the selection out of the inner loop
+    int i = 0;
+    for (; i < 20; i++)
+    {
+        uint32_t temp = RotateLeft(a, 5) + ((b & c) | (~b & d)) + e + 0x5a827999 + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    for (; i < 40; i++)
+    {
+        uint32_t temp = RotateLeft(a, 5) + (b ^ c ^ d) + e + 0x6ed9eba1 + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    for (; i < 60; i++)
+    {
+        uint32_t temp = RotateLeft(a, 5) + ((b & c) | (b & d) | (c & d)) + e + 0x8f1bbcdc + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    for (; i < 80; i++)
+    {
+        uint32_t temp = RotateLeft(a, 5) + (b ^ c ^ d) + e + 0xca62c1d6 + w[i];
+        e = d;
+        d = c;
+        c = RotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+}
+
+HmacSha1::HmacSha1()
+    : HmacSha1(nullptr, 0)
+{
+}
+
+HmacSha1::HmacSha1(const void* key, size_t keyLength)
+{
+    uint8_t block[Sha1::BLOCK_SIZE] = {};
+    if (keyLength > Sha1::BLOCK_SIZE)
+    {
+        Sha1::Digest hashed = Sha1::Hash(key, keyLength);
+        memcpy(block, hashed.data(), hashed.size());
+    }
+    else if (keyLength > 0)
+    {
+        memcpy(block, key, keyLength);
+    }
+
+    uint8_t pad[Sha1::BLOCK_SIZE];
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; i++)
+    {
+        pad[i] = block[i] ^ 0x36;
+    }
+    m_inner.Update(pad, sizeof(pad));
+    for (size_t i = 0; i < Sha1::BLOCK_SIZE; i++)
+    {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    m_outer.Update(pad, sizeof(pad));
+}
+
+Sha1::Digest HmacSha1::Compute(const void* data, size_t length) const
+{
+    Sha1 inner = m_inner;
+    inner.Update(data, length);
+    Sha1::Digest innerDigest = inner.Finish();
+
+    Sha1 outer = m_outer;
+    outer.Update(innerDigest.data(), innerDigest.size());
+    return outer.Finish();
+}
\ No newline at end of file
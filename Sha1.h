@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// SHA-1 (FIPS 180-4), on the x86 SHA extensions when the CPU has them and
+// portable code otherwise. Only for HMAC-SHA1-96, the integrity check of
+// the Kerberos AES encryption types; not for anything that needs collision
+// resistance.
+class Sha1
+{
+public:
+    static constexpr size_t DIGEST_SIZE = 20;
+    static constexpr size_t BLOCK_SIZE = 64;
+    using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+    Sha1();
+
+    void Update(const void* data, size_t length);
+    Digest Finish();
+
+    static Digest Hash(const void* data, size_t length);
+
+private:
+    void Transform(const uint8_t* block);
+
+    uint32_t m_state[5];
+    uint8_t m_buffer[BLOCK_SIZE];
+    size_t m_bufferLength;
+    uint64_t m_totalLength;
+};
+
+// HMAC-SHA1 (RFC 2104) with the keyed inner and outer states computed once
+class HmacSha1
+{
+public:
+    HmacSha1();
+    HmacSha1(const void* key, size_t keyLength);
+
+    Sha1::Digest Compute(const void* data, size_t length) const;
+
+private:
+    Sha1 m_inner;
+    Sha1 m_outer;
+};
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Portable SHA-256 (FIPS 180-4). Used to key caches by token content, where
+// a non-cryptographic hash would let a crafted token collide with a cached one.
+class Sha256
+{
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+    using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+    Sha256();
+
+    void Update(const void* data, size_t length);
+    Digest Finish();
+
+    static Digest Hash(const void* data, size_t length);
+
+private:
+    void Transform(const uint8_t* block);
+
+    uint32_t m_state[8];
+    uint8_t m_buffer[BLOCK_SIZE];
+    size_t m_bufferLength;
+    uint64_t m_totalLength;
+};
+
+// HMAC-SHA256 (RFC 2104) with the keyed inner and outer states computed once,
+// so each MAC costs two compressions plus the message
+class HmacSha256
+{
+public:
+    HmacSha256(const void* key, size_t keyLength);
+
+    Sha256::Digest Compute(const void* data, size_t length) const;
+
+private:
+    Sha256 m_inner;
+    Sha256 m_outer;
+};
+
+// Compares without an early exit, so timing does not reveal the matching prefix
+bool ConstantTimeEquals(const void* a, const void* b, size_t length);
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "SharedMetrics.h"
+#include "Log.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    std::wstring MappingName(const std::wstring& name)
+    {
+        return L"Local\\" + name;
+    }
+#else
+    std::string ShmName(const std::wstring& name)
+    {
+        std::string shmName = "/";
+        shmName.append(name.begin(), name.end());
+        return shmName;
+    }
+#endif
+
+    bool LayoutMatches(const SharedMetricsBlock& block)
+    {
+        return block.magic == SHARED_METRICS_MAGIC && block.version == SHARED_METRICS_VERSION &&
+            block.counterCount == METRIC_COUNTER_COUNT && block.stageCount == METRIC_STAGE_COUNT &&
+            block.bucketCount == METRIC_BUCKET_COUNT;
+    }
+
+    // Copies a mapped block under its sequence number
+    bool CopyBlock(const SharedMetricsBlock* block, MetricsSnapshot& snapshot, int attempts)
+    {
+        if (!LayoutMatches(*block))
+        {
+            return false;
+        }
+
+        for (int attempt = 0; attempt < attempts; attempt++)
+        {
+            uint64_t before = block->sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+
+            memcpy(snapshot.counters, block->counters, sizeof(snapshot.counters));
+            for (size_t stage = 0; stage < METRIC_STAGE_COUNT; stage++)
+            {
+                snapshot.stages[stage].count = block->stages[stage].count;
+                snapshot.stages[stage].sum = block->stages[stage].sum;
+                memcpy(snapshot.stages[stage].buckets, block->stages[stage].buckets, sizeof(snapshot.stages[stage].buckets));
+            }
+            snapshot.threads = block->threads;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (block->sequence.load(std::memory_order_relaxed) == before)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+SharedMetrics::SharedMetrics()
+    : m_block(nullptr)
+#ifdef _WIN32
+    , m_mapping(nullptr)
+#endif
+    , m_intervalMs(1000)
+    , m_running(false)
+{
+}
+
+SharedMetrics::~SharedMetrics()
+{
+    Stop();
+}
+
+bool SharedMetrics::Start(const std::wstring& name, unsigned intervalMs)
+{
+    if (m_block)
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedMetricsBlock),
+        MappingName(name).c_str());
+    if (!m_mapping)
+    {
+        Log::Write(LogLevel::Error) << L"CreateFileMapping failed for metrics snapshot " << name << L": " << GetLastError();
+        return false;
+    }
+    m_block = static_cast<SharedMetricsBlock*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedMetricsBlock)));
+    if (!m_block)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+        return false;
+    }
+#else
+    m_name = ShmName(name);
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        Log::Write(LogLevel::Error) << L"shm_open failed for metrics snapshot " << name << L": " << errno;
+        return false;
+    }
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, sizeof(SharedMetricsBlock)) == 0)
+    {
+        mapped = mmap(nullptr, sizeof(SharedMetricsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    m_block = static_cast<SharedMetricsBlock*>(mapped);
+#endif
+
+    // Sequence stays odd until the layout fields and a first snapshot are in
+    m_block->sequence.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_block->magic = SHARED_METRICS_MAGIC;
+    m_block->version = SHARED_METRICS_VERSION;
+    m_block->counterCount = static_cast<uint32_t>(METRIC_COUNTER_COUNT);
+    m_block->stageCount = static_cast<uint32_t>(METRIC_STAGE_COUNT);
+    m_block->bucketCount = static_cast<uint32_t>(METRIC_BUCKET_COUNT);
+    m_block->sequence.store(2, std::memory_order_release);
+    Publish();
+
+    m_intervalMs = intervalMs ? intervalMs : 1000;
+    m_running = true;
+    m_thread = std::thread(&SharedMetrics::PublishThread, this);
+    return true;
+}
+
+void SharedMetrics::Stop()
+{
+    if (!m_block)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    Publish();
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_block);
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+#else
+    munmap(m_block, sizeof(SharedMetricsBlock));
+    shm_unlink(m_name.c_str());
+#endif
+    m_block = nullptr;
+}
+
+void SharedMetrics::Publish()
+{
+    // Built off to the side: a snapshot sums every thread's shard, which is
+    // far too slow to do with the sequence odd
+    std::unique_ptr<MetricsSnapshot> snapshot = std::make_unique<MetricsSnapshot>(Metrics::Snapshot());
+
+    uint64_t sequence = m_block->sequence.load(std::memory_order_relaxed);
+    m_block->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_block->updatedUnixMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    m_block->threads = static_cast<uint32_t>(snapshot->threads);
+    memcpy(m_block->counters, snapshot->counters, sizeof(m_block->counters));
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; stage++)
+    {
+        m_block->stages[stage].count = snapshot->stages[stage].count;
+        m_block->stages[stage].sum = snapshot->stages[stage].sum;
+        memcpy(m_block->stages[stage].buckets, snapshot->stages[stage].buckets, sizeof(m_block->stages[stage].buckets));
+    }
+
+    m_block->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void SharedMetrics::PublishThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running)
+    {
+        m_condition.wait_for(lock, std::chrono::milliseconds(m_intervalMs));
+        if (!m_running)
+        {
+            break;
+        }
+        lock.unlock();
+        Publish();
+        lock.lock();
+    }
+}
+
+bool SharedMetrics::Read(const std::wstring& name, MetricsSnapshot& snapshot)
+{
+    bool copied = false;
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, MappingName(name).c_str());
+    if (!mapping)
+    {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedMetricsBlock));
+    if (view)
+    {
+        copied = CopyBlock(static_cast<const SharedMetricsBlock*>(view), snapshot, READ_ATTEMPTS);
+        UnmapViewOfFile(view);
+    }
+    CloseHandle(mapping);
+#else
+    int fd = shm_open(ShmName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* view = mmap(nullptr, sizeof(SharedMetricsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view != MAP_FAILED)
+    {
+        copied = CopyBlock(static_cast<const SharedMetricsBlock*>(view), snapshot, READ_ATTEMPTS);
+        munmap(view, sizeof(SharedMetricsBlock));
+    }
+#endif
+    return copied;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Metrics.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Layout of the shared-memory snapshot. A local scraper maps it read-only and
+// copies it under the sequence number: odd while the server is writing, so a
+// copy is good when the sequence was even and unchanged across it.
+struct SharedMetricsBlock
+{
+    uint32_t magic;             // SHARED_METRICS_MAGIC
+    uint32_t version;
+    std::atomic<uint64_t> sequence;
+    int64_t updatedUnixMs;
+    uint32_t counterCount;      // METRIC_COUNTER_COUNT
+    uint32_t stageCount;        // METRIC_STAGE_COUNT
+    uint32_t bucketCount;       // METRIC_BUCKET_COUNT
+    uint32_t threads;
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    struct Stage
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t buckets[METRIC_BUCKET_COUNT];
+    } stages[METRIC_STAGE_COUNT];
+};
+
+constexpr uint32_t SHARED_METRICS_MAGIC = 0x534d454b;   // "KEMS"
+constexpr uint32_t SHARED_METRICS_VERSION = 1;
+
+// Publishes Metrics::Snapshot into a named shared-memory block at a fixed
+// interval: "Local\<name>" file mapping on Windows, POSIX shm "/<name>"
+// elsewhere (removed again by Stop).
+class SharedMetrics
+{
+public:
+    SharedMetrics();
+    ~SharedMetrics();
+
+    SharedMetrics(const SharedMetrics&) = delete;
+    SharedMetrics& operator=(const SharedMetrics&) = delete;
+
+    bool Start(const std::wstring& name, unsigned intervalMs);
+
+    // Publishes a last snapshot and removes the block
+    void Stop();
+
+    // Scraper side: a consistent copy of the named block, or false when it
+    // does not exist, has another layout, or kept changing under the reader
+    static bool Read(const std::wstring& name, MetricsSnapshot& snapshot);
+
+private:
+    void Publish();
+    void PublishThread();
+
+    static constexpr int READ_ATTEMPTS = 100;
+
+    SharedMetricsBlock* m_block;
+    std::string m_name;
+#ifdef _WIN32
+    void* m_mapping;
+#endif
+    unsigned m_intervalMs;
+    bool m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_thread;
+};
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "SlabPool.h"
+#include <algorithm>
+#include <new>
+
+namespace
+{
+    // Each block is preceded by its capacity, padded to keep the block aligned
+    constexpr size_t HEADER_SIZE = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+    // Starting classes until the first histogram is in
+    const size_t INITIAL_CLASSES[SLAB_CLASS_COUNT] = { 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576 };
+}
+
+SlabPool::SlabPool(size_t maxCachedBytes)
+    : m_classCount(CLASS_COUNT)
+    , m_sinceAdapt(0)
+    , m_cachedBytes(0)
+    , m_maxCachedBytes(maxCachedBytes)
+{
+    for (size_t i = 0; i < CLASS_COUNT; i++)
+    {
+        m_classes[i].size = INITIAL_CLASSES[i];
+    }
+    std::fill(m_histogram, m_histogram + BUCKET_COUNT, 0u);
+}
+
+SlabPool::~SlabPool()
+{
+    for (size_t i = 0; i < m_classCount; i++)
+    {
+        for (void* block : m_classes[i].free)
+        {
+            FreeBlock(block);
+        }
+    }
+}
+
+SlabPool& SlabPool::Buffers()
+{
+    static SlabPool pool(32 * 1024 * 1024);
+    return pool;
+}
+
+size_t SlabPool::BucketIndex(size_t size)
+{
+    // Bucket 0 holds sizes up to 16; after that four buckets per power of two
+    if (size <= 16)
+    {
+        return 0;
+    }
+    size_t value = size - 1;
+    size_t log2 = 4;
+    while ((value >> (log2 + 1)) != 0)
+    {
+        log2++;
+    }
+    size_t quarter = (value >> (log2 - 2)) & 3;
+    return std::min(BUCKET_COUNT - 1, (log2 - 4) * 4 + quarter + 1);
+}
+
+size_t SlabPool::BucketLimit(size_t index)
+{
+    if (index == 0)
+    {
+        return 16;
+    }
+    size_t log2 = 4 + (index - 1) / 4;
+    size_t quarter = (index - 1) % 4;
+    return (5 + quarter) << (log2 - 2);
+}
+
+void* SlabPool::AllocateBlock(size_t capacity)
+{
+    unsigned char* raw = static_cast<unsigned char*>(::operator new(HEADER_SIZE + capacity));
+    *reinterpret_cast<size_t*>(raw) = capacity;
+    return raw + HEADER_SIZE;
+}
+
+size_t SlabPool::BlockCapacity(void* block)
+{
+    return *reinterpret_cast<size_t*>(static_cast<unsigned char*>(block) - HEADER_SIZE);
+}
+
+void SlabPool::FreeBlock(void* block)
+{
+    ::operator delete(static_cast<unsigned char*>(block) - HEADER_SIZE);
+}
+
+void* SlabPool::Acquire(size_t size)
+{
+    size_t capacity;
+    return Acquire(size, capacity);
+}
+
+void* SlabPool::Acquire(size_t size, size_t& capacity)
+{
+    void* block = nullptr;
+    size_t blockSize = (std::max<size_t>(size, 1) + 15) & ~static_cast<size_t>(15);
+    std::vector<void*> retired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.acquired++;
+        m_histogram[BucketIndex(size)]++;
+        if (++m_sinceAdapt >= ADAPT_INTERVAL)
+        {
+            AdaptLocked(retired);
+        }
+
+        // Smallest class that holds the request, unless it would waste half the block
+        for (size_t i = 0; i < m_classCount; i++)
+        {
+            SizeClass& sizeClass = m_classes[i];
+            if (sizeClass.size < size)
+            {
+                continue;
+            }
+            if (sizeClass.size / 2 <= size)
+            {
+                blockSize = sizeClass.size;
+                if (!sizeClass.free.empty())
+                {
+                    block = sizeClass.free.back();
+                    sizeClass.free.pop_back();
+                    m_cachedBytes -= sizeClass.size;
+                    m_stats.reused++;
+                }
+            }
+            break;
+        }
+        if (!block)
+        {
+            m_stats.allocated++;
+        }
+    }
+
+    for (void* stale : retired)
+    {
+        FreeBlock(stale);
+    }
+
+    if (!block)
+    {
+        block = AllocateBlock(blockSize);
+    }
+    capacity = BlockCapacity(block);
+    return block;
+}
+
+void SlabPool::Release(void* block)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    size_t capacity = BlockCapacity(block);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cachedBytes + capacity <= m_maxCachedBytes)
+        {
+            for (size_t i = 0; i < m_classCount; i++)
+            {
+                if (m_classes[i].size == capacity)
+                {
+                    m_classes[i].free.push_back(block);
+                    m_cachedBytes += capacity;
+                    return;
+                }
+            }
+        }
+        m_stats.freed++;
+    }
+    FreeBlock(block);
+}
+
+void SlabPool::SetMaxCachedBytes(size_t maxCachedBytes)
+{
+    std::vector<void*> trimmed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxCachedBytes = maxCachedBytes;
+        for (size_t i = m_classCount; i-- > 0 && m_cachedBytes > m_maxCachedBytes;)
+        {
+            SizeClass& sizeClass = m_classes[i];
+            while (!sizeClass.free.empty() && m_cachedBytes > m_maxCachedBytes)
+            {
+                trimmed.push_back(sizeClass.free.back());
+                sizeClass.free.pop_back();
+                m_cachedBytes -= sizeClass.size;
+            }
+        }
+        m_stats.freed += trimmed.size();
+    }
+
+    for (void* block : trimmed)
+    {
+        FreeBlock(block);
+    }
+}
+
+SlabPoolStats SlabPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SlabPoolStats stats = m_stats;
+    stats.cachedBytes = m_cachedBytes;
+    stats.classCount = m_classCount;
+    for (size_t i = 0; i < m_classCount; i++)
+    {
+        stats.classSizes[i] = m_classes[i].size;
+    }
+    return stats;
+}
+
+void SlabPool::AdaptLocked(std::vector<void*>& retired)
+{
+    m_sinceAdapt = 0;
+    m_stats.adaptations++;
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        total += m_histogram[i];
+    }
+
+    // Class k ends at the bucket holding the k/CLASS_COUNT quantile, so each
+    // class serves about the same share of requests; the last one covers the
+    // largest size seen
+    size_t sizes[CLASS_COUNT];
+    size_t count = 0;
+    uint64_t cumulative = 0;
+    uint64_t quantile = 1;
+    for (size_t i = 0; i < BUCKET_COUNT && quantile <= CLASS_COUNT; i++)
+    {
+        cumulative += m_histogram[i];
+        if (m_histogram[i] == 0 || cumulative * CLASS_COUNT < total * quantile)
+        {
+            continue;
+        }
+        sizes[count++] = BucketLimit(i);
+        while (quantile <= CLASS_COUNT && cumulative * CLASS_COUNT >= total * quantile)
+        {
+            quantile++;
+        }
+    }
+
+    // Older observations fade so the classes follow the current workload
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        m_histogram[i] /= 2;
+    }
+
+    // Cached blocks move to the new class of the same size or are freed
+    SizeClass previous[CLASS_COUNT];
+    size_t previousCount = m_classCount;
+    for (size_t i = 0; i < previousCount; i++)
+    {
+        previous[i].size = m_classes[i].size;
+        previous[i].free.swap(m_classes[i].free);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        m_classes[i].size = sizes[i];
+        m_classes[i].free.clear();
+    }
+    m_classCount = count;
+
+    for (size_t i = 0; i < previousCount; i++)
+    {
+        SizeClass* kept = nullptr;
+        for (size_t j = 0; j < count; j++)
+        {
+            if (m_classes[j].size == previous[i].size)
+            {
+                kept = &m_classes[j];
+            }
+        }
+        if (kept)
+        {
+            kept->free.swap(previous[i].free);
+        }
+        else
+        {
+            m_cachedBytes -= previous[i].size * previous[i].free.size();
+            m_stats.freed += previous[i].free.size();
+            retired.insert(retired.end(), previous[i].free.begin(), previous[i].free.end());
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+constexpr size_t SLAB_CLASS_COUNT = 8;
+
+struct SlabPoolStats
+{
+    uint64_t acquired = 0;
+    uint64_t reused = 0;        // served from a free list
+    uint64_t allocated = 0;     // went to the heap
+    uint64_t freed = 0;         // returned to the heap (free list full, class retired, or unclassed)
+    uint64_t adaptations = 0;
+    size_t cachedBytes = 0;
+    size_t classCount = 0;
+    size_t classSizes[SLAB_CLASS_COUNT] = {};
+};
+
+// Size-classed pool for buffers that outlive one request: connection receive
+// buffers, grown HTTP.sys request buffers, pending security context entries.
+// Released blocks go onto a per-class free list and are handed out again
+// instead of returning to the heap.
+//
+// Class sizes are not fixed. The pool keeps a histogram of requested sizes
+// (four buckets per power of two) and every ADAPT_INTERVAL acquisitions
+// re-derives the classes from its quantiles, so they sit just above the sizes
+// the workload actually asks for (a 5 KB token buffer gets a 5.x KB block,
+// not 8 KB). A request more than twice as small as the class that would hold
+// it gets an exact, uncached block instead. Every block remembers its
+// capacity; blocks of a retired class are freed when released.
+class SlabPool
+{
+public:
+    explicit SlabPool(size_t maxCachedBytes);
+    ~SlabPool();
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    // Returns at least size bytes, aligned for any type; capacity receives
+    // the usable size of the block
+    void* Acquire(size_t size, size_t& capacity);
+    void* Acquire(size_t size);
+    void Release(void* block);
+
+    void SetMaxCachedBytes(size_t maxCachedBytes);
+    SlabPoolStats GetStats() const;
+
+    // Buffers shared by the transports
+    static SlabPool& Buffers();
+
+    static constexpr size_t CLASS_COUNT = SLAB_CLASS_COUNT;
+    static constexpr size_t ADAPT_INTERVAL = 4096;
+
+private:
+    struct SizeClass
+    {
+        size_t size = 0;
+        std::vector<void*> free;
+    };
+
+    static size_t BucketIndex(size_t size);
+    static size_t BucketLimit(size_t index);
+    static void* AllocateBlock(size_t capacity);
+    static size_t BlockCapacity(void* block);
+    static void FreeBlock(void* block);
+
+    void AdaptLocked(std::vector<void*>& retired);
+
+    static constexpr size_t BUCKET_COUNT = 96;    // sizes up to 2^27
+
+    mutable std::mutex m_mutex;
+    SizeClass m_classes[CLASS_COUNT];
+    size_t m_classCount;
+    uint32_t m_histogram[BUCKET_COUNT];
+    size_t m_sinceAdapt;
+    size_t m_cachedBytes;
+    size_t m_maxCachedBytes;
+    SlabPoolStats m_stats;
+};
+
+// Standard allocator over a SlabPool, for node-based containers whose nodes
+// should be recycled rather than freed
+template <typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(SlabPool& pool) : m_pool(&pool) {}
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) : m_pool(other.Pool()) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(m_pool->Acquire(sizeof(T) * count)); }
+    void deallocate(T* pointer, size_t) { m_pool->Release(pointer); }
+
+    SlabPool* Pool() const { return m_pool; }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const { return m_pool == other.Pool(); }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const { return m_pool != other.Pool(); }
+
+private:
+    SlabPool* m_pool;
+};
\ No newline at end of file
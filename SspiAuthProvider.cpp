@@ -0,0 +1,316 @@
+#include "SspiAuthProvider.h"
+#include "Base64.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "RequestArena.h"
+#include "Trace.h"
+#include <algorithm>
+#include <sddl.h>
+
+#pragma comment(lib, "secur32.lib")
+
+namespace
+{
+    // Every bad or replayed token fails here
+    LogLimiter g_acceptFailureLog;
+
+    std::string WideToUtf8(const wchar_t* text)
+    {
+        int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+        if (length <= 1)
+        {
+            return std::string();
+        }
+        std::string result(static_cast<size_t>(length - 1), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, text, -1, &result[0], length, nullptr, nullptr);
+        return result;
+    }
+
+    std::wstring Utf8ToWide(const std::string& text)
+    {
+        int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0);
+        std::wstring result(static_cast<size_t>(length), L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &result[0], length);
+        return result;
+    }
+
+    void AppendSid(PSID sid, std::vector<std::string>& sids)
+    {
+        LPWSTR text = nullptr;
+        if (ConvertSidToStringSidW(sid, &text))
+        {
+            sids.push_back(WideToUtf8(text));
+            LocalFree(text);
+        }
+    }
+
+    // The user's SID and those of the groups in its token that grant access
+    void AppendTokenSids(HANDLE token, std::vector<std::string>& sids)
+    {
+        DWORD size = 0;
+        GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+        std::vector<unsigned char> user(size);
+        if (size > 0 && GetTokenInformation(token, TokenUser, user.data(), size, &size))
+        {
+            AppendSid(reinterpret_cast<TOKEN_USER*>(user.data())->User.Sid, sids);
+        }
+
+        size = 0;
+        GetTokenInformation(token, TokenGroups, nullptr, 0, &size);
+        std::vector<unsigned char> buffer(size);
+        if (size == 0 || !GetTokenInformation(token, TokenGroups, buffer.data(), size, &size))
+        {
+            return;
+        }
+        const TOKEN_GROUPS* groups = reinterpret_cast<const TOKEN_GROUPS*>(buffer.data());
+        for (DWORD i = 0; i < groups->GroupCount; i++)
+        {
+            DWORD attributes = groups->Groups[i].Attributes;
+            if ((attributes & SE_GROUP_ENABLED) != 0 && (attributes & SE_GROUP_USE_FOR_DENY_ONLY) == 0)
+            {
+                AppendSid(groups->Groups[i].Sid, sids);
+            }
+        }
+    }
+
+    class SspiCredential : public AcceptorCredential
+    {
+    public:
+        explicit SspiCredential(PSecurityFunctionTable sspi)
+            : sspi(sspi)
+        {
+            ZeroMemory(&handle, sizeof(handle));
+        }
+
+        ~SspiCredential() override
+        {
+            if (sspi)
+            {
+                sspi->FreeCredentialsHandle(&handle);
+            }
+        }
+
+        PSecurityFunctionTable sspi;
+        CredHandle handle;
+    };
+}
+
+SspiAuthProvider::SspiAuthProvider(bool querySids)
+    : m_pSSPI(nullptr)
+    , m_querySids(querySids)
+{
+}
+
+SspiAuthProvider::~SspiAuthProvider()
+{
+    Cleanup();
+}
+
+bool SspiAuthProvider::Initialize()
+{
+    // Initialize the security function table
+    m_pSSPI = InitSecurityInterface();
+    if (!m_pSSPI)
+    {
+        Log::Write(LogLevel::Error) << L"Failed to initialize security interface";
+        return false;
+    }
+
+    Log::Write(LogLevel::Info) << L"Kerberos authentication initialized successfully";
+    return true;
+}
+
+std::shared_ptr<AcceptorCredential> SspiAuthProvider::AcquireCredential(const AcceptorIdentity& identity)
+{
+    std::wstring principal = Utf8ToWide(identity.principal);
+    auto credential = std::make_shared<SspiCredential>(m_pSSPI);
+
+    // Acquire credentials handle for the server
+    TimeStamp tsExpiry;
+    SECURITY_STATUS ss = m_pSSPI->AcquireCredentialsHandle(
+        principal.empty() ? nullptr : &principal[0],    // Principal (default: the service account)
+        const_cast<SEC_WCHAR*>(NEGOSSP_NAME),  // Package name (Negotiate)
+        SECPKG_CRED_INBOUND,        // Credentials use
+        nullptr,                    // Logon ID
+        nullptr,                    // Auth data
+        nullptr,                    // Get key function
+        nullptr,                    // Get key argument
+        &credential->handle,        // Credentials handle
+        &tsExpiry                   // Expiry time
+    );
+
+    if (ss != SEC_E_OK)
+    {
+        Log::Write(LogLevel::Error) << L"AcquireCredentialsHandle failed with error: 0x" << std::hex << ss;
+        credential->sspi = nullptr;
+        return nullptr;
+    }
+
+    // Inbound credentials usually never expire (a FILETIME near the largest
+    // one); a real expiry is tracked for a refresh before it passes
+    FILETIME ftNow;
+    GetSystemTimeAsFileTime(&ftNow);
+    ULARGE_INTEGER now;
+    now.LowPart = ftNow.dwLowDateTime;
+    now.HighPart = ftNow.dwHighDateTime;
+    ULONGLONG expires = static_cast<ULONGLONG>(tsExpiry.QuadPart);
+    ULONGLONG remaining = expires > now.QuadPart ? (expires - now.QuadPart) / 10000000 : 0;
+    if (remaining < MAX_TRACKED_EXPIRY_SECONDS)
+    {
+        credential->expiry = Clock::now() + std::chrono::seconds(remaining);
+    }
+    return credential;
+}
+
+void SspiAuthProvider::Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length,
+    bool continuing, PendingContext& context, AuthResult& result, Clock::time_point& expiry)
+{
+    CredHandle hCreds = static_cast<const SspiCredential&>(credential).handle;
+
+    CtxtHandle hContext;
+    hContext.dwLower = context.lower;
+    hContext.dwUpper = context.upper;
+
+    // Setup input buffer
+    SecBuffer inSecBuffer;
+    inSecBuffer.BufferType = SECBUFFER_TOKEN;
+    inSecBuffer.cbBuffer = static_cast<ULONG>(length);
+    inSecBuffer.pvBuffer = const_cast<unsigned char*>(token);
+
+    SecBufferDesc inSecBufferDesc;
+    inSecBufferDesc.ulVersion = SECBUFFER_VERSION;
+    inSecBufferDesc.cBuffers = 1;
+    inSecBufferDesc.pBuffers = &inSecBuffer;
+
+    // Setup output buffer
+    BYTE* outTokenBuffer = RequestArena::ForThread().AllocateArray<BYTE>(MAX_TOKEN_SIZE);
+
+    SecBuffer outSecBuffer;
+    outSecBuffer.BufferType = SECBUFFER_TOKEN;
+    outSecBuffer.cbBuffer = MAX_TOKEN_SIZE;
+    outSecBuffer.pvBuffer = outTokenBuffer;
+
+    SecBufferDesc outSecBufferDesc;
+    outSecBufferDesc.ulVersion = SECBUFFER_VERSION;
+    outSecBufferDesc.cBuffers = 1;
+    outSecBufferDesc.pBuffers = &outSecBuffer;
+
+    DWORD dwContextAttributes;
+    TimeStamp tsExpiry;
+
+    // Accept the security context. A later leg continues the context this
+    // connection left in the table; it was taken out, so no lock is held here.
+    auto acceptStart = std::chrono::steady_clock::now();
+    SECURITY_STATUS ss = m_pSSPI->AcceptSecurityContext(
+        &hCreds,                    // Credentials handle
+        continuing ? &hContext : nullptr,  // Existing context
+        &inSecBufferDesc,           // Input buffer
+        ASC_REQ_CONNECTION,         // Context requirements
+        SECURITY_NATIVE_DREP,       // Target data representation
+        &hContext,                  // New context handle
+        &outSecBufferDesc,          // Output buffer
+        &dwContextAttributes,       // Context attributes
+        &tsExpiry                   // Context expiry
+    );
+    Metrics::Record(MetricStage::Accept, acceptStart, std::chrono::steady_clock::now());
+
+    if (ss == SEC_I_COMPLETE_NEEDED || ss == SEC_I_COMPLETE_AND_CONTINUE)
+    {
+        SECURITY_STATUS completed;
+        {
+            TraceCall call("CompleteAuthToken");
+            completed = m_pSSPI->CompleteAuthToken(&hContext, &outSecBufferDesc);
+        }
+        if (completed != SEC_E_OK)
+        {
+            Log::Write(LogLevel::Warning, g_acceptFailureLog) << L"CompleteAuthToken failed with error: 0x" << std::hex << completed;
+            m_pSSPI->DeleteSecurityContext(&hContext);
+            return;
+        }
+        ss = (ss == SEC_I_COMPLETE_NEEDED) ? SEC_E_OK : SEC_I_CONTINUE_NEEDED;
+    }
+
+    if ((ss == SEC_E_OK || ss == SEC_I_CONTINUE_NEEDED) && outSecBuffer.cbBuffer > 0)
+    {
+        result.outputToken = Base64::Encode(outTokenBuffer, outSecBuffer.cbBuffer);
+    }
+
+    if (ss == SEC_E_OK)
+    {
+        Log::Write(LogLevel::Debug) << L"Authentication successful";
+
+        // Get the authenticated user name
+        {
+            StageTimer timer(MetricStage::Principal);
+            TraceCall call("QueryContextAttributes");
+            SecPkgContext_Names names;
+            if (m_pSSPI->QueryContextAttributes(&hContext, SECPKG_ATTR_NAMES, &names) == SEC_E_OK)
+            {
+                Log::Write(LogLevel::Debug) << L"Authenticated user: " << names.sUserName;
+                result.principal = WideToUtf8(names.sUserName);
+                m_pSSPI->FreeContextBuffer(names.sUserName);
+            }
+        }
+
+        // Group membership for the authorization policy, from the client's token
+        result.sids.clear();
+        if (m_querySids)
+        {
+            StageTimer timer(MetricStage::Principal);
+            TraceCall call("QuerySecurityContextToken");
+            HANDLE token = nullptr;
+            if (m_pSSPI->QuerySecurityContextToken(&hContext, &token) == SEC_E_OK)
+            {
+                AppendTokenSids(token, result.sids);
+                CloseHandle(token);
+            }
+        }
+
+        // Cached results must not outlive the ticket
+        FILETIME ftNow;
+        GetSystemTimeAsFileTime(&ftNow);
+        ULARGE_INTEGER now;
+        now.LowPart = ftNow.dwLowDateTime;
+        now.HighPart = ftNow.dwHighDateTime;
+        if (static_cast<ULONGLONG>(tsExpiry.QuadPart) <= now.QuadPart)
+        {
+            expiry = Clock::now();
+        }
+        else
+        {
+            auto remaining = std::chrono::seconds((static_cast<ULONGLONG>(tsExpiry.QuadPart) - now.QuadPart) / 10000000);
+            expiry = (std::min)(expiry, Clock::now() + remaining);
+        }
+
+        m_pSSPI->DeleteSecurityContext(&hContext);
+        result.status = AuthStatus::Success;
+    }
+    else if (ss == SEC_I_CONTINUE_NEEDED)
+    {
+        // Hand the context back to be parked until the client's next token
+        context.lower = hContext.dwLower;
+        context.upper = hContext.dwUpper;
+        result.status = AuthStatus::ContinueNeeded;
+    }
+    else
+    {
+        Log::Write(LogLevel::Warning, g_acceptFailureLog) << L"AcceptSecurityContext failed with error: 0x" << std::hex << ss;
+        if (continuing)
+        {
+            m_pSSPI->DeleteSecurityContext(&hContext);
+        }
+    }
+}
+
+void SspiAuthProvider::ReleaseContext(const PendingContext& context)
+{
+    CtxtHandle hContext;
+    hContext.dwLower = context.lower;
+    hContext.dwUpper = context.upper;
+    m_pSSPI->DeleteSecurityContext(&hContext);
+}
+
+void SspiAuthProvider::Cleanup()
+{
+    // Credentials are freed by their last holder
+}
\ No newline at end of file
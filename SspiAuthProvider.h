@@ -0,0 +1,38 @@
+#pragma once
+
+#define SECURITY_WIN32
+#include <windows.h>
+#include <sspi.h>
+#include <security.h>
+#include "AuthProvider.h"
+
+// Negotiate through SSPI with the service account's own credentials
+class SspiAuthProvider : public AuthProvider
+{
+public:
+    // querySids also returns the SIDs of the client's token with the principal
+    explicit SspiAuthProvider(bool querySids);
+    ~SspiAuthProvider() override;
+
+    bool Initialize() override;
+
+    // Inbound credentials of the service account. Every SPN registered on
+    // the account is covered by one; a named identity is passed to
+    // AcquireCredentialsHandle as the principal, and a keytab is ignored.
+    std::shared_ptr<AcceptorCredential> AcquireCredential(const AcceptorIdentity& identity) override;
+    void Accept(const AcceptorCredential& credential, const unsigned char* token, size_t length, bool continuing,
+        PendingContext& context, AuthResult& result, Clock::time_point& expiry) override;
+    void ReleaseContext(const PendingContext& context) override;
+    void Cleanup() override;
+    const wchar_t* Name() const override { return L"sspi"; }
+
+private:
+    // Largest output token the package writes, allocated per leg from the request arena
+    static constexpr DWORD MAX_TOKEN_SIZE = 12288;
+
+    // Credential expiries further out than this are taken as never
+    static constexpr ULONGLONG MAX_TRACKED_EXPIRY_SECONDS = 365ull * 24 * 3600;
+
+    PSecurityFunctionTable m_pSSPI;
+    bool m_querySids;
+};
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "StagePool.h"
+
+StagePool::StagePool(size_t threadCount, size_t capacity)
+    : m_threadCount(threadCount ? threadCount : 1)
+    , m_queue(capacity)
+    , m_open(false)
+    , m_running(false)
+    , m_posting(0)
+    , m_sleepers(0)
+    , m_peakDepth(0)
+    , m_processed(0)
+    , m_rejected(0)
+{
+}
+
+StagePool::~StagePool()
+{
+    Stop();
+}
+
+bool StagePool::Start(Handler handler)
+{
+    if (m_running)
+    {
+        return false;
+    }
+
+    m_handler = std::move(handler);
+    m_running = true;
+    m_open = true;
+
+    m_threads.reserve(m_threadCount);
+    for (size_t i = 0; i < m_threadCount; i++)
+    {
+        m_threads.emplace_back(&StagePool::WorkerThread, this);
+    }
+    return true;
+}
+
+void StagePool::Stop()
+{
+    if (!m_open.exchange(false))
+    {
+        return;
+    }
+
+    // Once no Post is between its check and its push, the queue only shrinks
+    while (m_posting.load() != 0)
+    {
+        std::this_thread::yield();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_sleepCondition.notify_all();
+
+    for (std::thread& thread : m_threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
+
+bool StagePool::Post(DeferredRequest* deferred)
+{
+    m_posting.fetch_add(1);
+    if (!m_open.load() || !m_queue.TryPush(deferred))
+    {
+        m_posting.fetch_sub(1);
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_posting.fetch_sub(1);
+
+    size_t depth = m_queue.Size();
+    size_t peak = m_peakDepth.load(std::memory_order_relaxed);
+    while (depth > peak && !m_peakDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed))
+    {
+    }
+
+    // Pairs with the sleeper count going up before a worker re-checks the
+    // queue: either it sees this push or this sees it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleepers.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_sleepCondition.notify_one();
+    }
+    return true;
+}
+
+StageStats StagePool::GetStats() const
+{
+    StageStats stats;
+    stats.depth = m_queue.Size();
+    stats.peakDepth = m_peakDepth.load(std::memory_order_relaxed);
+    stats.capacity = m_queue.Capacity();
+    stats.processed = m_processed.load(std::memory_order_relaxed);
+    stats.rejected = m_rejected.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void StagePool::WorkerThread()
+{
+    DeferredRequest* deferred = nullptr;
+    for (;;)
+    {
+        // A short spin catches back-to-back requests without a sleep and wake
+        bool found = false;
+        for (int i = 0; i < SPIN_ATTEMPTS && !found; i++)
+        {
+            found = m_queue.TryPop(deferred);
+        }
+        if (found)
+        {
+            m_handler(deferred);
+            m_processed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_sleepCondition.wait(lock, [this] { return m_queue.Size() > 0 || !m_running; });
+        m_sleepers.fetch_sub(1);
+
+        // Stopping drains whatever is still queued first
+        if (!m_running && m_queue.Size() == 0)
+        {
+            return;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "StageQueue.h"
+#include "Transport.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct StageStats
+{
+    size_t depth = 0;           // requests waiting right now
+    size_t peakDepth = 0;
+    size_t capacity = 0;
+    uint64_t processed = 0;
+    uint64_t rejected = 0;      // Post calls that found the queue full or closed
+};
+
+// One stage of the request pipeline: a bounded StageQueue and the threads
+// that drain it. Posting never blocks; a full queue is the caller's signal to
+// shed the request. Idle workers sleep on a condition variable, which the
+// posting side only touches when some worker is actually asleep.
+class StagePool
+{
+public:
+    using Handler = std::function<void(DeferredRequest* deferred)>;
+
+    StagePool(size_t threadCount, size_t capacity);
+    ~StagePool();
+
+    bool Start(Handler handler);
+
+    // Stops taking new requests, lets the workers finish the queued ones and
+    // joins them
+    void Stop();
+
+    // False when the queue is full or the stage is stopping
+    bool Post(DeferredRequest* deferred);
+
+    size_t ThreadCount() const { return m_threadCount; }
+    StageStats GetStats() const;
+
+private:
+    void WorkerThread();
+
+    size_t m_threadCount;
+    StageQueue<DeferredRequest*> m_queue;
+    std::vector<std::thread> m_threads;
+    Handler m_handler;
+    std::atomic<bool> m_open;
+    std::atomic<bool> m_running;
+    std::atomic<size_t> m_posting;      // Post calls between their open check and their push
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<size_t> m_sleepers;
+
+    std::atomic<size_t> m_peakDepth;
+    std::atomic<uint64_t> m_processed;
+    std::atomic<uint64_t> m_rejected;
+
+    static constexpr int SPIN_ATTEMPTS = 64;
+};
\ No newline at end of file
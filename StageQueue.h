@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded multi-producer, multi-consumer ring of trivially copyable values
+// (Vyukov's sequence-numbered cells). Producers and consumers each claim a
+// slot with one compare-and-swap on their own index and publish it through
+// the slot's sequence number, so neither side takes a lock and a full or
+// empty queue is reported rather than waited on.
+template <typename T>
+class StageQueue
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit StageQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+
+        m_cells.reset(new Cell[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue.store(0, std::memory_order_relaxed);
+    }
+
+    StageQueue(const StageQueue&) = delete;
+    StageQueue& operator=(const StageQueue&) = delete;
+
+    // False when the queue is full
+    bool TryPush(T value)
+    {
+        size_t position = m_enqueue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // False when the queue is empty
+    bool TryPop(T& value)
+    {
+        size_t position = m_dequeue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference == 0)
+            {
+                if (m_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Claimed slots, so it can run ahead of what TryPop will find by the
+    // pushes still being written
+    size_t Size() const
+    {
+        size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+        size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    size_t Capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+
+    // Producers and consumers each get their own cache line
+    alignas(64) std::atomic<size_t> m_enqueue;
+    alignas(64) std::atomic<size_t> m_dequeue;
+};
\ No newline at end of file
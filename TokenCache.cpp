@@ -0,0 +1,164 @@
+#include "TokenCache.h"
+#include <algorithm>
+#include <cstring>
+
+size_t TokenCache::DigestHash::operator()(const Sha256::Digest& digest) const
+{
+    // The digest is already uniformly distributed
+    size_t hash;
+    memcpy(&hash, digest.data() + 8, sizeof(hash));
+    return hash;
+}
+
+TokenCache::TokenCache(size_t maxEntries, std::chrono::seconds replayWindow)
+    : m_shards(new Shard[SHARD_COUNT])
+    , m_shardLimit(std::max<size_t>(1, maxEntries / SHARD_COUNT))
+    , m_replayWindow(replayWindow)
+    , m_hits(0)
+    , m_misses(0)
+    , m_coalesced(0)
+    , m_evictions(0)
+{
+}
+
+AuthResult TokenCache::Verify(std::string_view token, const VerifyFunction& verify)
+{
+    Clock::time_point expiry = Clock::now() + m_replayWindow;
+    if (!Enabled())
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return verify(expiry);
+    }
+
+    Sha256::Digest key = Sha256::Hash(token.data(), token.size());
+    Shard& shard = m_shards[key[0] & (SHARD_COUNT - 1)];
+    std::shared_ptr<Flight> flight;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end())
+        {
+            if (Clock::now() < it->second.expiry)
+            {
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.result;
+            }
+            shard.expiries.erase(it->second.byExpiry);
+            shard.entries.erase(it);
+        }
+
+        auto inFlight = shard.flights.find(key);
+        if (inFlight != shard.flights.end())
+        {
+            flight = inFlight->second;
+        }
+        else
+        {
+            flight = std::make_shared<Flight>();
+            shard.flights.emplace(key, flight);
+            leader = true;
+        }
+    }
+
+    if (!leader)
+    {
+        m_coalesced.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(flight->mutex);
+            flight->done.wait(lock, [&flight] { return flight->finished; });
+            if (flight->result.status != AuthStatus::ContinueNeeded)
+            {
+                return flight->result;
+            }
+        }
+
+        // A handshake that needs another leg is bound to the leader's
+        // connection, so this one has to start its own
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        expiry = Clock::now() + m_replayWindow;
+        return verify(expiry);
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    AuthResult result;
+    try
+    {
+        result = verify(expiry);
+    }
+    catch (...)
+    {
+        // The waiters fail with the leader instead of waiting forever
+        Land(shard, key, *flight, AuthResult(), expiry);
+        throw;
+    }
+    Land(shard, key, *flight, result, expiry);
+    return result;
+}
+
+void TokenCache::Land(Shard& shard, const Sha256::Digest& key, Flight& flight, const AuthResult& result, Clock::time_point expiry)
+{
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.flights.erase(key);
+        if (result.status == AuthStatus::Success && expiry > Clock::now())
+        {
+            InsertLocked(shard, key, result, expiry);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(flight.mutex);
+        flight.result = result;
+        flight.finished = true;
+    }
+    flight.done.notify_all();
+}
+
+void TokenCache::InsertLocked(Shard& shard, const Sha256::Digest& key, const AuthResult& result, Clock::time_point expiry)
+{
+    auto existing = shard.entries.find(key);
+    if (existing != shard.entries.end())
+    {
+        shard.expiries.erase(existing->second.byExpiry);
+        shard.entries.erase(existing);
+    }
+
+    // Expired entries first, then, still full, the one closest to expiring
+    Clock::time_point now = Clock::now();
+    while (!shard.expiries.empty() &&
+           (shard.expiries.begin()->first <= now || shard.entries.size() >= m_shardLimit))
+    {
+        shard.entries.erase(shard.expiries.begin()->second);
+        shard.expiries.erase(shard.expiries.begin());
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ExpiryIndex::iterator byExpiry = shard.expiries.emplace(expiry, key);
+    shard.entries.emplace(key, Entry{ result, expiry, byExpiry });
+}
+
+TokenCacheStats TokenCache::GetStats() const
+{
+    TokenCacheStats stats;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+    stats.evictions = m_evictions.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        stats.entries += m_shards[i].entries.size();
+    }
+    return stats;
+}
+
+void TokenCache::Clear()
+{
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        m_shards[i].entries.clear();
+        m_shards[i].expiries.clear();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "AuthResult.h"
+#include "Sha256.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+struct TokenCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;        // verified by the security package
+    uint64_t coalesced = 0;     // waited for an identical token already being verified
+    uint64_t evictions = 0;
+    size_t entries = 0;
+};
+
+// Cache of successfully verified first-leg tokens, keyed by the SHA-256 of
+// the token as received. A hit skips base64 decoding and the security package
+// entirely and returns the principal (and mutual-auth token) of the original
+// verification.
+//
+// The replay window is the security/performance trade-off: a token verified
+// once is accepted again for that long (never past the ticket's own expiry),
+// which is exactly what the security package's replay detection would refuse.
+// A window of zero, the default, disables the cache so every presentation
+// is verified; deployments opt in with -tokenwindow.
+//
+// Each shard also keeps its entries ordered by expiry, so making room in a
+// full shard drops the expired ones from the front and, failing that, the one
+// closest to expiring, in logarithmic time rather than a scan under the lock.
+//
+// Identical tokens arriving while one is being verified wait for that
+// verification instead of starting their own (single-flight). Should the
+// verification throw, they get a failure and the leader's caller the exception.
+class TokenCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Verifies the token; may lower expiry (initially now + replay window)
+    using VerifyFunction = std::function<AuthResult(Clock::time_point& expiry)>;
+
+    TokenCache(size_t maxEntries, std::chrono::seconds replayWindow);
+
+    bool Enabled() const { return m_replayWindow.count() > 0; }
+
+    AuthResult Verify(std::string_view token, const VerifyFunction& verify);
+
+    TokenCacheStats GetStats() const;
+    void Clear();
+
+    static constexpr size_t SHARD_COUNT = 64;
+
+private:
+    struct DigestHash
+    {
+        size_t operator()(const Sha256::Digest& digest) const;
+    };
+
+    using ExpiryIndex = std::multimap<Clock::time_point, Sha256::Digest>;
+
+    struct Entry
+    {
+        AuthResult result;
+        Clock::time_point expiry;
+        ExpiryIndex::iterator byExpiry;
+    };
+
+    struct Flight
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+        AuthResult result;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<Sha256::Digest, Entry, DigestHash> entries;
+        ExpiryIndex expiries;       // one per entry, soonest first
+        std::unordered_map<Sha256::Digest, std::shared_ptr<Flight>, DigestHash> flights;
+    };
+
+    // Ends the leader's flight: caches a success and hands result to the waiters
+    void Land(Shard& shard, const Sha256::Digest& key, Flight& flight, const AuthResult& result, Clock::time_point expiry);
+    void InsertLocked(Shard& shard, const Sha256::Digest& key, const AuthResult& result, Clock::time_point expiry);
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_shardLimit;
+    std::chrono::seconds m_replayWindow;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_coalesced;
+    std::atomic<uint64_t> m_evictions;
+};
\ No newline at end of file
@@ -0,0 +1,533 @@
+#include "TokenScreen.h"
+#include "KerberosCrypto.h"
+#include <cstring>
+
+namespace
+{
+    // DER contents (without tag and length) of the mechanism OIDs
+    const uint8_t SPNEGO_OID[] = { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x02 };
+    const uint8_t KRB5_OID[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+    const uint8_t MS_KRB5_OID[] = { 0x2a, 0x86, 0x48, 0x82, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+    const uint8_t NTLM_OID[] = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x02, 0x02, 0x0a };
+
+    const uint8_t NTLM_SIGNATURE[] = { 'N', 'T', 'L', 'M', 'S', 'S', 'P', 0 };
+    const uint8_t TOK_ID_AP_REQ[] = { 0x01, 0x00 };
+
+    constexpr int32_t RC4_HMAC = 23;
+
+    TokenMechanism MechanismOf(const DerReader& oid)
+    {
+        if (oid.Equals(KRB5_OID, sizeof(KRB5_OID)) || oid.Equals(MS_KRB5_OID, sizeof(MS_KRB5_OID)))
+        {
+            return TokenMechanism::Kerberos;
+        }
+        if (oid.Equals(NTLM_OID, sizeof(NTLM_OID)))
+        {
+            return TokenMechanism::Ntlm;
+        }
+        return TokenMechanism::Other;
+    }
+
+    // NEGOTIATE (1) and AUTHENTICATE (3) are the only messages a client sends
+    bool IsNtlmMessage(const DerReader& token, bool& valid)
+    {
+        if (token.Size() < sizeof(NTLM_SIGNATURE) || memcmp(token.Data(), NTLM_SIGNATURE, sizeof(NTLM_SIGNATURE)) != 0)
+        {
+            return false;
+        }
+        const uint8_t* type = token.Data() + sizeof(NTLM_SIGNATURE);
+        valid = token.Size() >= sizeof(NTLM_SIGNATURE) + 4 && (type[0] == 1 || type[0] == 3) &&
+            type[1] == 0 && type[2] == 0 && type[3] == 0;
+        return true;
+    }
+
+    bool ParseEncryptedData(DerReader& parent, int number, int64_t& etype, int64_t& kvno, DerReader& cipher)
+    {
+        DerReader field;
+        DerReader sequence;
+        if (!parent.Read(DerReader::Context(number), field) || !field.Read(DerReader::SEQUENCE, sequence) ||
+            !sequence.ReadTaggedInteger(0, etype))
+        {
+            return false;
+        }
+        if (sequence.PeekTag() == DerReader::Context(1) && !sequence.ReadTaggedInteger(1, kvno))
+        {
+            return false;
+        }
+        return sequence.ReadTagged(2, DerReader::OCTET_STRING, cipher) && sequence.Empty();
+    }
+
+    std::string_view View(const DerReader& value)
+    {
+        return std::string_view(reinterpret_cast<const char*>(value.Data()), value.Size());
+    }
+
+    // AP-REQ ::= [APPLICATION 14] SEQUENCE { pvno [0], msg-type [1], ap-options [2],
+    //     ticket [3] Ticket, authenticator [4] EncryptedData }
+    bool ParseApReq(DerReader apReq, TokenFacts& facts)
+    {
+        DerReader body;
+        DerReader sequence;
+        DerReader options;
+        int64_t pvno = 0;
+        int64_t messageType = 0;
+        if (!apReq.Read(DerReader::Application(14), body) || !apReq.Empty() || !body.Read(DerReader::SEQUENCE, sequence) ||
+            !body.Empty() || !sequence.ReadTaggedInteger(0, pvno) || pvno != 5 ||
+            !sequence.ReadTaggedInteger(1, messageType) || messageType != 14 ||
+            !sequence.ReadTagged(2, DerReader::BIT_STRING, options))
+        {
+            return false;
+        }
+
+        // Ticket ::= [APPLICATION 1] SEQUENCE { tkt-vno [0], realm [1], sname [2], enc-part [3] }
+        DerReader ticketField;
+        DerReader ticket;
+        DerReader ticketSequence;
+        DerReader realm;
+        int64_t ticketVersion = 0;
+        if (!sequence.Read(DerReader::Context(3), ticketField) || !ticketField.Read(DerReader::Application(1), ticket) ||
+            !ticketField.Empty() || !ticket.Read(DerReader::SEQUENCE, ticketSequence) || !ticket.Empty() ||
+            !ticketSequence.ReadTaggedInteger(0, ticketVersion) || ticketVersion != 5 ||
+            !ticketSequence.ReadTagged(1, DerReader::GENERAL_STRING, realm) || realm.Empty())
+        {
+            return false;
+        }
+
+        // PrincipalName ::= SEQUENCE { name-type [0], name-string [1] SEQUENCE OF KerberosString }
+        DerReader nameField;
+        DerReader name;
+        DerReader names;
+        int64_t nameType = 0;
+        if (!ticketSequence.Read(DerReader::Context(2), nameField) || !nameField.Read(DerReader::SEQUENCE, name) ||
+            !name.ReadTaggedInteger(0, nameType) || !name.ReadTagged(1, DerReader::SEQUENCE, names) || names.Empty())
+        {
+            return false;
+        }
+        while (!names.Empty())
+        {
+            DerReader component;
+            if (facts.serviceComponents == TokenFacts::MAX_SERVICE_COMPONENTS ||
+                !names.Read(DerReader::GENERAL_STRING, component))
+            {
+                return false;
+            }
+            facts.service[facts.serviceComponents++] = View(component);
+        }
+
+        int64_t etype = 0;
+        DerReader cipher;
+        if (!ParseEncryptedData(ticketSequence, 3, etype, facts.kvno, cipher) || etype < INT32_MIN || etype > INT32_MAX)
+        {
+            return false;
+        }
+
+        // The authenticator is only checked for shape
+        int64_t authenticatorEtype = 0;
+        int64_t authenticatorKvno = -1;
+        DerReader authenticator;
+        if (!ParseEncryptedData(sequence, 4, authenticatorEtype, authenticatorKvno, authenticator) || !sequence.Empty())
+        {
+            return false;
+        }
+
+        facts.hasApReq = true;
+        facts.realm = View(realm);
+        facts.etype = static_cast<int32_t>(etype);
+        facts.ticketSize = cipher.Size();
+        facts.ticketCipher = View(cipher);
+        return true;
+    }
+
+    // GSS framing: [APPLICATION 0] { mech OID, mech-specific bytes }; body is
+    // left on the bytes after the OID
+    bool ParseGssToken(DerReader token, DerReader& oid, DerReader& body)
+    {
+        DerReader framed;
+        if (!token.Read(DerReader::Application(0), framed) || !token.Empty() || !framed.Read(DerReader::OID, oid))
+        {
+            return false;
+        }
+        body = framed;
+        return true;
+    }
+
+    bool ParseKerberosBody(const DerReader& body, TokenFacts& facts)
+    {
+        facts.mechanism = TokenMechanism::Kerberos;
+        if (body.Size() < 2)
+        {
+            return false;
+        }
+        if (memcmp(body.Data(), TOK_ID_AP_REQ, 2) != 0)
+        {
+            // KRB-ERROR, IAKERB and friends are the provider's business
+            return true;
+        }
+        return ParseApReq(DerReader(body.Data() + 2, body.Size() - 2), facts);
+    }
+
+    // A mechanism token inside SPNEGO: NTLMSSP, GSS-framed Kerberos, or
+    // something opaque (NegoEx) left to the provider
+    bool ParseMechToken(const DerReader& token, TokenFacts& facts)
+    {
+        bool valid = false;
+        if (IsNtlmMessage(token, valid))
+        {
+            facts.mechanism = TokenMechanism::Ntlm;
+            return valid;
+        }
+        if (token.PeekTag() != DerReader::Application(0))
+        {
+            return true;
+        }
+        DerReader oid;
+        DerReader body;
+        if (!ParseGssToken(token, oid, body))
+        {
+            return false;
+        }
+        facts.mechanism = MechanismOf(oid);
+        return facts.mechanism != TokenMechanism::Kerberos || ParseKerberosBody(body, facts);
+    }
+
+    // NegTokenInit ::= SEQUENCE { mechTypes [0] SEQUENCE OF OID, reqFlags [1],
+    //     mechToken [2] OCTET STRING, mechListMIC [3] OCTET STRING }
+    bool ParseNegTokenInit(DerReader choice, TokenFacts& facts)
+    {
+        DerReader init;
+        DerReader mechTypes;
+        if (!choice.Read(DerReader::SEQUENCE, init) || !choice.Empty() ||
+            !init.ReadTagged(0, DerReader::SEQUENCE, mechTypes) || !mechTypes.Read(DerReader::OID, facts.mechOid))
+        {
+            return false;
+        }
+        while (!mechTypes.Empty())
+        {
+            DerReader oid;
+            if (!mechTypes.Read(DerReader::OID, oid))
+            {
+                return false;
+            }
+        }
+        facts.mechanism = MechanismOf(facts.mechOid);
+
+        DerReader field;
+        bool present = false;
+        if (!init.ReadOptional(DerReader::Context(1), field, present))
+        {
+            return false;
+        }
+        DerReader mechToken;
+        if (!init.ReadOptional(DerReader::Context(2), field, present) ||
+            (present && (!field.Read(DerReader::OCTET_STRING, mechToken) || !field.Empty())))
+        {
+            return false;
+        }
+        DerReader mic;
+        bool hasMic = false;
+        if (!init.ReadOptional(DerReader::Context(3), mic, hasMic) || !init.Empty())
+        {
+            return false;
+        }
+        return !present || ParseMechToken(mechToken, facts);
+    }
+
+    // NegTokenResp ::= SEQUENCE { negState [0] ENUMERATED, supportedMech [1] OID,
+    //     responseToken [2] OCTET STRING, mechListMIC [3] OCTET STRING }, all optional
+    bool ParseNegTokenResp(DerReader choice, TokenFacts& facts)
+    {
+        DerReader response;
+        if (!choice.Read(DerReader::SEQUENCE, response) || !choice.Empty())
+        {
+            return false;
+        }
+        DerReader field;
+        DerReader negState;
+        bool present = false;
+        if (!response.ReadOptional(DerReader::Context(0), field, present) ||
+            (present && !field.Read(DerReader::ENUMERATED, negState)))
+        {
+            return false;
+        }
+        if (!response.ReadOptional(DerReader::Context(1), field, present) ||
+            (present && !field.Read(DerReader::OID, facts.mechOid)))
+        {
+            return false;
+        }
+        if (present)
+        {
+            facts.mechanism = MechanismOf(facts.mechOid);
+        }
+        DerReader responseToken;
+        if (!response.ReadOptional(DerReader::Context(2), field, present) ||
+            (present && (!field.Read(DerReader::OCTET_STRING, responseToken) || !field.Empty())))
+        {
+            return false;
+        }
+        DerReader mic;
+        bool hasMic = false;
+        if (!response.ReadOptional(DerReader::Context(3), mic, hasMic) || !response.Empty())
+        {
+            return false;
+        }
+        return !present || ParseMechToken(responseToken, facts);
+    }
+
+    // ASCII case-insensitive; realms and host names are compared this way in practice
+    bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            // Letters differing only in case differ only in bit 5
+            uint8_t difference = static_cast<uint8_t>(a[i] ^ b[i]);
+            if (difference != 0 &&
+                (difference != 0x20 || static_cast<uint8_t>((a[i] | 0x20) - 'a') > static_cast<uint8_t>('z' - 'a')))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+}
+
+TokenScreen::TokenScreen()
+    : m_kerberos(0)
+    , m_ntlm(0)
+    , m_other(0)
+    , m_aes256(0)
+    , m_aes128(0)
+    , m_rc4(0)
+    , m_otherEtype(0)
+    , m_ticketBytes(0)
+    , m_malformed(0)
+    , m_wrongRealm(0)
+    , m_wrongService(0)
+{
+}
+
+bool ServicePrincipal::Parse(std::string_view name, ServicePrincipal& principal)
+{
+    principal = ServicePrincipal();
+    size_t at = name.rfind('@');
+    if (at != std::string_view::npos)
+    {
+        principal.realm = std::string(name.substr(at + 1));
+        name = name.substr(0, at);
+        if (principal.realm.empty())
+        {
+            return false;
+        }
+    }
+    while (true)
+    {
+        size_t slash = name.find('/');
+        std::string_view component = name.substr(0, slash);
+        if (component.empty())
+        {
+            return false;
+        }
+        principal.components.emplace_back(component);
+        if (slash == std::string_view::npos)
+        {
+            break;
+        }
+        name = name.substr(slash + 1);
+    }
+    return principal.components.size() <= TokenFacts::MAX_SERVICE_COMPONENTS;
+}
+
+bool ServicePrincipal::MatchesRealm(const TokenFacts& facts) const
+{
+    return realm.empty() || EqualsIgnoreCase(realm, facts.realm);
+}
+
+bool ServicePrincipal::Matches(const TokenFacts& facts) const
+{
+    if (!facts.hasApReq || !MatchesRealm(facts) || components.size() != facts.serviceComponents)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < facts.serviceComponents; i++)
+    {
+        if (!EqualsIgnoreCase(components[i], facts.service[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TokenScreen::Configure(const std::string& servicePrincipals)
+{
+    m_services.clear();
+    std::string_view list = servicePrincipals;
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view name = Trim(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        ServicePrincipal service;
+        if (!ServicePrincipal::Parse(name, service))
+        {
+            return false;
+        }
+        m_services.push_back(std::move(service));
+    }
+    return true;
+}
+
+bool TokenScreen::Parse(const uint8_t* token, size_t length, TokenFacts& facts)
+{
+    facts = TokenFacts();
+    DerReader outer(token, length);
+
+    // Bare NTLM, as sent with "Authorization: NTLM" or by older clients
+    bool valid = false;
+    if (IsNtlmMessage(outer, valid))
+    {
+        facts.mechanism = TokenMechanism::Ntlm;
+        return valid;
+    }
+
+    // Continuation legs of a SPNEGO exchange
+    if (outer.PeekTag() == DerReader::Context(1))
+    {
+        DerReader choice;
+        facts.spnego = true;
+        return outer.Read(DerReader::Context(1), choice) && outer.Empty() && ParseNegTokenResp(choice, facts);
+    }
+
+    DerReader body;
+    if (!ParseGssToken(outer, facts.mechOid, body))
+    {
+        return false;
+    }
+    if (facts.mechOid.Equals(SPNEGO_OID, sizeof(SPNEGO_OID)))
+    {
+        DerReader choice;
+        facts.spnego = true;
+        return body.Read(DerReader::Context(0), choice) && body.Empty() && ParseNegTokenInit(choice, facts);
+    }
+    facts.mechanism = MechanismOf(facts.mechOid);
+    return facts.mechanism != TokenMechanism::Kerberos || ParseKerberosBody(body, facts);
+}
+
+TokenScreen::Verdict TokenScreen::Classify(const TokenFacts& facts) const
+{
+    if (facts.mechanism == TokenMechanism::Ntlm)
+    {
+        return Verdict::SlowLane;
+    }
+    if (!facts.hasApReq || m_services.empty())
+    {
+        return Verdict::Pass;
+    }
+
+    bool knownRealm = false;
+    for (const ServicePrincipal& service : m_services)
+    {
+        if (!service.MatchesRealm(facts))
+        {
+            continue;
+        }
+        knownRealm = true;
+        if (service.Matches(facts))
+        {
+            return Verdict::Pass;
+        }
+    }
+    return knownRealm ? Verdict::WrongService : Verdict::WrongRealm;
+}
+
+void TokenScreen::Count(const TokenFacts& facts, Verdict verdict)
+{
+    switch (verdict)
+    {
+    case Verdict::Malformed:
+        m_malformed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    case Verdict::WrongRealm:
+        m_wrongRealm.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case Verdict::WrongService:
+        m_wrongService.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+
+    switch (facts.mechanism)
+    {
+    case TokenMechanism::Kerberos:
+        m_kerberos.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case TokenMechanism::Ntlm:
+        m_ntlm.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        m_other.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+
+    if (facts.hasApReq)
+    {
+        switch (facts.etype)
+        {
+        case KerberosCrypto::AES256_CTS_HMAC_SHA1_96:
+            m_aes256.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case KerberosCrypto::AES128_CTS_HMAC_SHA1_96:
+            m_aes128.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case RC4_HMAC:
+            m_rc4.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            m_otherEtype.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        m_ticketBytes.fetch_add(facts.ticketSize, std::memory_order_relaxed);
+    }
+}
+
+TokenScreen::Verdict TokenScreen::Screen(const uint8_t* token, size_t length, TokenFacts& facts)
+{
+    Verdict verdict = Parse(token, length, facts) ? Classify(facts) : Verdict::Malformed;
+    Count(facts, verdict);
+    return verdict;
+}
+
+TokenScreenStats TokenScreen::GetStats() const
+{
+    TokenScreenStats stats;
+    stats.kerberos = m_kerberos.load(std::memory_order_relaxed);
+    stats.ntlm = m_ntlm.load(std::memory_order_relaxed);
+    stats.other = m_other.load(std::memory_order_relaxed);
+    stats.aes256 = m_aes256.load(std::memory_order_relaxed);
+    stats.aes128 = m_aes128.load(std::memory_order_relaxed);
+    stats.rc4 = m_rc4.load(std::memory_order_relaxed);
+    stats.otherEtype = m_otherEtype.load(std::memory_order_relaxed);
+    stats.ticketBytes = m_ticketBytes.load(std::memory_order_relaxed);
+    stats.malformed = m_malformed.load(std::memory_order_relaxed);
+    stats.wrongRealm = m_wrongRealm.load(std::memory_order_relaxed);
+    stats.wrongService = m_wrongService.load(std::memory_order_relaxed);
+    return stats;
+}
\ No newline at end of file
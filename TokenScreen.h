@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Der.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class TokenMechanism
+{
+    Kerberos,
+    Ntlm,
+    Other       // NegoEx, IAKERB or anything else the provider may know
+};
+
+// What a Negotiate token says about itself. Every view points into the
+// token, so filling this copies and allocates nothing.
+struct TokenFacts
+{
+    static constexpr size_t MAX_SERVICE_COMPONENTS = 4;
+
+    TokenMechanism mechanism = TokenMechanism::Other;
+    bool spnego = false;
+    DerReader mechOid;          // first mechanism listed (or the raw token's); empty for bare NTLM
+    bool hasApReq = false;      // the fields below are only set for a Kerberos AP-REQ
+    std::string_view realm;     // ticket realm, which is the service's realm
+    std::string_view service[MAX_SERVICE_COMPONENTS];
+    size_t serviceComponents = 0;
+    int32_t etype = 0;          // ticket enc-part etype
+    int64_t kvno = -1;          // -1 when the ticket does not carry one
+    size_t ticketSize = 0;      // ticket enc-part ciphertext bytes
+    std::string_view ticketCipher;
+};
+
+// A "service/host[@REALM]" name, matched against the service a ticket is for
+struct ServicePrincipal
+{
+    std::vector<std::string> components;
+    std::string realm;      // empty = any realm
+
+    // False if the name is empty, has an empty component or too many of them
+    static bool Parse(std::string_view name, ServicePrincipal& principal);
+
+    // Case-insensitive, as the KDC compares them
+    bool MatchesRealm(const TokenFacts& facts) const;
+    bool Matches(const TokenFacts& facts) const;
+};
+
+struct TokenScreenStats
+{
+    uint64_t kerberos = 0;
+    uint64_t ntlm = 0;
+    uint64_t other = 0;
+    uint64_t aes256 = 0;        // AP-REQ ticket etypes
+    uint64_t aes128 = 0;
+    uint64_t rc4 = 0;
+    uint64_t otherEtype = 0;
+    uint64_t ticketBytes = 0;   // summed over AP-REQs
+    uint64_t malformed = 0;
+    uint64_t wrongRealm = 0;
+    uint64_t wrongService = 0;
+};
+
+// Structural pre-screen run on every decoded token before any crypto or
+// provider call. It walks the GSS framing, SPNEGO NegTokenInit/NegTokenResp,
+// raw NTLMSSP messages and the Kerberos AP-REQ's outer fields with DerReader,
+// which is bounds-checked and zero-copy, so it costs a few hundred
+// nanoseconds at worst.
+//
+// Tokens that cannot be parsed, and AP-REQs for a realm or service principal
+// outside the configured list, are turned away there; NTLM is sent to the
+// slow lane because only the provider (and often a domain controller round
+// trip) can answer it. Everything else passes unchanged, since the provider
+// stays the judge of what it understands.
+class TokenScreen
+{
+public:
+    enum class Verdict
+    {
+        Pass,
+        SlowLane,       // NTLM
+        Malformed,
+        WrongRealm,
+        WrongService
+    };
+
+    TokenScreen();
+
+    // Comma-separated "service/host[@REALM]" names AP-REQs must be for; a
+    // name without a realm matches any. Empty allows every principal.
+    // False if a name is empty or has an empty component.
+    bool Configure(const std::string& servicePrincipals);
+    size_t ServiceCount() const { return m_services.size(); }
+
+    // Fills facts; false if the token is malformed
+    static bool Parse(const uint8_t* token, size_t length, TokenFacts& facts);
+
+    // Parses, classifies and counts one token
+    Verdict Screen(const uint8_t* token, size_t length, TokenFacts& facts);
+
+    TokenScreenStats GetStats() const;
+
+private:
+    Verdict Classify(const TokenFacts& facts) const;
+    void Count(const TokenFacts& facts, Verdict verdict);
+
+    std::vector<ServicePrincipal> m_services;
+
+    std::atomic<uint64_t> m_kerberos;
+    std::atomic<uint64_t> m_ntlm;
+    std::atomic<uint64_t> m_other;
+    std::atomic<uint64_t> m_aes256;
+    std::atomic<uint64_t> m_aes128;
+    std::atomic<uint64_t> m_rc4;
+    std::atomic<uint64_t> m_otherEtype;
+    std::atomic<uint64_t> m_ticketBytes;
+    std::atomic<uint64_t> m_malformed;
+    std::atomic<uint64_t> m_wrongRealm;
+    std::atomic<uint64_t> m_wrongService;
+};
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "Trace.h"
+#include "ServerConfig.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    // One per thread that has recorded a span; never freed, so the spans of
+    // a thread that has exited can still be exported
+    struct ThreadBuffer
+    {
+        std::atomic<uint64_t> head{ 0 };        // spans ever written; only the owner stores it
+        std::atomic<uint64_t> picked{ 0 };      // requests this thread picked for tracing
+        uint64_t received = 0;                  // requests this thread has seen, for sampling
+        uint32_t threadId = 0;
+        size_t capacity = 0;
+        std::unique_ptr<TraceSpan[]> spans;
+    };
+
+    // Low bits of a request id are its sequence on the receiving thread
+    constexpr unsigned SEQUENCE_BITS = 40;
+
+    std::mutex g_registryMutex;
+    std::vector<ThreadBuffer*> g_buffers;
+    thread_local ThreadBuffer* t_buffer = nullptr;
+
+    ThreadBuffer& Buffer(size_t capacity)
+    {
+        if (t_buffer)
+        {
+            return *t_buffer;
+        }
+
+        ThreadBuffer* buffer = new ThreadBuffer();
+        buffer->capacity = capacity;
+        buffer->spans.reset(new TraceSpan[capacity]);
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        buffer->threadId = static_cast<uint32_t>(g_buffers.size() + 1);
+        g_buffers.push_back(buffer);
+        t_buffer = buffer;
+        return *buffer;
+    }
+
+    int64_t Nanoseconds(Trace::Clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    // Copies a ring's spans, leaving out any its owner overwrote meanwhile
+    void CopySpans(const ThreadBuffer& buffer, std::vector<TraceSpan>& spans)
+    {
+        uint64_t head = buffer.head.load(std::memory_order_acquire);
+        uint64_t first = head > buffer.capacity ? head - buffer.capacity : 0;
+        size_t base = spans.size();
+        for (uint64_t i = first; i < head; i++)
+        {
+            spans.push_back(buffer.spans[i % buffer.capacity]);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = buffer.head.load(std::memory_order_relaxed);
+        uint64_t intact = after > buffer.capacity ? after - buffer.capacity : 0;
+        if (intact > first)
+        {
+            size_t lost = static_cast<size_t>((std::min)(intact, head) - first);
+            spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(base), spans.begin() + static_cast<std::ptrdiff_t>(base + lost));
+        }
+    }
+
+    bool IsRequestSpan(const TraceSpan& span)
+    {
+        return strcmp(span.name, "request") == 0;
+    }
+}
+
+std::atomic<uint32_t> Trace::s_sampleEvery{ 0 };
+std::atomic<int64_t> Trace::s_thresholdNanoseconds{ 0 };
+std::atomic<size_t> Trace::s_spansPerThread{ Trace::DEFAULT_SPANS_PER_THREAD };
+
+void Trace::Configure(const ServerConfig& config)
+{
+    s_spansPerThread = config.traceSpansPerThread ? config.traceSpansPerThread : DEFAULT_SPANS_PER_THREAD;
+    s_thresholdNanoseconds = static_cast<int64_t>(config.traceThresholdUs) * 1000;
+
+    // A threshold alone traces everything and keeps only the slow requests
+    uint32_t every = config.traceSampleEvery;
+    if (every == 0 && config.traceThresholdUs > 0)
+    {
+        every = 1;
+    }
+    s_sampleEvery = every;
+}
+
+uint64_t Trace::BeginRequest()
+{
+    uint32_t every = s_sampleEvery.load(std::memory_order_relaxed);
+    if (every == 0)
+    {
+        return 0;
+    }
+
+    ThreadBuffer& buffer = Buffer(s_spansPerThread.load(std::memory_order_relaxed));
+    if (buffer.received++ % every != 0)
+    {
+        return 0;
+    }
+    uint64_t sequence = buffer.picked.load(std::memory_order_relaxed) + 1;
+    buffer.picked.store(sequence, std::memory_order_relaxed);
+    return (static_cast<uint64_t>(buffer.threadId) << SEQUENCE_BITS) | (sequence & ((uint64_t(1) << SEQUENCE_BITS) - 1));
+}
+
+void Trace::Record(uint64_t request, const char* name, Clock::time_point start, Clock::time_point end, int status)
+{
+    ThreadBuffer& buffer = Buffer(s_spansPerThread.load(std::memory_order_relaxed));
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    TraceSpan& span = buffer.spans[head % buffer.capacity];
+    span.request = request;
+    span.name = name;
+    span.start = Nanoseconds(start.time_since_epoch());
+    span.duration = Nanoseconds(end - start);
+    span.threadId = buffer.threadId;
+    span.status = status;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::WriteChromeTrace(std::string& out)
+{
+    std::vector<TraceSpan> spans;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        for (const ThreadBuffer* buffer : g_buffers)
+        {
+            CopySpans(*buffer, spans);
+        }
+    }
+
+    // Keep whole requests that were slow; one still in flight has no request
+    // span yet and is left out
+    int64_t threshold = s_thresholdNanoseconds.load(std::memory_order_relaxed);
+    if (threshold > 0)
+    {
+        std::unordered_set<uint64_t> slow;
+        for (const TraceSpan& span : spans)
+        {
+            if (IsRequestSpan(span) && span.duration >= threshold)
+            {
+                slow.insert(span.request);
+            }
+        }
+        spans.erase(std::remove_if(spans.begin(), spans.end(),
+            [&slow](const TraceSpan& span) { return slow.count(span.request) == 0; }), spans.end());
+    }
+    std::sort(spans.begin(), spans.end(), [](const TraceSpan& a, const TraceSpan& b) { return a.start < b.start; });
+
+    // Complete ("X") events in microseconds from the first span; each
+    // request's spans share a flow id, so viewers link them across threads
+    int64_t origin = spans.empty() ? 0 : spans.front().start;
+    out.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"KerberosEchoService\"}}");
+    for (const TraceSpan& span : spans)
+    {
+        bool request = IsRequestSpan(span);
+        char line[384];
+        int length = snprintf(line, sizeof(line),
+            ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"bind_id\":\"0x%llx\",\"flow_in\":true,\"flow_out\":true,\"args\":{\"request\":\"0x%llx\"",
+            span.name, request ? "request" : "stage", span.threadId, static_cast<double>(span.start - origin) / 1000.0,
+            static_cast<double>(span.duration) / 1000.0, static_cast<unsigned long long>(span.request),
+            static_cast<unsigned long long>(span.request));
+        if (length <= 0 || static_cast<size_t>(length) >= sizeof(line))
+        {
+            continue;
+        }
+        out.append(line, static_cast<size_t>(length));
+        if (request)
+        {
+            length = snprintf(line, sizeof(line), ",\"status\":%d", span.status);
+            out.append(line, static_cast<size_t>(length));
+        }
+        out.append("}}");
+    }
+    out.append("\n]}\n");
+}
+
+bool Trace::WriteChromeTrace(const std::wstring& path)
+{
+    std::string text;
+    WriteChromeTrace(text);
+
+#ifdef _WIN32
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, path.c_str(), L"wb") != 0)
+    {
+        return false;
+    }
+#else
+    std::string narrow(path.begin(), path.end());
+    FILE* file = fopen(narrow.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+#endif
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && written;
+}
+
+TraceStats Trace::GetStats()
+{
+    TraceStats stats;
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (const ThreadBuffer* buffer : g_buffers)
+    {
+        stats.requests += buffer->picked.load(std::memory_order_relaxed);
+        stats.spans += buffer->head.load(std::memory_order_relaxed);
+    }
+    stats.threads = g_buffers.size();
+    return stats;
+}
\ No newline at end of file
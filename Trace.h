@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ServerConfig;
+
+// One timed interval of a traced request, as kept in a thread's buffer
+struct TraceSpan
+{
+    uint64_t request;
+    const char* name;           // a string literal
+    int64_t start;              // steady clock, nanoseconds
+    int64_t duration;
+    uint32_t threadId;
+    int32_t status;             // HTTP status on the request span, 0 on the others
+};
+
+struct TraceStats
+{
+    uint64_t requests = 0;      // requests picked for tracing
+    uint64_t spans = 0;         // spans recorded, including ones since overwritten
+    size_t threads = 0;         // threads with a span buffer
+};
+
+// Optional per-request tracing for latency investigations. A request picked
+// when it is received (one in -tracesample, or every one with a threshold)
+// gets a nonzero id, which travels with it in HttpRequest::traceId and, while
+// a thread works for it, in a TraceScope. Every stage it passes through on
+// any thread records a span into that thread's ring of -tracespans entries,
+// oldest overwritten first, so memory stays fixed however long tracing runs.
+//
+// WriteChromeTrace exports what the rings hold as Chrome trace event JSON
+// (chrome://tracing or Perfetto), with each request's spans linked by a flow;
+// with -tracethreshold only requests that took at least that long are kept.
+// Off, a traced call site costs a thread-local load and a branch.
+class Trace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static void Configure(const ServerConfig& config);
+    static bool Enabled() { return s_sampleEvery.load(std::memory_order_relaxed) != 0; }
+
+    // Id for a request just received, or 0 when it is not traced
+    static uint64_t BeginRequest();
+
+    // The request this thread is working for, or 0
+    static uint64_t Current() { return t_current; }
+
+    static void Span(uint64_t request, const char* name, Clock::time_point start, Clock::time_point end)
+    {
+        if (request)
+        {
+            Record(request, name, start, end, 0);
+        }
+    }
+
+    static void Span(const char* name, Clock::time_point start, Clock::time_point end)
+    {
+        Span(t_current, name, start, end);
+    }
+
+    // The request's own span: from its first byte to the response being
+    // handed to the transport. The threshold is applied to this one.
+    static void EndRequest(uint64_t request, Clock::time_point received, int status)
+    {
+        if (request)
+        {
+            Record(request, "request", received, Clock::now(), status);
+        }
+    }
+
+    static void WriteChromeTrace(std::string& out);
+    static bool WriteChromeTrace(const std::wstring& path);
+
+    static TraceStats GetStats();
+
+    static constexpr size_t DEFAULT_SPANS_PER_THREAD = 16384;
+
+private:
+    friend class TraceScope;
+
+    static void Record(uint64_t request, const char* name, Clock::time_point start, Clock::time_point end, int status);
+
+    static std::atomic<uint32_t> s_sampleEvery;     // 0 = off
+    static std::atomic<int64_t> s_thresholdNanoseconds;
+    static std::atomic<size_t> s_spansPerThread;
+
+    static inline thread_local uint64_t t_current = 0;
+};
+
+// Marks the thread as working for a request until it goes out of scope
+class TraceScope
+{
+public:
+    explicit TraceScope(uint64_t request) : m_previous(Trace::t_current) { Trace::t_current = request; }
+    ~TraceScope() { Trace::t_current = m_previous; }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    uint64_t m_previous;
+};
+
+// Span around one call into the security package, named after the call; the
+// clock is only read for a traced request
+class TraceCall
+{
+public:
+    explicit TraceCall(const char* name) : m_name(name), m_request(Trace::Current())
+    {
+        if (m_request)
+        {
+            m_start = Trace::Clock::now();
+        }
+    }
+
+    ~TraceCall()
+    {
+        if (m_request)
+        {
+            Trace::Span(m_request, m_name, m_start, Trace::Clock::now());
+        }
+    }
+
+    TraceCall(const TraceCall&) = delete;
+    TraceCall& operator=(const TraceCall&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_request;
+    Trace::Clock::time_point m_start;
+};
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "TrafficTrace.h"
+#include "Base64.h"
+#include "Log.h"
+#include "MockAuthProvider.h"
+#include "SecureRandom.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr size_t RECORD_ALIGNMENT = 8;
+    constexpr std::string_view NEGOTIATE_PREFIX = "Negotiate ";
+
+    // Left out of every record: the replay frames requests itself
+    bool IsFramingHeader(std::string_view name)
+    {
+        return EqualsIgnoreCase(name, "Content-Length") || EqualsIgnoreCase(name, "Transfer-Encoding") ||
+            EqualsIgnoreCase(name, "Connection");
+    }
+
+    void AppendHeader(std::string& out, std::string_view name, std::string_view value)
+    {
+        out.append(name.data(), name.size());
+        out.append(": ", 2);
+        out.append(value.data(), value.size());
+        out.append("\r\n", 2);
+    }
+}
+
+TrafficCapture::TrafficCapture()
+    : m_file(nullptr)
+    , m_tokens(TrafficTokens::Replace)
+    , m_active(false)
+    , m_running(false)
+    , m_records(0)
+    , m_dropped(0)
+    , m_bytes(0)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    Stop();
+}
+
+bool TrafficCapture::ParseTokens(const std::wstring& name, TrafficTokens& tokens)
+{
+    if (name == L"keep")
+    {
+        tokens = TrafficTokens::Keep;
+    }
+    else if (name == L"redact")
+    {
+        tokens = TrafficTokens::Redact;
+    }
+    else if (name == L"replace")
+    {
+        tokens = TrafficTokens::Replace;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool TrafficCapture::Start(const std::wstring& path, const std::wstring& tokens)
+{
+    if (m_file)
+    {
+        return false;
+    }
+    if (!ParseTokens(tokens, m_tokens))
+    {
+        Log::Write(LogLevel::Error) << L"Unknown capture token mode: " << tokens;
+        return false;
+    }
+
+    uint8_t key[Sha256::DIGEST_SIZE];
+    if (!GenerateRandom(key, sizeof(key)))
+    {
+        return false;
+    }
+    m_tokenKey = std::make_unique<HmacSha256>(key, sizeof(key));
+
+#ifdef _WIN32
+    if (_wfopen_s(&m_file, path.c_str(), L"wb") != 0)
+    {
+        m_file = nullptr;
+    }
+#else
+    std::string narrow(path.begin(), path.end());
+    m_file = fopen(narrow.c_str(), "wb");
+#endif
+    if (!m_file)
+    {
+        Log::Write(LogLevel::Error) << L"Cannot create capture file " << path;
+        return false;
+    }
+
+    TrafficTraceHeader header = {};
+    memcpy(header.magic, TRAFFIC_TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRAFFIC_TRACE_VERSION;
+    header.tokens = static_cast<uint32_t>(m_tokens);
+    header.startUnixMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    m_start = std::chrono::steady_clock::now();
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1)
+    {
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_bytes = sizeof(header);
+
+    m_running = true;
+    m_thread = std::thread(&TrafficCapture::WriterThread, this);
+    m_active = true;
+    return true;
+}
+
+void TrafficCapture::Stop()
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    m_active = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void TrafficCapture::Record(const HttpRequest& request)
+{
+    // Formatted into a per-thread buffer, so only the copy into the queue is locked
+    thread_local std::string record;
+    record.assign(sizeof(TrafficRecord), '\0');
+    record.append(request.methodName.data(), request.methodName.size());
+    record.append(request.path.data(), request.path.size());
+    if (!request.query.empty())
+    {
+        record.push_back('?');
+        record.append(request.query.data(), request.query.size());
+    }
+    size_t headersStart = record.size();
+
+    uint16_t headerCount = 0;
+    for (size_t i = 0; i < request.headerCount && headerCount < UINT16_MAX; i++)
+    {
+        const HttpHeader& header = request.headers[i];
+        if (IsFramingHeader(header.name))
+        {
+            continue;
+        }
+
+        // Session cookies name the principal and are signed with this
+        // server's keys, so only a capture that keeps tokens keeps them
+        if (m_tokens != TrafficTokens::Keep && EqualsIgnoreCase(header.name, "Cookie"))
+        {
+            continue;
+        }
+        if (m_tokens != TrafficTokens::Keep && EqualsIgnoreCase(header.name, "Authorization"))
+        {
+            if (m_tokens == TrafficTokens::Redact)
+            {
+                continue;
+            }
+            size_t mark = record.size();
+            record.append("Authorization: ");
+            if (!AppendReplacement(header.value, record))
+            {
+                record.resize(mark);
+                continue;
+            }
+            record.append("\r\n", 2);
+            headerCount++;
+            continue;
+        }
+        AppendHeader(record, header.name, header.value);
+        headerCount++;
+    }
+
+    size_t headersLength = record.size() - headersStart;
+    record.resize((record.size() + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT, '\0');
+    if (record.size() > UINT32_MAX || request.path.size() + request.query.size() + 1 > UINT32_MAX ||
+        request.methodName.size() > UINT16_MAX)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Transports that do not stamp arrival get the time of the handoff
+    std::chrono::steady_clock::time_point received = request.received;
+    if (received == std::chrono::steady_clock::time_point())
+    {
+        received = std::chrono::steady_clock::now();
+    }
+
+    TrafficRecord fields = {};
+    fields.size = static_cast<uint32_t>(record.size());
+    fields.methodLength = static_cast<uint16_t>(request.methodName.size());
+    fields.headerCount = headerCount;
+    fields.targetLength = static_cast<uint32_t>(headersStart - sizeof(TrafficRecord) - request.methodName.size());
+    fields.headersLength = static_cast<uint32_t>(headersLength);
+    fields.offsetNs = received > m_start ? static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(received - m_start).count()) : 0;
+    fields.connection = request.connectionId;
+    fields.bodySize = request.contentLength;
+    memcpy(&record[0], &fields, sizeof(fields));
+
+    bool flush = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.size() + record.size() > MAX_PENDING_BYTES)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_pending.append(record);
+        flush = m_pending.size() >= FLUSH_BYTES;
+    }
+    m_records.fetch_add(1, std::memory_order_relaxed);
+    if (flush)
+    {
+        m_condition.notify_one();
+    }
+}
+
+bool TrafficCapture::AppendReplacement(std::string_view value, std::string& out) const
+{
+    if (value.substr(0, NEGOTIATE_PREFIX.size()) != NEGOTIATE_PREFIX)
+    {
+        return false;
+    }
+
+    // Keyed so equal tokens get equal stand-ins without the stand-in
+    // revealing the token; the decoded size is kept
+    std::string_view token = value.substr(NEGOTIATE_PREFIX.size());
+    Sha256::Digest digest = m_tokenKey->Compute(token.data(), token.size());
+    char principal[64];
+    snprintf(principal, sizeof(principal), "user-%02x%02x%02x%02x@%s", digest[0], digest[1], digest[2], digest[3],
+        MockAuthProvider::REALM);
+    uint64_t nonce = 0;
+    memcpy(&nonce, digest.data() + 8, sizeof(nonce));
+
+    std::string mock = MockAuthProvider::BuildToken(principal, nonce, Base64::DecodedMaxLength(token.size()));
+    if (mock.empty())
+    {
+        return false;
+    }
+    out.append(NEGOTIATE_PREFIX.data(), NEGOTIATE_PREFIX.size());
+    out.append(Base64::Encode(mock.data(), mock.size()));
+    return true;
+}
+
+void TrafficCapture::WriterThread()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_condition.wait_for(lock, std::chrono::milliseconds(100),
+            [this] { return !m_running || m_pending.size() >= FLUSH_BYTES; });
+        bool running = m_running;
+        batch.swap(m_pending);
+        lock.unlock();
+
+        if (!batch.empty())
+        {
+            if (fwrite(batch.data(), 1, batch.size(), m_file) == batch.size())
+            {
+                m_bytes.fetch_add(batch.size(), std::memory_order_relaxed);
+            }
+            batch.clear();
+        }
+        if (!running)
+        {
+            fflush(m_file);
+            return;
+        }
+        lock.lock();
+    }
+}
+
+TrafficCaptureStats TrafficCapture::GetStats() const
+{
+    TrafficCaptureStats stats;
+    stats.records = m_records.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    stats.bytes = m_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+TrafficTrace::TrafficTrace()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_header(nullptr)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+#endif
+{
+}
+
+TrafficTrace::~TrafficTrace()
+{
+    Close();
+}
+
+bool TrafficTrace::Open(const std::string& path)
+{
+    Close();
+
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size = {};
+    if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(TrafficTraceHeader)))
+    {
+        Close();
+        return false;
+    }
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        Close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status = {};
+    void* view = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(TrafficTraceHeader))
+    {
+        view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = static_cast<size_t>(status.st_size);
+#endif
+
+    m_header = reinterpret_cast<const TrafficTraceHeader*>(m_data);
+    if (memcmp(m_header->magic, TRAFFIC_TRACE_MAGIC, sizeof(m_header->magic)) != 0 ||
+        m_header->version != TRAFFIC_TRACE_VERSION || m_header->tokens > static_cast<uint32_t>(TrafficTokens::Replace))
+    {
+        Close();
+        return false;
+    }
+
+    // Stops at the first record that does not fit, as a capture cut short ends
+    for (size_t offset = sizeof(TrafficTraceHeader); m_size - offset >= sizeof(TrafficRecord);)
+    {
+        const TrafficRecord* record = reinterpret_cast<const TrafficRecord*>(m_data + offset);
+        size_t contents = static_cast<size_t>(record->methodLength) + record->targetLength + record->headersLength;
+        if (record->size < sizeof(TrafficRecord) || record->size % RECORD_ALIGNMENT != 0 || record->size > m_size - offset ||
+            contents > record->size - sizeof(TrafficRecord))
+        {
+            break;
+        }
+        m_records.push_back(record);
+        offset += record->size;
+    }
+
+    // Threads hand requests over slightly out of arrival order
+    std::stable_sort(m_records.begin(), m_records.end(),
+        [](const TrafficRecord* a, const TrafficRecord* b) { return a->offsetNs < b->offsetNs; });
+    return true;
+}
+
+void TrafficTrace::Close()
+{
+    m_records.clear();
+    m_header = nullptr;
+#ifdef _WIN32
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_data)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+TrafficEntry TrafficTrace::Entry(size_t index) const
+{
+    const TrafficRecord* record = m_records[index];
+    const char* text = reinterpret_cast<const char*>(record + 1);
+
+    TrafficEntry entry;
+    entry.offsetNs = record->offsetNs;
+    entry.connection = record->connection;
+    entry.bodySize = record->bodySize;
+    entry.method = std::string_view(text, record->methodLength);
+    entry.target = std::string_view(text + record->methodLength, record->targetLength);
+    entry.headers = std::string_view(text + record->methodLength + record->targetLength, record->headersLength);
+    return entry;
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "HttpMessage.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class HmacSha256;
+
+// What a capture keeps of each Negotiate token
+enum class TrafficTokens : uint32_t
+{
+    Keep,       // the token itself; the capture is as sensitive as the traffic
+    Redact,     // nothing: the request is replayed without Authorization
+    Replace     // a MockAuthProvider token, the same for every copy of one token
+};
+
+// Layout of a traffic trace: this header, then one record per request in the
+// order they were handed to the server, each padded to 8 bytes so the file
+// can be mapped and walked in place
+struct TrafficTraceHeader
+{
+    char magic[8];              // TRAFFIC_TRACE_MAGIC
+    uint32_t version;
+    uint32_t tokens;            // TrafficTokens
+    int64_t startUnixMs;        // wall clock at offset 0
+};
+
+// Followed by the method, the target (path and query) and the header lines
+// ("Name: value\r\n"). Framing headers are left out: the replay sends
+// Content-Length for bodySize bytes of its own.
+struct TrafficRecord
+{
+    uint32_t size;              // whole record including padding
+    uint16_t methodLength;
+    uint16_t headerCount;
+    uint32_t targetLength;
+    uint32_t headersLength;
+    uint64_t offsetNs;          // arrival since the capture started
+    uint64_t connection;        // the transport's connection id
+    uint64_t bodySize;
+};
+
+constexpr char TRAFFIC_TRACE_MAGIC[8] = { 'K', 'E', 'T', 'R', 'A', 'F', 'F', 'C' };
+constexpr uint32_t TRAFFIC_TRACE_VERSION = 1;
+
+struct TrafficCaptureStats
+{
+    uint64_t records = 0;
+    uint64_t dropped = 0;       // requests lost because the writer fell behind
+    uint64_t bytes = 0;         // written to the file
+};
+
+// Records every request handed to the server into a traffic trace for
+// TrafficReplay. Record formats on the calling thread and queues; a
+// background thread writes the queue out, and requests arriving while it
+// holds more than MAX_PENDING_BYTES are dropped and counted.
+class TrafficCapture
+{
+public:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+    // tokens is "keep", "redact" or "replace"
+    bool Start(const std::wstring& path, const std::wstring& tokens);
+    void Stop();
+    bool Active() const { return m_active.load(std::memory_order_relaxed); }
+
+    void Record(const HttpRequest& request);
+
+    TrafficCaptureStats GetStats() const;
+
+    static bool ParseTokens(const std::wstring& name, TrafficTokens& tokens);
+
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+    static constexpr size_t MAX_PENDING_BYTES = 64 << 20;
+
+private:
+    // Appends "Negotiate <mock token>" standing in for value; false when value
+    // is not a Negotiate token
+    bool AppendReplacement(std::string_view value, std::string& out) const;
+    void WriterThread();
+
+    FILE* m_file;
+    TrafficTokens m_tokens;
+    std::unique_ptr<HmacSha256> m_tokenKey;     // random per capture, so stand-ins cannot be linked across captures
+    std::chrono::steady_clock::time_point m_start;
+    std::atomic<bool> m_active;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::string m_pending;
+    bool m_running;
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_records;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_bytes;
+};
+
+// One request of a mapped trace; the views point into the mapping
+struct TrafficEntry
+{
+    uint64_t offsetNs = 0;
+    uint64_t connection = 0;
+    uint64_t bodySize = 0;
+    std::string_view method;
+    std::string_view target;
+    std::string_view headers;
+};
+
+// Read side: maps a trace and indexes its records by arrival. A capture cut
+// short (the server killed) is read up to its last complete record.
+class TrafficTrace
+{
+public:
+    TrafficTrace();
+    ~TrafficTrace();
+
+    TrafficTrace(const TrafficTrace&) = delete;
+    TrafficTrace& operator=(const TrafficTrace&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    size_t Size() const { return m_records.size(); }
+    TrafficEntry Entry(size_t index) const;
+    TrafficTokens Tokens() const { return static_cast<TrafficTokens>(m_header->tokens); }
+    int64_t StartUnixMs() const { return m_header->startUnixMs; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    const TrafficTraceHeader* m_header;
+    std::vector<const TrafficRecord*> m_records;   // sorted by offsetNs
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+};
\ No newline at end of file
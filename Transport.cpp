@@ -0,0 +1,36 @@
+#include "Transport.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include "HttpSysTransport.h"
+#else
+#include "EpollTransport.h"
+#include "IoUringTransport.h"
+#endif
+
+std::unique_ptr<Transport> CreateTransport(const ServerConfig& config)
+{
+#ifdef _WIN32
+    if (config.transport.empty() || config.transport == L"httpsys")
+    {
+        return std::make_unique<HttpSysTransport>(config);
+    }
+#else
+    if (config.transport.empty() || config.transport == L"epoll")
+    {
+        return std::make_unique<EpollTransport>(config);
+    }
+    if (config.transport == L"io_uring")
+    {
+        if (IoUringTransport::IsSupported())
+        {
+            return std::make_unique<IoUringTransport>(config);
+        }
+        Log::Write(LogLevel::Warning) << L"io_uring is not available on this kernel; falling back to epoll";
+        return std::make_unique<EpollTransport>(config);
+    }
+#endif
+
+    Log::Write(LogLevel::Error) << L"Transport not available on this platform: " << config.transport;
+    return nullptr;
+}
\ No newline at end of file
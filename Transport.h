@@ -0,0 +1,80 @@
+#pragma once
+
+#include "HttpMessage.h"
+#include "ServerConfig.h"
+#include <cstdint>
+#include <memory>
+
+// A request the handler answers on its own threads. It carries a copy of the
+// request, so the transport's buffers are free again once SubmitRequest has
+// returned; string_views in response may point into that copy.
+struct DeferredRequest
+{
+    HttpRequest request;
+    HttpResponse response;
+    uint64_t tag = 0;       // the transport's routing data, as given to SubmitRequest
+};
+
+// Where deferred responses go. Complete is called on a handler thread; the
+// transport sends the response, or hands it to the thread that owns the
+// connection, and then gives the request back with RequestHandler::Release.
+class ResponseSink
+{
+public:
+    virtual ~ResponseSink() = default;
+    virtual void Complete(DeferredRequest* deferred) = 0;
+};
+
+enum class RequestDisposition
+{
+    Completed,      // response is filled in
+    Deferred        // the answer arrives later through the sink
+};
+
+// Implemented by the request-handling pipeline (HttpServer). Transports call
+// it on their own threads, possibly from several threads at once.
+class RequestHandler
+{
+public:
+    virtual ~RequestHandler() = default;
+    virtual void ProcessRequest(const HttpRequest& request, HttpResponse& response) = 0;
+
+    // Like ProcessRequest, but the handler may instead copy the request and
+    // finish it later through sink, passing tag back untouched. A transport
+    // that receives Deferred must keep later requests on the same connection
+    // waiting until the response arrives, so responses stay in order.
+    virtual RequestDisposition SubmitRequest(const HttpRequest& request, HttpResponse& response, ResponseSink* sink, uint64_t tag)
+    {
+        (void)sink;
+        (void)tag;
+        ProcessRequest(request, response);
+        return RequestDisposition::Completed;
+    }
+    virtual void Release(DeferredRequest* deferred) { (void)deferred; }
+};
+
+// Counters a transport keeps about its own I/O
+struct TransportStats
+{
+    uint64_t requests = 0;
+    uint64_t syscalls = 0;
+};
+
+// Receives HTTP requests from the network and sends back the responses the
+// handler produces. Implementations own their threads and buffers.
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual bool Initialize() = 0;
+    virtual bool Start(RequestHandler* handler) = 0;
+    virtual void Stop() = 0;
+    virtual void Pause() = 0;
+    virtual void Resume() = 0;
+    virtual const wchar_t* Name() const = 0;
+    virtual TransportStats GetStats() const { return TransportStats(); }
+};
+
+// Builds the transport named by config.transport, or the platform default
+std::unique_ptr<Transport> CreateTransport(const ServerConfig& config);
\ No newline at end of file
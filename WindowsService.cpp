@@ -1,12 +1,14 @@
 #include "WindowsService.h"
 #include "HttpServer.h"
+#include "Log.h"
 #include <iostream>
 
 WindowsService* WindowsService::s_instance = nullptr;
 
-WindowsService::WindowsService(const std::wstring& serviceName, const std::wstring& displayName)
+WindowsService::WindowsService(const std::wstring& serviceName, const std::wstring& displayName, const ServerConfig& config)
     : m_serviceName(serviceName)
     , m_displayName(displayName)
+    , m_config(config)
     , m_statusHandle(nullptr)
     , m_running(false)
 {
@@ -15,7 +17,7 @@ WindowsService::WindowsService(const std::wstring& serviceName, const std::wstri
     ZeroMemory(&m_status, sizeof(m_status));
     m_status.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
     m_status.dwCurrentState = SERVICE_START_PENDING;
-    m_status.dwControlsAccepted = SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_PAUSE_CONTINUE;
+    m_status.dwControlsAccepted = SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_PAUSE_CONTINUE | SERVICE_ACCEPT_PARAMCHANGE;
 }
 
 WindowsService::~WindowsService()
@@ -36,6 +38,12 @@ void WINAPI WindowsService::ServiceMain(DWORD argc, LPWSTR* argv)
         {
             s_instance->ReportServiceStatus(SERVICE_START_PENDING);
             
+            // No console to write to as a service
+            if (s_instance->m_config.logSink.empty())
+            {
+                s_instance->m_config.logSink = L"eventlog";
+            }
+
             if (s_instance->Initialize())
             {
                 s_instance->ReportServiceStatus(SERVICE_RUNNING);
@@ -67,6 +75,9 @@ void WINAPI WindowsService::ServiceCtrlHandler(DWORD ctrl)
             s_instance->ReportServiceStatus(SERVICE_CONTINUE_PENDING);
             s_instance->Continue();
             break;
+        case SERVICE_CONTROL_PARAMCHANGE:
+            s_instance->ReloadLimits();
+            break;
         default:
             break;
         }
@@ -75,16 +86,21 @@ void WINAPI WindowsService::ServiceCtrlHandler(DWORD ctrl)
 
 bool WindowsService::Initialize()
 {
+    Log::Start(m_config, m_serviceName);
     try
     {
-        m_httpServer = std::make_unique<HttpServer>(8080);
-        return m_httpServer->Initialize();
+        m_httpServer = std::make_unique<HttpServer>(m_config);
+        if (m_httpServer->Initialize())
+        {
+            return true;
+        }
     }
     catch (const std::exception& e)
     {
         LogEvent(L"Failed to initialize HTTP server", EVENTLOG_ERROR_TYPE);
-        return false;
     }
+    Log::Stop();
+    return false;
 }
 
 void WindowsService::Run()
@@ -103,6 +119,7 @@ void WindowsService::Run()
         
         m_httpServer->Stop();
     }
+    Log::Stop();
     
     ReportServiceStatus(SERVICE_STOPPED);
 }
@@ -130,6 +147,14 @@ void WindowsService::Continue()
     ReportServiceStatus(SERVICE_RUNNING);
 }
 
+void WindowsService::ReloadLimits()
+{
+    if (m_httpServer)
+    {
+        m_httpServer->ReloadLimits();
+    }
+}
+
 void WindowsService::ReportServiceStatus(DWORD currentState, DWORD exitCode, DWORD waitHint)
 {
     static DWORD checkPoint = 1;
@@ -141,7 +166,7 @@ void WindowsService::ReportServiceStatus(DWORD currentState, DWORD exitCode, DWO
     if (currentState == SERVICE_START_PENDING)
         m_status.dwControlsAccepted = 0;
     else
-        m_status.dwControlsAccepted = SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_PAUSE_CONTINUE;
+        m_status.dwControlsAccepted = SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_PAUSE_CONTINUE | SERVICE_ACCEPT_PARAMCHANGE;
 
     if ((currentState == SERVICE_RUNNING) || (currentState == SERVICE_STOPPED))
         m_status.dwCheckPoint = 0;
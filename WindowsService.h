@@ -4,13 +4,14 @@
 #include <winsvc.h>
 #include <string>
 #include <memory>
+#include "ServerConfig.h"
 
 class HttpServer;
 
 class WindowsService
 {
 public:
-    WindowsService(const std::wstring& serviceName, const std::wstring& displayName);
+    WindowsService(const std::wstring& serviceName, const std::wstring& displayName, const ServerConfig& config);
     ~WindowsService();
 
     // Service control functions
@@ -23,6 +24,7 @@ public:
     void Stop();
     void Pause();
     void Continue();
+    void ReloadLimits();
 
     // Installation/removal
     bool InstallService();
@@ -37,6 +39,7 @@ private:
 
     std::wstring m_serviceName;
     std::wstring m_displayName;
+    ServerConfig m_config;
     SERVICE_STATUS_HANDLE m_statusHandle;
     SERVICE_STATUS m_status;
     bool m_running;
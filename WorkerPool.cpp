@@ -0,0 +1,193 @@
+#include "WorkerPool.h"
+#include "Log.h"
+#include <chrono>
+
+WorkerPool::WorkerPool(size_t threadCount)
+    : m_threadCount(threadCount ? threadCount : DefaultThreadCount())
+    , m_running(false)
+    , m_inFlight(0)
+#ifdef _WIN32
+    , m_hPort(nullptr)
+#else
+    , m_queueOpen(false)
+#endif
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+
+#ifdef _WIN32
+    if (m_hPort)
+    {
+        CloseHandle(m_hPort);
+        m_hPort = nullptr;
+    }
+#endif
+}
+
+size_t WorkerPool::DefaultThreadCount()
+{
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores ? cores : 1;
+}
+
+bool WorkerPool::Initialize()
+{
+#ifdef _WIN32
+    // Allow every worker to run concurrently; the port wakes threads LIFO which
+    // keeps the hottest stacks and receive buffers in cache.
+    m_hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, static_cast<DWORD>(m_threadCount));
+    if (!m_hPort)
+    {
+        Log::Write(LogLevel::Error) << L"CreateIoCompletionPort failed with error: " << GetLastError();
+        return false;
+    }
+#else
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_queueOpen = true;
+#endif
+    return true;
+}
+
+#ifdef _WIN32
+bool WorkerPool::Associate(HANDLE handle)
+{
+    if (!CreateIoCompletionPort(handle, m_hPort, 0, 0))
+    {
+        Log::Write(LogLevel::Error) << L"Failed to associate handle with completion port, error: " << GetLastError();
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool WorkerPool::Start(CompletionHandler handler)
+{
+    if (m_running)
+    {
+        return false;
+    }
+
+    m_handler = std::move(handler);
+    m_running = true;
+
+    m_threads.reserve(m_threadCount);
+    for (size_t i = 0; i < m_threadCount; i++)
+    {
+        m_threads.emplace_back(&WorkerPool::WorkerThread, this, i);
+    }
+    return true;
+}
+
+void WorkerPool::Stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+
+    // One null completion per thread tells each worker to exit
+#ifdef _WIN32
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        PostQueuedCompletionStatus(m_hPort, 0, 0, nullptr);
+    }
+#else
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        for (size_t i = 0; i < m_threads.size(); i++)
+        {
+            m_queue.push_back(IoCompletion{ nullptr, 0, 0 });
+        }
+    }
+    m_queueCondition.notify_all();
+#endif
+
+    for (std::thread& thread : m_threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
+
+bool WorkerPool::Post(IoOperation* operation, uint32_t bytesTransferred, uint32_t status)
+{
+#ifdef _WIN32
+    // The completion key carries the status for posted (non-I/O) completions
+    return PostQueuedCompletionStatus(m_hPort, bytesTransferred, static_cast<ULONG_PTR>(status), &operation->overlapped) != FALSE;
+#else
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (!m_queueOpen)
+        {
+            return false;
+        }
+        m_queue.push_back(IoCompletion{ operation, bytesTransferred, status });
+    }
+    m_queueCondition.notify_one();
+    return true;
+#endif
+}
+
+void WorkerPool::BeginOperation()
+{
+    m_inFlight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WorkerPool::EndOperation()
+{
+    if (m_inFlight.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        m_drainCondition.notify_all();
+    }
+}
+
+bool WorkerPool::WaitForDrain(uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_drainMutex);
+    return m_drainCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+        [this] { return m_inFlight.load(std::memory_order_acquire) == 0; });
+}
+
+bool WorkerPool::Dequeue(IoCompletion& completion)
+{
+#ifdef _WIN32
+    DWORD bytesTransferred = 0;
+    ULONG_PTR key = 0;
+    LPOVERLAPPED pOverlapped = nullptr;
+
+    BOOL ok = GetQueuedCompletionStatus(m_hPort, &bytesTransferred, &key, &pOverlapped, INFINITE);
+    if (!pOverlapped)
+    {
+        // Either the shutdown sentinel or the port itself failed
+        return false;
+    }
+
+    completion.operation = CONTAINING_RECORD(pOverlapped, IoOperation, overlapped);
+    completion.bytesTransferred = bytesTransferred;
+    completion.status = ok ? static_cast<uint32_t>(key) : GetLastError();
+    return true;
+#else
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_queueCondition.wait(lock, [this] { return !m_queue.empty(); });
+
+    completion = m_queue.front();
+    m_queue.pop_front();
+    return completion.operation != nullptr;
+#endif
+}
+
+void WorkerPool::WorkerThread(size_t workerIndex)
+{
+    IoCompletion completion;
+    while (Dequeue(completion))
+    {
+        m_handler(workerIndex, completion);
+    }
+}
\ No newline at end of file
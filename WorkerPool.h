@@ -0,0 +1,92 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Base for every asynchronous operation completed through a WorkerPool.
+// On Windows the OVERLAPPED header lets the same object be handed straight
+// to overlapped APIs such as HttpReceiveHttpRequest.
+struct IoOperation
+{
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+#endif
+
+    IoOperation() { Reset(); }
+    void Reset()
+    {
+#ifdef _WIN32
+        ZeroMemory(&overlapped, sizeof(overlapped));
+#endif
+    }
+};
+
+struct IoCompletion
+{
+    IoOperation* operation;
+    uint32_t bytesTransferred;
+    uint32_t status;
+};
+
+// Fixed set of worker threads draining one completion queue. On Windows the
+// queue is an I/O completion port; elsewhere it is a condition-variable queue
+// with the same semantics so the pool can be exercised without HTTP.sys.
+class WorkerPool
+{
+public:
+    using CompletionHandler = std::function<void(size_t workerIndex, const IoCompletion& completion)>;
+
+    explicit WorkerPool(size_t threadCount = 0);
+    ~WorkerPool();
+
+    bool Initialize();
+#ifdef _WIN32
+    bool Associate(HANDLE handle);
+#endif
+    bool Start(CompletionHandler handler);
+    void Stop();
+
+    // Queue a completion as if an I/O operation had finished
+    bool Post(IoOperation* operation, uint32_t bytesTransferred = 0, uint32_t status = 0);
+
+    // In-flight tracking so owners can drain outstanding work before Stop()
+    void BeginOperation();
+    void EndOperation();
+    bool WaitForDrain(uint32_t timeoutMs);
+    size_t InFlight() const { return m_inFlight.load(std::memory_order_relaxed); }
+
+    size_t ThreadCount() const { return m_threadCount; }
+    static size_t DefaultThreadCount();
+
+private:
+    void WorkerThread(size_t workerIndex);
+    bool Dequeue(IoCompletion& completion);
+
+    size_t m_threadCount;
+    std::vector<std::thread> m_threads;
+    CompletionHandler m_handler;
+    std::atomic<bool> m_running;
+
+    std::atomic<size_t> m_inFlight;
+    std::mutex m_drainMutex;
+    std::condition_variable m_drainCondition;
+
+#ifdef _WIN32
+    HANDLE m_hPort;
+#else
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCondition;
+    std::deque<IoCompletion> m_queue;
+    bool m_queueOpen;
+#endif
+};
\ No newline at end of file
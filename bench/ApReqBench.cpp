@@ -0,0 +1,736 @@
+// Checks the native AP-REQ verifier against fixtures built the way a KDC and
+// an MIT/Windows client build them, then measures validations per second on
+// one core: ApReqVerifier directly, KerberosAuth::AuthenticateToken with the
+// native path, and AuthenticateToken through the platform provider (GSSAPI
+// accepts these fixtures with the generated keytab; SSPI needs the machine
+// account's keys, so it reports unavailable).
+//
+// Service keys come from the RFC 3962 string-to-key (PBKDF2-HMAC-SHA1 plus
+// DK "kerberos"), which is checked against the RFC's test vectors first.
+
+#include "ApReqVerifier.h"
+#include "DerFixtures.h"
+#include "Base64.h"
+#include "Der.h"
+#include "KerberosAuth.h"
+#include "KerberosCrypto.h"
+#include "RequestArena.h"
+#include "SecureRandom.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const char* KEYTAB_PATH = "ApReqBench.keytab";
+static const char* SERVICE_REALM = "EXAMPLE.COM";
+static const uint32_t SERVICE_KVNO = 3;
+
+// ---- RFC 3962 string-to-key ----
+
+static void Pbkdf2HmacSha1(const std::string& password, const std::string& salt, uint32_t iterations, uint8_t* out,
+    size_t length)
+{
+    HmacSha1 prf(password.data(), password.size());
+    for (uint32_t block = 1; length > 0; block++)
+    {
+        Bytes input(salt.begin(), salt.end());
+        input.push_back(static_cast<uint8_t>(block >> 24));
+        input.push_back(static_cast<uint8_t>(block >> 16));
+        input.push_back(static_cast<uint8_t>(block >> 8));
+        input.push_back(static_cast<uint8_t>(block));
+        Sha1::Digest u = prf.Compute(input.data(), input.size());
+        Sha1::Digest t = u;
+        for (uint32_t i = 1; i < iterations; i++)
+        {
+            u = prf.Compute(u.data(), u.size());
+            for (size_t j = 0; j < t.size(); j++)
+            {
+                t[j] ^= u[j];
+            }
+        }
+        size_t take = length < t.size() ? length : t.size();
+        memcpy(out, t.data(), take);
+        out += take;
+        length -= take;
+    }
+}
+
+static Bytes StringToKey(int32_t etype, const std::string& password, const std::string& salt, uint32_t iterations)
+{
+    size_t keySize = KerberosCrypto::KeySize(etype);
+    uint8_t tkey[KerberosCrypto::MAX_KEY_SIZE];
+    Pbkdf2HmacSha1(password, salt, iterations, tkey, keySize);
+    Bytes key(keySize);
+    KerberosCrypto::DeriveKey(tkey, keySize, reinterpret_cast<const uint8_t*>("kerberos"), 8, key.data());
+    return key;
+}
+
+static std::string Hex(const Bytes& bytes)
+{
+    std::string text;
+    for (uint8_t b : bytes)
+    {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", b);
+        text += digits;
+    }
+    return text;
+}
+
+static bool CheckStringToKey()
+{
+    // RFC 3962 appendix B, iteration counts 1 and 1200
+    struct Vector
+    {
+        int32_t etype;
+        uint32_t iterations;
+        const char* key;
+    };
+    const Vector vectors[] = {
+        { KerberosCrypto::AES128_CTS_HMAC_SHA1_96, 1, "42263c6e89f4fc28b8df68ee09799f15" },
+        { KerberosCrypto::AES256_CTS_HMAC_SHA1_96, 1,
+            "fe697b52bc0d3ce14432ba036a92e65bbb52280990a2fa27883998d72af30161" },
+        { KerberosCrypto::AES128_CTS_HMAC_SHA1_96, 1200, "4c01cd46d632d01e6dbe230a01ed642a" },
+        { KerberosCrypto::AES256_CTS_HMAC_SHA1_96, 1200,
+            "55a6ac740ad17b4846941051e1e8b0a7548d93b0ab30a8bc3ff16280382b8c2a" },
+    };
+    for (const Vector& vector : vectors)
+    {
+        std::string key = Hex(StringToKey(vector.etype, "password", "ATHENA.MIT.EDUraeburn", vector.iterations));
+        if (key != vector.key)
+        {
+            printf("FAIL: string-to-key for etype %d, %u iterations: %s\n", vector.etype, vector.iterations, key.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---- Encryption for the fixtures ----
+
+static Bytes Encrypt(int32_t etype, const Bytes& key, uint32_t usage, const Bytes& plain)
+{
+    KerberosUsageKey usageKey;
+    usageKey.Initialize(etype, key.data(), key.size(), usage);
+    uint8_t confounder[KerberosCrypto::CONFOUNDER_SIZE];
+    GenerateRandom(confounder, sizeof(confounder));
+    Bytes scratch(KerberosCrypto::CONFOUNDER_SIZE + plain.size());
+    Bytes cipher(KerberosCrypto::EncryptedLength(plain.size()));
+    usageKey.Encrypt(confounder, plain.data(), plain.size(), scratch.data(), cipher.data());
+    return cipher;
+}
+
+// ---- Fixtures ----
+
+struct ServiceKeys
+{
+    Bytes aes256;
+    Bytes aes128;
+};
+
+// What the client and KDC put into one token; the defaults are the common case
+struct Fixture
+{
+    int32_t ticketEtype = KerberosCrypto::AES256_CTS_HMAC_SHA1_96;
+    int64_t kvno = SERVICE_KVNO;
+    std::vector<std::string> service = { "HTTP", "bench.example.com" };
+    int32_t sessionEtype = KerberosCrypto::AES256_CTS_HMAC_SHA1_96;
+    std::string client = "alice";
+    std::string authenticatorClient = "alice";
+    int64_t startOffset = -60;          // relative to now
+    int64_t endOffset = 36000;
+    int64_t clockOffset = 0;            // client clock error
+    bool mutual = false;
+    bool spnego = true;
+    bool ntlmFirst = false;
+    Bytes pac;                          // authorization data; none when empty
+};
+
+struct Token
+{
+    Bytes bytes;
+    Bytes sessionKey;
+    int64_t ctime = 0;
+    int64_t cusec = 0;
+};
+
+static Token MakeToken(const Fixture& fixture, const ServiceKeys& keys, int64_t now)
+{
+    Token token;
+    token.sessionKey.resize(KerberosCrypto::KeySize(fixture.sessionEtype));
+    GenerateRandom(token.sessionKey.data(), token.sessionKey.size());
+
+    // Ticket, encrypted by the "KDC" under the service key
+    const uint8_t flags[] = { 0x00, 0x40, 0xe1, 0x00, 0x00 };   // forwardable, renewable, initial, pre-authent
+    // The KDC wraps the PAC in AD-IF-RELEVANT
+    Bytes authorizationData;
+    if (!fixture.pac.empty())
+    {
+        Bytes pac = Tlv(DerReader::SEQUENCE, Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(128)),
+            Tagged(1, Tlv(DerReader::OCTET_STRING, fixture.pac)) })));
+        authorizationData = Tagged(10, Tlv(DerReader::SEQUENCE, Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(1)),
+            Tagged(1, Tlv(DerReader::OCTET_STRING, pac)) }))));
+    }
+    Bytes encTicketPart = Tlv(DerReader::Application(3), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Tlv(DerReader::BIT_STRING, Raw(flags, sizeof(flags)))),
+        Tagged(1, Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(fixture.sessionEtype)),
+            Tagged(1, Tlv(DerReader::OCTET_STRING, token.sessionKey)) }))),
+        Tagged(2, KerberosString(SERVICE_REALM)),
+        Tagged(3, PrincipalName(1, { fixture.client })),
+        Tagged(4, Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(1)), Tagged(1, Tlv(DerReader::OCTET_STRING, Bytes())) }))),
+        Tagged(5, KerberosTime(now + fixture.startOffset)),
+        Tagged(6, KerberosTime(now + fixture.startOffset)),
+        Tagged(7, KerberosTime(now + fixture.endOffset)),
+        authorizationData,
+    })));
+    const Bytes& serviceKey = fixture.ticketEtype == KerberosCrypto::AES128_CTS_HMAC_SHA1_96 ? keys.aes128 : keys.aes256;
+    int32_t keyEtype = fixture.ticketEtype == KerberosCrypto::AES128_CTS_HMAC_SHA1_96 ?
+        KerberosCrypto::AES128_CTS_HMAC_SHA1_96 : KerberosCrypto::AES256_CTS_HMAC_SHA1_96;
+    Bytes ticket = Tlv(DerReader::Application(1), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Integer(5)),
+        Tagged(1, KerberosString(SERVICE_REALM)),
+        Tagged(2, PrincipalName(2, fixture.service)),
+        Tagged(3, EncryptedData(fixture.ticketEtype, fixture.kvno,
+            Encrypt(keyEtype, serviceKey, KerberosCrypto::USAGE_TICKET, encTicketPart))),
+    })));
+
+    // Authenticator with the GSS-API checksum: bindings length 16, no
+    // bindings, then the context flags (little-endian)
+    uint8_t cusecBytes[4];
+    GenerateRandom(cusecBytes, sizeof(cusecBytes));
+    token.cusec = ((static_cast<uint32_t>(cusecBytes[0]) << 16) | (cusecBytes[1] << 8) | cusecBytes[2]) % 1000000;
+    token.ctime = now + fixture.clockOffset;
+    uint8_t checksum[24] = { 0x10 };
+    checksum[20] = fixture.mutual ? 0x02 : 0x00;
+    Bytes authenticator = Tlv(DerReader::Application(2), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Integer(5)),
+        Tagged(1, KerberosString(SERVICE_REALM)),
+        Tagged(2, PrincipalName(1, { fixture.authenticatorClient })),
+        Tagged(3, Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(0x8003)),
+            Tagged(1, Tlv(DerReader::OCTET_STRING, Raw(checksum, sizeof(checksum)))) }))),
+        Tagged(4, Integer(token.cusec)),
+        Tagged(5, KerberosTime(token.ctime)),
+    })));
+
+    const uint8_t options[] = { 0x00, static_cast<uint8_t>(fixture.mutual ? 0x20 : 0x00), 0x00, 0x00, 0x00 };
+    int32_t sessionKeyEtype = fixture.sessionEtype == KerberosCrypto::AES128_CTS_HMAC_SHA1_96 ?
+        KerberosCrypto::AES128_CTS_HMAC_SHA1_96 : KerberosCrypto::AES256_CTS_HMAC_SHA1_96;
+    Bytes apReq = Tlv(DerReader::Application(14), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Integer(5)),
+        Tagged(1, Integer(14)),
+        Tagged(2, Tlv(DerReader::BIT_STRING, Raw(options, sizeof(options)))),
+        Tagged(3, ticket),
+        Tagged(4, EncryptedData(fixture.sessionEtype, -1,
+            Encrypt(sessionKeyEtype, token.sessionKey, KerberosCrypto::USAGE_AUTHENTICATOR, authenticator))),
+    })));
+
+    const uint8_t tokenId[] = { 0x01, 0x00 };
+    Bytes krb5Token = Tlv(DerReader::Application(0),
+        Cat({ Tlv(DerReader::OID, Raw(KRB5_OID, sizeof(KRB5_OID))), Raw(tokenId, sizeof(tokenId)), apReq }));
+    if (!fixture.spnego)
+    {
+        token.bytes = krb5Token;
+        return token;
+    }
+
+    Bytes krb5Mech = Tlv(DerReader::OID, Raw(KRB5_OID, sizeof(KRB5_OID)));
+    Bytes ntlmMech = Tlv(DerReader::OID, Raw(NTLM_OID, sizeof(NTLM_OID)));
+    Bytes mechTypes = fixture.ntlmFirst ? Cat({ ntlmMech, krb5Mech }) : Cat({ krb5Mech, ntlmMech });
+    token.bytes = Tlv(DerReader::Application(0), Cat({
+        Tlv(DerReader::OID, Raw(SPNEGO_OID, sizeof(SPNEGO_OID))),
+        Tagged(0, Tlv(DerReader::SEQUENCE, Cat({
+            Tagged(0, Tlv(DerReader::SEQUENCE, mechTypes)),
+            Tagged(2, Tlv(DerReader::OCTET_STRING, krb5Token)),
+        }))),
+    }));
+    return token;
+}
+
+static void Put(Bytes& out, uint32_t value, int bytes)
+{
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void PutCounted(Bytes& out, const std::string& text)
+{
+    Put(out, static_cast<uint32_t>(text.size()), 2);
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// Keytab format 0x0502 with both AES keys and an RC4 key the verifier must skip
+static bool WriteKeytab(const ServiceKeys& keys)
+{
+    Bytes rc4Key(16, 0x5a);
+    struct Entry
+    {
+        int32_t etype;
+        const Bytes* key;
+    };
+    const Entry entries[] = {
+        { KerberosCrypto::AES256_CTS_HMAC_SHA1_96, &keys.aes256 },
+        { KerberosCrypto::AES128_CTS_HMAC_SHA1_96, &keys.aes128 },
+        { 23, &rc4Key },
+    };
+
+    Bytes file = { 0x05, 0x02 };
+    for (const Entry& entry : entries)
+    {
+        Bytes body;
+        Put(body, 2, 2);
+        PutCounted(body, SERVICE_REALM);
+        PutCounted(body, "HTTP");
+        PutCounted(body, "bench.example.com");
+        Put(body, 1, 4);
+        Put(body, 0, 4);
+        Put(body, SERVICE_KVNO, 1);
+        Put(body, static_cast<uint32_t>(entry.etype), 2);
+        Put(body, static_cast<uint32_t>(entry.key->size()), 2);
+        body.insert(body.end(), entry.key->begin(), entry.key->end());
+        Put(body, SERVICE_KVNO, 4);
+        Put(file, static_cast<uint32_t>(body.size()), 4);
+        file.insert(file.end(), body.begin(), body.end());
+    }
+
+    FILE* stream = fopen(KEYTAB_PATH, "wb");
+    if (!stream)
+    {
+        return false;
+    }
+    bool ok = fwrite(file.data(), 1, file.size(), stream) == file.size();
+    return fclose(stream) == 0 && ok;
+}
+
+// ---- Behaviour ----
+
+static int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static ApReqOutcome Run(ApReqVerifier& verifier, const Bytes& token, AuthResult& result)
+{
+    ArenaScope scope;
+    int64_t ticketEnd = 0;
+    return verifier.Verify(token.data(), token.size(), Now(), result, ticketEnd);
+}
+
+static const char* OutcomeName(ApReqOutcome outcome)
+{
+    switch (outcome)
+    {
+    case ApReqOutcome::Accepted:
+        return "accepted";
+    case ApReqOutcome::Rejected:
+        return "rejected";
+    default:
+        return "fallback";
+    }
+}
+
+// The AP-REP inside a NegTokenResp must decrypt under the session key and
+// echo the authenticator's ctime and cusec
+static bool CheckApRep(const std::string& outputToken, const Token& token, int32_t sessionEtype)
+{
+    Bytes reply(Base64::DecodedMaxLength(outputToken.size()));
+    size_t replyLength = 0;
+    if (!Base64::Decode(outputToken, reply.data(), replyLength))
+    {
+        return false;
+    }
+
+    DerReader outer(reply.data(), replyLength);
+    DerReader response;
+    DerReader fields;
+    DerReader state;
+    DerReader mech;
+    DerReader responseToken;
+    if (!outer.Read(DerReader::Context(1), response) || !response.Read(DerReader::SEQUENCE, fields) ||
+        !fields.ReadTagged(0, DerReader::ENUMERATED, state) || state.Size() != 1 || state.Data()[0] != 0 ||
+        !fields.ReadTagged(1, DerReader::OID, mech) || !fields.ReadTagged(2, DerReader::OCTET_STRING, responseToken))
+    {
+        return false;
+    }
+
+    DerReader gss;
+    DerReader oid;
+    if (!responseToken.Read(DerReader::Application(0), gss) || !gss.Read(DerReader::OID, oid) || gss.Size() < 2 ||
+        gss.Data()[0] != 0x02 || gss.Data()[1] != 0x00)
+    {
+        return false;
+    }
+    DerReader apRep(gss.Data() + 2, gss.Size() - 2);
+    DerReader apRepBody;
+    DerReader apRepFields;
+    int64_t pvno = 0;
+    int64_t messageType = 0;
+    DerReader encPart;
+    DerReader encData;
+    int64_t etype = 0;
+    DerReader cipher;
+    if (!apRep.Read(DerReader::Application(15), apRepBody) || !apRepBody.Read(DerReader::SEQUENCE, apRepFields) ||
+        !apRepFields.ReadTaggedInteger(0, pvno) || !apRepFields.ReadTaggedInteger(1, messageType) || messageType != 15 ||
+        !apRepFields.Read(DerReader::Context(2), encPart) || !encPart.Read(DerReader::SEQUENCE, encData) ||
+        !encData.ReadTaggedInteger(0, etype) || etype != sessionEtype ||
+        !encData.ReadTagged(2, DerReader::OCTET_STRING, cipher))
+    {
+        return false;
+    }
+
+    KerberosUsageKey replyKey;
+    replyKey.Initialize(sessionEtype, token.sessionKey.data(), token.sessionKey.size(), KerberosCrypto::USAGE_AP_REP);
+    Bytes scratch(cipher.Size());
+    const uint8_t* plain = nullptr;
+    size_t plainLength = 0;
+    if (!replyKey.Decrypt(cipher.Data(), cipher.Size(), scratch.data(), plain, plainLength))
+    {
+        return false;
+    }
+
+    DerReader encApRep(plain, plainLength);
+    DerReader body;
+    DerReader part;
+    DerReader ctime;
+    int64_t cusec = -1;
+    Bytes expectedTime = KerberosTime(token.ctime);
+    return encApRep.Read(DerReader::Application(27), body) && body.Read(DerReader::SEQUENCE, part) &&
+        part.ReadTagged(0, DerReader::GENERALIZED_TIME, ctime) && ctime.Size() == 15 &&
+        memcmp(ctime.Data(), expectedTime.data() + 2, 15) == 0 && part.ReadTaggedInteger(1, cusec) && cusec == token.cusec;
+}
+
+static bool CheckBehaviour(const ServiceKeys& keys)
+{
+    ApReqVerifier verifier(1000, std::chrono::seconds(300), true);
+    if (!verifier.Load(KEYTAB_PATH) || verifier.KeyCount() != 2)
+    {
+        printf("FAIL: keytab did not load exactly the two AES keys\n");
+        return false;
+    }
+
+    bool ok = true;
+    auto expect = [&](const char* name, const Fixture& fixture, ApReqOutcome expected)
+    {
+        Token token = MakeToken(fixture, keys, Now());
+        AuthResult result;
+        ApReqOutcome outcome = Run(verifier, token.bytes, result);
+        if (outcome != expected)
+        {
+            printf("FAIL: %s: %s, expected %s\n", name, OutcomeName(outcome), OutcomeName(expected));
+            ok = false;
+        }
+        else if (outcome == ApReqOutcome::Accepted && result.principal != fixture.client + "@" + SERVICE_REALM)
+        {
+            printf("FAIL: %s: principal %s\n", name, result.principal.c_str());
+            ok = false;
+        }
+        return token;
+    };
+
+    Fixture aes256;
+    expect("aes256 SPNEGO", aes256, ApReqOutcome::Accepted);
+
+    Fixture aes128;
+    aes128.ticketEtype = KerberosCrypto::AES128_CTS_HMAC_SHA1_96;
+    aes128.sessionEtype = KerberosCrypto::AES128_CTS_HMAC_SHA1_96;
+    expect("aes128 SPNEGO", aes128, ApReqOutcome::Accepted);
+
+    Fixture raw;
+    raw.spnego = false;
+    expect("aes256 raw krb5", raw, ApReqOutcome::Accepted);
+
+    Fixture mixed;
+    mixed.sessionEtype = KerberosCrypto::AES128_CTS_HMAC_SHA1_96;
+    expect("aes256 ticket, aes128 session", mixed, ApReqOutcome::Accepted);
+
+    Fixture noKvno;
+    noKvno.kvno = -1;
+    expect("ticket without kvno", noKvno, ApReqOutcome::Accepted);
+
+    // Group SIDs from the PAC; a ticket without one has none
+    Fixture withPac;
+    withPac.pac = LogonInfoPac("S-1-5-21-1004336348-1177238915-682003330", 1105, { 512, 1130 }, { "S-1-18-1" });
+    {
+        Token token = MakeToken(withPac, keys, Now());
+        AuthResult result;
+        std::vector<std::string> expected = { "S-1-18-1", "S-1-5-21-1004336348-1177238915-682003330-1105",
+            "S-1-5-21-1004336348-1177238915-682003330-1130", "S-1-5-21-1004336348-1177238915-682003330-512",
+            "S-1-5-21-1004336348-1177238915-682003330-513" };
+        if (Run(verifier, token.bytes, result) != ApReqOutcome::Accepted || result.sids != expected)
+        {
+            printf("FAIL: PAC group SIDs (%zu read)\n", result.sids.size());
+            ok = false;
+        }
+        token = MakeToken(aes256, keys, Now());
+        if (Run(verifier, token.bytes, result) != ApReqOutcome::Accepted || !result.sids.empty())
+        {
+            printf("FAIL: SIDs left over from a ticket without a PAC\n");
+            ok = false;
+        }
+    }
+
+    // Mutual authentication returns an AP-REP the client can decrypt
+    Fixture mutual;
+    mutual.mutual = true;
+    {
+        Token token = MakeToken(mutual, keys, Now());
+        AuthResult result;
+        if (Run(verifier, token.bytes, result) != ApReqOutcome::Accepted ||
+            !CheckApRep(result.outputToken, token, mutual.sessionEtype))
+        {
+            printf("FAIL: mutual authentication reply\n");
+            ok = false;
+        }
+    }
+
+    // Replays and tampering
+    {
+        Token token = MakeToken(aes256, keys, Now());
+        AuthResult result;
+        if (Run(verifier, token.bytes, result) != ApReqOutcome::Accepted ||
+            Run(verifier, token.bytes, result) != ApReqOutcome::Rejected)
+        {
+            printf("FAIL: replayed authenticator was not rejected\n");
+            ok = false;
+        }
+    }
+
+    // A full replay cache sends new tokens to the provider and still knows
+    // every authenticator it recorded
+    {
+        ApReqVerifier small(64, std::chrono::seconds(300));
+        small.Load(KEYTAB_PATH);
+        std::vector<Token> accepted;
+        ApReqOutcome outcome = ApReqOutcome::Accepted;
+        for (size_t i = 0; i < 100000 && outcome == ApReqOutcome::Accepted; i++)
+        {
+            Token token = MakeToken(aes256, keys, Now());
+            AuthResult result;
+            outcome = Run(small, token.bytes, result);
+            if (outcome == ApReqOutcome::Accepted)
+            {
+                accepted.push_back(std::move(token));
+            }
+        }
+        size_t remembered = 0;
+        for (const Token& token : accepted)
+        {
+            AuthResult result;
+            remembered += Run(small, token.bytes, result) == ApReqOutcome::Rejected;
+        }
+        if (outcome != ApReqOutcome::Fallback || remembered != accepted.size() || small.GetStats().replayCacheFull != 1)
+        {
+            printf("FAIL: full replay cache: %s after %zu tokens, %zu of them rejected when replayed\n", OutcomeName(outcome),
+                accepted.size(), remembered);
+            ok = false;
+        }
+    }
+    {
+        Token token = MakeToken(aes256, keys, Now());
+        size_t rejected = 0;
+        size_t accepted = 0;
+        for (size_t offset = token.bytes.size() - 40; offset < token.bytes.size(); offset++)
+        {
+            Bytes tampered = token.bytes;
+            tampered[offset] ^= 0x01;
+            AuthResult result;
+            ApReqOutcome outcome = Run(verifier, tampered, result);
+            rejected += outcome == ApReqOutcome::Rejected;
+            accepted += outcome == ApReqOutcome::Accepted;
+        }
+        Bytes tampered = token.bytes;
+        tampered[tampered.size() / 2] ^= 0x80;
+        AuthResult result;
+        if (accepted != 0 || rejected == 0 || Run(verifier, tampered, result) == ApReqOutcome::Accepted)
+        {
+            printf("FAIL: tampered token accepted\n");
+            ok = false;
+        }
+    }
+
+    Fixture expired;
+    expired.startOffset = -86400;
+    expired.endOffset = -3600;
+    expect("expired ticket", expired, ApReqOutcome::Rejected);
+
+    Fixture postdated;
+    postdated.startOffset = 3600;
+    expect("ticket not yet valid", postdated, ApReqOutcome::Rejected);
+
+    Fixture skewed;
+    skewed.clockOffset = -900;
+    expect("client clock 15 minutes slow", skewed, ApReqOutcome::Rejected);
+
+    Fixture impostor;
+    impostor.authenticatorClient = "mallory";
+    expect("authenticator for another client", impostor, ApReqOutcome::Rejected);
+
+    // Not ours to decide: the provider sees these unchanged
+    Fixture wrongService;
+    wrongService.service = { "HTTP", "other.example.com" };
+    expect("ticket for another SPN", wrongService, ApReqOutcome::Fallback);
+
+    Fixture oldKvno;
+    oldKvno.kvno = 2;
+    expect("kvno the keytab lacks", oldKvno, ApReqOutcome::Fallback);
+
+    Fixture rc4;
+    rc4.ticketEtype = 23;
+    expect("rc4-hmac ticket", rc4, ApReqOutcome::Fallback);
+
+    Fixture ntlmFirst;
+    ntlmFirst.ntlmFirst = true;
+    expect("SPNEGO listing NTLM first", ntlmFirst, ApReqOutcome::Fallback);
+
+    const char ntlm[] = "NTLMSSP\0\x01\0\0\0\x07\x82\x08\xa2";
+    AuthResult result;
+    if (Run(verifier, Raw(ntlm, sizeof(ntlm) - 1), result) != ApReqOutcome::Fallback)
+    {
+        printf("FAIL: raw NTLM token was not passed on\n");
+        ok = false;
+    }
+
+    if (ok)
+    {
+        printf("Behaviour: aes128/aes256, raw and SPNEGO, mutual AP-REP verified; replay, tampering, expiry and skew "
+               "rejected; other SPNs, kvnos, etypes and NTLM passed on\n");
+    }
+    return ok;
+}
+
+// ---- Throughput ----
+
+template <typename Operation>
+static void Report(const char* path, const std::vector<std::string>& tokens, Operation operation)
+{
+    size_t accepted = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string& token : tokens)
+    {
+        accepted += operation(token);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (accepted != tokens.size())
+    {
+        printf("%-44s %14s\n", path, "unavailable");
+        return;
+    }
+    printf("%-44s %14.0f %12.2f\n", path, static_cast<double>(tokens.size()) / seconds,
+        seconds * 1e6 / static_cast<double>(tokens.size()));
+}
+
+static double AesMegabytesPerSecond(Aes::Kernel kernel, size_t length, size_t iterations)
+{
+    uint8_t key[32] = { 1, 2, 3 };
+    Aes aes;
+    aes.SetKey(kernel, key, sizeof(key));
+    Bytes in(length, 0x42);
+    Bytes out(length);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        aes.DecryptCts(in.data(), in.size(), out.data());
+        in[0] ^= out[1];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(length * iterations) / seconds / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    // The verifier logs through std::wcout; keep it off the narrow stdout stream
+    std::ios::sync_with_stdio(false);
+    setvbuf(stdout, nullptr, _IOLBF, 1024);
+
+    size_t count = 20000;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--tokens") == 0)
+            count = strtoul(argv[++i], nullptr, 10);
+    }
+
+    if (!CheckStringToKey())
+    {
+        return 1;
+    }
+    ServiceKeys keys;
+    keys.aes256 = StringToKey(KerberosCrypto::AES256_CTS_HMAC_SHA1_96, "bench-password", "EXAMPLE.COMHTTPbench.example.com", 4096);
+    keys.aes128 = StringToKey(KerberosCrypto::AES128_CTS_HMAC_SHA1_96, "bench-password", "EXAMPLE.COMHTTPbench.example.com", 4096);
+    if (!WriteKeytab(keys))
+    {
+        printf("FAIL: cannot write %s\n", KEYTAB_PATH);
+        return 1;
+    }
+
+    bool ok = CheckBehaviour(keys);
+    if (ok)
+    {
+        // Every token carries its own authenticator, so none is a replay and
+        // the token cache never answers
+        Fixture fixture;
+        fixture.mutual = true;
+        std::vector<std::string> tokens;
+        tokens.reserve(count);
+        int64_t now = Now();
+        for (size_t i = 0; i < count; i++)
+        {
+            Bytes token = MakeToken(fixture, keys, now).bytes;
+            tokens.push_back(Base64::Encode(token.data(), token.size()));
+        }
+
+        printf("AES kernel: %s; %zu distinct SPNEGO tokens of %zu bytes, aes256, mutual\n",
+            Aes::KernelName(Aes::ActiveKernel()), count, Base64::DecodedMaxLength(tokens[0].size()));
+        printf("%-44s %14s %12s\n", "path", "tokens/sec", "us/token");
+
+        ApReqVerifier verifier(count * 2, std::chrono::seconds(300));
+        verifier.Load(KEYTAB_PATH);
+        Bytes decoded(Base64::DecodedMaxLength(tokens[0].size()) + 16);
+        Report("ApReqVerifier::Verify", tokens, [&](const std::string& token)
+        {
+            ArenaScope scope;
+            size_t length = 0;
+            Base64::Decode(token, decoded.data(), length);
+            AuthResult result;
+            int64_t ticketEnd = 0;
+            return verifier.Verify(decoded.data(), length, Now(), result, ticketEnd) == ApReqOutcome::Accepted;
+        });
+
+        for (int native = 1; native >= 0; native--)
+        {
+            ServerConfig config;
+            config.keytab = std::wstring(KEYTAB_PATH, KEYTAB_PATH + strlen(KEYTAB_PATH));
+            config.nativeApReq = native != 0;
+            config.tokenReplayWindowSeconds = 0;
+            KerberosAuth auth(config);
+            std::string path = std::string("AuthenticateToken, ") +
+                (native ? "native verifier" : "provider (" + std::string(auth.ProviderName(), auth.ProviderName() + wcslen(auth.ProviderName())) + ")");
+            if (!auth.Initialize())
+            {
+                printf("%-44s %14s\n", path.c_str(), "unavailable");
+                continue;
+            }
+            uint64_t connection = 0;
+            Report(path.c_str(), tokens, [&](const std::string& token)
+            {
+                return auth.AuthenticateToken(++connection, token).status == AuthStatus::Success;
+            });
+        }
+
+        printf("AES-CTS decrypt of a 1 KB ticket:");
+        for (Aes::Kernel kernel : { Aes::Kernel::Portable, Aes::Kernel::AesNi })
+        {
+            if (Aes::Supported(kernel))
+            {
+                printf(" %s %.0f MB/s", Aes::KernelName(kernel), AesMegabytesPerSecond(kernel, 1024, 200000));
+            }
+        }
+        printf("\n");
+    }
+
+    remove(KEYTAB_PATH);
+    return ok ? 0 : 1;
+}
\ No newline at end of file
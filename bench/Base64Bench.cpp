@@ -0,0 +1,127 @@
+// Base64 throughput for each kernel the CPU supports, at Negotiate token
+// sizes (a Kerberos ticket with a PAC is 4-12 KB) and one large buffer.
+// The "legacy" rows are the per-call-table decoder KerberosAuth used before.
+
+#include "Base64.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_sink(0);
+
+static std::vector<unsigned char> LegacyDecode(const std::string& encoded)
+{
+    std::vector<unsigned char> result;
+    std::string cleanEncoded;
+    for (char c : encoded)
+    {
+        if (!isspace(c))
+            cleanEncoded += c;
+    }
+
+    const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::vector<int> T(256, -1);
+    for (int i = 0; i < 64; i++)
+        T[chars[i]] = i;
+
+    for (size_t i = 0; i < cleanEncoded.size(); i += 4)
+    {
+        int n = T[cleanEncoded[i]] << 18 | T[cleanEncoded[i + 1]] << 12 | T[cleanEncoded[i + 2]] << 6 | T[cleanEncoded[i + 3]];
+        result.push_back((n >> 16) & 0xFF);
+        if (cleanEncoded[i + 2] != '=')
+            result.push_back((n >> 8) & 0xFF);
+        if (cleanEncoded[i + 3] != '=')
+            result.push_back(n & 0xFF);
+    }
+    return result;
+}
+
+// Runs the operation for about the given time and returns GB/s of input
+template <typename Operation>
+static double Throughput(size_t bytesPerCall, double seconds, Operation operation)
+{
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            operation();
+        }
+        calls += 64;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < seconds);
+    return static_cast<double>(bytesPerCall) * static_cast<double>(calls) / elapsed / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = 0.5;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0)
+            seconds = strtod(argv[++i], nullptr);
+    }
+
+    const size_t sizes[] = { 1024, 4096, 12288, 1 << 20 };
+    const Base64::Kernel kernels[] = { Base64::Kernel::Scalar, Base64::Kernel::Sse41, Base64::Kernel::Avx2 };
+
+    printf("Base64 throughput (GB/s of input), active kernel: %s\n", Base64::KernelName(Base64::ActiveKernel()));
+    printf("%-8s %-8s %10s %10s\n", "kernel", "bytes", "encode", "decode");
+
+    for (size_t size : sizes)
+    {
+        std::vector<unsigned char> data(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = static_cast<unsigned char>(i * 2654435761u >> 13);
+        }
+        std::string encoded = Base64::Encode(data.data(), data.size());
+        std::vector<char> text(encoded.size());
+        std::vector<unsigned char> decoded(Base64::DecodedMaxLength(encoded.size()));
+
+        for (Base64::Kernel kernel : kernels)
+        {
+            if (!Base64::Supported(kernel))
+            {
+                continue;
+            }
+
+            size_t length = 0;
+            if (!Base64::Decode(kernel, encoded, decoded.data(), length) || length != size ||
+                memcmp(decoded.data(), data.data(), size) != 0)
+            {
+                printf("FAIL: %s round trip at %zu bytes\n", Base64::KernelName(kernel), size);
+                return 1;
+            }
+
+            double encode = Throughput(size, seconds, [&]
+            {
+                g_sink.fetch_add(Base64::Encode(kernel, data.data(), data.size(), text.data()), std::memory_order_relaxed);
+            });
+            double decode = Throughput(encoded.size(), seconds, [&]
+            {
+                size_t written = 0;
+                Base64::Decode(kernel, encoded, decoded.data(), written);
+                g_sink.fetch_add(written, std::memory_order_relaxed);
+            });
+            printf("%-8s %-8zu %10.2f %10.2f\n", Base64::KernelName(kernel), size, encode, decode);
+        }
+
+        if (size <= 12288)
+        {
+            double legacy = Throughput(encoded.size(), seconds, [&]
+            {
+                g_sink.fetch_add(LegacyDecode(encoded).size(), std::memory_order_relaxed);
+            });
+            printf("%-8s %-8zu %10s %10.2f\n", "legacy", size, "-", legacy);
+        }
+    }
+
+    return g_sink.load() == 0 ? 1 : 0;
+}
\ No newline at end of file
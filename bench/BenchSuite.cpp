@@ -0,0 +1,382 @@
+// Microbenchmarks for the per-request hot paths, with a regression report.
+// Each benchmark is checked for the right answer, then timed for a fixed
+// time several runs over; the fastest run (the one the machine disturbed
+// least) is reported in ns per operation:
+//
+//   base64_decode      a 4 KB Negotiate header value (a ticket with a PAC)
+//   parse_head         a browser request head carrying that token
+//   build_response     WriteEchoResponse for that request, serialized for the wire
+//   token_cache_hit    a repeated first leg answered by the token cache
+//   negotiate_mock     a first leg through KerberosAuth to the mock provider
+//                      with the cache off: decode, screen and accept
+//
+// The report is JSON. Given a baseline (an earlier report) every result is
+// compared with it, and one slower by more than the tolerance fails the run.
+// Baselines are per machine: store one with --report on the machine that
+// later compares against it.
+//
+//   BenchSuite [--report FILE] [--baseline FILE] [--tolerance 10]
+//              [--seconds 0.2] [--runs 5] [--filter NAME]
+
+#include "Base64.h"
+#include "EchoResponse.h"
+#include "HttpParser.h"
+#include "KerberosAuth.h"
+#include "MockAuthProvider.h"
+#include "TokenCache.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<uint64_t> g_sink(0);
+
+    constexpr size_t TOKEN_BYTES = 3072;    // 4 KB once base64-encoded
+
+    struct Options
+    {
+        std::string report;
+        std::string baseline;
+        std::string filter;
+        double tolerance = 10.0;    // percent slower than the baseline that counts as a regression
+        double seconds = 0.2;       // per run
+        int runs = 5;
+    };
+
+    struct Benchmark
+    {
+        const char* name;
+        std::function<bool()> check;        // false fails the suite
+        std::function<void()> operation;
+    };
+
+    struct Result
+    {
+        std::string name;
+        double nanos = 0;
+        double baseline = 0;        // 0 when the baseline has no such benchmark
+        bool regressed = false;
+    };
+
+    // The fastest of runs, each at least seconds long, in ns per call
+    double NanosPerOperation(const Options& options, const std::function<void()>& operation)
+    {
+        double best = 0;
+        for (int run = 0; run < options.runs; run++)
+        {
+            uint64_t calls = 0;
+            auto start = Clock::now();
+            double elapsed = 0;
+            do
+            {
+                for (int i = 0; i < 64; i++)
+                {
+                    operation();
+                }
+                calls += 64;
+                elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            } while (elapsed < options.seconds);
+
+            double nanos = elapsed * 1e9 / static_cast<double>(calls);
+            if (run == 0 || nanos < best)
+            {
+                best = nanos;
+            }
+        }
+        return best;
+    }
+
+    // Reads the results of an earlier report. The report is written by
+    // WriteReport with one benchmark per line, which is all this expects.
+    bool ReadBaseline(const std::string& path, std::map<std::string, double>& baseline)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            size_t nameAt = line.find("\"name\": \"");
+            size_t nanosAt = line.find("\"ns_per_op\": ");
+            if (nameAt == std::string::npos || nanosAt == std::string::npos)
+            {
+                continue;
+            }
+            nameAt += 9;
+            size_t nameEnd = line.find('"', nameAt);
+            if (nameEnd == std::string::npos)
+            {
+                continue;
+            }
+            baseline[line.substr(nameAt, nameEnd - nameAt)] = strtod(line.c_str() + nanosAt + 13, nullptr);
+        }
+        return true;
+    }
+
+    bool WriteReport(const std::string& path, const Options& options, const std::vector<Result>& results,
+        bool haveBaseline, size_t regressions)
+    {
+        std::ostringstream json;
+        json.precision(1);
+        json << std::fixed;
+        json << "{\n";
+        json << "  \"suite\": \"KerberosEchoService\",\n";
+        json << "  \"base64_kernel\": \"" << Base64::KernelName(Base64::ActiveKernel()) << "\",\n";
+        json << "  \"runs\": " << options.runs << ",\n";
+        json << "  \"seconds_per_run\": " << options.seconds << ",\n";
+        json << "  \"baseline\": " << (haveBaseline ? "\"" + options.baseline + "\"" : std::string("null")) << ",\n";
+        json << "  \"tolerance_percent\": " << options.tolerance << ",\n";
+        json << "  \"regressions\": " << regressions << ",\n";
+        json << "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result& result = results[i];
+            json << "    { \"name\": \"" << result.name << "\", \"ns_per_op\": " << result.nanos;
+            if (result.baseline > 0)
+            {
+                json << ", \"baseline_ns_per_op\": " << result.baseline
+                     << ", \"change_percent\": " << (result.nanos / result.baseline - 1.0) * 100.0
+                     << ", \"regressed\": " << (result.regressed ? "true" : "false");
+            }
+            json << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        json << "  ]\n";
+        json << "}\n";
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << json.str();
+        return static_cast<bool>(file);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        if (name == "--report") options.report = argv[i + 1];
+        else if (name == "--baseline") options.baseline = argv[i + 1];
+        else if (name == "--filter") options.filter = argv[i + 1];
+        else if (name == "--tolerance") options.tolerance = atof(argv[i + 1]);
+        else if (name == "--seconds") options.seconds = atof(argv[i + 1]);
+        else if (name == "--runs") options.runs = atoi(argv[i + 1]);
+    }
+    if (options.runs < 1)
+    {
+        options.runs = 1;
+    }
+
+    // One client token, as a browser would send it, and a request carrying it
+    std::string token = MockAuthProvider::BuildToken("bench@MOCK.TEST", 1, TOKEN_BYTES);
+    std::string encoded = Base64::Encode(token.data(), token.size());
+    std::string head =
+        "GET /app/orders?id=42&view=full HTTP/1.1\r\n"
+        "Host: intranet.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Authorization: Negotiate " + encoded + "\r\n"
+        "\r\n";
+
+    std::vector<unsigned char> decoded(Base64::DecodedMaxLength(encoded.size()));
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    ParsedRequest parsed;
+    HttpResponse response;
+    std::string wire;
+
+    TokenCache cache(1024, std::chrono::seconds(3600));
+    auto verify = [](TokenCache::Clock::time_point&)
+    {
+        AuthResult result;
+        result.status = AuthStatus::Success;
+        result.principal = "bench@MOCK.TEST";
+        return result;
+    };
+
+    ServerConfig config;
+    config.authProvider = L"mock";
+    config.tokenReplayWindowSeconds = 0;
+    KerberosAuth auth(config);
+    if (!auth.Initialize())
+    {
+        printf("FAIL: mock provider did not initialize\n");
+        return 1;
+    }
+
+    std::vector<Benchmark> benchmarks;
+    benchmarks.push_back({ "base64_decode",
+        [&]
+        {
+            size_t length = 0;
+            return Base64::Decode(encoded, decoded.data(), length) && length == token.size() &&
+                memcmp(decoded.data(), token.data(), length) == 0;
+        },
+        [&]
+        {
+            size_t length = 0;
+            Base64::Decode(encoded, decoded.data(), length);
+            g_sink.fetch_add(length, std::memory_order_relaxed);
+        } });
+    benchmarks.push_back({ "parse_head",
+        [&]
+        {
+            // Chunked has to be the last coding over every Transfer-Encoding field
+            struct Framing
+            {
+                const char* codings;
+                ParseStatus expected;
+            };
+            const Framing framings[] = {
+                { "Transfer-Encoding: chunked\r\n", ParseStatus::Complete },
+                { "Transfer-Encoding: gzip, chunked\r\n", ParseStatus::Complete },
+                { "Transfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n", ParseStatus::Complete },
+                { "Transfer-Encoding: chunked, gzip\r\n", ParseStatus::Invalid },
+                { "Transfer-Encoding: chunked\r\nTransfer-Encoding: gzip\r\n", ParseStatus::Invalid },
+                { "Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n", ParseStatus::Invalid },
+                { "Transfer-Encoding: gzip\r\n", ParseStatus::Invalid },
+            };
+            for (const Framing& framing : framings)
+            {
+                std::string upload = std::string("POST /upload HTTP/1.1\r\nHost: intranet.example.com\r\n") + framing.codings + "\r\n";
+                parsed = ParsedRequest();
+                if (ParseRequestHead(upload.data(), upload.size(), headers, parsed) != framing.expected)
+                {
+                    return false;
+                }
+            }
+
+            parsed = ParsedRequest();
+            return ParseRequestHead(head.data(), head.size(), headers, parsed) == ParseStatus::Complete &&
+                parsed.headBytes == head.size() && parsed.request.FindHeader("Authorization").size() == encoded.size() + 10;
+        },
+        [&]
+        {
+            parsed = ParsedRequest();
+            ParseRequestHead(head.data(), head.size(), headers, parsed);
+            g_sink.fetch_add(parsed.request.headerCount, std::memory_order_relaxed);
+        } });
+    benchmarks.push_back({ "build_response",
+        [&]
+        {
+            // parse_head left the request in parsed
+            response.Reset();
+            WriteEchoResponse(parsed.request, response);
+            wire.clear();
+            AppendResponse(response, true, true, wire);
+            return wire.compare(0, 15, "HTTP/1.1 200 OK") == 0 && wire.find(encoded) != std::string::npos;
+        },
+        [&]
+        {
+            response.Reset();
+            WriteEchoResponse(parsed.request, response);
+            wire.clear();
+            AppendResponse(response, true, true, wire);
+            g_sink.fetch_add(wire.size(), std::memory_order_relaxed);
+        } });
+    benchmarks.push_back({ "token_cache_hit",
+        [&]
+        {
+            return cache.Verify(encoded, verify).status == AuthStatus::Success &&
+                cache.Verify(encoded, verify).status == AuthStatus::Success && cache.GetStats().hits == 1;
+        },
+        [&]
+        {
+            AuthResult result = cache.Verify(encoded, verify);
+            g_sink.fetch_add(result.principal.size(), std::memory_order_relaxed);
+        } });
+    benchmarks.push_back({ "negotiate_mock",
+        [&]
+        {
+            AuthResult result = auth.AuthenticateToken(1, encoded);
+            return result.status == AuthStatus::Success && result.principal == "bench@MOCK.TEST";
+        },
+        [&]
+        {
+            AuthResult result = auth.AuthenticateToken(1, encoded);
+            g_sink.fetch_add(result.principal.size(), std::memory_order_relaxed);
+        } });
+
+    std::map<std::string, double> baseline;
+    bool haveBaseline = !options.baseline.empty() && ReadBaseline(options.baseline, baseline);
+    if (!options.baseline.empty() && !haveBaseline)
+    {
+        printf("No baseline at %s; store one with --report %s\n", options.baseline.c_str(), options.baseline.c_str());
+    }
+
+    printf("%-18s %12s %12s %9s\n", "benchmark", "ns/op", "baseline", "change");
+    std::vector<Result> results;
+    size_t regressions = 0;
+    int failures = 0;
+    for (const Benchmark& benchmark : benchmarks)
+    {
+        if (!options.filter.empty() && strstr(benchmark.name, options.filter.c_str()) == nullptr)
+        {
+            continue;
+        }
+        if (!benchmark.check())
+        {
+            printf("FAIL: %s gave the wrong answer\n", benchmark.name);
+            failures++;
+            continue;
+        }
+
+        Result result;
+        result.name = benchmark.name;
+        result.nanos = NanosPerOperation(options, benchmark.operation);
+        auto known = baseline.find(result.name);
+        if (known == baseline.end() || known->second <= 0)
+        {
+            printf("%-18s %12.1f %12s %9s\n", benchmark.name, result.nanos, "-", "-");
+            results.push_back(result);
+            continue;
+        }
+
+        result.baseline = known->second;
+        double change = (result.nanos / result.baseline - 1.0) * 100.0;
+        result.regressed = change > options.tolerance;
+        regressions += result.regressed ? 1 : 0;
+        printf("%-18s %12.1f %12.1f %+8.1f%%%s\n", benchmark.name, result.nanos, result.baseline, change,
+            result.regressed ? "  REGRESSED" : "");
+        results.push_back(result);
+    }
+    auth.Cleanup();
+
+    if (!options.report.empty())
+    {
+        if (!WriteReport(options.report, options, results, haveBaseline, regressions))
+        {
+            printf("FAIL: could not write %s\n", options.report.c_str());
+            return 1;
+        }
+        printf("Report written to %s\n", options.report.c_str());
+    }
+
+    if (failures > 0)
+    {
+        return 1;
+    }
+    if (regressions > 0)
+    {
+        printf("FAIL: %zu benchmark(s) more than %.0f%% slower than the baseline\n", regressions, options.tolerance);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
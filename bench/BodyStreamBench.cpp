@@ -0,0 +1,295 @@
+// Streams a large POST body through the echo handler of each Linux transport
+// over loopback and checks that it comes back intact. Reports throughput and
+// how far the process RSS rose above its level before the upload, which
+// should stay near the connection buffers regardless of the body size. A
+// small GET follows on the same connection to check the framing after the
+// streamed body.
+//
+//   BodyStreamBench [--transports epoll,io_uring] [--port 18081] [--mb 100]
+
+#include "EchoResponse.h"
+#include "ServerConfig.h"
+#include "Transport.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    class EchoHandler : public RequestHandler
+    {
+    public:
+        void ProcessRequest(const HttpRequest& request, HttpResponse& response) override
+        {
+            WriteEchoResponse(request, response);
+        }
+    };
+
+    // The body repeats a 251-byte cycle, so any slice of it starts somewhere
+    // in the first cycle of this buffer
+    constexpr size_t PATTERN_CYCLE = 251;
+    constexpr size_t IO_SIZE = 256 * 1024;
+
+    const char* Pattern(uint64_t offset)
+    {
+        static const std::vector<char> pattern = []
+        {
+            std::vector<char> bytes(IO_SIZE + PATTERN_CYCLE);
+            for (size_t i = 0; i < bytes.size(); i++)
+            {
+                bytes[i] = static_cast<char>(i % PATTERN_CYCLE);
+            }
+            return bytes;
+        }();
+        return pattern.data() + offset % PATTERN_CYCLE;
+    }
+
+    size_t ResidentKilobytes()
+    {
+        FILE* status = fopen("/proc/self/status", "r");
+        if (!status)
+        {
+            return 0;
+        }
+        char line[256];
+        size_t kilobytes = 0;
+        while (fgets(line, sizeof(line), status))
+        {
+            if (strncmp(line, "VmRSS:", 6) == 0)
+            {
+                kilobytes = strtoul(line + 6, nullptr, 10);
+                break;
+            }
+        }
+        fclose(status);
+        return kilobytes;
+    }
+
+    int Connect(int port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    bool SendAll(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data += sent;
+            length -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // Reads one response, checking that its body ends with the uploaded
+    // pattern when bodyLength is nonzero. Tracks peak RSS while it reads.
+    class ResponseReader
+    {
+    public:
+        explicit ResponseReader(int fd) : m_fd(fd), m_buffer(IO_SIZE) {}
+
+        bool Read(uint64_t bodyLength, size_t& peakKilobytes)
+        {
+            std::string head;
+            for (;;)
+            {
+                size_t end = head.find("\r\n\r\n");
+                if (end != std::string::npos)
+                {
+                    m_pending.assign(head, end + 4, std::string::npos);
+                    head.resize(end + 4);
+                    break;
+                }
+                ssize_t received = recv(m_fd, m_buffer.data(), m_buffer.size(), 0);
+                if (received <= 0)
+                {
+                    return false;
+                }
+                head.append(m_buffer.data(), static_cast<size_t>(received));
+            }
+
+            size_t field = head.find("Content-Length: ");
+            if (head.compare(0, 12, "HTTP/1.1 200") != 0 || field == std::string::npos)
+            {
+                printf("unexpected response head:\n%s", head.c_str());
+                return false;
+            }
+            uint64_t contentLength = strtoull(head.c_str() + field + 16, nullptr, 10);
+            if (contentLength < bodyLength)
+            {
+                return false;
+            }
+
+            // Everything before the relayed body is the echo text
+            uint64_t prefix = contentLength - bodyLength;
+            uint64_t offset = 0;
+            size_t samples = 0;
+            auto check = [&](const char* data, size_t length)
+            {
+                uint64_t end = offset + length;
+                if (end > prefix)
+                {
+                    size_t skip = offset < prefix ? static_cast<size_t>(prefix - offset) : 0;
+                    if (memcmp(data + skip, Pattern(offset + skip - prefix), length - skip) != 0)
+                    {
+                        return false;
+                    }
+                }
+                offset = end;
+                return true;
+            };
+
+            if (!check(m_pending.data(), static_cast<size_t>(std::min<uint64_t>(m_pending.size(), contentLength))))
+            {
+                return false;
+            }
+            while (offset < contentLength)
+            {
+                size_t wanted = static_cast<size_t>(std::min<uint64_t>(m_buffer.size(), contentLength - offset));
+                ssize_t received = recv(m_fd, m_buffer.data(), wanted, 0);
+                if (received <= 0 || !check(m_buffer.data(), static_cast<size_t>(received)))
+                {
+                    return false;
+                }
+                if (++samples % 64 == 0)
+                {
+                    peakKilobytes = std::max(peakKilobytes, ResidentKilobytes());
+                }
+            }
+            return true;
+        }
+
+    private:
+        int m_fd;
+        std::vector<char> m_buffer;
+        std::string m_pending;
+    };
+
+    struct Result
+    {
+        bool ok;
+        double seconds;
+        size_t rssGrowthKilobytes;
+    };
+
+    Result Run(int port, uint64_t bodyLength)
+    {
+        Result result = { false, 0.0, 0 };
+        int fd = Connect(port);
+        if (fd < 0)
+        {
+            return result;
+        }
+
+        size_t baseline = ResidentKilobytes();
+        size_t peak = baseline;
+        auto start = std::chrono::steady_clock::now();
+
+        // The upload runs on its own thread while this one reads the echo
+        std::thread uploader([fd, bodyLength]
+        {
+            std::string head = "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/octet-stream\r\n"
+                "Content-Length: " + std::to_string(bodyLength) + "\r\n\r\n";
+            if (!SendAll(fd, head.data(), head.size()))
+            {
+                return;
+            }
+            for (uint64_t offset = 0; offset < bodyLength;)
+            {
+                size_t length = static_cast<size_t>(std::min<uint64_t>(IO_SIZE, bodyLength - offset));
+                if (!SendAll(fd, Pattern(offset), length))
+                {
+                    return;
+                }
+                offset += length;
+            }
+        });
+
+        ResponseReader reader(fd);
+        bool streamed = reader.Read(bodyLength, peak);
+        uploader.join();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.rssGrowthKilobytes = peak > baseline ? peak - baseline : 0;
+
+        // The connection must still frame requests after the streamed body
+        const char follow[] = "GET /after HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        result.ok = streamed && SendAll(fd, follow, sizeof(follow) - 1) && reader.Read(0, peak);
+        close(fd);
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string transports = "epoll,io_uring";
+    int port = 18081;
+    uint64_t megabytes = 100;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--transports") == 0)
+            transports = argv[i + 1];
+        else if (strcmp(argv[i], "--port") == 0)
+            port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--mb") == 0)
+            megabytes = strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    uint64_t bodyLength = megabytes * 1024 * 1024;
+    printf("Echoing a %llu MB POST body over loopback\n", static_cast<unsigned long long>(megabytes));
+    printf("%-10s %10s %10s %16s\n", "transport", "seconds", "MB/s", "RSS growth KB");
+
+    bool failed = false;
+    std::stringstream list(transports);
+    std::string name;
+    while (std::getline(list, name, ','))
+    {
+        ServerConfig config;
+        config.port = port;
+        config.workerThreads = 1;
+        config.transport = std::wstring(name.begin(), name.end());
+
+        EchoHandler handler;
+        std::unique_ptr<Transport> transport = CreateTransport(config);
+        if (!transport || !transport->Initialize() || !transport->Start(&handler))
+        {
+            printf("%-10s failed to start\n", name.c_str());
+            continue;
+        }
+
+        Result result = Run(port, bodyLength);
+        transport->Stop();
+
+        printf("%-10s %10.2f %10.0f %16zu%s\n", name.c_str(), result.seconds,
+            static_cast<double>(megabytes) / result.seconds, result.rssGrowthKilobytes,
+            result.ok ? "" : "  FAILED");
+        failed |= !result.ok;
+    }
+    return failed ? 1 : 0;
+}
\ No newline at end of file
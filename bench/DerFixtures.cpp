@@ -0,0 +1,289 @@
+#include "DerFixtures.h"
+#include "Der.h"
+#include <algorithm>
+#include <cstdio>
+
+const uint8_t KRB5_OID[9] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x12, 0x01, 0x02, 0x02 };
+const uint8_t SPNEGO_OID[6] = { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x02 };
+const uint8_t NTLM_OID[10] = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x02, 0x02, 0x0a };
+
+Bytes Tlv(uint8_t tag, const Bytes& contents)
+{
+    Bytes out;
+    out.push_back(tag);
+    size_t length = contents.size();
+    if (length < 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(length));
+    }
+    else
+    {
+        uint8_t digits[4];
+        int count = 0;
+        for (size_t rest = length; rest > 0; rest >>= 8)
+        {
+            digits[count++] = static_cast<uint8_t>(rest);
+        }
+        out.push_back(static_cast<uint8_t>(0x80 | count));
+        while (count > 0)
+        {
+            out.push_back(digits[--count]);
+        }
+    }
+    out.insert(out.end(), contents.begin(), contents.end());
+    return out;
+}
+
+Bytes Cat(std::initializer_list<Bytes> parts)
+{
+    Bytes out;
+    for (const Bytes& part : parts)
+    {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    return out;
+}
+
+Bytes Raw(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    return Bytes(bytes, bytes + length);
+}
+
+Bytes Integer(int64_t value)
+{
+    Bytes contents;
+    for (int shift = 56; shift >= 0; shift -= 8)
+    {
+        contents.push_back(static_cast<uint8_t>(value >> shift));
+    }
+    while (contents.size() > 1 &&
+        ((contents[0] == 0x00 && !(contents[1] & 0x80)) || (contents[0] == 0xff && (contents[1] & 0x80))))
+    {
+        contents.erase(contents.begin());
+    }
+    return Tlv(DerReader::INTEGER, contents);
+}
+
+Bytes Tagged(int number, const Bytes& element)
+{
+    return Tlv(DerReader::Context(number), element);
+}
+
+Bytes KerberosString(const std::string& text)
+{
+    return Tlv(DerReader::GENERAL_STRING, Raw(text.data(), text.size()));
+}
+
+Bytes KerberosTime(int64_t seconds)
+{
+    // Civil date from days since 1970 (Howard Hinnant's algorithm)
+    int64_t days = seconds / 86400;
+    int64_t rest = seconds % 86400;
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t dayOfEra = days - era * 146097;
+    int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+    int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    int64_t year = yearOfEra + era * 400 + (month <= 2);
+
+    // Fields reduced to their widths, so the compiler can see they fit
+    unsigned fields[6] = { static_cast<unsigned>((std::min)((std::max)(year, int64_t(0)), int64_t(9999))), static_cast<unsigned>(month),
+        static_cast<unsigned>(day), static_cast<unsigned>(rest / 3600), static_cast<unsigned>(rest / 60 % 60), static_cast<unsigned>(rest % 60) };
+    char text[16];
+    snprintf(text, sizeof(text), "%04u%02u%02u%02u%02u%02uZ", fields[0] % 10000, fields[1] % 100, fields[2] % 100,
+        fields[3] % 100, fields[4] % 100, fields[5] % 100);
+    return Tlv(DerReader::GENERALIZED_TIME, Raw(text, 15));
+}
+
+Bytes PrincipalName(int nameType, const std::vector<std::string>& components)
+{
+    Bytes names;
+    for (const std::string& component : components)
+    {
+        Bytes encoded = KerberosString(component);
+        names.insert(names.end(), encoded.begin(), encoded.end());
+    }
+    return Tlv(DerReader::SEQUENCE, Cat({ Tagged(0, Integer(nameType)), Tagged(1, Tlv(DerReader::SEQUENCE, names)) }));
+}
+
+Bytes EncryptedData(int32_t etype, int64_t kvno, const Bytes& cipher)
+{
+    Bytes fields = Tagged(0, Integer(etype));
+    if (kvno >= 0)
+    {
+        fields = Cat({ fields, Tagged(1, Integer(kvno)) });
+    }
+    return Tlv(DerReader::SEQUENCE, Cat({ fields, Tagged(2, Tlv(DerReader::OCTET_STRING, cipher)) }));
+}
+
+namespace
+{
+    // Little-endian NDR, aligned relative to the start of the buffer
+    struct NdrWriter
+    {
+        Bytes bytes;
+
+        void Align(size_t boundary)
+        {
+            while (bytes.size() % boundary != 0)
+            {
+                bytes.push_back(0);
+            }
+        }
+
+        void U16(uint16_t value)
+        {
+            Align(2);
+            bytes.push_back(static_cast<uint8_t>(value));
+            bytes.push_back(static_cast<uint8_t>(value >> 8));
+        }
+
+        void U32(uint32_t value)
+        {
+            Align(4);
+            for (int i = 0; i < 4; i++)
+            {
+                bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        void Zeros(size_t count) { bytes.insert(bytes.end(), count, 0); }
+
+        // RPC_UNICODE_STRING header; the buffer follows later with String
+        void StringHeader(const std::string& text, uint32_t pointer)
+        {
+            U16(static_cast<uint16_t>(text.size() * 2));
+            U16(static_cast<uint16_t>(text.size() * 2));
+            U32(text.empty() ? 0 : pointer);
+        }
+
+        void String(const std::string& text)
+        {
+            if (text.empty())
+            {
+                return;
+            }
+            U32(static_cast<uint32_t>(text.size()));
+            U32(0);
+            U32(static_cast<uint32_t>(text.size()));
+            for (char c : text)
+            {
+                U16(static_cast<uint8_t>(c));
+            }
+        }
+
+        // RPC_SID from "S-1-5-21-..."
+        void Sid(const std::string& text)
+        {
+            std::vector<uint64_t> parts;
+            for (size_t start = 2; start <= text.size();)
+            {
+                size_t dash = text.find('-', start);
+                parts.push_back(std::stoull(text.substr(start, dash - start)));
+                start = dash == std::string::npos ? text.size() + 1 : dash + 1;
+            }
+            U32(static_cast<uint32_t>(parts.size() - 2));
+            bytes.push_back(static_cast<uint8_t>(parts[0]));
+            bytes.push_back(static_cast<uint8_t>(parts.size() - 2));
+            for (int i = 5; i >= 0; i--)
+            {
+                bytes.push_back(static_cast<uint8_t>(parts[1] >> (8 * i)));
+            }
+            for (size_t i = 2; i < parts.size(); i++)
+            {
+                U32(static_cast<uint32_t>(parts[i]));
+            }
+        }
+    };
+}
+
+Bytes LogonInfoPac(const std::string& domainSid, uint32_t userRid, const std::vector<uint32_t>& groupRids,
+    const std::vector<std::string>& extraSids)
+{
+    const std::string userName = "alice";
+    const std::string logonServer = "DC1";
+    const std::string domainName = "EXAMPLE";
+    uint32_t pointer = 0x00020000;
+
+    // Common and private type headers, then the referent of the structure
+    NdrWriter info;
+    const uint8_t header[] = { 0x01, 0x10, 0x08, 0x00, 0xcc, 0xcc, 0xcc, 0xcc };
+    info.bytes.assign(header, header + sizeof(header));
+    info.U32(0);                                // object length, patched below
+    info.U32(0);
+    info.U32(pointer++);
+
+    // KERB_VALIDATION_INFO
+    info.Zeros(48);                             // logon, logoff, kickoff and password times
+    info.StringHeader(userName, pointer++);
+    for (int i = 0; i < 5; i++)
+    {
+        info.StringHeader(std::string(), 0);    // full name, script, profile, home directory and drive
+    }
+    info.U16(0);                                // LogonCount
+    info.U16(0);                                // BadPasswordCount
+    info.U32(userRid);
+    info.U32(513);                              // Domain Users
+    info.U32(static_cast<uint32_t>(groupRids.size()));
+    info.U32(groupRids.empty() ? 0 : pointer++);
+    info.U32(extraSids.empty() ? 0 : 0x20);     // UserFlags: LOGON_EXTRA_SIDS
+    info.Zeros(16);                             // UserSessionKey
+    info.StringHeader(logonServer, pointer++);
+    info.StringHeader(domainName, pointer++);
+    info.U32(pointer++);                        // LogonDomainId
+    info.Zeros(40);
+    info.U32(static_cast<uint32_t>(extraSids.size()));
+    info.U32(extraSids.empty() ? 0 : pointer++);
+    info.U32(0);                                // ResourceGroupDomainSid
+    info.U32(0);                                // ResourceGroupCount
+    info.U32(0);                                // ResourceGroupIds
+
+    // Deferred pointees in pointer order
+    info.String(userName);
+    if (!groupRids.empty())
+    {
+        info.U32(static_cast<uint32_t>(groupRids.size()));
+        for (uint32_t rid : groupRids)
+        {
+            info.U32(rid);
+            info.U32(7);                        // mandatory, enabled by default, enabled
+        }
+    }
+    info.String(logonServer);
+    info.String(domainName);
+    info.Sid(domainSid);
+    if (!extraSids.empty())
+    {
+        info.U32(static_cast<uint32_t>(extraSids.size()));
+        for (size_t i = 0; i < extraSids.size(); i++)
+        {
+            info.U32(pointer++);
+            info.U32(7);
+        }
+        for (const std::string& sid : extraSids)
+        {
+            info.Sid(sid);
+        }
+    }
+    info.Align(8);
+    uint32_t objectLength = static_cast<uint32_t>(info.bytes.size() - 16);
+    for (int i = 0; i < 4; i++)
+    {
+        info.bytes[8 + i] = static_cast<uint8_t>(objectLength >> (8 * i));
+    }
+
+    // PACTYPE with the one buffer
+    NdrWriter pac;
+    pac.U32(1);
+    pac.U32(0);
+    pac.U32(1);                                 // logon information
+    pac.U32(static_cast<uint32_t>(info.bytes.size()));
+    pac.U32(24);
+    pac.U32(0);
+    pac.bytes.insert(pac.bytes.end(), info.bytes.begin(), info.bytes.end());
+    return pac.bytes;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+// Forward DER encoding for benchmark fixtures: Kerberos and SPNEGO messages
+// built the way a KDC and a client build them, shared by the benchmarks that
+// feed tokens to the service's parsers.
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+
+// DER contents (without tag and length) of the mechanism OIDs
+extern const uint8_t KRB5_OID[9];
+extern const uint8_t SPNEGO_OID[6];
+extern const uint8_t NTLM_OID[10];
+
+Bytes Tlv(uint8_t tag, const Bytes& contents);
+Bytes Cat(std::initializer_list<Bytes> parts);
+Bytes Raw(const void* data, size_t length);
+Bytes Integer(int64_t value);
+
+// [number] EXPLICIT wrapper
+Bytes Tagged(int number, const Bytes& element);
+
+Bytes KerberosString(const std::string& text);
+
+// GeneralizedTime "YYYYMMDDHHMMSSZ" for seconds since 1970
+Bytes KerberosTime(int64_t seconds);
+
+Bytes PrincipalName(int nameType, const std::vector<std::string>& components);
+
+// EncryptedData; kvno below zero leaves it out
+Bytes EncryptedData(int32_t etype, int64_t kvno, const Bytes& cipher);
+
+// PAC (MS-PAC) with a logon information buffer for a user of domainSid
+// ("S-1-5-21-...") with userRid, the groups of that domain in groupRids and
+// extraSids; NDR-encoded the way a domain controller writes it
+Bytes LogonInfoPac(const std::string& domainSid, uint32_t userRid, const std::vector<uint32_t>& groupRids,
+    const std::vector<std::string>& extraSids);
\ No newline at end of file
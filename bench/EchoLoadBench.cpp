@@ -0,0 +1,23 @@
+// Keep-alive, pipelining load generator for the socket transports. Opens a
+// set of connections to the service, keeps a fixed number of small echo
+// requests in flight on each, and reports completed requests per second and
+// latency percentiles.
+//
+//   EchoLoadBench [--host 127.0.0.1] [--port 8080] [--connections 64]
+//                 [--pipeline 16] [--threads 1] [--seconds 10] [--path /]
+
+#include "LoadClient.h"
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    LoadOptions options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        ParseLoadOption(argv[i], argv[i + 1], options);
+    }
+
+    LoadResult result = RunLoad(options);
+    PrintLoadResult(options, result);
+    return 0;
+}
\ No newline at end of file
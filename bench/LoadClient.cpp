@@ -0,0 +1,274 @@
+#include "LoadClient.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct ClientConnection
+    {
+        int fd = -1;
+        std::string input;
+        std::deque<Clock::time_point> sentAt;   // one entry per request in flight
+    };
+
+    struct Totals
+    {
+        std::mutex mutex;
+        LoadResult result;
+    };
+
+    int Connect(const LoadOptions& options)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    bool SendAll(int fd, const std::string& data)
+    {
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            ssize_t sent = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // Consumes complete responses from the front of input; returns how many
+    size_t ConsumeResponses(std::string& input, std::map<int, uint64_t>& statuses, bool& malformed)
+    {
+        size_t count = 0;
+        size_t offset = 0;
+        for (;;)
+        {
+            size_t headEnd = input.find("\r\n\r\n", offset);
+            if (headEnd == std::string::npos)
+            {
+                break;
+            }
+
+            size_t lengthAt = input.find("Content-Length: ", offset);
+            if (lengthAt == std::string::npos || lengthAt > headEnd || input.compare(offset, 9, "HTTP/1.1 ") != 0)
+            {
+                malformed = true;
+                break;
+            }
+
+            size_t bodyLength = strtoul(input.c_str() + lengthAt + 16, nullptr, 10);
+            size_t total = headEnd + 4 + bodyLength;
+            if (input.size() < total)
+            {
+                break;
+            }
+
+            statuses[atoi(input.c_str() + offset + 9)]++;
+            offset = total;
+            count++;
+        }
+        input.erase(0, offset);
+        return count;
+    }
+
+    void SendRequests(ClientConnection& connection, const std::string& request, size_t count)
+    {
+        std::string burst;
+        burst.reserve(request.size() * count);
+        for (size_t i = 0; i < count; i++)
+        {
+            burst += request;
+        }
+
+        Clock::time_point now = Clock::now();
+        connection.sentAt.insert(connection.sentAt.end(), count, now);
+        SendAll(connection.fd, burst);
+    }
+
+    void ClientThread(const LoadOptions& options, int connectionCount, std::atomic<bool>& running, Totals& totals)
+    {
+        std::string request = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host +
+            "\r\nUser-Agent: LoadClient\r\n" + options.extraHeaders + "\r\n";
+
+        LoadResult local;
+        int epollFd = epoll_create1(0);
+        std::vector<ClientConnection> connections(connectionCount);
+        for (auto& connection : connections)
+        {
+            connection.fd = Connect(options);
+            if (connection.fd < 0)
+            {
+                local.errors++;
+                continue;
+            }
+
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = &connection;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, connection.fd, &event);
+            SendRequests(connection, request, options.pipeline);
+        }
+
+        std::vector<epoll_event> events(connectionCount + 1);
+        char buffer[65536];
+
+        while (running)
+        {
+            int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+            for (int i = 0; i < count; i++)
+            {
+                ClientConnection* connection = static_cast<ClientConnection*>(events[i].data.ptr);
+                ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                {
+                    local.errors++;
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+                    close(connection->fd);
+                    connection->fd = -1;
+                    continue;
+                }
+
+                connection->input.append(buffer, static_cast<size_t>(received));
+                bool malformed = false;
+                size_t done = ConsumeResponses(connection->input, local.statusCounts, malformed);
+                if (malformed)
+                {
+                    local.errors++;
+                }
+                if (done == 0)
+                {
+                    continue;
+                }
+
+                Clock::time_point now = Clock::now();
+                for (size_t r = 0; r < done && !connection->sentAt.empty(); r++)
+                {
+                    local.latencies.push_back(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(now - connection->sentAt.front()).count()));
+                    connection->sentAt.pop_front();
+                }
+                local.completed += done;
+
+                // Refill the pipeline with as many requests as just completed
+                SendRequests(*connection, request, done);
+            }
+        }
+
+        for (auto& connection : connections)
+        {
+            if (connection.fd >= 0)
+            {
+                close(connection.fd);
+            }
+        }
+        close(epollFd);
+
+        std::lock_guard<std::mutex> lock(totals.mutex);
+        totals.result.completed += local.completed;
+        totals.result.errors += local.errors;
+        for (const auto& entry : local.statusCounts)
+        {
+            totals.result.statusCounts[entry.first] += entry.second;
+        }
+        totals.result.latencies.insert(totals.result.latencies.end(), local.latencies.begin(), local.latencies.end());
+    }
+}
+
+double LoadResult::LatencyMicros(double fraction)
+{
+    if (latencies.empty())
+    {
+        return 0;
+    }
+    if (!m_sorted)
+    {
+        std::sort(latencies.begin(), latencies.end());
+        m_sorted = true;
+    }
+
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(latencies.size() - 1));
+    return static_cast<double>(latencies[index]) / 1000.0;
+}
+
+bool ParseLoadOption(const std::string& name, const char* value, LoadOptions& options)
+{
+    if (name == "--host") options.host = value;
+    else if (name == "--port") options.port = atoi(value);
+    else if (name == "--connections") options.connections = atoi(value);
+    else if (name == "--pipeline") options.pipeline = atoi(value);
+    else if (name == "--threads") options.threads = atoi(value);
+    else if (name == "--seconds") options.seconds = atoi(value);
+    else if (name == "--path") options.path = value;
+    else return false;
+    return true;
+}
+
+LoadResult RunLoad(const LoadOptions& options)
+{
+    Totals totals;
+    std::atomic<bool> running(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; t++)
+    {
+        int share = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+        threads.emplace_back(ClientThread, std::cref(options), share, std::ref(running), std::ref(totals));
+    }
+
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    running = false;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    totals.result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return std::move(totals.result);
+}
+
+void PrintLoadResult(const LoadOptions& options, LoadResult& result)
+{
+    printf("%d connections x %d pipelined, %d client threads, %.1f s\n",
+        options.connections, options.pipeline, options.threads, result.seconds);
+    printf("requests/sec: %.0f\n", result.RequestsPerSecond());
+    printf("latency us: p50 %.1f  p99 %.1f  p99.9 %.1f\n",
+        result.LatencyMicros(0.50), result.LatencyMicros(0.99), result.LatencyMicros(0.999));
+    for (const auto& entry : result.statusCounts)
+    {
+        printf("  HTTP %d: %llu\n", entry.first, static_cast<unsigned long long>(entry.second));
+    }
+    if (result.errors)
+    {
+        printf("  errors: %llu\n", static_cast<unsigned long long>(result.errors));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+// Keep-alive, pipelining HTTP load generator shared by the socket benchmarks.
+// Each client thread drives its share of the connections from one epoll
+// instance and keeps a fixed number of requests in flight on each.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct LoadOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 64;
+    int pipeline = 16;
+    int threads = 1;
+    int seconds = 10;
+    std::string path = "/";
+    std::string extraHeaders;       // appended verbatim, each line ending in \r\n
+};
+
+struct LoadResult
+{
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+    std::map<int, uint64_t> statusCounts;
+    std::vector<uint64_t> latencies;    // nanoseconds, one per completed request
+
+    double RequestsPerSecond() const { return seconds > 0 ? static_cast<double>(completed) / seconds : 0; }
+
+    // Sorts latencies on first use; fraction in [0, 1]
+    double LatencyMicros(double fraction);
+
+private:
+    bool m_sorted = false;
+};
+
+// Parses "--name value" pairs into options; unknown names are left to the caller
+bool ParseLoadOption(const std::string& name, const char* value, LoadOptions& options);
+
+LoadResult RunLoad(const LoadOptions& options);
+
+void PrintLoadResult(const LoadOptions& options, LoadResult& result);
\ No newline at end of file
@@ -0,0 +1,210 @@
+// Logger: checks that a burst past the thread's ring is counted as dropped
+// rather than lost silently, and that the limiter holds a repeated failure to
+// its rate and reports what it held back; then measures ns per line on the
+// calling thread against a synchronous stream flushed with std::endl, single
+// threaded and with every thread logging at once.
+
+#include "Log.h"
+#include "ServerConfig.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const char* LOG_PATH = "LogBench.log";
+
+    bool StartLog(unsigned sampleEvery, unsigned ratePerSecond)
+    {
+        ServerConfig config;
+        config.logSink = std::wstring(LOG_PATH, LOG_PATH + strlen(LOG_PATH));
+        config.logSampleEvery = sampleEvery;
+        config.logRatePerSecond = ratePerSecond;
+        remove(LOG_PATH);
+        return Log::Start(config, L"LogBench");
+    }
+
+    // Lines in the log file, and how many of them contain text
+    size_t CountLines(const char* text, size_t& matching)
+    {
+        std::ifstream in(LOG_PATH);
+        std::string line;
+        size_t lines = 0;
+        matching = 0;
+        while (std::getline(in, line))
+        {
+            lines++;
+            matching += line.find(text) != std::string::npos ? 1 : 0;
+        }
+        return lines;
+    }
+
+    bool CheckDrops()
+    {
+        if (!StartLog(1, 0))
+        {
+            printf("FAIL: could not open %s\n", LOG_PATH);
+            return false;
+        }
+
+        // Far more than one ring holds, faster than the consumer's interval
+        const size_t burst = Log::RING_SLOTS * 16;
+        for (size_t i = 0; i < burst; i++)
+        {
+            Log::Write(LogLevel::Info) << L"burst line " << i;
+        }
+        LogStats stats = Log::GetStats();
+        Log::Stop();
+
+        size_t reports = 0;
+        size_t lines = CountLines("Log buffers full", reports);
+        if (stats.dropped == 0 || reports == 0 || lines - reports + stats.dropped != burst)
+        {
+            printf("FAIL: %zu lines logged, %zu written, %llu counted as dropped, %zu drop reports\n", burst, lines - reports,
+                static_cast<unsigned long long>(stats.dropped), reports);
+            return false;
+        }
+        printf("%-34s %zu of %zu dropped, reported %zu times\n", "burst past one ring", static_cast<size_t>(stats.dropped),
+            burst, reports);
+        return true;
+    }
+
+    bool CheckLimiter()
+    {
+        const unsigned rate = 5;
+        if (!StartLog(2, rate))
+        {
+            printf("FAIL: could not open %s\n", LOG_PATH);
+            return false;
+        }
+
+        LogLimiter limiter;
+        const size_t attempts = 10000;
+        auto start = Clock::now();
+        for (size_t i = 0; i < attempts; i++)
+        {
+            Log::Write(LogLevel::Warning, limiter) << L"AcceptSecurityContext failed with error: 0x" << std::hex << 0x8009030cu;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        LogStats before = Log::GetStats();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        Log::Write(LogLevel::Warning, limiter) << L"AcceptSecurityContext failed with error: 0x" << std::hex << 0x8009030cu;
+        Log::Stop();
+
+        // Every call lands in at most two wall-clock seconds, each allowing rate lines
+        size_t carried = 0;
+        size_t lines = CountLines("similar suppressed", carried);
+        size_t allowed = rate * (static_cast<size_t>(seconds) + 2) + 1;
+        if (lines == 0 || lines > allowed || lines + before.suppressed < attempts || carried == 0)
+        {
+            printf("FAIL: %zu of %zu repeated lines written (at most %zu allowed), %llu suppressed, %zu carrying a count\n",
+                lines, attempts + 1, allowed, static_cast<unsigned long long>(before.suppressed), carried);
+            return false;
+        }
+        printf("%-34s %zu of %zu written, %llu suppressed\n", "one in 2, 5 per second", lines, attempts + 1,
+            static_cast<unsigned long long>(before.suppressed));
+        return true;
+    }
+
+    // ns per line on the calling thread, in bursts the ring can hold so the
+    // measurement never includes a drop
+    double LogNanosecondsPerLine(size_t lines)
+    {
+        const size_t burst = Log::RING_SLOTS / 2;
+        double nanoseconds = 0;
+        for (size_t done = 0; done < lines; done += burst)
+        {
+            auto start = Clock::now();
+            for (size_t i = 0; i < burst; i++)
+            {
+                Log::Write(LogLevel::Info) << L"Request " << done + i << L" from " << L"user@EXAMPLE.COM" << L" took "
+                    << 1234 << L" us";
+            }
+            nanoseconds += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            Log::Flush();
+        }
+        return nanoseconds / static_cast<double>(lines);
+    }
+
+    double StreamNanosecondsPerLine(size_t lines)
+    {
+        std::wofstream out("LogBench.stream.log");
+        auto start = Clock::now();
+        for (size_t i = 0; i < lines; i++)
+        {
+            out << L"Request " << i << L" from " << L"user@EXAMPLE.COM" << L" took " << 1234 << L" us" << std::endl;
+        }
+        double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        out.close();
+        remove("LogBench.stream.log");
+        return nanoseconds / static_cast<double>(lines);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t lines = 200000;
+    size_t threads = (std::max)(std::thread::hardware_concurrency(), 2u);
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--lines") == 0)
+        {
+            lines = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            threads = strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+    if (!CheckDrops() || !CheckLimiter())
+    {
+        return 1;
+    }
+    printf("Log checks passed\n\n");
+
+    if (!StartLog(1, 0))
+    {
+        printf("FAIL: could not open %s\n", LOG_PATH);
+        return 1;
+    }
+    LogStats start = Log::GetStats();
+
+    double single = LogNanosecondsPerLine(lines);
+    double stream = StreamNanosecondsPerLine(lines);
+    printf("%-34s %10s\n", "single thread", "ns/line");
+    printf("%-34s %10.1f\n", "Log::Write to a file", single);
+    printf("%-34s %10.1f\n", "wofstream with std::endl", stream);
+
+    std::vector<double> results(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t] { results[t] = LogNanosecondsPerLine(lines / threads); });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double total = 0;
+    for (double result : results)
+    {
+        total += result;
+    }
+    LogStats end = Log::GetStats();
+    Log::Stop();
+    remove(LOG_PATH);
+
+    printf("\n%zu threads logging at once       %10s\n", threads, "ns/line");
+    printf("%-34s %10.1f\n", "Log::Write to a file", total / static_cast<double>(threads));
+    printf("%-34s %10llu\n", "dropped", static_cast<unsigned long long>(end.dropped - start.dropped));
+    return 0;
+}
\ No newline at end of file
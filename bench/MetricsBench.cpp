@@ -0,0 +1,305 @@
+// Request metrics: checks the histogram bucket boundaries, percentiles and
+// the shared-memory snapshot, then measures ns per recorded event, single
+// threaded and with every thread recording at once against one histogram of
+// shared atomics. Fails if recording a latency costs more than 20 ns.
+
+#include "Metrics.h"
+#include "SharedMetrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr double MAX_RECORD_NANOSECONDS = 20.0;
+
+    bool CheckBuckets()
+    {
+        std::mt19937_64 random(42);
+        for (int i = 0; i < 1000000; i++)
+        {
+            // Small values exhaustively, then random magnitudes up to 2^40
+            uint64_t shift = 23 + random() % 40;
+            uint64_t value = i < 100000 ? static_cast<uint64_t>(i) : random() >> shift;
+            size_t index = Metrics::BucketIndex(value);
+            uint64_t upper = Metrics::BucketUpperBound(index);
+            if (index >= METRIC_BUCKET_COUNT || value > upper || (index > 0 && value <= Metrics::BucketUpperBound(index - 1)))
+            {
+                printf("FAIL: %llu landed in bucket %zu (upper bound %llu)\n", static_cast<unsigned long long>(value), index,
+                    static_cast<unsigned long long>(upper));
+                return false;
+            }
+            if (value >= METRIC_SUB_BUCKETS && static_cast<double>(upper - value) > static_cast<double>(value) / METRIC_SUB_BUCKETS)
+            {
+                printf("FAIL: bucket %zu overstates %llu by more than 1/%zu\n", index, static_cast<unsigned long long>(value),
+                    METRIC_SUB_BUCKETS);
+                return false;
+            }
+        }
+        if (Metrics::BucketIndex(UINT64_MAX) != METRIC_BUCKET_COUNT - 1)
+        {
+            printf("FAIL: values past 2^%zu ns are not clamped to the last bucket\n", METRIC_MAX_BIT);
+            return false;
+        }
+        return true;
+    }
+
+    bool CheckPercentiles()
+    {
+        // 1..100000 us uniformly: each quantile is known exactly
+        std::unique_ptr<HistogramSnapshot> histogram = std::make_unique<HistogramSnapshot>();
+        for (uint64_t us = 1; us <= 100000; us++)
+        {
+            histogram->buckets[Metrics::BucketIndex(us * 1000)]++;
+        }
+        for (double q : { 0.5, 0.99, 0.999 })
+        {
+            double expected = q * 100000 * 1000;
+            double reported = static_cast<double>(histogram->Percentile(q));
+            if (reported < expected * 0.99 || reported > expected * (1.0 + 1.0 / METRIC_SUB_BUCKETS) * 1.01)
+            {
+                printf("FAIL: p%g reported %.0f ns, expected about %.0f\n", q * 100, reported, expected);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Events from threads that have exited are still in the snapshot
+    bool CheckSnapshot()
+    {
+        std::unique_ptr<MetricsSnapshot> before = std::make_unique<MetricsSnapshot>(Metrics::Snapshot());
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([]
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    Metrics::Count(MetricCounter::Requests);
+                    Metrics::Record(MetricStage::Format, static_cast<uint64_t>(i));
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::unique_ptr<MetricsSnapshot> after = std::make_unique<MetricsSnapshot>(Metrics::Snapshot());
+        size_t format = static_cast<size_t>(MetricStage::Format);
+        uint64_t requests = after->counters[static_cast<size_t>(MetricCounter::Requests)] -
+            before->counters[static_cast<size_t>(MetricCounter::Requests)];
+        uint64_t recorded = after->stages[format].count - before->stages[format].count;
+        if (requests != 40000 || recorded != 40000)
+        {
+            printf("FAIL: 40000 events per metric, snapshot shows %llu requests and %llu records\n",
+                static_cast<unsigned long long>(requests), static_cast<unsigned long long>(recorded));
+            return false;
+        }
+
+        std::string text;
+        Metrics::FormatPrometheus(*after, text);
+        if (text.find("kerberos_echo_stage_duration_seconds_bucket{stage=\"format\",le=\"+Inf\"}") == std::string::npos)
+        {
+            printf("FAIL: Prometheus text has no format histogram\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool CheckSharedMemory()
+    {
+        std::wstring name = L"KerberosEchoMetricsBench" + std::to_wstring(static_cast<unsigned long long>(
+            std::chrono::system_clock::now().time_since_epoch().count() % 1000000));
+        Metrics::Count(MetricCounter::BytesSent, 12345);
+
+        SharedMetrics shared;
+        if (!shared.Start(name, 10))
+        {
+            printf("FAIL: could not create the shared-memory snapshot\n");
+            return false;
+        }
+
+        std::unique_ptr<MetricsSnapshot> local = std::make_unique<MetricsSnapshot>(Metrics::Snapshot());
+        std::unique_ptr<MetricsSnapshot> mapped = std::make_unique<MetricsSnapshot>();
+        bool read = SharedMetrics::Read(name, *mapped);
+        size_t sent = static_cast<size_t>(MetricCounter::BytesSent);
+        if (!read || mapped->counters[sent] != local->counters[sent])
+        {
+            printf("FAIL: shared-memory snapshot %s (%llu bytes sent, expected %llu)\n", read ? "differs" : "unreadable",
+                static_cast<unsigned long long>(mapped->counters[sent]), static_cast<unsigned long long>(local->counters[sent]));
+            return false;
+        }
+
+        // Readers racing the publisher get a snapshot every time, and never
+        // an older one than before
+        uint64_t failed = 0;
+        uint64_t backwards = 0;
+        uint64_t last = 0;
+        std::atomic<bool> writing(true);
+        std::thread writer([&writing]
+        {
+            while (writing.load(std::memory_order_relaxed))
+            {
+                Metrics::Count(MetricCounter::Requests);
+            }
+        });
+        for (int i = 0; i < 200; i++)
+        {
+            if (!SharedMetrics::Read(name, *mapped))
+            {
+                failed++;
+            }
+            else
+            {
+                uint64_t requests = mapped->counters[static_cast<size_t>(MetricCounter::Requests)];
+                backwards += requests < last ? 1 : 0;
+                last = requests;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        writing = false;
+        writer.join();
+        shared.Stop();
+
+        if (failed > 0 || backwards > 0)
+        {
+            printf("FAIL: %llu shared-memory reads failed, %llu went backwards\n", static_cast<unsigned long long>(failed),
+                static_cast<unsigned long long>(backwards));
+            return false;
+        }
+        if (SharedMetrics::Read(name, *mapped))
+        {
+            printf("FAIL: shared-memory snapshot still readable after Stop\n");
+            return false;
+        }
+        return true;
+    }
+
+    template <typename Body>
+    double NanosecondsPerEvent(uint64_t events, Body body)
+    {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < events; i++)
+        {
+            body(i);
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(events);
+    }
+
+    // What the per-thread shards avoid: one histogram every thread increments
+    struct SharedHistogram
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum{ 0 };
+        std::atomic<uint64_t> buckets[METRIC_BUCKET_COUNT] = {};
+    };
+
+    template <typename Body>
+    double ConcurrentNanosecondsPerEvent(size_t threadCount, uint64_t events, Body body)
+    {
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<double> results(threadCount);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, t]
+            {
+                ready.fetch_add(1);
+                while (!go.load())
+                {
+                    std::this_thread::yield();
+                }
+                results[t] = NanosecondsPerEvent(events, body);
+            });
+        }
+        while (ready.load() < threadCount)
+        {
+            std::this_thread::yield();
+        }
+        go = true;
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        double total = 0;
+        for (double result : results)
+        {
+            total += result;
+        }
+        return total / static_cast<double>(threadCount);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t events = 20000000;
+    size_t threads = (std::max)(std::thread::hardware_concurrency(), 2u);
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--events") == 0)
+        {
+            events = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            threads = strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+    if (!CheckBuckets() || !CheckPercentiles() || !CheckSnapshot() || !CheckSharedMemory())
+    {
+        return 1;
+    }
+    printf("Metrics checks passed\n\n");
+
+    // Latencies spread over a few hundred buckets, like real stage timings
+    auto latency = [](uint64_t i) { return (i * 2654435761u) % 5000000; };
+
+    double count = NanosecondsPerEvent(events, [](uint64_t) { Metrics::Count(MetricCounter::Requests); });
+    double record = NanosecondsPerEvent(events, [&](uint64_t i) { Metrics::Record(MetricStage::Accept, latency(i)); });
+    double timer = NanosecondsPerEvent(events / 10, [](uint64_t) { StageTimer timer(MetricStage::Principal); });
+    double clock = NanosecondsPerEvent(events / 10, [](uint64_t) { volatile auto now = Clock::now(); (void)now; });
+    printf("%-34s %10s\n", "single thread", "ns/event");
+    printf("%-34s %10.2f\n", "Count", count);
+    printf("%-34s %10.2f\n", "Record", record);
+    printf("%-34s %10.2f\n", "StageTimer (two clock reads)", timer);
+    printf("%-34s %10.2f\n", "steady_clock::now", clock);
+
+    std::unique_ptr<SharedHistogram> shared = std::make_unique<SharedHistogram>();
+    uint64_t perThread = events / threads;
+    double sharded = ConcurrentNanosecondsPerEvent(threads, perThread, [&](uint64_t i)
+    {
+        Metrics::Record(MetricStage::Accept, latency(i));
+    });
+    double atomic = ConcurrentNanosecondsPerEvent(threads, perThread, [&](uint64_t i)
+    {
+        uint64_t value = latency(i);
+        shared->buckets[Metrics::BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shared->count.fetch_add(1, std::memory_order_relaxed);
+        shared->sum.fetch_add(value, std::memory_order_relaxed);
+    });
+    printf("\n%zu threads recording at once     %10s\n", threads, "ns/event");
+    printf("%-34s %10.2f\n", "per-thread shards", sharded);
+    printf("%-34s %10.2f\n", "one histogram, atomic fetch_add", atomic);
+
+    if (record > MAX_RECORD_NANOSECONDS)
+    {
+        printf("\nFAIL: Record took %.2f ns, budget %.0f ns\n", record, MAX_RECORD_NANOSECONDS);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,705 @@
+// SPNEGO load generator: keep-alive connections that each run Negotiate
+// handshakes back to back, the way browsers on an intranet do. A handshake
+// is an anonymous request answered 401 with the challenge, the same request
+// with "Authorization: Negotiate <token>" answered 200, then optionally a
+// number of requests carrying the session cookie that 200 set.
+//
+// Tokens come from one of two places:
+//
+//   mock     MockAuthProvider tokens for --users principals, for a service run
+//            with -auth mock; no KDC needed. --fresh 1 gives every handshake
+//            a token of its own (a token cache miss and a provider leg each);
+//            --fresh 0 reuses one token per user, as clients do while their
+//            ticket is valid.
+//   gssapi   real SPNEGO from gss_init_sec_context for --spn, with mutual
+//            authentication checked against the server's final token; needs
+//            a credential cache (kinit, or test-gssapi.sh's throwaway KDC)
+//
+//   NegotiateLoadBench [--host 127.0.0.1] [--port 8080] [--connections 64]
+//                      [--threads 1] [--seconds 10] [--path /]
+//                      [--mode mock] [--users 1000] [--fresh 1] [--token-bytes 3072]
+//                      [--session-requests 0] [--spn HTTP@localhost]
+
+#include "Base64.h"
+#include "MockAuthProvider.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifdef KERBEROS_ECHO_HAVE_GSSAPI
+#include <gssapi/gssapi.h>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        int connections = 64;
+        int threads = 1;
+        int seconds = 10;
+        std::string path = "/";
+        std::string mode = "mock";
+        unsigned users = 1000;
+        bool fresh = true;
+        size_t tokenBytes = 3072;
+        int sessionRequests = 0;
+        std::string spn = "HTTP@localhost";
+    };
+
+    // Round trips of a handshake, timed separately
+    enum class Phase
+    {
+        Challenge,      // anonymous request, expecting 401 Negotiate
+        Negotiate,      // a leg carrying a token, expecting 200 (or 401 with another leg)
+        Session         // cookie request after the handshake, expecting 200
+    };
+
+    constexpr int PHASE_COUNT = 3;
+    const char* const PHASE_NAMES[PHASE_COUNT] = { "challenge", "negotiate", "session" };
+
+    struct Response
+    {
+        int status = 0;
+        std::string_view negotiate;     // token of "WWW-Authenticate: Negotiate <token>", if any
+        bool challenged = false;        // WWW-Authenticate: Negotiate present
+        std::string_view cookie;        // name=value of Set-Cookie, if any
+    };
+
+    struct Counts
+    {
+        uint64_t handshakes = 0;        // completed with a 200
+        uint64_t requests = 0;
+        uint64_t legs = 0;              // tokens sent
+        uint64_t unexpected = 0;        // a status or header the phase did not expect
+        uint64_t mutualFailed = 0;      // the server's final token did not verify
+        uint64_t disconnects = 0;
+        std::map<int, uint64_t> statuses;
+        std::vector<uint64_t> latencies[PHASE_COUNT];   // ns per round trip
+        std::vector<uint64_t> handshakeLatencies;       // challenge sent to 200 received
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        Phase phase = Phase::Challenge;
+        int sessionLeft = 0;
+        uint64_t user = 0;
+        std::string input;
+        std::string cookie;
+        Clock::time_point sentAt;
+        Clock::time_point handshakeStart;
+#ifdef KERBEROS_ECHO_HAVE_GSSAPI
+        gss_ctx_id_t context = GSS_C_NO_CONTEXT;
+#endif
+    };
+
+    // Hands out first legs and answers the server's tokens
+    class TokenSource
+    {
+    public:
+        virtual ~TokenSource() = default;
+
+        // Base64 first leg of a new handshake on the connection; false on failure
+        virtual bool Begin(Connection& connection, std::string& token) = 0;
+
+        // serverToken came with a 401 (complete false: the next leg goes in
+        // token) or with the 200 (complete true: mutual authentication).
+        virtual bool Continue(Connection& connection, std::string_view serverToken, bool complete, std::string& token) = 0;
+
+        virtual void End(Connection&) {}
+    };
+
+    class MockTokens : public TokenSource
+    {
+    public:
+        explicit MockTokens(const Options& options)
+            : m_options(options)
+            , m_nonce(0)
+        {
+            if (!options.fresh)
+            {
+                for (unsigned user = 0; user < options.users; user++)
+                {
+                    std::string token = MockAuthProvider::BuildToken(Principal(user), 0, options.tokenBytes);
+                    m_tokens.push_back(Base64::Encode(token.data(), token.size()));
+                }
+            }
+        }
+
+        bool Begin(Connection& connection, std::string& token) override
+        {
+            if (!m_options.fresh)
+            {
+                token = m_tokens[connection.user];
+                return true;
+            }
+
+            uint64_t nonce = m_nonce.fetch_add(1, std::memory_order_relaxed) + 1;
+            std::string raw = MockAuthProvider::BuildToken(Principal(connection.user), nonce, m_options.tokenBytes);
+            token = Base64::Encode(raw.data(), raw.size());
+            return !raw.empty();
+        }
+
+        // The mock provider finishes in one leg and sends nothing back
+        bool Continue(Connection&, std::string_view serverToken, bool complete, std::string&) override
+        {
+            return complete && serverToken.empty();
+        }
+
+    private:
+        static std::string Principal(uint64_t user)
+        {
+            return "user" + std::to_string(user) + "@" + MockAuthProvider::REALM;
+        }
+
+        const Options& m_options;
+        std::vector<std::string> m_tokens;      // per user, when tokens are reused
+        std::atomic<uint64_t> m_nonce;
+    };
+
+#ifdef KERBEROS_ECHO_HAVE_GSSAPI
+    class GssapiTokens : public TokenSource
+    {
+    public:
+        GssapiTokens()
+            : m_target(GSS_C_NO_NAME)
+        {
+        }
+
+        ~GssapiTokens() override
+        {
+            OM_uint32 minor = 0;
+            if (m_target != GSS_C_NO_NAME)
+            {
+                gss_release_name(&minor, &m_target);
+            }
+        }
+
+        bool Initialize(const std::string& spn)
+        {
+            OM_uint32 minor = 0;
+            gss_buffer_desc name = { spn.size(), const_cast<char*>(spn.data()) };
+            return gss_import_name(&minor, &name, GSS_C_NT_HOSTBASED_SERVICE, &m_target) == GSS_S_COMPLETE;
+        }
+
+        bool Begin(Connection& connection, std::string& token) override
+        {
+            End(connection);
+            OM_uint32 status = Step(connection, std::string_view(), token);
+            return status == GSS_S_COMPLETE || status == GSS_S_CONTINUE_NEEDED;
+        }
+
+        bool Continue(Connection& connection, std::string_view serverToken, bool complete, std::string& token) override
+        {
+            if (serverToken.empty())
+            {
+                return false;
+            }
+            OM_uint32 status = Step(connection, serverToken, token);
+            return complete ? status == GSS_S_COMPLETE : (status == GSS_S_CONTINUE_NEEDED && !token.empty());
+        }
+
+        void End(Connection& connection) override
+        {
+            OM_uint32 minor = 0;
+            if (connection.context != GSS_C_NO_CONTEXT)
+            {
+                gss_delete_sec_context(&minor, &connection.context, GSS_C_NO_BUFFER);
+            }
+        }
+
+    private:
+        OM_uint32 Step(Connection& connection, std::string_view serverToken, std::string& token)
+        {
+            static gss_OID_desc spnego = { 6, const_cast<char*>("\x2b\x06\x01\x05\x05\x02") };
+
+            std::vector<unsigned char> decoded(Base64::DecodedMaxLength(serverToken.size()));
+            size_t decodedLength = 0;
+            if (!serverToken.empty() && !Base64::Decode(serverToken, decoded.data(), decodedLength))
+            {
+                return GSS_S_DEFECTIVE_TOKEN;
+            }
+
+            gss_buffer_desc input = { decodedLength, decoded.data() };
+            gss_buffer_desc output = GSS_C_EMPTY_BUFFER;
+            OM_uint32 minor = 0;
+            OM_uint32 status = gss_init_sec_context(&minor, GSS_C_NO_CREDENTIAL, &connection.context, m_target, &spnego,
+                GSS_C_MUTUAL_FLAG, 0, GSS_C_NO_CHANNEL_BINDINGS, serverToken.empty() ? GSS_C_NO_BUFFER : &input,
+                nullptr, &output, nullptr, nullptr);
+
+            token = output.length ? Base64::Encode(output.value, output.length) : std::string();
+            gss_release_buffer(&minor, &output);
+            return status;
+        }
+
+        gss_name_t m_target;
+    };
+#endif
+
+    int Connect(const Options& options)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    bool SendAll(int fd, const std::string& data)
+    {
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            ssize_t sent = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // Value of the first header called name in head, or an empty view
+    std::string_view FindHeader(std::string_view head, std::string_view name)
+    {
+        size_t at = 0;
+        while ((at = head.find("\r\n", at)) != std::string_view::npos)
+        {
+            at += 2;
+            if (head.size() - at > name.size() && strncasecmp(head.data() + at, name.data(), name.size()) == 0 &&
+                head[at + name.size()] == ':')
+            {
+                size_t start = head.find_first_not_of(' ', at + name.size() + 1);
+                size_t end = head.find("\r\n", at);
+                return start < end ? head.substr(start, end - start) : std::string_view();
+            }
+        }
+        return std::string_view();
+    }
+
+    // Parses the response at the front of input; returns its length, or 0
+    // while it is incomplete. malformed is set for anything else.
+    size_t ParseResponse(const std::string& input, Response& response, bool& malformed)
+    {
+        size_t headEnd = input.find("\r\n\r\n");
+        if (headEnd == std::string::npos)
+        {
+            return 0;
+        }
+
+        std::string_view head(input.data(), headEnd + 2);
+        std::string_view length = FindHeader(head, "Content-Length");
+        if (head.substr(0, 9) != "HTTP/1.1 " || length.empty())
+        {
+            malformed = true;
+            return 0;
+        }
+
+        size_t total = headEnd + 4 + strtoul(length.data(), nullptr, 10);
+        if (input.size() < total)
+        {
+            return 0;
+        }
+
+        response.status = atoi(input.c_str() + 9);
+        std::string_view challenge = FindHeader(head, "WWW-Authenticate");
+        response.challenged = challenge.substr(0, 9) == "Negotiate";
+        response.negotiate = challenge.size() > 10 ? challenge.substr(10) : std::string_view();
+        std::string_view cookie = FindHeader(head, "Set-Cookie");
+        response.cookie = cookie.substr(0, cookie.find(';'));
+        return total;
+    }
+
+    class Client
+    {
+    public:
+        Client(const Options& options, TokenSource& tokens, std::atomic<uint64_t>& nextUser)
+            : m_options(options)
+            , m_tokens(tokens)
+            , m_nextUser(nextUser)
+            , m_epoll(epoll_create1(0))
+        {
+        }
+
+        void Run(int connectionCount, const std::atomic<bool>& running)
+        {
+            m_connections.resize(connectionCount);
+            for (auto& connection : m_connections)
+            {
+                Open(connection);
+            }
+
+            std::vector<epoll_event> events(connectionCount + 1);
+            char buffer[65536];
+            while (running)
+            {
+                int count = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), 100);
+                for (int i = 0; i < count; i++)
+                {
+                    Connection& connection = *static_cast<Connection*>(events[i].data.ptr);
+                    ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+                    if (received <= 0)
+                    {
+                        Reopen(connection);
+                        continue;
+                    }
+
+                    connection.input.append(buffer, static_cast<size_t>(received));
+                    Response response;
+                    bool malformed = false;
+                    size_t length = ParseResponse(connection.input, response, malformed);
+                    if (malformed)
+                    {
+                        m_counts.unexpected++;
+                        Reopen(connection);
+                    }
+                    else if (length > 0)
+                    {
+                        // One request is in flight per connection, so nothing follows it
+                        OnResponse(connection, response);
+                        connection.input.erase(0, length);
+                    }
+                }
+            }
+
+            for (auto& connection : m_connections)
+            {
+                Close(connection);
+            }
+            close(m_epoll);
+        }
+
+        Counts& GetCounts() { return m_counts; }
+
+    private:
+        void Open(Connection& connection)
+        {
+            connection.fd = Connect(m_options);
+            if (connection.fd < 0)
+            {
+                m_counts.disconnects++;
+                return;
+            }
+
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = &connection;
+            epoll_ctl(m_epoll, EPOLL_CTL_ADD, connection.fd, &event);
+            StartHandshake(connection);
+        }
+
+        void Close(Connection& connection)
+        {
+            m_tokens.End(connection);
+            if (connection.fd >= 0)
+            {
+                close(connection.fd);
+                connection.fd = -1;
+            }
+            connection.input.clear();
+        }
+
+        void Reopen(Connection& connection)
+        {
+            m_counts.disconnects++;
+            Close(connection);
+            Open(connection);
+        }
+
+        void StartHandshake(Connection& connection)
+        {
+            connection.user = m_nextUser.fetch_add(1, std::memory_order_relaxed) % m_options.users;
+            connection.cookie.clear();
+            connection.phase = Phase::Challenge;
+            connection.handshakeStart = Clock::now();
+            Send(connection, std::string_view(), std::string_view());
+        }
+
+        void SendLeg(Connection& connection, const std::string& token)
+        {
+            m_counts.legs++;
+            connection.phase = Phase::Negotiate;
+            Send(connection, "Authorization: Negotiate ", token);
+        }
+
+        void Send(Connection& connection, std::string_view name, std::string_view value)
+        {
+            m_request.assign("GET ").append(m_options.path).append(" HTTP/1.1\r\nHost: ").append(m_options.host);
+            m_request.append("\r\nUser-Agent: NegotiateLoadBench\r\n");
+            if (!name.empty())
+            {
+                m_request.append(name).append(value).append("\r\n");
+            }
+            m_request.append("\r\n");
+
+            connection.sentAt = Clock::now();
+            if (!SendAll(connection.fd, m_request))
+            {
+                Reopen(connection);
+            }
+        }
+
+        void OnResponse(Connection& connection, const Response& response)
+        {
+            Clock::time_point now = Clock::now();
+            m_counts.requests++;
+            m_counts.statuses[response.status]++;
+            m_counts.latencies[static_cast<int>(connection.phase)].push_back(Nanoseconds(connection.sentAt, now));
+
+            std::string token;
+            switch (connection.phase)
+            {
+            case Phase::Challenge:
+                if (response.status != 401 || !response.challenged)
+                {
+                    m_counts.unexpected++;
+                    StartHandshake(connection);
+                }
+                else if (!m_tokens.Begin(connection, token))
+                {
+                    m_counts.mutualFailed++;
+                    StartHandshake(connection);
+                }
+                else
+                {
+                    SendLeg(connection, token);
+                }
+                return;
+
+            case Phase::Negotiate:
+                if (response.status == 401 && !response.negotiate.empty())
+                {
+                    // Another leg
+                    if (m_tokens.Continue(connection, response.negotiate, false, token))
+                    {
+                        SendLeg(connection, token);
+                    }
+                    else
+                    {
+                        m_counts.mutualFailed++;
+                        StartHandshake(connection);
+                    }
+                    return;
+                }
+                if (response.status != 200)
+                {
+                    m_counts.unexpected++;
+                    StartHandshake(connection);
+                    return;
+                }
+                if (!m_tokens.Continue(connection, response.negotiate, true, token))
+                {
+                    m_counts.mutualFailed++;
+                }
+                m_tokens.End(connection);
+                m_counts.handshakes++;
+                m_counts.handshakeLatencies.push_back(Nanoseconds(connection.handshakeStart, now));
+                connection.cookie.assign(response.cookie.data(), response.cookie.size());
+                connection.sessionLeft = connection.cookie.empty() ? 0 : m_options.sessionRequests;
+                break;
+
+            case Phase::Session:
+                if (response.status != 200)
+                {
+                    m_counts.unexpected++;
+                    connection.sessionLeft = 0;
+                }
+                break;
+            }
+
+            if (connection.sessionLeft > 0)
+            {
+                connection.sessionLeft--;
+                connection.phase = Phase::Session;
+                Send(connection, "Cookie: ", connection.cookie);
+                return;
+            }
+            StartHandshake(connection);
+        }
+
+        static uint64_t Nanoseconds(Clock::time_point from, Clock::time_point to)
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+        }
+
+        const Options& m_options;
+        TokenSource& m_tokens;
+        std::atomic<uint64_t>& m_nextUser;
+        int m_epoll;
+        std::vector<Connection> m_connections;
+        std::string m_request;
+        Counts m_counts;
+    };
+
+    double Percentile(std::vector<uint64_t>& values, double fraction)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return static_cast<double>(values[index]) / 1000.0;
+    }
+
+    void PrintLatencies(const char* name, std::vector<uint64_t>& values)
+    {
+        if (values.empty())
+        {
+            return;
+        }
+        printf("  %-10s %9zu   p50 %8.1f  p99 %8.1f  p99.9 %8.1f\n", name, values.size(),
+            Percentile(values, 0.50), Percentile(values, 0.99), Percentile(values, 0.999));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        const char* value = argv[i + 1];
+        if (name == "--host") options.host = value;
+        else if (name == "--port") options.port = atoi(value);
+        else if (name == "--connections") options.connections = atoi(value);
+        else if (name == "--threads") options.threads = atoi(value);
+        else if (name == "--seconds") options.seconds = atoi(value);
+        else if (name == "--path") options.path = value;
+        else if (name == "--mode") options.mode = value;
+        else if (name == "--users") options.users = static_cast<unsigned>(atoi(value));
+        else if (name == "--fresh") options.fresh = atoi(value) != 0;
+        else if (name == "--token-bytes") options.tokenBytes = static_cast<size_t>(atoi(value));
+        else if (name == "--session-requests") options.sessionRequests = atoi(value);
+        else if (name == "--spn") options.spn = value;
+    }
+    if (options.users == 0)
+    {
+        options.users = 1;
+    }
+    if (options.threads < 1)
+    {
+        options.threads = 1;
+    }
+
+    std::unique_ptr<TokenSource> tokens;
+    if (options.mode == "mock")
+    {
+        tokens = std::make_unique<MockTokens>(options);
+    }
+#ifdef KERBEROS_ECHO_HAVE_GSSAPI
+    else if (options.mode == "gssapi")
+    {
+        auto gssapi = std::make_unique<GssapiTokens>();
+        if (!gssapi->Initialize(options.spn))
+        {
+            printf("FAIL: cannot import service name %s\n", options.spn.c_str());
+            return 1;
+        }
+        tokens = std::move(gssapi);
+    }
+#endif
+    else
+    {
+        printf("FAIL: unknown or unavailable mode %s\n", options.mode.c_str());
+        return 1;
+    }
+
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> nextUser(0);
+    std::vector<std::unique_ptr<Client>> clients;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; t++)
+    {
+        int share = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+        clients.push_back(std::make_unique<Client>(options, *tokens, nextUser));
+        threads.emplace_back(&Client::Run, clients.back().get(), share, std::cref(running));
+    }
+
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    running = false;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Counts total;
+    for (auto& client : clients)
+    {
+        Counts& counts = client->GetCounts();
+        total.handshakes += counts.handshakes;
+        total.requests += counts.requests;
+        total.legs += counts.legs;
+        total.unexpected += counts.unexpected;
+        total.mutualFailed += counts.mutualFailed;
+        total.disconnects += counts.disconnects;
+        for (const auto& entry : counts.statuses)
+        {
+            total.statuses[entry.first] += entry.second;
+        }
+        for (int phase = 0; phase < PHASE_COUNT; phase++)
+        {
+            total.latencies[phase].insert(total.latencies[phase].end(), counts.latencies[phase].begin(), counts.latencies[phase].end());
+        }
+        total.handshakeLatencies.insert(total.handshakeLatencies.end(), counts.handshakeLatencies.begin(), counts.handshakeLatencies.end());
+    }
+
+    printf("%s tokens, %d connections, %d client threads, %.1f s\n", options.mode.c_str(), options.connections, options.threads, seconds);
+    if (options.mode == "mock")
+    {
+        printf("%u users, %s tokens of %zu bytes, %d session requests per handshake\n", options.users,
+            options.fresh ? "fresh" : "reused", options.tokenBytes, options.sessionRequests);
+    }
+    printf("handshakes/sec: %.0f\n", static_cast<double>(total.handshakes) / seconds);
+    printf("requests/sec:   %.0f\n", static_cast<double>(total.requests) / seconds);
+    printf("latency us:       count\n");
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        PrintLatencies(PHASE_NAMES[phase], total.latencies[phase]);
+    }
+    PrintLatencies("handshake", total.handshakeLatencies);
+    for (const auto& entry : total.statuses)
+    {
+        printf("  HTTP %d: %llu\n", entry.first, static_cast<unsigned long long>(entry.second));
+    }
+    printf("  legs sent: %llu\n", static_cast<unsigned long long>(total.legs));
+    if (total.unexpected || total.mutualFailed || total.disconnects)
+    {
+        printf("  unexpected responses: %llu, token failures: %llu, reconnects: %llu\n",
+            static_cast<unsigned long long>(total.unexpected), static_cast<unsigned long long>(total.mutualFailed),
+            static_cast<unsigned long long>(total.disconnects));
+    }
+    return total.handshakes > 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+// Principal interning at full cardinality. Threads intern --principals names
+// concurrently, each in its own order, and every thread must get the same ID
+// for a name, with IDs dense from 1; the columns are then checked against the
+// names, and a full table must refuse newcomers while still finding known
+// names. Reports ns per intern of a known name (once per authentication), per
+// request update (Touch, once per request), for the busiest-principal scan,
+// and the table's memory per principal from the process's resident size.
+//
+//   PrincipalTableBench [--principals 100000] [--threads 4] [--touches 10000000]
+
+#include "PrincipalTable.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fstream>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Resident set size in bytes; 0 where it cannot be read
+    size_t ResidentBytes()
+    {
+#ifndef _WIN32
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, 6, "VmRSS:") == 0)
+            {
+                return static_cast<size_t>(atoll(line.c_str() + 6)) * 1024;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    std::string Name(size_t i)
+    {
+        static const char* realms[] = { "EXAMPLE.COM", "CORP.EXAMPLE.COM", "PARTNER.ORG", "LEGACY.EXAMPLE.COM" };
+        return "svc-account-" + std::to_string(i) + "@" + realms[i % 4];
+    }
+
+    double NanosPer(Clock::time_point start, size_t count)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = 100000;
+    size_t threads = 4;
+    size_t touches = 10000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        if (name == "--principals") count = static_cast<size_t>(atoll(argv[i + 1]));
+        else if (name == "--threads") threads = static_cast<size_t>(atoi(argv[i + 1]));
+        else if (name == "--touches") touches = static_cast<size_t>(atoll(argv[i + 1]));
+    }
+    printf("%zu principals, %zu threads\n", count, threads);
+
+    std::vector<std::string> names(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = Name(i);
+    }
+
+    int failures = 0;
+    size_t before = ResidentBytes();
+    PrincipalTable table(count);
+
+    // Concurrent first sight: every thread interns every name in its own order
+    std::vector<std::vector<uint32_t>> ids(threads, std::vector<uint32_t>(count));
+    std::vector<std::thread> workers;
+    auto start = Clock::now();
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+        {
+            std::vector<size_t> order(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                order[i] = i;
+            }
+            std::shuffle(order.begin(), order.end(), std::mt19937(static_cast<uint32_t>(t)));
+            for (size_t i : order)
+            {
+                ids[t][i] = table.Intern(names[i]);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double internNanos = NanosPer(start, count * threads);
+    size_t after = ResidentBytes();
+
+    std::vector<bool> seen(count + 1, false);
+    size_t mismatched = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t id = ids[0][i];
+        for (size_t t = 1; t < threads; t++)
+        {
+            mismatched += ids[t][i] != id;
+        }
+        if (id == PrincipalTable::NO_PRINCIPAL || id > count || seen[id] || table.Name(id) != names[i])
+        {
+            mismatched++;
+            continue;
+        }
+        seen[id] = true;
+    }
+    if (mismatched > 0 || table.Size() != count)
+    {
+        printf("FAIL: %zu names without one ID of their own, %zu interned\n", mismatched, table.Size());
+        return 1;
+    }
+
+    // Columns
+    uint32_t first = ids[0][1];
+    if (table.Realm(first) != "CORP.EXAMPLE.COM" || table.DisplayName(first) != "svc-account-1" ||
+        table.RealmId(first) == table.RealmId(ids[0][2]) || table.RealmId(first) != table.RealmId(ids[0][5]) ||
+        table.GetStats().realms != 4)
+    {
+        printf("FAIL: realm or display name columns\n");
+        failures++;
+    }
+    PrincipalTable domain(2);
+    uint32_t sspi = domain.Intern("EXAMPLE\\alice");
+    if (domain.Realm(sspi) != "EXAMPLE" || domain.DisplayName(sspi) != "alice")
+    {
+        printf("FAIL: DOMAIN\\user realm or display name\n");
+        failures++;
+    }
+
+    // A full table refuses newcomers and still knows everyone it holds
+    if (table.Intern("newcomer@EXAMPLE.COM") != PrincipalTable::NO_PRINCIPAL || table.GetStats().refused != 1 ||
+        table.Intern(names[count / 2]) != ids[0][count / 2] || table.Find("newcomer@EXAMPLE.COM") != PrincipalTable::NO_PRINCIPAL)
+    {
+        printf("FAIL: a full table did not refuse a newcomer\n");
+        failures++;
+    }
+
+    // Group sets expire
+    uint64_t groups[1] = { 1 };
+    Clock::time_point now = Clock::now();
+    table.SetGroups(first, groups, now + std::chrono::seconds(1));
+    if (table.Groups(first, now) != groups || table.Groups(first, now + std::chrono::seconds(1)) != nullptr ||
+        table.Groups(ids[0][2], now) != nullptr)
+    {
+        printf("FAIL: group set column\n");
+        failures++;
+    }
+
+    // Known names, as every authentication after the first interns them
+    std::mt19937 random(23);
+    std::vector<uint32_t> picks(1 << 16);
+    for (uint32_t& pick : picks)
+    {
+        pick = static_cast<uint32_t>(random() % count);
+    }
+    start = Clock::now();
+    uint64_t sink = 0;
+    for (size_t i = 0; i < 1000000; i++)
+    {
+        sink += table.Intern(names[picks[i & (picks.size() - 1)]]);
+    }
+    double knownNanos = NanosPer(start, 1000000);
+
+    // Per-request updates from every thread, over the whole population
+    std::atomic<uint64_t> total(0);
+    workers.clear();
+    start = Clock::now();
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+        {
+            Clock::time_point when = Clock::now();
+            size_t share = touches / threads;
+            for (size_t i = 0; i < share; i++)
+            {
+                table.Touch(ids[0][picks[(i + t * 7919) & (picks.size() - 1)]], when);
+            }
+            total.fetch_add(share);
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double touchNanos = NanosPer(start, total.load()) * static_cast<double>(threads);
+
+    uint64_t requests = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        requests += table.Requests(ids[0][i]);
+    }
+    start = Clock::now();
+    uint32_t busiest = table.Busiest();
+    double scanMicros = NanosPer(start, 1) / 1000;
+    if (requests != total.load() || busiest == PrincipalTable::NO_PRINCIPAL || table.LastSeen(busiest) == Clock::time_point())
+    {
+        printf("FAIL: %llu requests counted of %llu\n", static_cast<unsigned long long>(requests),
+            static_cast<unsigned long long>(total.load()));
+        failures++;
+    }
+
+    printf("  first intern:  %8.1f ns (%zu threads)\n", internNanos, threads);
+    printf("  known intern:  %8.1f ns\n", knownNanos);
+    printf("  touch:         %8.1f ns per thread\n", touchNanos);
+    printf("  busiest scan:  %8.1f us over %zu principals (%s, %llu requests)\n", scanMicros, count,
+        std::string(table.Name(busiest)).c_str(), static_cast<unsigned long long>(table.Requests(busiest)));
+    if (after > before)
+    {
+        printf("  memory:        %8.1f bytes per principal\n", static_cast<double>(after - before) / static_cast<double>(count));
+    }
+
+    if (failures > 0 || sink == 0)
+    {
+        return 1;
+    }
+    printf("OK: %zu principals interned once each across %zu threads\n", count, threads);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,409 @@
+// Per-principal quotas at full cardinality. Checks that a principal's requests
+// in progress stop at its concurrency, also with threads racing on one
+// principal, that the sliding window admits its rate, carries the weighted
+// previous window across the boundary and forgets an idle one, that a quota
+// is matched on the principal's name, its realm and its SIDs in the file's
+// order (name and realm only for a session), that a reload takes effect with
+// requests still in progress, and that quota lines parse. Reports ns per
+// check and release over --principals interned principals, on one thread and
+// on --threads, and the memory the quotas take per principal.
+//
+//   QuotaBench [--principals 100000] [--threads 4] [--checks 4000000]
+
+#include "Limits.h"
+#include "PrincipalQuotas.h"
+#include "PrincipalTable.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fstream>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Resident set size in bytes; 0 where it cannot be read
+    size_t ResidentBytes()
+    {
+#ifndef _WIN32
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, 6, "VmRSS:") == 0)
+            {
+                return static_cast<size_t>(atoll(line.c_str() + 6)) * 1024;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    double NanosPer(Clock::time_point start, size_t count)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+    }
+
+    // Admitted of attempts, released at once when release is set
+    size_t CountAdmitted(PrincipalQuotas& quotas, uint32_t principal, const std::vector<std::string>* sids, Clock::time_point now,
+        size_t attempts, bool release)
+    {
+        size_t admitted = 0;
+        for (size_t i = 0; i < attempts; i++)
+        {
+            if (quotas.Acquire(principal, sids, now) == QuotaDecision::Admit)
+            {
+                admitted++;
+                if (release)
+                {
+                    quotas.Release(principal);
+                }
+            }
+        }
+        return admitted;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = 100000;
+    size_t threads = 4;
+    size_t checks = 4000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string name = argv[i];
+        if (name == "--principals") count = static_cast<size_t>(atoll(argv[i + 1]));
+        else if (name == "--threads") threads = static_cast<size_t>(atoi(argv[i + 1]));
+        else if (name == "--checks") checks = static_cast<size_t>(atoll(argv[i + 1]));
+    }
+    printf("%zu principals, %zu threads\n", count, threads);
+
+    int failures = 0;
+
+    // The start of a whole second, so window boundaries fall where expected
+    Clock::time_point now = Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration_cast<std::chrono::seconds>(Clock::now().time_since_epoch()) + std::chrono::seconds(10)));
+
+    PrincipalTable small(64);
+    uint32_t alice = small.Intern("alice@EXAMPLE.COM");
+    uint32_t backup = small.Intern("svc-backup@EXAMPLE.COM");
+    uint32_t partner = small.Intern("bob@PARTNER.ORG");
+    uint32_t admin = small.Intern("carol@PARTNER.ORG");
+    std::vector<std::string> none;
+    std::vector<std::string> admins = { "S-1-5-21-1004336348-1177238915-682003330-513", "S-1-5-21-1004336348-1177238915-682003330-512" };
+
+    // Concurrency: at most three in progress, and a release makes room
+    {
+        PrincipalQuotas quotas(small);
+        QuotaLimits limits;
+        limits.standard.concurrency = 3;
+        quotas.SetLimits(limits);
+        size_t held = CountAdmitted(quotas, alice, &none, now, 5, false);
+        quotas.Release(alice);
+        size_t again = CountAdmitted(quotas, alice, &none, now, 5, false);
+        size_t other = CountAdmitted(quotas, backup, &none, now, 5, false);
+        QuotaStats stats = quotas.GetStats();
+        if (held != 3 || again != 1 || other != 3 || quotas.InFlight(alice) != 3 || stats.overConcurrency != 2 + 4 + 2)
+        {
+            printf("FAIL: concurrency 3 admitted %zu, %zu after a release, %zu for another principal\n", held, again, other);
+            failures++;
+        }
+
+        // Principals without an ID share one slot under the standard quota
+        size_t anonymous = CountAdmitted(quotas, PrincipalTable::NO_PRINCIPAL, nullptr, now, 5, false);
+        size_t beyond = CountAdmitted(quotas, 1000, nullptr, now, 1, false);
+        quotas.Release(1000);
+        size_t freed = CountAdmitted(quotas, PrincipalTable::NO_PRINCIPAL, nullptr, now, 2, false);
+        stats = quotas.GetStats();
+        if (anonymous != 3 || beyond != 0 || freed != 1 || quotas.InFlight(PrincipalTable::NO_PRINCIPAL) != 3 ||
+            stats.overflow != 8 || stats.overConcurrency != 2 + 4 + 2 + 2 + 1 + 1)
+        {
+            printf("FAIL: the overflow slot admitted %zu without an ID, %zu past the table, %zu after a release (%llu charged)\n",
+                anonymous, beyond, freed, static_cast<unsigned long long>(stats.overflow));
+            failures++;
+        }
+
+        // A reload applies at once and requests in progress still count
+        limits.standard.concurrency = 5;
+        quotas.SetLimits(limits);
+        if (CountAdmitted(quotas, alice, &none, now, 5, false) != 2 || quotas.InFlight(alice) != 5)
+        {
+            printf("FAIL: a raised concurrency did not apply over the requests in progress\n");
+            failures++;
+        }
+    }
+
+    // Threads racing on one principal never exceed its concurrency
+    {
+        PrincipalQuotas quotas(small);
+        QuotaLimits limits;
+        limits.standard.concurrency = 2;
+        quotas.SetLimits(limits);
+        std::atomic<uint32_t> holding(0);
+        std::atomic<uint32_t> most(0);
+        std::atomic<size_t> admitted(0);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&]
+            {
+                for (size_t i = 0; i < 100000; i++)
+                {
+                    if (quotas.Acquire(alice, &none, now) == QuotaDecision::Admit)
+                    {
+                        // InFlight also counts attempts about to be refused, so keep our own count
+                        uint32_t inFlight = holding.fetch_add(1) + 1;
+                        uint32_t seen = most.load();
+                        while (inFlight > seen && !most.compare_exchange_weak(seen, inFlight))
+                        {
+                        }
+                        admitted.fetch_add(1);
+                        holding.fetch_sub(1);
+                        quotas.Release(alice);
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        if (most.load() > 2 || admitted.load() == 0 || quotas.InFlight(alice) != 0)
+        {
+            printf("FAIL: %u in progress at once with a concurrency of 2, %u left\n", most.load(), quotas.InFlight(alice));
+            failures++;
+        }
+    }
+
+    // Sliding window: 10 a second
+    {
+        PrincipalQuotas quotas(small);
+        QuotaLimits limits;
+        limits.standard.rate = 10;
+        limits.windowSeconds = 1;
+        quotas.SetLimits(limits);
+        size_t first = CountAdmitted(quotas, alice, &none, now, 20, true);
+        size_t late = CountAdmitted(quotas, alice, &none, now + std::chrono::milliseconds(900), 20, true);
+        size_t halfway = CountAdmitted(quotas, alice, &none, now + std::chrono::milliseconds(1500), 20, true);
+        size_t quarter = CountAdmitted(quotas, alice, &none, now + std::chrono::milliseconds(1750), 20, true);
+        size_t idle = CountAdmitted(quotas, alice, &none, now + std::chrono::milliseconds(3500), 20, true);
+        if (first != 10 || late != 0 || halfway != 5 || quarter != 3 || idle != 10 || quotas.InFlight(alice) != 0)
+        {
+            printf("FAIL: sliding window admitted %zu, %zu late in the window, %zu and %zu into the next, %zu after an idle one\n",
+                first, late, halfway, quarter, idle);
+            failures++;
+        }
+    }
+
+    // Matching: own name, then the first of realm and SIDs listed
+    {
+        PrincipalQuotas quotas(small);
+        QuotaLimits limits;
+        limits.standard.concurrency = 1;
+        limits.subjects.emplace_back("S-1-5-21-1004336348-1177238915-682003330-512", QuotaRule{ 4, 0 });
+        limits.subjects.emplace_back("@partner.org", QuotaRule{ 2, 0 });
+        limits.subjects.emplace_back("SVC-BACKUP@EXAMPLE.COM", QuotaRule{ 3, 0 });
+        limits.subjects.emplace_back("svc-backup@EXAMPLE.COM", QuotaRule{ 9, 0 });
+        quotas.SetLimits(limits);
+        size_t standard = CountAdmitted(quotas, alice, &none, now, 10, false);
+        size_t own = CountAdmitted(quotas, backup, &admins, now, 10, false);
+        size_t realm = CountAdmitted(quotas, partner, &none, now, 10, false);
+        size_t group = CountAdmitted(quotas, admin, &admins, now, 10, false);
+        if (standard != 1 || own != 3 || realm != 2 || group != 4)
+        {
+            printf("FAIL: matched concurrencies %zu (standard), %zu (own), %zu (realm), %zu (group listed before the realm)\n",
+                standard, own, realm, group);
+            failures++;
+        }
+
+        // Reloaded without the group: a session matches the realm at once,
+        // and a Negotiate after a reload with the group back matches it again
+        for (uint32_t id : { alice, backup, partner, admin })
+        {
+            while (quotas.InFlight(id) > 0)
+            {
+                quotas.Release(id);
+            }
+        }
+        limits.subjects.erase(limits.subjects.begin());
+        quotas.SetLimits(limits);
+        size_t session = CountAdmitted(quotas, admin, nullptr, now, 10, false);
+        quotas.Release(admin);
+        quotas.Release(admin);
+        limits.subjects.insert(limits.subjects.begin(), std::make_pair(std::string("S-1-5-21-1004336348-1177238915-682003330-512"), QuotaRule{ 4, 0 }));
+        quotas.SetLimits(limits);
+        size_t sessionAgain = CountAdmitted(quotas, admin, nullptr, now, 10, false);
+        size_t negotiated = CountAdmitted(quotas, admin, &admins, now, 10, false);
+        if (session != 2 || sessionAgain != 2 || negotiated != 2 || quotas.GetLimits().subjects.size() != 4)
+        {
+            printf("FAIL: after reloads %zu admitted by session, %zu by session and %zu more by Negotiate with the group back\n",
+                session, sessionAgain, negotiated);
+            failures++;
+        }
+    }
+
+    // Replaced limits are freed once retired long enough; until then reloads are refused
+    {
+        PrincipalQuotas quotas(small);
+        QuotaLimits limits;
+        size_t reloads = 0;
+        while (reloads < PrincipalQuotas::MAX_LIMIT_SETS * 2 && quotas.SetLimits(limits, now))
+        {
+            reloads++;
+        }
+        limits.standard.concurrency = 1;
+        bool refused = !quotas.SetLimits(limits, now + std::chrono::seconds(PrincipalQuotas::RETIRE_SECONDS - 1));
+        bool freed = quotas.SetLimits(limits, now + std::chrono::seconds(PrincipalQuotas::RETIRE_SECONDS));
+        size_t admitted = CountAdmitted(quotas, alice, &none, now, 2, false);
+        if (reloads != PrincipalQuotas::MAX_LIMIT_SETS - 1 || !refused || !freed || admitted != 1 || quotas.GetStats().limitSets != 2)
+        {
+            printf("FAIL: %zu reloads kept, refused %d, then %d after the grace; %zu admitted, %zu sets\n", reloads,
+                refused, freed, admitted, quotas.GetStats().limitSets);
+            failures++;
+        }
+    }
+
+    // Limits file
+    {
+        ServerConfig config;
+        config.userConcurrency = 8;
+        config.userRate = 600;
+        Limits parsed = DefaultLimits(config);
+        bool ok = ParseLimits("userrate 100\nuserwindow 10\nquota svc-backup@EXAMPLE.COM 2 60\n"
+                              "quota  EXAMPLE\\Batch User\t4  0   # spaces in an SSPI name\n", parsed);
+        if (!ok || parsed.quotas.standard.concurrency != 8 || parsed.quotas.standard.rate != 100 || parsed.quotas.windowSeconds != 10 ||
+            parsed.quotas.subjects.size() != 2 || parsed.quotas.subjects[1].first != "EXAMPLE\\Batch User" ||
+            parsed.quotas.subjects[1].second.concurrency != 4 || parsed.quotas.subjects[0].second.rate != 60)
+        {
+            printf("FAIL: quota lines not parsed\n");
+            failures++;
+        }
+        Limits bad = DefaultLimits(config);
+        if (ParseLimits("quota alice@EXAMPLE.COM 2\n", bad) || ParseLimits("quota 2 60\n", bad) || ParseLimits("quota alice 2 many\n", bad) ||
+            ParseLimits("userrate\n", bad))
+        {
+            printf("FAIL: a bad quota line was accepted\n");
+            failures++;
+        }
+    }
+
+    // Full cardinality
+    std::vector<std::string> names(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = "svc-account-" + std::to_string(i) + (i % 2 ? "@EXAMPLE.COM" : "@PARTNER.ORG");
+    }
+    PrincipalTable table(count);
+    std::vector<uint32_t> ids(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ids[i] = table.Intern(names[i]);
+    }
+
+    size_t before = ResidentBytes();
+    PrincipalQuotas quotas(table);
+    QuotaLimits limits;
+    limits.standard.concurrency = 4;
+    limits.standard.rate = 1000000;
+    limits.subjects.emplace_back("@PARTNER.ORG", QuotaRule{ 8, 1000000 });
+    limits.subjects.emplace_back("svc-account-7@EXAMPLE.COM", QuotaRule{ 1, 10 });
+    quotas.SetLimits(limits);
+
+    // Each principal's first check assigns its quota
+    Clock::time_point start = Clock::now();
+    size_t admitted = 0;
+    for (uint32_t id : ids)
+    {
+        admitted += quotas.Acquire(id, &none, now) == QuotaDecision::Admit;
+        quotas.Release(id);
+    }
+    double assignNanos = NanosPer(start, count);
+    size_t after = ResidentBytes();
+    if (admitted != count || quotas.GetStats().assigned != count)
+    {
+        printf("FAIL: %zu of %zu principals admitted on their first request\n", admitted, count);
+        failures++;
+    }
+
+    std::mt19937 random(25);
+    std::vector<uint32_t> picks(1 << 16);
+    for (uint32_t& pick : picks)
+    {
+        pick = ids[random() % count];
+    }
+    start = Clock::now();
+    uint64_t sink = 0;
+    for (size_t i = 0; i < checks; i++)
+    {
+        uint32_t id = picks[i & (picks.size() - 1)];
+        QuotaDecision decision = quotas.Acquire(id, &none, now);
+        sink += static_cast<uint64_t>(decision);
+        if (decision == QuotaDecision::Admit)
+        {
+            quotas.Release(id);
+        }
+    }
+    double checkNanos = NanosPer(start, checks);
+
+    std::vector<std::thread> workers;
+    start = Clock::now();
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+        {
+            for (size_t i = 0; i < checks / threads; i++)
+            {
+                uint32_t id = picks[(i + t * 7919) & (picks.size() - 1)];
+                if (quotas.Acquire(id, &none, now + std::chrono::milliseconds(i / 65536)) == QuotaDecision::Admit)
+                {
+                    quotas.Release(id);
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    double threadNanos = NanosPer(start, checks / threads * threads) * static_cast<double>(threads);
+
+    size_t leaked = 0;
+    for (uint32_t id : ids)
+    {
+        leaked += quotas.InFlight(id);
+    }
+    if (leaked > 0)
+    {
+        printf("FAIL: %zu requests left in progress\n", leaked);
+        failures++;
+    }
+
+    QuotaStats stats = quotas.GetStats();
+    printf("  first check:   %8.1f ns (assigns the quota)\n", assignNanos);
+    printf("  check+release: %8.1f ns over %zu principals\n", checkNanos, count);
+    printf("  threaded:      %8.1f ns per thread, %zu threads\n", threadNanos, threads);
+    printf("  memory:        %8.1f bytes per principal allocated", static_cast<double>(stats.bytes) / static_cast<double>(count));
+    if (after > before)
+    {
+        printf(", %.1f resident", static_cast<double>(after - before) / static_cast<double>(count));
+    }
+    printf("\n");
+    printf("  429s:          %llu over concurrency, %llu over rate\n", static_cast<unsigned long long>(stats.overConcurrency),
+        static_cast<unsigned long long>(stats.overRate));
+
+    if (failures > 0 || sink == UINT64_MAX)
+    {
+        return 1;
+    }
+    printf("OK: %zu principals held to their quotas\n", count);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,341 @@
+// Coroutine handlers against a thread per in-flight request. Every simulated
+// request waits ioMs for its body, spends authUs of CPU in the auth stage and
+// waits ioMs for its send to complete. The thread model blocks a thread for
+// each wait; the coroutine model suspends a RequestTask whose waits are
+// resumed by a completion thread (standing in for the transport) and whose
+// auth step hops to a StagePool. Reports throughput and the memory each
+// in-flight request costs while all of them are waiting.
+
+#include "RequestTask.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Memory
+    {
+        double residentKb = 0;
+        double virtualKb = 0;
+    };
+
+    // Hands memory left over from earlier runs back to the system, so the
+    // next run's growth is its own
+    void TrimMemory()
+    {
+        RequestTask::Frames().SetMaxCachedBytes(0);
+        RequestTask::Frames().SetMaxCachedBytes(RequestTask::MAX_CACHED_FRAME_BYTES);
+        malloc_trim(0);
+    }
+
+    Memory ReadMemory()
+    {
+        Memory memory;
+        FILE* file = fopen("/proc/self/statm", "r");
+        if (!file)
+        {
+            return memory;
+        }
+        unsigned long size = 0;
+        unsigned long resident = 0;
+        if (fscanf(file, "%lu %lu", &size, &resident) == 2)
+        {
+            double pageKb = static_cast<double>(sysconf(_SC_PAGESIZE)) / 1024.0;
+            memory.virtualKb = size * pageKb;
+            memory.residentKb = resident * pageKb;
+        }
+        fclose(file);
+        return memory;
+    }
+
+    void Spin(unsigned microseconds)
+    {
+        Clock::time_point until = Clock::now() + std::chrono::microseconds(microseconds);
+        while (Clock::now() < until)
+        {
+        }
+    }
+
+    struct Result
+    {
+        double requestsPerSecond = 0;
+        double residentKbPerRequest = 0;
+        double virtualKbPerRequest = 0;
+    };
+
+    struct Workload
+    {
+        size_t inFlight = 0;
+        uint64_t total = 0;
+        unsigned ioMs = 0;
+        unsigned authUs = 0;
+    };
+
+    Result RunThreads(const Workload& workload)
+    {
+        std::atomic<uint64_t> started(0);
+        std::atomic<uint64_t> completed(0);
+        TrimMemory();
+        Memory before = ReadMemory();
+        Clock::time_point start = Clock::now();
+
+        std::vector<std::thread> threads;
+        threads.reserve(workload.inFlight);
+        for (size_t i = 0; i < workload.inFlight; i++)
+        {
+            threads.emplace_back([&]
+            {
+                while (started.fetch_add(1, std::memory_order_relaxed) < workload.total)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(workload.ioMs));
+                    Spin(workload.authUs);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(workload.ioMs));
+                    completed.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        // Every thread is started and parked in a wait by now
+        std::this_thread::sleep_for(std::chrono::milliseconds(workload.ioMs));
+        Memory during = ReadMemory();
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        Result result;
+        result.requestsPerSecond = static_cast<double>(completed.load()) / seconds;
+        result.residentKbPerRequest = (during.residentKb - before.residentKb) / workload.inFlight;
+        result.virtualKbPerRequest = (during.virtualKb - before.virtualKb) / workload.inFlight;
+        return result;
+    }
+
+    // Resumes suspended tasks when their simulated I/O is due, the way a
+    // transport's event loop would
+    class CompletionThread
+    {
+    public:
+        CompletionThread() : m_running(true), m_thread(&CompletionThread::Run, this) {}
+
+        ~CompletionThread()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running = false;
+            }
+            m_condition.notify_one();
+            m_thread.join();
+        }
+
+        void Schedule(Clock::time_point due, std::coroutine_handle<> handle)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_timers.push(Timer{ due, handle });
+            }
+            m_condition.notify_one();
+        }
+
+    private:
+        struct Timer
+        {
+            Clock::time_point due;
+            std::coroutine_handle<> handle;
+
+            bool operator>(const Timer& other) const { return due > other.due; }
+        };
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_running)
+            {
+                if (m_timers.empty())
+                {
+                    m_condition.wait(lock);
+                    continue;
+                }
+                Timer next = m_timers.top();
+                if (Clock::now() < next.due)
+                {
+                    m_condition.wait_until(lock, next.due);
+                    continue;
+                }
+                m_timers.pop();
+
+                lock.unlock();
+                next.handle.resume();
+                lock.lock();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+        bool m_running;
+        std::thread m_thread;
+    };
+
+    class WaitIo
+    {
+    public:
+        WaitIo(CompletionThread& completions, unsigned milliseconds) : m_completions(completions), m_milliseconds(milliseconds) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_completions.Schedule(Clock::now() + std::chrono::milliseconds(m_milliseconds), handle);
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        CompletionThread& m_completions;
+        unsigned m_milliseconds;
+    };
+
+    struct CoroutineRun
+    {
+        const Workload* workload = nullptr;
+        CompletionThread* completions = nullptr;
+        StagePool* authStage = nullptr;
+        std::atomic<uint64_t> started{ 0 };
+        std::atomic<uint64_t> completed{ 0 };
+        std::atomic<size_t> active{ 0 };
+    };
+
+    RequestTask Serve(CoroutineRun& run, ResumableRequest* request);
+
+    // Each finished request starts the next one on its slot until total is reached
+    void StartNext(CoroutineRun& run, ResumableRequest* request)
+    {
+        if (run.started.fetch_add(1, std::memory_order_relaxed) >= run.workload->total)
+        {
+            run.active.fetch_sub(1);
+            return;
+        }
+        Serve(run, request).Detach().resume();
+    }
+
+    RequestTask Serve(CoroutineRun& run, ResumableRequest* request)
+    {
+        co_await WaitIo(*run.completions, run.workload->ioMs);
+        bool resumed = co_await ResumeOn(*run.authStage, request);
+        if (resumed)
+        {
+            Spin(run.workload->authUs);
+        }
+        co_await WaitIo(*run.completions, run.workload->ioMs);
+        run.completed.fetch_add(1, std::memory_order_relaxed);
+        StartNext(run, request);
+    }
+
+    Result RunCoroutines(const Workload& workload, size_t stageThreads)
+    {
+        std::vector<ResumableRequest> requests(workload.inFlight);
+        CoroutineRun run;
+        run.workload = &workload;
+        run.active = workload.inFlight;
+
+        StagePool authStage(stageThreads, workload.inFlight);
+        authStage.Start(ResumeRequest);
+        run.authStage = &authStage;
+
+        CompletionThread completions;
+        run.completions = &completions;
+
+        TrimMemory();
+        Memory before = ReadMemory();
+        Clock::time_point start = Clock::now();
+        for (ResumableRequest& request : requests)
+        {
+            StartNext(run, &request);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(workload.ioMs));
+        Memory during = ReadMemory();
+
+        while (run.active.load() != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        authStage.Stop();
+
+        Result result;
+        result.requestsPerSecond = static_cast<double>(run.completed.load()) / seconds;
+        result.residentKbPerRequest = (during.residentKb - before.residentKb) / workload.inFlight;
+        result.virtualKbPerRequest = (during.virtualKb - before.virtualKb) / workload.inFlight;
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t maxInFlight = 4000;
+    unsigned ioMs = 5;
+    unsigned authUs = 20;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--inflight") == 0)
+        {
+            maxInFlight = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--ioms") == 0)
+        {
+            ioMs = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--authus") == 0)
+        {
+            authUs = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        }
+    }
+
+    size_t stageThreads = std::thread::hardware_concurrency();
+    if (stageThreads == 0)
+    {
+        stageThreads = 1;
+    }
+
+    printf("Each request: %u ms receive, %u us auth, %u ms send; %zu auth stage threads for coroutines\n\n", ioMs, authUs,
+        ioMs, stageThreads);
+    printf("%-10s %-12s %12s %16s %16s\n", "in-flight", "model", "requests/s", "RSS KB/request", "virt KB/request");
+    for (size_t inFlight : { 10, 100, 1000, 4000, 10000 })
+    {
+        if (inFlight > maxInFlight)
+        {
+            break;
+        }
+
+        Workload workload;
+        workload.inFlight = inFlight;
+        workload.total = inFlight * 20;
+        workload.ioMs = ioMs;
+        workload.authUs = authUs;
+
+        Result threads = RunThreads(workload);
+        Result coroutines = RunCoroutines(workload, stageThreads);
+        printf("%-10zu %-12s %12.0f %16.2f %16.1f\n", inFlight, "threads", threads.requestsPerSecond,
+            threads.residentKbPerRequest, threads.virtualKbPerRequest);
+        printf("%-10zu %-12s %12.0f %16.2f %16.1f\n", inFlight, "coroutines", coroutines.requestsPerSecond,
+            coroutines.residentKbPerRequest, coroutines.virtualKbPerRequest);
+    }
+
+    SlabPoolStats frames = RequestTask::Frames().GetStats();
+    printf("\nFrames: %llu acquired, %llu reused from the pool, %llu from the heap\n",
+        static_cast<unsigned long long>(frames.acquired), static_cast<unsigned long long>(frames.reused),
+        static_cast<unsigned long long>(frames.allocated));
+    return 0;
+}
\ No newline at end of file
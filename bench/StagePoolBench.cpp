@@ -0,0 +1,352 @@
+// Request pipeline building blocks: checks StageQueue for lost or duplicated
+// entries under contention, compares its hand-off rate with a mutex-guarded
+// deque, then overloads a StagePool whose handler sleeps like a provider
+// waiting on a domain controller and reports how many requests were shed
+// and how long the accepted ones queued.
+
+#include "StagePool.h"
+#include "StageQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    bool CheckSingleThread()
+    {
+        StageQueue<uint64_t> queue(5);
+        if (queue.Capacity() != 8)
+        {
+            printf("FAIL: capacity 5 rounds to %zu, expected 8\n", queue.Capacity());
+            return false;
+        }
+
+        uint64_t value = 0;
+        if (queue.TryPop(value))
+        {
+            printf("FAIL: pop from an empty queue\n");
+            return false;
+        }
+        for (int round = 0; round < 3; round++)
+        {
+            for (uint64_t i = 0; i < 8; i++)
+            {
+                if (!queue.TryPush(i))
+                {
+                    printf("FAIL: push %llu of 8 refused\n", static_cast<unsigned long long>(i));
+                    return false;
+                }
+            }
+            if (queue.TryPush(8) || queue.Size() != 8)
+            {
+                printf("FAIL: full queue accepted a push\n");
+                return false;
+            }
+            for (uint64_t i = 0; i < 8; i++)
+            {
+                if (!queue.TryPop(value) || value != i)
+                {
+                    printf("FAIL: entries out of order\n");
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Every producer pushes its own numbers; consumers mark what they see
+    bool CheckContended(size_t producers, size_t consumers, uint64_t perProducer)
+    {
+        StageQueue<uint64_t> queue(64);
+        std::vector<std::atomic<uint8_t>> seen(producers * perProducer);
+        for (auto& flag : seen)
+        {
+            flag.store(0, std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> consumed(0);
+        const uint64_t total = producers * perProducer;
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p < producers; p++)
+        {
+            threads.emplace_back([&, p]
+            {
+                for (uint64_t i = 0; i < perProducer; i++)
+                {
+                    while (!queue.TryPush(p * perProducer + i))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (size_t c = 0; c < consumers; c++)
+        {
+            threads.emplace_back([&]
+            {
+                uint64_t value = 0;
+                while (consumed.load(std::memory_order_relaxed) < total)
+                {
+                    if (queue.TryPop(value))
+                    {
+                        seen[value].fetch_add(1, std::memory_order_relaxed);
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (uint64_t i = 0; i < total; i++)
+        {
+            if (seen[i].load() != 1)
+            {
+                printf("FAIL: %zu producers, %zu consumers: entry %llu seen %d times\n", producers, consumers,
+                    static_cast<unsigned long long>(i), seen[i].load());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The baseline the stages would otherwise use
+    class LockedQueue
+    {
+    public:
+        explicit LockedQueue(size_t capacity) : m_capacity(capacity) {}
+
+        bool TryPush(uint64_t value)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.size() >= m_capacity)
+            {
+                return false;
+            }
+            m_items.push_back(value);
+            return true;
+        }
+
+        bool TryPop(uint64_t& value)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.empty())
+            {
+                return false;
+            }
+            value = m_items.front();
+            m_items.pop_front();
+            return true;
+        }
+
+    private:
+        size_t m_capacity;
+        std::mutex m_mutex;
+        std::deque<uint64_t> m_items;
+    };
+
+    // Millions of push/pop pairs per second with pairs producer/consumer threads
+    template <typename Queue>
+    double HandOffRate(size_t pairs, uint64_t perProducer)
+    {
+        Queue queue(1024);
+        std::atomic<uint64_t> consumed(0);
+        const uint64_t total = pairs * perProducer;
+
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p < pairs; p++)
+        {
+            threads.emplace_back([&]
+            {
+                for (uint64_t i = 0; i < perProducer; i++)
+                {
+                    while (!queue.TryPush(i))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+            threads.emplace_back([&]
+            {
+                uint64_t value = 0;
+                while (consumed.load(std::memory_order_relaxed) < total)
+                {
+                    if (queue.TryPop(value))
+                    {
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return static_cast<double>(total) / seconds / 1e6;
+    }
+
+    struct TimedRequest : DeferredRequest
+    {
+        Clock::time_point queued;
+        Clock::time_point deadline;
+    };
+
+    struct OverloadResult
+    {
+        uint64_t offered = 0;
+        uint64_t served = 0;
+        uint64_t shedFull = 0;
+        uint64_t shedDeadline = 0;
+        double p50WaitMs = 0;
+        double p99WaitMs = 0;
+        size_t peakDepth = 0;
+    };
+
+    // Offers requests at offeredRate for durationMs to a stage that can serve
+    // threads / serviceMs of them per millisecond
+    OverloadResult Overload(size_t threads, size_t capacity, unsigned serviceMs, unsigned deadlineMs,
+        unsigned offeredRate, unsigned durationMs)
+    {
+        OverloadResult result;
+        std::vector<TimedRequest> requests(capacity + threads + 1);
+        StageQueue<TimedRequest*> free(requests.size());
+        for (TimedRequest& request : requests)
+        {
+            free.TryPush(&request);
+        }
+
+        std::mutex waitsMutex;
+        std::vector<double> waits;
+        std::atomic<uint64_t> shedDeadline(0);
+        StagePool pool(threads, capacity);
+        pool.Start([&](DeferredRequest* deferred)
+        {
+            TimedRequest* request = static_cast<TimedRequest*>(deferred);
+            Clock::time_point now = Clock::now();
+            if (now > request->deadline)
+            {
+                shedDeadline.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                {
+                    std::lock_guard<std::mutex> lock(waitsMutex);
+                    waits.push_back(std::chrono::duration<double, std::milli>(now - request->queued).count());
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(serviceMs));
+            }
+            free.TryPush(request);
+        });
+
+        auto start = Clock::now();
+        auto interval = std::chrono::nanoseconds(1000000000ull / offeredRate);
+        auto next = start;
+        while (Clock::now() - start < std::chrono::milliseconds(durationMs))
+        {
+            std::this_thread::sleep_until(next);
+            next += interval;
+            result.offered++;
+
+            TimedRequest* request = nullptr;
+            if (!free.TryPop(request))
+            {
+                result.shedFull++;
+                continue;
+            }
+            request->queued = Clock::now();
+            request->deadline = request->queued + std::chrono::milliseconds(deadlineMs);
+            if (!pool.Post(request))
+            {
+                free.TryPush(request);
+                result.shedFull++;
+            }
+        }
+        pool.Stop();
+
+        result.shedDeadline = shedDeadline.load();
+        result.served = waits.size();
+        result.peakDepth = pool.GetStats().peakDepth;
+        std::sort(waits.begin(), waits.end());
+        if (!waits.empty())
+        {
+            result.p50WaitMs = waits[waits.size() / 2];
+            result.p99WaitMs = waits[std::min(waits.size() - 1, waits.size() * 99 / 100)];
+        }
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t operations = 2000000;
+    unsigned serviceMs = 5;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--operations") == 0)
+        {
+            operations = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--servicems") == 0)
+        {
+            serviceMs = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        }
+    }
+
+    if (!CheckSingleThread() || !CheckContended(1, 1, 200000) || !CheckContended(4, 4, 100000) ||
+        !CheckContended(8, 2, 50000))
+    {
+        return 1;
+    }
+    printf("StageQueue checks passed\n\n");
+
+    printf("%-8s %18s %18s\n", "pairs", "StageQueue M/s", "mutex deque M/s");
+    for (size_t pairs : { 1, 2, 4 })
+    {
+        double lockFree = HandOffRate<StageQueue<uint64_t>>(pairs, operations / pairs);
+        double locked = HandOffRate<LockedQueue>(pairs, operations / pairs);
+        printf("%-8zu %18.2f %18.2f\n", pairs, lockFree, locked);
+    }
+
+    // 4 threads at serviceMs each serve 4000 / serviceMs requests a second;
+    // offer twice that
+    const size_t threads = 4;
+    const unsigned rate = static_cast<unsigned>(2 * threads * 1000 / (serviceMs ? serviceMs : 1));
+    printf("\nOverload: %zu threads, %u ms per request, %u requests/s offered for 2 s\n", threads, serviceMs, rate);
+    printf("%-10s %-10s %9s %9s %11s %11s %10s %10s %7s\n", "queue", "deadline", "offered", "served", "shed full",
+        "shed late", "p50 ms", "p99 ms", "peak");
+    struct Shape
+    {
+        size_t capacity;
+        unsigned deadlineMs;
+    };
+    for (Shape shape : { Shape{ 16, 1000 }, Shape{ 256, 1000 }, Shape{ 256, 100 }, Shape{ 4096, 60000 } })
+    {
+        OverloadResult result = Overload(threads, shape.capacity, serviceMs, shape.deadlineMs, rate, 2000);
+        printf("%-10zu %-10u %9llu %9llu %11llu %11llu %10.1f %10.1f %7zu\n", shape.capacity, shape.deadlineMs,
+            static_cast<unsigned long long>(result.offered), static_cast<unsigned long long>(result.served),
+            static_cast<unsigned long long>(result.shedFull), static_cast<unsigned long long>(result.shedDeadline),
+            result.p50WaitMs, result.p99WaitMs, result.peakDepth);
+    }
+    return 0;
+}
\ No newline at end of file
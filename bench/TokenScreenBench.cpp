@@ -0,0 +1,394 @@
+// Token pre-screen cost per token over a fuzz-derived corpus. Seed tokens
+// cover the shapes clients send - SPNEGO and raw Kerberos AP-REQs with AD-size
+// tickets, AP-REQs for the wrong service or realm, NTLM bare and in SPNEGO,
+// NegoEx, a NegTokenResp continuation - and are checked for the expected
+// verdict and extracted fields. The corpus is then mutated the way a fuzzer
+// would (bit flips, byte and length-field overwrites, truncation, insertion,
+// deletion, splices between seeds, plain garbage) and screened repeatedly;
+// every token lives in its own exact-size allocation, so an AddressSanitizer
+// build also proves the walker never reads past a token.
+
+#include "DerFixtures.h"
+#include "Der.h"
+#include "KerberosCrypto.h"
+#include "TokenScreen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const char* SERVICE_PRINCIPALS = "HTTP/bench.example.com@EXAMPLE.COM,HTTP/bench@EXAMPLE.COM";
+
+// xorshift64*, so a corpus is reproducible from its seed
+struct Random
+{
+    uint64_t state;
+
+    explicit Random(uint64_t seed)
+        : state(seed ? seed : 1)
+    {
+    }
+
+    uint64_t Next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dULL;
+    }
+
+    size_t Below(size_t bound) { return bound ? static_cast<size_t>(Next() % bound) : 0; }
+};
+
+// ---- Seed tokens ----
+
+static Bytes RandomBytes(Random& random, size_t length)
+{
+    Bytes bytes(length);
+    for (uint8_t& b : bytes)
+    {
+        b = static_cast<uint8_t>(random.Next());
+    }
+    return bytes;
+}
+
+// The screen never decrypts, so the ciphertexts are random bytes of the
+// sizes real tickets have (an AD ticket with its PAC is 1-2 KB)
+static Bytes ApReq(Random& random, const std::string& realm, const std::vector<std::string>& service, int32_t etype,
+    size_t ticketCipher)
+{
+    const uint8_t options[] = { 0x00, 0x20, 0x00, 0x00, 0x00 };
+    Bytes ticket = Tlv(DerReader::Application(1), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Integer(5)),
+        Tagged(1, KerberosString(realm)),
+        Tagged(2, PrincipalName(2, service)),
+        Tagged(3, EncryptedData(etype, 3, RandomBytes(random, ticketCipher))),
+    })));
+    return Tlv(DerReader::Application(14), Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Integer(5)),
+        Tagged(1, Integer(14)),
+        Tagged(2, Tlv(DerReader::BIT_STRING, Raw(options, sizeof(options)))),
+        Tagged(3, ticket),
+        Tagged(4, EncryptedData(etype, -1, RandomBytes(random, 180))),
+    })));
+}
+
+static Bytes Krb5Token(const Bytes& apReq)
+{
+    const uint8_t tokenId[] = { 0x01, 0x00 };
+    return Tlv(DerReader::Application(0),
+        Cat({ Tlv(DerReader::OID, Raw(KRB5_OID, sizeof(KRB5_OID))), Raw(tokenId, sizeof(tokenId)), apReq }));
+}
+
+static Bytes NegTokenInit(const std::vector<Bytes>& mechs, const Bytes* mechToken)
+{
+    Bytes mechTypes;
+    for (const Bytes& mech : mechs)
+    {
+        Bytes oid = Tlv(DerReader::OID, mech);
+        mechTypes.insert(mechTypes.end(), oid.begin(), oid.end());
+    }
+    Bytes fields = Tagged(0, Tlv(DerReader::SEQUENCE, mechTypes));
+    if (mechToken)
+    {
+        fields = Cat({ fields, Tagged(2, Tlv(DerReader::OCTET_STRING, *mechToken)) });
+    }
+    return Tlv(DerReader::Application(0), Cat({
+        Tlv(DerReader::OID, Raw(SPNEGO_OID, sizeof(SPNEGO_OID))),
+        Tagged(0, Tlv(DerReader::SEQUENCE, fields)),
+    }));
+}
+
+static Bytes NtlmMessage(Random& random, uint8_t type, size_t length)
+{
+    Bytes message = RandomBytes(random, length);
+    memcpy(message.data(), "NTLMSSP", 8);
+    message[8] = type;
+    message[9] = message[10] = message[11] = 0;
+    return message;
+}
+
+struct Seed
+{
+    const char* name;
+    Bytes token;
+    TokenScreen::Verdict verdict;
+    TokenMechanism mechanism;
+};
+
+static std::vector<Seed> MakeSeeds(Random& random)
+{
+    const Bytes krb5(KRB5_OID, KRB5_OID + sizeof(KRB5_OID));
+    const Bytes ntlm(NTLM_OID, NTLM_OID + sizeof(NTLM_OID));
+    const Bytes negoex = { 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x02, 0x02, 0x1e };
+    const std::vector<std::string> service = { "HTTP", "bench.example.com" };
+
+    Bytes aes256 = Krb5Token(ApReq(random, "EXAMPLE.COM", service, KerberosCrypto::AES256_CTS_HMAC_SHA1_96, 1400));
+    Bytes aes128 = Krb5Token(ApReq(random, "EXAMPLE.COM", { "HTTP", "bench" }, KerberosCrypto::AES128_CTS_HMAC_SHA1_96, 300));
+    Bytes rc4 = Krb5Token(ApReq(random, "example.com", service, 23, 1100));
+    Bytes elsewhere = Krb5Token(ApReq(random, "EXAMPLE.COM", { "HTTP", "elsewhere.example.com" },
+        KerberosCrypto::AES256_CTS_HMAC_SHA1_96, 1400));
+    Bytes otherRealm = Krb5Token(ApReq(random, "OTHER.EXAMPLE", service, KerberosCrypto::AES256_CTS_HMAC_SHA1_96, 1400));
+    Bytes negotiate = NtlmMessage(random, 1, 40);
+    Bytes authenticate = NtlmMessage(random, 3, 400);
+    Bytes negoexToken = RandomBytes(random, 120);
+    memcpy(negoexToken.data(), "NEGOEXTS", 8);
+
+    // Continuation leg: NegTokenResp { negState accept-incomplete, responseToken }
+    const uint8_t acceptIncomplete[] = { 0x01 };
+    Bytes response = Tagged(1, Tlv(DerReader::SEQUENCE, Cat({
+        Tagged(0, Tlv(DerReader::ENUMERATED, Raw(acceptIncomplete, sizeof(acceptIncomplete)))),
+        Tagged(2, Tlv(DerReader::OCTET_STRING, authenticate)),
+    })));
+
+    using Verdict = TokenScreen::Verdict;
+    std::vector<Seed> seeds;
+    seeds.push_back({ "SPNEGO AP-REQ aes256", NegTokenInit({ krb5, ntlm }, &aes256), Verdict::Pass, TokenMechanism::Kerberos });
+    seeds.push_back({ "raw AP-REQ aes128", aes128, Verdict::Pass, TokenMechanism::Kerberos });
+    seeds.push_back({ "SPNEGO AP-REQ rc4", NegTokenInit({ krb5, ntlm }, &rc4), Verdict::Pass, TokenMechanism::Kerberos });
+    seeds.push_back({ "SPNEGO AP-REQ wrong SPN", NegTokenInit({ krb5 }, &elsewhere), Verdict::WrongService,
+        TokenMechanism::Kerberos });
+    seeds.push_back({ "SPNEGO AP-REQ wrong realm", NegTokenInit({ krb5 }, &otherRealm), Verdict::WrongRealm,
+        TokenMechanism::Kerberos });
+    seeds.push_back({ "SPNEGO without mechToken", NegTokenInit({ krb5, ntlm }, nullptr), Verdict::Pass,
+        TokenMechanism::Kerberos });
+    seeds.push_back({ "bare NTLM NEGOTIATE", negotiate, Verdict::SlowLane, TokenMechanism::Ntlm });
+    seeds.push_back({ "SPNEGO NTLM NEGOTIATE", NegTokenInit({ ntlm, krb5 }, &negotiate), Verdict::SlowLane,
+        TokenMechanism::Ntlm });
+    seeds.push_back({ "NegTokenResp NTLM AUTHENTICATE", response, Verdict::SlowLane, TokenMechanism::Ntlm });
+    seeds.push_back({ "SPNEGO NegoEx", NegTokenInit({ negoex, krb5 }, &negoexToken), Verdict::Pass, TokenMechanism::Other });
+    return seeds;
+}
+
+static bool CheckSeeds(TokenScreen& screen, const std::vector<Seed>& seeds)
+{
+    bool ok = true;
+    for (const Seed& seed : seeds)
+    {
+        TokenFacts facts;
+        TokenScreen::Verdict verdict = screen.Screen(seed.token.data(), seed.token.size(), facts);
+        if (verdict != seed.verdict || facts.mechanism != seed.mechanism)
+        {
+            printf("FAIL: %s: verdict %d mechanism %d\n", seed.name, static_cast<int>(verdict),
+                static_cast<int>(facts.mechanism));
+            ok = false;
+        }
+    }
+
+    TokenFacts facts;
+    const Bytes& first = seeds[0].token;
+    if (!TokenScreen::Parse(first.data(), first.size(), facts) || !facts.spnego || !facts.hasApReq ||
+        facts.realm != "EXAMPLE.COM" || facts.serviceComponents != 2 || facts.service[0] != "HTTP" ||
+        facts.service[1] != "bench.example.com" || facts.etype != KerberosCrypto::AES256_CTS_HMAC_SHA1_96 ||
+        facts.kvno != 3 || facts.ticketSize != 1400 || !facts.mechOid.Equals(KRB5_OID, sizeof(KRB5_OID)))
+    {
+        printf("FAIL: AP-REQ fields not extracted\n");
+        ok = false;
+    }
+
+    // Every strict prefix of a DER token is malformed (bare NTLM has no length to check)
+    for (const Seed& seed : seeds)
+    {
+        for (size_t length = 0; length < seed.token.size() && seed.token[0] != 'N'; length++)
+        {
+            std::unique_ptr<uint8_t[]> prefix(new uint8_t[length + 1]);
+            memcpy(prefix.get(), seed.token.data(), length);
+            if (TokenScreen::Parse(prefix.get(), length, facts))
+            {
+                printf("FAIL: %s: %zu-byte prefix accepted\n", seed.name, length);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    TokenScreen bad;
+    if (bad.Configure("HTTP//host") || bad.Configure("HTTP/host@") || bad.Configure("a/b/c/d/e") ||
+        !bad.Configure(" HTTP/host , HTTP/other@REALM "))
+    {
+        printf("FAIL: service principal list parsing\n");
+        ok = false;
+    }
+
+    if (ok)
+    {
+        printf("PASS: %zu seed tokens screened as expected\n", seeds.size());
+    }
+    return ok;
+}
+
+// ---- Mutations ----
+
+static Bytes Mutate(Random& random, const std::vector<Seed>& seeds)
+{
+    Bytes token = seeds[random.Below(seeds.size())].token;
+    int rounds = 1 + static_cast<int>(random.Below(3));
+    for (int round = 0; round < rounds && !token.empty(); round++)
+    {
+        size_t position = random.Below(token.size());
+        switch (random.Below(8))
+        {
+        case 0:
+            token[position] ^= static_cast<uint8_t>(1u << random.Below(8));
+            break;
+        case 1:
+        {
+            // Length fields: short form, long form with too many or zero bytes, huge
+            static const uint8_t lengths[] = { 0x00, 0x01, 0x7f, 0x80, 0x81, 0x82, 0x84, 0x85, 0x89, 0xff };
+            token[position] = lengths[random.Below(sizeof(lengths))];
+            break;
+        }
+        case 2:
+            token[position] = static_cast<uint8_t>(random.Next());
+            break;
+        case 3:
+            token.resize(position);
+            break;
+        case 4:
+        {
+            Bytes inserted = RandomBytes(random, 1 + random.Below(8));
+            token.insert(token.begin() + static_cast<std::ptrdiff_t>(position), inserted.begin(), inserted.end());
+            break;
+        }
+        case 5:
+        {
+            size_t count = (std::min)(token.size() - position, 1 + random.Below(16));
+            token.erase(token.begin() + static_cast<std::ptrdiff_t>(position),
+                token.begin() + static_cast<std::ptrdiff_t>(position + count));
+            break;
+        }
+        case 6:
+        {
+            // Splice the tail of another seed
+            const Bytes& other = seeds[random.Below(seeds.size())].token;
+            size_t from = random.Below(other.size());
+            token.resize(position);
+            token.insert(token.end(), other.begin() + static_cast<std::ptrdiff_t>(from), other.end());
+            break;
+        }
+        default:
+            token = RandomBytes(random, random.Below(64));
+            break;
+        }
+    }
+    return token;
+}
+
+struct CorpusToken
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t length;
+};
+
+static CorpusToken Store(const Bytes& token)
+{
+    CorpusToken stored;
+    stored.length = token.size();
+    stored.data.reset(new uint8_t[(std::max)(token.size(), size_t(1))]);
+    if (!token.empty())
+    {
+        memcpy(stored.data.get(), token.data(), token.size());
+    }
+    return stored;
+}
+
+// Screens the corpus passes times and returns nanoseconds per token
+static double Measure(TokenScreen& screen, const std::vector<CorpusToken>& corpus, int passes, uint64_t* verdicts)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (const CorpusToken& token : corpus)
+        {
+            TokenFacts facts;
+            verdicts[static_cast<int>(screen.Screen(token.data.get(), token.length, facts))]++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * 1e9 / (static_cast<double>(corpus.size()) * passes);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = 100000;
+    int passes = 20;
+    uint64_t seed = 20240601;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--tokens") == 0)
+            count = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--passes") == 0)
+            passes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            seed = strtoull(argv[++i], nullptr, 10);
+    }
+
+    Random random(seed);
+    std::vector<Seed> seeds = MakeSeeds(random);
+    TokenScreen screen;
+    if (!screen.Configure(SERVICE_PRINCIPALS))
+    {
+        printf("FAIL: cannot configure %s\n", SERVICE_PRINCIPALS);
+        return 1;
+    }
+    if (!CheckSeeds(screen, seeds))
+    {
+        return 1;
+    }
+
+    std::vector<CorpusToken> valid;
+    for (const Seed& s : seeds)
+    {
+        valid.push_back(Store(s.token));
+    }
+    std::vector<CorpusToken> fuzzed;
+    fuzzed.reserve(count);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        Bytes token = Mutate(random, seeds);
+        bytes += token.size();
+        fuzzed.push_back(Store(token));
+    }
+
+    printf("Corpus: %zu seeds, %zu mutated tokens averaging %zu bytes (seed %llu)\n", seeds.size(), count,
+        count ? bytes / count : 0, static_cast<unsigned long long>(seed));
+    printf("%-34s %10s %10s %10s %10s %10s %10s\n", "corpus", "ns/token", "pass", "slow lane", "malformed",
+        "wrong realm", "wrong SPN");
+
+    struct Row
+    {
+        const char* name;
+        const std::vector<CorpusToken>* corpus;
+        int passes;
+    };
+    const Row rows[] = {
+        { "well-formed seeds", &valid, passes * static_cast<int>((std::max)(count / seeds.size(), size_t(1))) },
+        { "fuzz-derived", &fuzzed, passes },
+    };
+    for (const Row& row : rows)
+    {
+        uint64_t warmup[5] = {};
+        Measure(screen, *row.corpus, 1, warmup);
+        uint64_t verdicts[5] = {};
+        double nanoseconds = Measure(screen, *row.corpus, row.passes, verdicts);
+        double total = static_cast<double>(row.corpus->size()) * row.passes / 100.0;
+        printf("%-34s %10.1f %9.1f%% %9.1f%% %9.1f%% %10.1f%% %9.1f%%\n", row.name, nanoseconds,
+            verdicts[0] / total, verdicts[1] / total, verdicts[2] / total, verdicts[3] / total, verdicts[4] / total);
+    }
+
+    // Per seed, since ticket size and nesting depth set the cost
+    for (const Seed& s : seeds)
+    {
+        std::vector<CorpusToken> one;
+        one.push_back(Store(s.token));
+        uint64_t verdicts[5] = {};
+        double nanoseconds = Measure(screen, one, 200000, verdicts);
+        printf("  %-32s %10.1f  (%zu bytes)\n", s.name, nanoseconds, s.token.size());
+    }
+    return 0;
+}
\ No newline at end of file
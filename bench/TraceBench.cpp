@@ -0,0 +1,179 @@
+// Request tracing: checks sampling picks one request in N, that a ring past
+// its capacity keeps only its newest spans, and that a threshold exports only
+// the slow requests whole; then measures ns per timed stage with tracing off,
+// on but the request not picked, and on for every request.
+
+#include "Metrics.h"
+#include "ServerConfig.h"
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace
+{
+    using Clock = Trace::Clock;
+
+    void Configure(unsigned sampleEvery, unsigned thresholdUs, size_t spansPerThread)
+    {
+        ServerConfig config;
+        config.traceSampleEvery = sampleEvery;
+        config.traceThresholdUs = thresholdUs;
+        config.traceSpansPerThread = spansPerThread;
+        Trace::Configure(config);
+    }
+
+    size_t Count(const std::string& json, const char* text)
+    {
+        size_t count = 0;
+        for (size_t at = json.find(text); at != std::string::npos; at = json.find(text, at + 1))
+        {
+            count++;
+        }
+        return count;
+    }
+
+    // Spans are recorded into the ring of the thread that records them, sized
+    // when the thread first traces; each check runs on a thread of its own
+    template <typename Check>
+    bool OnThread(Check check)
+    {
+        bool passed = false;
+        std::thread thread([&] { passed = check(); });
+        thread.join();
+        return passed;
+    }
+
+    bool CheckSampling()
+    {
+        Configure(4, 0, 1024);
+        const size_t requests = 1000;
+        size_t picked = 0;
+        for (size_t i = 0; i < requests; i++)
+        {
+            picked += Trace::BeginRequest() != 0 ? 1 : 0;
+        }
+        Configure(0, 0, 0);
+        size_t off = Trace::BeginRequest() != 0 ? 1 : 0;
+        if (picked != requests / 4 || off != 0)
+        {
+            printf("FAIL: one in 4 picked %zu of %zu requests, %zu picked with tracing off\n", picked, requests, off);
+            return false;
+        }
+        printf("%-34s %zu of %zu picked\n", "one in 4", picked, requests);
+        return true;
+    }
+
+    bool CheckRing()
+    {
+        const size_t capacity = 64;
+        Configure(1, 0, capacity);
+        TraceStats before = Trace::GetStats();
+        auto start = Clock::now();
+        const size_t requests = 100;
+        for (size_t i = 0; i < requests; i++)
+        {
+            uint64_t request = Trace::BeginRequest();
+            Trace::Span(request, "decode", start, start + std::chrono::microseconds(1));
+            Trace::EndRequest(request, start, i < requests - 1 ? 401 : 200);
+        }
+        TraceStats after = Trace::GetStats();
+
+        std::string json;
+        Trace::WriteChromeTrace(json);
+        size_t exported = Count(json, "\"ph\":\"X\"");
+        size_t recorded = static_cast<size_t>(after.spans - before.spans);
+        if (recorded != requests * 2 || exported == 0 || exported > capacity ||
+            Count(json, "\"status\":200") != 1)
+        {
+            printf("FAIL: %zu spans recorded, %zu of them exported from a ring of %zu, newest request %s\n", recorded,
+                exported, capacity, Count(json, "\"status\":200") ? "kept" : "lost");
+            return false;
+        }
+        printf("%-34s %zu of %zu spans kept\n", "ring of 64", exported, recorded);
+        return true;
+    }
+
+    bool CheckThreshold()
+    {
+        Configure(0, 500, 1024);
+        auto start = Clock::now();
+        size_t slow = 0;
+        const size_t requests = 200;
+        for (size_t i = 0; i < requests; i++)
+        {
+            uint64_t request = Trace::BeginRequest();
+            bool isSlow = i % 10 == 0;
+            slow += isSlow ? 1 : 0;
+            Clock::time_point received = start - std::chrono::microseconds(isSlow ? 2000 : 50);
+            Trace::Span(request, "accept", received, start);
+            Trace::EndRequest(request, received, isSlow ? 200 : 401);
+        }
+
+        std::string json;
+        Trace::WriteChromeTrace(json);
+        Configure(0, 0, 0);
+        size_t requestSpans = Count(json, "\"name\":\"request\"");
+        size_t stageSpans = Count(json, "\"name\":\"accept\"");
+        if (requestSpans != slow || stageSpans != slow || Count(json, "\"status\":401") != 0)
+        {
+            printf("FAIL: %zu of %zu requests over 500 us, exported %zu request and %zu stage spans\n", slow, requests,
+                requestSpans, stageSpans);
+            return false;
+        }
+        printf("%-34s %zu of %zu exported\n", "over 500 us", requestSpans, requests);
+        return true;
+    }
+
+    // ns per stage timed the way the pipeline does it: one StageTimer per
+    // stage, under the request's TraceScope
+    double NanosecondsPerStage(size_t requests)
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < requests; i++)
+        {
+            uint64_t request = Trace::BeginRequest();
+            TraceScope scope(request);
+            {
+                StageTimer timer(MetricStage::Decode);
+            }
+            {
+                StageTimer timer(MetricStage::Accept);
+            }
+            {
+                StageTimer timer(MetricStage::Format);
+            }
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(requests * 3);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t requests = 2000000;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--requests") == 0)
+        {
+            requests = strtoull(argv[++i], nullptr, 10);
+        }
+    }
+
+    if (!OnThread(CheckSampling) || !OnThread(CheckRing) || !OnThread(CheckThreshold))
+    {
+        return 1;
+    }
+    printf("Trace checks passed\n\n");
+
+    printf("%-34s %10s\n", "timed stage", "ns");
+    Configure(0, 0, 0);
+    printf("%-34s %10.1f\n", "tracing off", NanosecondsPerStage(requests));
+    Configure(1000000, 0, 0);
+    printf("%-34s %10.1f\n", "tracing on, request not picked", NanosecondsPerStage(requests));
+    Configure(1, 0, 0);
+    printf("%-34s %10.1f\n", "every request traced", NanosecondsPerStage(requests));
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,514 @@
+// Replays a traffic capture (-capture) against a running service: at the
+// captured pace (--speed 1), N times faster (--speed N), or as fast as the
+// connections allow (--speed 0, --pipeline requests in flight on each).
+// Requests from one captured connection stay on one replay connection, in
+// order; captured connections are dealt out over --connections. Bodies are
+// sent as zeros of the captured size.
+//
+// With tokens captured in "replace" mode, run the service with "--auth mock"
+// so the stand-in tokens authenticate without a KDC or keytab, and
+// "--mockauthus" to give each leg the cost of the real provider.
+//
+// Reports throughput and p50/p99/p99.9 latency per endpoint (method and path)
+// and, for paced replays, how far sends fell behind the schedule.
+
+#include "TrafficTrace.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct ReplayOptions
+    {
+        std::string trace;
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        int connections = 64;
+        int threads = 1;
+        double speed = 1;
+        int pipeline = 1;
+        int repeat = 1;
+        int timeoutSeconds = 30;    // to drain responses after the last send
+    };
+
+    struct EndpointResult
+    {
+        std::vector<uint64_t> latencies;    // nanoseconds
+        std::map<int, uint64_t> statuses;
+    };
+
+    struct ReplayResult
+    {
+        std::vector<EndpointResult> endpoints;
+        std::vector<uint64_t> lag;          // nanoseconds behind schedule, paced replays only
+        uint64_t sent = 0;
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+    };
+
+    // A request ready to send: the head is built once, the body is zeros
+    struct ReplayRequest
+    {
+        std::string head;
+        uint64_t bodySize = 0;
+        uint64_t offsetNs = 0;
+        size_t endpoint = 0;
+        size_t connection = 0;
+        bool headOnly = false;      // HEAD: the response carries no body
+    };
+
+    struct InFlight
+    {
+        size_t request;
+        Clock::time_point sent;
+    };
+
+    struct ReplayConnection
+    {
+        int fd = -1;
+        std::string input;
+        std::deque<InFlight> inFlight;
+        std::deque<size_t> queue;       // unpaced replays: requests not yet sent
+    };
+
+    const size_t ZERO_CHUNK = 65536;
+
+    double Percentile(std::vector<uint64_t>& values, double fraction)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+        return static_cast<double>(values[index]) / 1000.0;
+    }
+
+    int Connect(const ReplayOptions& options)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    bool SendAll(int fd, const char* data, size_t length)
+    {
+        size_t offset = 0;
+        while (offset < length)
+        {
+            ssize_t sent = send(fd, data + offset, length - offset, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool SendRequest(int fd, const ReplayRequest& request)
+    {
+        static const std::string zeros(ZERO_CHUNK, '\0');
+        if (!SendAll(fd, request.head.data(), request.head.size()))
+        {
+            return false;
+        }
+        for (uint64_t remaining = request.bodySize; remaining > 0;)
+        {
+            size_t chunk = static_cast<size_t>((std::min)(remaining, static_cast<uint64_t>(ZERO_CHUNK)));
+            if (!SendAll(fd, zeros.data(), chunk))
+            {
+                return false;
+            }
+            remaining -= chunk;
+        }
+        return true;
+    }
+
+    // Builds every request of the trace, repeated, and deals captured
+    // connections out over the replay connections in order of first use
+    void BuildRequests(const TrafficTrace& trace, const ReplayOptions& options, std::vector<ReplayRequest>& requests,
+        std::vector<std::string>& endpoints)
+    {
+        std::unordered_map<std::string, size_t> endpointIds;
+        std::unordered_map<uint64_t, size_t> connectionIds;
+        uint64_t duration = trace.Size() > 0 ? trace.Entry(trace.Size() - 1).offsetNs : 0;
+        for (int round = 0; round < options.repeat; round++)
+        {
+            for (size_t i = 0; i < trace.Size(); i++)
+            {
+                TrafficEntry entry = trace.Entry(i);
+                ReplayRequest request;
+                request.head.reserve(entry.method.size() + entry.target.size() + entry.headers.size() + 48);
+                request.head.append(entry.method).append(" ").append(entry.target).append(" HTTP/1.1\r\n");
+                request.head.append(entry.headers);
+                if (entry.bodySize > 0)
+                {
+                    request.head.append("Content-Length: ").append(std::to_string(entry.bodySize)).append("\r\n");
+                }
+                request.head.append("\r\n");
+                request.bodySize = entry.bodySize;
+                request.offsetNs = entry.offsetNs + static_cast<uint64_t>(round) * (duration + 1);
+                request.headOnly = entry.method == "HEAD";
+
+                std::string endpoint = std::string(entry.method) + " " + std::string(entry.target.substr(0, entry.target.find('?')));
+                auto found = endpointIds.emplace(endpoint, endpoints.size());
+                if (found.second)
+                {
+                    endpoints.push_back(endpoint);
+                }
+                request.endpoint = found.first->second;
+
+                auto connection = connectionIds.emplace(entry.connection, connectionIds.size());
+                request.connection = connection.first->second % static_cast<size_t>(options.connections);
+                requests.push_back(std::move(request));
+            }
+        }
+    }
+
+    // Matches complete responses at the front of input to the requests in
+    // flight, oldest first; false when the stream cannot be parsed
+    bool ConsumeResponses(ReplayConnection& connection, const std::vector<ReplayRequest>& requests, ReplayResult& result)
+    {
+        size_t offset = 0;
+        bool valid = true;
+        while (!connection.inFlight.empty())
+        {
+            size_t headEnd = connection.input.find("\r\n\r\n", offset);
+            if (headEnd == std::string::npos)
+            {
+                break;
+            }
+            if (connection.input.compare(offset, 9, "HTTP/1.1 ") != 0)
+            {
+                valid = false;
+                break;
+            }
+
+            const ReplayRequest& request = requests[connection.inFlight.front().request];
+            size_t bodyLength = 0;
+            size_t lengthAt = connection.input.find("Content-Length: ", offset);
+            if (lengthAt != std::string::npos && lengthAt < headEnd && !request.headOnly)
+            {
+                bodyLength = strtoul(connection.input.c_str() + lengthAt + 16, nullptr, 10);
+            }
+            size_t total = headEnd + 4 + bodyLength;
+            if (connection.input.size() < total)
+            {
+                break;
+            }
+
+            EndpointResult& endpoint = result.endpoints[request.endpoint];
+            endpoint.statuses[atoi(connection.input.c_str() + offset + 9)]++;
+            endpoint.latencies.push_back(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - connection.inFlight.front().sent).count()));
+            connection.inFlight.pop_front();
+            result.completed++;
+            offset = total;
+        }
+        connection.input.erase(0, offset);
+        return valid;
+    }
+
+    bool Send(ReplayConnection& connection, const ReplayOptions& options, int epollFd, size_t index,
+        const std::vector<ReplayRequest>& requests, ReplayResult& result)
+    {
+        if (connection.fd < 0)
+        {
+            connection.fd = Connect(options);
+            if (connection.fd < 0)
+            {
+                result.errors++;
+                return false;
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = &connection;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, connection.fd, &event);
+        }
+
+        connection.inFlight.push_back(InFlight{ index, Clock::now() });
+        result.sent++;
+        if (!SendRequest(connection.fd, requests[index]))
+        {
+            result.errors++;
+            connection.inFlight.pop_back();
+            return false;
+        }
+        return true;
+    }
+
+    void Disconnect(ReplayConnection& connection, int epollFd, ReplayResult& result)
+    {
+        result.errors += connection.inFlight.size();
+        connection.inFlight.clear();
+        connection.input.clear();
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connection.fd = -1;
+    }
+
+    // Replays the requests on this thread's connections (every threads-th one)
+    void ReplayThread(const ReplayOptions& options, const std::vector<ReplayRequest>& requests, size_t endpointCount,
+        int thread, Clock::time_point start, ReplayResult& result)
+    {
+        result.endpoints.resize(endpointCount);
+        std::vector<ReplayConnection> connections(static_cast<size_t>(options.connections));
+        std::vector<size_t> schedule;
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            if (requests[i].connection % static_cast<size_t>(options.threads) == static_cast<size_t>(thread))
+            {
+                schedule.push_back(i);
+                connections[requests[i].connection].queue.push_back(i);
+            }
+        }
+
+        bool paced = options.speed > 0;
+        int epollFd = epoll_create1(0);
+        std::vector<epoll_event> events(64);
+        char buffer[65536];
+        size_t next = 0;
+        Clock::time_point lastSend = start;
+        auto answered = [&]() { return result.completed + result.errors; };
+
+        while (answered() < schedule.size())
+        {
+            Clock::time_point now = Clock::now();
+            int timeoutMs = 100;
+            if (paced)
+            {
+                // Everything due goes out now; the wait is up to the next one
+                while (next < schedule.size())
+                {
+                    const ReplayRequest& request = requests[schedule[next]];
+                    Clock::time_point due = start + std::chrono::nanoseconds(
+                        static_cast<int64_t>(static_cast<double>(request.offsetNs) / options.speed));
+                    if (due > now)
+                    {
+                        timeoutMs = static_cast<int>((std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(
+                            due - now).count() + 1, static_cast<int64_t>(100)));
+                        break;
+                    }
+                    result.lag.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count()));
+                    Send(connections[request.connection], options, epollFd, schedule[next], requests, result);
+                    lastSend = now;
+                    next++;
+                }
+            }
+            else
+            {
+                for (ReplayConnection& connection : connections)
+                {
+                    while (!connection.queue.empty() && connection.inFlight.size() < static_cast<size_t>(options.pipeline))
+                    {
+                        size_t index = connection.queue.front();
+                        connection.queue.pop_front();
+                        Send(connection, options, epollFd, index, requests, result);
+                        lastSend = now;
+                        next++;
+                    }
+                }
+            }
+
+            if (next == schedule.size() && now - lastSend > std::chrono::seconds(options.timeoutSeconds))
+            {
+                break;
+            }
+
+            int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeoutMs);
+            for (int i = 0; i < count; i++)
+            {
+                ReplayConnection* connection = static_cast<ReplayConnection*>(events[i].data.ptr);
+                ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                {
+                    Disconnect(*connection, epollFd, result);
+                    continue;
+                }
+                connection->input.append(buffer, static_cast<size_t>(received));
+                if (!ConsumeResponses(*connection, requests, result))
+                {
+                    Disconnect(*connection, epollFd, result);
+                }
+            }
+        }
+
+        for (ReplayConnection& connection : connections)
+        {
+            if (connection.fd >= 0)
+            {
+                result.errors += connection.inFlight.size();
+                close(connection.fd);
+            }
+        }
+        close(epollFd);
+    }
+
+    bool ParseOption(const std::string& name, const char* value, ReplayOptions& options)
+    {
+        if (name == "--trace") options.trace = value;
+        else if (name == "--host") options.host = value;
+        else if (name == "--port") options.port = atoi(value);
+        else if (name == "--connections") options.connections = atoi(value);
+        else if (name == "--threads") options.threads = atoi(value);
+        else if (name == "--speed") options.speed = atof(value);
+        else if (name == "--pipeline") options.pipeline = atoi(value);
+        else if (name == "--repeat") options.repeat = atoi(value);
+        else if (name == "--timeout") options.timeoutSeconds = atoi(value);
+        else return false;
+        return true;
+    }
+
+    const char* TokenModeName(TrafficTokens tokens)
+    {
+        switch (tokens)
+        {
+        case TrafficTokens::Keep:
+            return "kept";
+        case TrafficTokens::Redact:
+            return "redacted";
+        default:
+            return "replaced";
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!ParseOption(argv[i], argv[i + 1], options))
+        {
+            printf("unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    options.connections = (std::max)(options.connections, 1);
+    options.threads = (std::max)((std::min)(options.threads, options.connections), 1);
+    options.pipeline = (std::max)(options.pipeline, 1);
+    options.repeat = (std::max)(options.repeat, 1);
+    if (options.trace.empty())
+    {
+        printf("usage: TrafficReplay --trace FILE [--port N] [--host ADDR] [--connections N] [--threads N]\n"
+               "                     [--speed X (0 = max)] [--pipeline N] [--repeat N] [--timeout S]\n");
+        return 1;
+    }
+
+    TrafficTrace trace;
+    if (!trace.Open(options.trace))
+    {
+        printf("FAIL: %s is not a readable traffic trace\n", options.trace.c_str());
+        return 1;
+    }
+
+    std::vector<ReplayRequest> requests;
+    std::vector<std::string> endpoints;
+    BuildRequests(trace, options, requests, endpoints);
+    if (requests.empty())
+    {
+        printf("FAIL: %s holds no requests\n", options.trace.c_str());
+        return 1;
+    }
+    double capturedSeconds = static_cast<double>(trace.Entry(trace.Size() - 1).offsetNs) / 1e9;
+    printf("%zu requests (%.1f s captured, tokens %s) x %d", trace.Size(), capturedSeconds, TokenModeName(trace.Tokens()),
+        options.repeat);
+    if (options.speed > 0)
+    {
+        printf(" at %gx", options.speed);
+    }
+    else
+    {
+        printf(" at maximum rate, %d in flight per connection", options.pipeline);
+    }
+    printf(" over %d connections, %d threads\n", options.connections, options.threads);
+
+    std::vector<ReplayResult> results(static_cast<size_t>(options.threads));
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+    for (int t = 0; t < options.threads; t++)
+    {
+        threads.emplace_back(ReplayThread, std::cref(options), std::cref(requests), endpoints.size(), t, start,
+            std::ref(results[static_cast<size_t>(t)]));
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    ReplayResult total;
+    total.endpoints.resize(endpoints.size());
+    for (ReplayResult& result : results)
+    {
+        total.sent += result.sent;
+        total.completed += result.completed;
+        total.errors += result.errors;
+        total.lag.insert(total.lag.end(), result.lag.begin(), result.lag.end());
+        for (size_t e = 0; e < endpoints.size(); e++)
+        {
+            EndpointResult& endpoint = total.endpoints[e];
+            endpoint.latencies.insert(endpoint.latencies.end(), result.endpoints[e].latencies.begin(),
+                result.endpoints[e].latencies.end());
+            for (const auto& status : result.endpoints[e].statuses)
+            {
+                endpoint.statuses[status.first] += status.second;
+            }
+        }
+    }
+
+    printf("completed %llu of %zu in %.2f s: %.0f requests/sec, %llu errors\n",
+        static_cast<unsigned long long>(total.completed), requests.size(), seconds,
+        static_cast<double>(total.completed) / seconds, static_cast<unsigned long long>(total.errors));
+    if (!total.lag.empty())
+    {
+        double worst = static_cast<double>(*std::max_element(total.lag.begin(), total.lag.end())) / 1000.0;
+        printf("behind schedule us: p50 %.1f  p99 %.1f  max %.1f\n", Percentile(total.lag, 0.50), Percentile(total.lag, 0.99), worst);
+    }
+
+    printf("\n%-40s %9s %9s %9s %9s %9s  %s\n", "endpoint", "requests", "req/s", "p50 us", "p99 us", "p99.9 us", "statuses");
+    for (size_t e = 0; e < endpoints.size(); e++)
+    {
+        EndpointResult& endpoint = total.endpoints[e];
+        std::string statuses;
+        for (const auto& status : endpoint.statuses)
+        {
+            statuses += std::to_string(status.first) + ":" + std::to_string(status.second) + " ";
+        }
+        size_t count = endpoint.latencies.size();
+        printf("%-40s %9zu %9.0f %9.1f %9.1f %9.1f  %s\n", endpoints[e].substr(0, 40).c_str(), count,
+            static_cast<double>(count) / seconds, Percentile(endpoint.latencies, 0.50), Percentile(endpoint.latencies, 0.99),
+            Percentile(endpoint.latencies, 0.999), statuses.c_str());
+    }
+    return total.completed == 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Measures how request throughput scales with the number of WorkerPool
+// threads, without HTTP.sys. Each operation stands in for one receive
+// context: its completion runs a fixed amount of request-sized work and
+// re-arms itself, the same way HttpServer re-posts HttpReceiveHttpRequest.
+
+#include "WorkerPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+struct BenchOperation : IoOperation
+{
+    std::vector<unsigned char> buffer;
+};
+
+static std::atomic<uint64_t> g_sink(0);
+
+// FNV-1a over the operation's buffer; roughly the cost of parsing and
+// formatting a small echo request per round
+static uint64_t SimulateRequest(const std::vector<unsigned char>& buffer, unsigned rounds)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned r = 0; r < rounds; r++)
+    {
+        for (unsigned char c : buffer)
+        {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static double RunOnce(size_t threads, size_t totalRequests, unsigned rounds, size_t bufferSize)
+{
+    WorkerPool pool(threads);
+    if (!pool.Initialize())
+    {
+        return 0.0;
+    }
+
+    // Match HttpServer: one outstanding receive per worker
+    std::vector<std::unique_ptr<BenchOperation>> operations;
+    for (size_t i = 0; i < threads; i++)
+    {
+        auto operation = std::make_unique<BenchOperation>();
+        operation->buffer.assign(bufferSize, static_cast<unsigned char>(i));
+        operations.push_back(std::move(operation));
+    }
+
+    std::atomic<size_t> issued(operations.size());
+    pool.Start([&](size_t, const IoCompletion& completion)
+    {
+        BenchOperation* operation = static_cast<BenchOperation*>(completion.operation);
+        g_sink.fetch_add(SimulateRequest(operation->buffer, rounds), std::memory_order_relaxed);
+
+        if (issued.fetch_add(1, std::memory_order_relaxed) < totalRequests)
+        {
+            pool.BeginOperation();
+            pool.Post(operation);
+        }
+        pool.EndOperation();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& operation : operations)
+    {
+        pool.BeginOperation();
+        pool.Post(operation.get());
+    }
+
+    while (!pool.WaitForDrain(1000))
+    {
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    pool.Stop();
+    return static_cast<double>(totalRequests) / elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t totalRequests = 500000;
+    size_t maxThreads = 32;
+    unsigned rounds = 2;
+    size_t bufferSize = 2048;
+
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--requests") == 0)
+            totalRequests = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--max-threads") == 0)
+            maxThreads = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--work") == 0)
+            rounds = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--buffer") == 0)
+            bufferSize = strtoul(argv[++i], nullptr, 10);
+    }
+
+    printf("WorkerPool scaling: %zu requests, %u rounds over %zu bytes each, %zu cores\n",
+        totalRequests, rounds, bufferSize, WorkerPool::DefaultThreadCount());
+    printf("%8s %14s %9s\n", "threads", "requests/sec", "speedup");
+
+    double baseline = 0.0;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double rate = RunOnce(threads, totalRequests, rounds, bufferSize);
+        if (threads == 1)
+        {
+            baseline = rate;
+        }
+        printf("%8zu %14.0f %8.2fx\n", threads, rate, baseline > 0 ? rate / baseline : 0.0);
+    }
+
+    return g_sink.load() == 0 ? 1 : 0;
+}
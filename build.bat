@@ -15,17 +15,57 @@ if %errorlevel% neq 0 (
 
 REM Compile the service
 echo Compiling...
-cl /EHsc /std:c++17 ^
+cl /EHsc /std:c++20 ^
    /DWIN32_LEAN_AND_MEAN ^
    /DSECURITY_WIN32 ^
    /D_CRT_SECURE_NO_WARNINGS ^
    main.cpp ^
    WindowsService.cpp ^
    HttpServer.cpp ^
+   EchoResponse.cpp ^
+   HttpSysTransport.cpp ^
+   HttpMessage.cpp ^
+   HttpParser.cpp ^
+   Transport.cpp ^
    KerberosAuth.cpp ^
+   AuthProvider.cpp ^
+   SspiAuthProvider.cpp ^
+   SecurityContextTable.cpp ^
+   TokenCache.cpp ^
+   Sha256.cpp ^
+   Base64.cpp ^
+   SessionCookie.cpp ^
+   SecureRandom.cpp ^
+   ApReqVerifier.cpp ^
+   TokenScreen.cpp ^
+   KerberosCrypto.cpp ^
+   Aes.cpp ^
+   Sha1.cpp ^
+   Der.cpp ^
+   Keytab.cpp ^
+   ReplayCache.cpp ^
+   RequestArena.cpp ^
+   SlabPool.cpp ^
+   WorkerPool.cpp ^
+   StagePool.cpp ^
+   RequestTask.cpp ^
+   Metrics.cpp ^
+   SharedMetrics.cpp ^
+   Log.cpp ^
+   Trace.cpp ^
+   MockAuthProvider.cpp ^
+   TrafficTrace.cpp ^
+   CredentialManager.cpp ^
+   Pac.cpp ^
+   AccessPolicy.cpp ^
+   PrincipalTable.cpp ^
+   AdmissionControl.cpp ^
+   PrincipalQuotas.cpp ^
+   Limits.cpp ^
    /Fe:KerberosEchoService.exe ^
    httpapi.lib ^
-   secur32.lib
+   secur32.lib ^
+   bcrypt.lib
 
 if %errorlevel% neq 0 (
     echo Build failed!
@@ -1,13 +1,242 @@
-#include "WindowsService.h"
+#include "ServerConfig.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <cwchar>
+
+#ifdef _WIN32
+#include "WindowsService.h"
+#else
+#include "HttpServer.h"
+#include "Log.h"
+#include "Trace.h"
+#include <csignal>
+#include <pthread.h>
+#endif
 
+// Picks up "-threads N", "-port N", "-transport NAME", "-auth NAME", "-keytab
+// PATH", "-nativeapreq 0|1", "-replayrate N", "-spn LIST", "-acceptors
+// LIST", "-credrefresh SECONDS", "-authz FILE", "-authzttl SECONDS", "-principals N", "-clientrate
+// N", "-clientburst N", "-rejectttl SECONDS", "-userconcurrency N",
+// "-userrate N", "-userwindow SECONDS", "-limits FILE", "-slowlane N",
+// "-auththreads N", "-handlerthreads N", "-queue N", "-queuedeadline MS",
+// "-retryafter SECONDS",
+// "-authcontexts N", "-authttl SECONDS", "-tokencache N", "-tokenwindow
+// SECONDS", "-sessionttl SECONDS", "-sessionrotate SECONDS", "-metrics PATH",
+// "-metricsshm NAME", "-metricsinterval MS", "-log SINK", "-loglevel LEVEL",
+// "-logsample N", "-lograte N", "-tracesample N", "-tracethreshold US",
+// "-tracespans N", "-trace PATH", "-tracefile PATH", "-capture PATH",
+// "-capturetokens MODE" and "-mockauthus US" (also /name or --name) anywhere
+// on the command line, so they work both after a command and in the service
+// ImagePath
+static void ParseOptions(const std::vector<std::wstring>& args, ServerConfig& config)
+{
+    for (size_t i = 1; i + 1 < args.size(); i++)
+    {
+        std::wstring name = args[i];
+        name.erase(0, name.find_first_not_of(L"-/"));
+
+        if (name == L"threads")
+        {
+            config.workerThreads = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"port")
+        {
+            config.port = static_cast<int>(wcstol(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"transport")
+        {
+            config.transport = args[++i];
+        }
+        else if (name == L"auth")
+        {
+            config.authProvider = args[++i];
+        }
+        else if (name == L"keytab")
+        {
+            config.keytab = args[++i];
+        }
+        else if (name == L"replayrate")
+        {
+            config.replayRate = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"nativeapreq")
+        {
+            config.nativeApReq = wcstoul(args[++i].c_str(), nullptr, 10) != 0;
+        }
+        else if (name == L"spn")
+        {
+            config.servicePrincipals = args[++i];
+        }
+        else if (name == L"acceptors")
+        {
+            config.acceptors = args[++i];
+        }
+        else if (name == L"credrefresh")
+        {
+            config.credentialRefreshSeconds = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"authz")
+        {
+            config.authzRules = args[++i];
+        }
+        else if (name == L"authzttl")
+        {
+            config.authzMembershipSeconds = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"principals")
+        {
+            config.principalLimit = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"clientrate")
+        {
+            config.clientRate = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"clientburst")
+        {
+            config.clientBurst = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"rejectttl")
+        {
+            config.rejectSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"userconcurrency")
+        {
+            config.userConcurrency = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"userrate")
+        {
+            config.userRate = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"userwindow")
+        {
+            config.userWindowSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"limits")
+        {
+            config.limitsFile = args[++i];
+        }
+        else if (name == L"slowlane")
+        {
+            config.slowLaneLimit = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"auththreads")
+        {
+            config.authThreads = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"handlerthreads")
+        {
+            config.handlerThreads = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"queue")
+        {
+            config.stageQueueDepth = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"queuedeadline")
+        {
+            config.queueDeadlineMs = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"retryafter")
+        {
+            config.retryAfterSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"authcontexts")
+        {
+            config.authContextLimit = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"authttl")
+        {
+            config.authContextTtlSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"tokencache")
+        {
+            config.tokenCacheEntries = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"tokenwindow")
+        {
+            config.tokenReplayWindowSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"sessionttl")
+        {
+            config.sessionLifetimeSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"sessionrotate")
+        {
+            config.sessionKeyRotationSeconds = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"metrics")
+        {
+            config.metricsPath = args[++i] == L"off" ? std::wstring() : args[i];
+        }
+        else if (name == L"metricsshm")
+        {
+            config.metricsSharedMemory = args[++i];
+        }
+        else if (name == L"metricsinterval")
+        {
+            config.metricsIntervalMs = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"log")
+        {
+            config.logSink = args[++i];
+        }
+        else if (name == L"loglevel")
+        {
+            config.logLevel = args[++i];
+        }
+        else if (name == L"logsample")
+        {
+            config.logSampleEvery = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"lograte")
+        {
+            config.logRatePerSecond = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"tracesample")
+        {
+            config.traceSampleEvery = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"tracethreshold")
+        {
+            config.traceThresholdUs = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+        else if (name == L"tracespans")
+        {
+            config.traceSpansPerThread = wcstoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (name == L"trace")
+        {
+            config.tracePath = args[++i] == L"off" ? std::wstring() : args[i];
+        }
+        else if (name == L"tracefile")
+        {
+            config.traceFile = args[++i];
+        }
+        else if (name == L"capture")
+        {
+            config.captureFile = args[++i];
+        }
+        else if (name == L"capturetokens")
+        {
+            config.captureTokens = args[++i];
+        }
+        else if (name == L"mockauthus")
+        {
+            config.mockAuthMicros = static_cast<unsigned>(wcstoul(args[++i].c_str(), nullptr, 10));
+        }
+    }
+}
+
+#ifdef _WIN32
 int wmain(int argc, wchar_t* argv[])
 {
     const std::wstring SERVICE_NAME = L"KerberosEchoService";
     const std::wstring DISPLAY_NAME = L"Kerberos Echo HTTP Service";
 
-    WindowsService service(SERVICE_NAME, DISPLAY_NAME);
+    ServerConfig config;
+    ParseOptions(std::vector<std::wstring>(argv, argv + argc), config);
+
+    WindowsService service(SERVICE_NAME, DISPLAY_NAME, config);
 
     if (argc > 1)
     {
@@ -43,12 +272,59 @@ int wmain(int argc, wchar_t* argv[])
         }
         else if (arg == L"help" || arg == L"/help" || arg == L"-help" || arg == L"/?")
         {
-            std::wcout << L"Usage: " << argv[0] << L" [option]" << std::endl;
-            std::wcout << L"Options:" << std::endl;
+            std::wcout << L"Usage: " << argv[0] << L" [command] [options]" << std::endl;
+            std::wcout << L"Commands:" << std::endl;
             std::wcout << L"  install   - Install the service" << std::endl;
             std::wcout << L"  uninstall - Uninstall the service" << std::endl;
             std::wcout << L"  console   - Run in console mode for testing" << std::endl;
             std::wcout << L"  help      - Show this help" << std::endl;
+            std::wcout << L"Options:" << std::endl;
+            std::wcout << L"  -port N    - HTTP port to listen on (default 8080)" << std::endl;
+            std::wcout << L"  -threads N - Number of worker threads (default: one per CPU)" << std::endl;
+            std::wcout << L"  -transport httpsys - Request transport (only HTTP.sys on Windows)" << std::endl;
+            std::wcout << L"  -auth sspi|mock - Authentication provider; mock accepts only captured stand-in tokens (default sspi)" << std::endl;
+            std::wcout << L"  -mockauthus N   - Microseconds of CPU the mock provider spends per leg (default 0)" << std::endl;
+            std::wcout << L"  -keytab PATH    - Service keytab (ktpass) for verifying AES tickets in process" << std::endl;
+            std::wcout << L"  -nativeapreq 0  - Send every token to SSPI even with a keytab (default 1)" << std::endl;
+            std::wcout << L"  -replayrate N   - New AP-REQs a second verified in process; more go to SSPI (default 1000)" << std::endl;
+            std::wcout << L"  -spn LIST       - Comma-separated service/host[@REALM] tickets must be for (default: any)" << std::endl;
+            std::wcout << L"  -acceptors LIST - Comma-separated service/host[@REALM] names to acquire credentials as (default: the service account)" << std::endl;
+            std::wcout << L"  -credrefresh N  - Seconds between credential refreshes; 0 = only near expiry (default 3600)" << std::endl;
+            std::wcout << L"  -authz FILE     - URL authorization rules: path prefixes and the principals, realms and groups allowed" << std::endl;
+            std::wcout << L"  -authzttl N     - Seconds a principal's group membership is cached for -authz (default 300)" << std::endl;
+            std::wcout << L"  -principals N   - Principals given an ID for per-user state (default 100000)" << std::endl;
+            std::wcout << L"  -clientrate N   - Negotiate tokens per second per client address; 429 past it (default: no limit)" << std::endl;
+            std::wcout << L"  -clientburst N  - Tokens a client may send at once before -clientrate applies (default: the rate)" << std::endl;
+            std::wcout << L"  -rejectttl N    - Seconds a failed token is answered 401 without another try; 0 disables (default 10)" << std::endl;
+            std::wcout << L"  -userconcurrency N - Requests one principal may have past authentication at once; 429 past it (default: no limit)" << std::endl;
+            std::wcout << L"  -userrate N     - Requests one principal may make per -userwindow; 429 past it (default: no limit)" << std::endl;
+            std::wcout << L"  -userwindow N   - Seconds of the sliding window for -userrate (default 60)" << std::endl;
+            std::wcout << L"  -limits FILE    - Overrides the six above and sets quotas per principal or group; re-read on the service paramchange control" << std::endl;
+            std::wcout << L"  -slowlane N     - NTLM legs in SSPI at once (default: a quarter of the CPUs)" << std::endl;
+            std::wcout << L"  -auththreads N  - Threads validating Negotiate tokens (default: two per CPU)" << std::endl;
+            std::wcout << L"  -handlerthreads N - Threads building responses to them (default: half the CPUs)" << std::endl;
+            std::wcout << L"  -queue N        - Requests each stage holds before answering 503; 0 authenticates inline (default 1024)" << std::endl;
+            std::wcout << L"  -queuedeadline N - Milliseconds a request may wait in a stage before 503 (default 2000)" << std::endl;
+            std::wcout << L"  -retryafter N   - Retry-After seconds sent with 503 (default 1)" << std::endl;
+            std::wcout << L"  -authcontexts N - Max SPNEGO handshakes in progress (default 10000)" << std::endl;
+            std::wcout << L"  -authttl N      - Seconds before an idle handshake is dropped (default 60)" << std::endl;
+            std::wcout << L"  -tokencache N   - Verified tokens kept for reuse (default 10000)" << std::endl;
+            std::wcout << L"  -tokenwindow N  - Seconds a verified token is accepted again without verifying it (default 0: never)" << std::endl;
+            std::wcout << L"  -sessionttl N   - Session cookie lifetime in seconds; 0 disables (default 900)" << std::endl;
+            std::wcout << L"  -sessionrotate N - Seconds between cookie signing key rotations (default 3600)" << std::endl;
+            std::wcout << L"  -metrics PATH   - Unauthenticated Prometheus scrape path; off disables (default /metrics)" << std::endl;
+            std::wcout << L"  -metricsshm NAME - Also publish metrics to the Local\\NAME file mapping (default: off)" << std::endl;
+            std::wcout << L"  -metricsinterval N - Milliseconds between shared-memory snapshots (default 1000)" << std::endl;
+            std::wcout << L"  -log SINK       - console, eventlog or a file path (default: console, the Event Log as a service)" << std::endl;
+            std::wcout << L"  -loglevel LEVEL - debug, info, warning or error (default info)" << std::endl;
+            std::wcout << L"  -logsample N    - Log one in N repeated auth and receive failures (default 1)" << std::endl;
+            std::wcout << L"  -lograte N      - Most of those lines per second from each call site; 0 = no limit (default 20)" << std::endl;
+            std::wcout << L"  -tracesample N  - Trace one request in N (default: off)" << std::endl;
+            std::wcout << L"  -tracethreshold US - Keep only traced requests slower than this; alone, traces every request" << std::endl;
+            std::wcout << L"  -tracespans N   - Spans each thread keeps, 40 bytes each (default 16384)" << std::endl;
+            std::wcout << L"  -trace PATH     - Unauthenticated Chrome trace download while tracing; off disables (default /trace)" << std::endl;
+            std::wcout << L"  -capture PATH   - Record requests to a traffic trace for TrafficReplay (default: off)" << std::endl;
+            std::wcout << L"  -capturetokens MODE - keep, redact or replace Negotiate tokens with mock ones (default replace)" << std::endl;
             std::wcout << L"" << std::endl;
             std::wcout << L"When run without arguments, starts as a Windows service." << std::endl;
             std::wcout << L"" << std::endl;
@@ -83,4 +359,120 @@ int wmain(int argc, wchar_t* argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#else
+// Foreground host for Linux: run until SIGINT or SIGTERM, e.g. under systemd
+int main(int argc, char* argv[])
+{
+    std::vector<std::wstring> args;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        args.emplace_back(arg.begin(), arg.end());
+    }
+
+    if (argc > 1 && (args[1] == L"help" || args[1] == L"-help" || args[1] == L"--help"))
+    {
+        std::wcout << L"Usage: " << args[0] << L" [options]" << std::endl;
+        std::wcout << L"Options:" << std::endl;
+        std::wcout << L"  --port N        - HTTP port to listen on (default 8080)" << std::endl;
+        std::wcout << L"  --threads N     - Number of event loops (default: one per CPU)" << std::endl;
+        std::wcout << L"  --transport epoll|io_uring - Request transport (io_uring falls back to epoll when unsupported)" << std::endl;
+        std::wcout << L"  --auth gssapi|mock - Authentication provider; mock accepts only captured stand-in tokens (default gssapi)" << std::endl;
+        std::wcout << L"  --mockauthus N  - Microseconds of CPU the mock provider spends per leg (default 0)" << std::endl;
+        std::wcout << L"  --keytab PATH   - Service keytab (default: KRB5_KTNAME or the system keytab)" << std::endl;
+        std::wcout << L"  --nativeapreq 0 - Send every token to GSSAPI instead of verifying AES tickets in process (default 1)" << std::endl;
+        std::wcout << L"  --replayrate N  - New AP-REQs a second verified in process; more go to GSSAPI (default 1000)" << std::endl;
+        std::wcout << L"  --spn LIST      - Comma-separated service/host[@REALM] tickets must be for (default: any)" << std::endl;
+        std::wcout << L"  --acceptors LIST - Comma-separated service/host[@REALM][=keytab] identities for virtual hosts (default: any in --keytab)" << std::endl;
+        std::wcout << L"  --credrefresh N - Seconds between credential refreshes; 0 = only near expiry or on a keytab change (default 3600)" << std::endl;
+        std::wcout << L"  --authz FILE - URL authorization rules: path prefixes and the principals, realms and SIDs allowed" << std::endl;
+        std::wcout << L"  --authzttl N - Seconds a principal's group membership is cached for --authz (default 300)" << std::endl;
+        std::wcout << L"  --principals N - Principals given an ID for per-user state (default 100000)" << std::endl;
+        std::wcout << L"  --clientrate N  - Negotiate tokens per second per client address; 429 past it (default: no limit)" << std::endl;
+        std::wcout << L"  --clientburst N - Tokens a client may send at once before --clientrate applies (default: the rate)" << std::endl;
+        std::wcout << L"  --rejectttl N   - Seconds a failed token is answered 401 without another try; 0 disables (default 10)" << std::endl;
+        std::wcout << L"  --userconcurrency N - Requests one principal may have past authentication at once; 429 past it (default: no limit)" << std::endl;
+        std::wcout << L"  --userrate N    - Requests one principal may make per --userwindow; 429 past it (default: no limit)" << std::endl;
+        std::wcout << L"  --userwindow N  - Seconds of the sliding window for --userrate (default 60)" << std::endl;
+        std::wcout << L"  --limits FILE   - Overrides the six above and sets quotas per principal or group; re-read on SIGHUP" << std::endl;
+        std::wcout << L"  --slowlane N    - NTLM legs in GSSAPI at once (default: a quarter of the CPUs)" << std::endl;
+        std::wcout << L"  --auththreads N - Threads validating Negotiate tokens (default: two per CPU)" << std::endl;
+        std::wcout << L"  --handlerthreads N - Threads building responses to them (default: half the CPUs)" << std::endl;
+        std::wcout << L"  --queue N       - Requests each stage holds before answering 503; 0 authenticates inline (default 1024)" << std::endl;
+        std::wcout << L"  --queuedeadline N - Milliseconds a request may wait in a stage before 503 (default 2000)" << std::endl;
+        std::wcout << L"  --retryafter N  - Retry-After seconds sent with 503 (default 1)" << std::endl;
+        std::wcout << L"  --authcontexts N - Max SPNEGO handshakes in progress (default 10000)" << std::endl;
+        std::wcout << L"  --authttl N     - Seconds before an idle handshake is dropped (default 60)" << std::endl;
+        std::wcout << L"  --tokencache N  - Verified tokens kept for reuse (default 10000)" << std::endl;
+        std::wcout << L"  --tokenwindow N - Seconds a verified token is accepted again without verifying it (default 0: never)" << std::endl;
+        std::wcout << L"  --sessionttl N  - Session cookie lifetime in seconds; 0 disables (default 900)" << std::endl;
+        std::wcout << L"  --sessionrotate N - Seconds between cookie signing key rotations (default 3600)" << std::endl;
+        std::wcout << L"  --metrics PATH  - Unauthenticated Prometheus scrape path; off disables (default /metrics)" << std::endl;
+        std::wcout << L"  --metricsshm NAME - Also publish metrics to POSIX shared memory /NAME (default: off)" << std::endl;
+        std::wcout << L"  --metricsinterval N - Milliseconds between shared-memory snapshots (default 1000)" << std::endl;
+        std::wcout << L"  --log SINK      - console, journald or a file path (default console)" << std::endl;
+        std::wcout << L"  --loglevel LEVEL - debug, info, warning or error (default info)" << std::endl;
+        std::wcout << L"  --logsample N   - Log one in N repeated auth and accept failures (default 1)" << std::endl;
+        std::wcout << L"  --lograte N     - Most of those lines per second from each call site; 0 = no limit (default 20)" << std::endl;
+        std::wcout << L"  --tracesample N - Trace one request in N (default: off)" << std::endl;
+        std::wcout << L"  --tracethreshold US - Keep only traced requests slower than this; alone, traces every request" << std::endl;
+        std::wcout << L"  --tracespans N  - Spans each thread keeps, 40 bytes each (default 16384)" << std::endl;
+        std::wcout << L"  --trace PATH    - Unauthenticated Chrome trace download while tracing; off disables (default /trace)" << std::endl;
+        std::wcout << L"  --tracefile PATH - Where SIGUSR1 writes the trace (default trace.json)" << std::endl;
+        std::wcout << L"  --capture PATH  - Record requests to a traffic trace for TrafficReplay (default: off)" << std::endl;
+        std::wcout << L"  --capturetokens MODE - keep, redact or replace Negotiate tokens with mock ones (default replace)" << std::endl;
+        return 0;
+    }
+
+    ServerConfig config;
+    ParseOptions(args, config);
+
+    // Block the shutdown signals before any thread starts so only sigwait sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Log::Start(config, L"KerberosEchoService");
+    HttpServer server(config);
+    if (!server.Initialize())
+    {
+        Log::Stop();
+        return 1;
+    }
+
+    server.Start();
+    Log::Flush();
+    std::wcout << L"Press Ctrl+C to stop." << std::endl;
+
+    // SIGUSR1 dumps the trace and SIGHUP reloads the limits, without stopping
+    int received = 0;
+    while (sigwait(&signals, &received) == 0 && (received == SIGUSR1 || received == SIGHUP))
+    {
+        if (received == SIGHUP)
+        {
+            server.ReloadLimits();
+        }
+        else if (!Trace::Enabled())
+        {
+            Log::Write(LogLevel::Warning) << L"Tracing is off; start with --tracesample or --tracethreshold";
+        }
+        else if (Trace::WriteChromeTrace(config.traceFile))
+        {
+            Log::Write(LogLevel::Info) << L"Trace written to " << config.traceFile;
+        }
+        else
+        {
+            Log::Write(LogLevel::Error) << L"Cannot write trace to " << config.traceFile;
+        }
+    }
+    server.Stop();
+    Log::Stop();
+    return 0;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#!/bin/sh
+# End-to-end test of the GSSAPI provider and the native AP-REQ verifier
+# against a throwaway MIT KDC.
+# Needs krb5-kdc, krb5-admin-server (kadmin.local), krb5-user and curl; runs
+# as an ordinary user and leaves nothing behind.
+#
+#   ./test-gssapi.sh [path/to/KerberosEchoService] [port]
+
+SERVICE=${1:-./build-linux/KerberosEchoService}
+PORT=${2:-18080}
+REALM=ECHO.TEST
+KDC_PORT=$((PORT + 8))
+
+WORK=$(mktemp -d)
+KDC_PID=
+SERVICE_PID=
+cleanup()
+{
+    [ -n "$SERVICE_PID" ] && kill "$SERVICE_PID" 2>/dev/null
+    [ -n "$KDC_PID" ] && kill "$KDC_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+fail()
+{
+    echo "FAIL: $1"
+    [ -f "$WORK/service.log" ] && sed 's/^/  service: /' "$WORK/service.log"
+    exit 1
+}
+
+export KRB5_CONFIG="$WORK/krb5.conf"
+export KRB5_KDC_PROFILE="$WORK/kdc.conf"
+export KRB5CCNAME="FILE:$WORK/ccache"
+export KRB5_TRACE=/dev/null
+
+cat > "$KRB5_CONFIG" <<EOF
+[libdefaults]
+    default_realm = $REALM
+    dns_lookup_kdc = false
+    dns_lookup_realm = false
+    rdns = false
+[realms]
+    $REALM = {
+        kdc = 127.0.0.1:$KDC_PORT
+    }
+[domain_realm]
+    localhost = $REALM
+EOF
+
+cat > "$KRB5_KDC_PROFILE" <<EOF
+[realms]
+    $REALM = {
+        database_name = $WORK/principal
+        key_stash_file = $WORK/stash
+        kdc_listen = $KDC_PORT
+        kdc_tcp_listen = $KDC_PORT
+        supported_enctypes = aes256-cts-hmac-sha1-96:normal aes128-cts-hmac-sha1-96:normal
+    }
+[logging]
+    kdc = FILE:$WORK/kdc.log
+EOF
+
+echo "Creating realm $REALM in $WORK"
+kdb5_util create -s -r "$REALM" -P master-password >/dev/null || fail "kdb5_util create"
+kadmin.local -r "$REALM" -q "addprinc -pw user-password alice" >/dev/null || fail "addprinc alice"
+kadmin.local -r "$REALM" -q "addprinc -randkey HTTP/localhost" >/dev/null || fail "addprinc HTTP/localhost"
+kadmin.local -r "$REALM" -q "ktadd -k $WORK/http.keytab HTTP/localhost" >/dev/null || fail "ktadd"
+
+krb5kdc -n -r "$REALM" &
+KDC_PID=$!
+sleep 1
+
+echo user-password | kinit alice >/dev/null || fail "kinit alice"
+
+kadmin.local -r "$REALM" -q "addprinc -randkey HTTP/elsewhere" >/dev/null || fail "addprinc HTTP/elsewhere"
+
+URL="http://localhost:$PORT/gssapi-test"
+
+# Runs the checks once with GSSAPI alone, once with the native AP-REQ
+# verifier in front of it and once with an SPN list as well; arguments after
+# the first are passed to the service
+run_checks()
+{
+    NATIVE=$1
+    shift
+    "$SERVICE" --port "$PORT" --threads 2 --auth gssapi --keytab "$WORK/http.keytab" --nativeapreq "$NATIVE" "$@" \
+        > "$WORK/service.log" 2>&1 &
+    SERVICE_PID=$!
+    sleep 1
+    kill -0 "$SERVICE_PID" 2>/dev/null || fail "service did not start (nativeapreq $NATIVE)"
+
+    # Without a token: 401 with a bare challenge
+    STATUS=$(curl -s -o /dev/null -w '%{http_code}' "$URL")
+    [ "$STATUS" = "401" ] || fail "unauthenticated request returned $STATUS"
+
+    # With alice's ticket: 200, echoed principal and a session cookie
+    curl -s -D "$WORK/headers" -o "$WORK/body" --negotiate -u : "$URL" || fail "curl --negotiate"
+    grep -q '^HTTP/1.1 200' "$WORK/headers" || fail "negotiate request was not accepted (nativeapreq $NATIVE)"
+    grep -qi '^Set-Cookie: kes_session=' "$WORK/headers" || fail "no session cookie"
+    grep -q 'GET /gssapi-test' "$WORK/body" || fail "body is not the echo"
+
+    # A token for a principal the keytab does not hold is rejected
+    STATUS=$(curl -s -o /dev/null -w '%{http_code}' --negotiate -u : --connect-to elsewhere:$PORT:localhost:$PORT \
+        "http://elsewhere:$PORT/gssapi-test")
+    [ "$STATUS" = "401" ] || fail "token for another service returned $STATUS (nativeapreq $NATIVE)"
+
+    kill -INT "$SERVICE_PID"
+    wait "$SERVICE_PID" 2>/dev/null
+    SERVICE_PID=
+    grep -q 'Authentication (gssapi):' "$WORK/service.log" || fail "no authentication counters at shutdown"
+    grep 'Authentication (gssapi):' "$WORK/service.log"
+}
+
+run_checks 0
+grep -q 'Native AP-REQ:' "$WORK/service.log" && fail "native verifier ran with --nativeapreq 0"
+
+# alice's ticket is verified in process; the other SPN is passed to GSSAPI
+run_checks 1
+grep -q 'Native AP-REQ: 1 accepted, 0 rejected (0 replays), 1 passed to the provider' "$WORK/service.log" ||
+    fail "native verifier counters"
+grep 'Native AP-REQ:' "$WORK/service.log"
+
+# With the SPN list the other SPN is turned away by the token screen
+run_checks 1 --spn "HTTP/localhost@$REALM"
+grep -q 'Native AP-REQ: 1 accepted, 0 rejected (0 replays), 0 passed to the provider' "$WORK/service.log" ||
+    fail "native verifier counters with --spn"
+grep -q 'Token screen: 2 Kerberos .* 0 malformed, 0 wrong realm, 1 wrong SPN' "$WORK/service.log" ||
+    fail "token screen counters"
+grep 'Token screen:' "$WORK/service.log"
+
+echo "PASS"
\ No newline at end of file